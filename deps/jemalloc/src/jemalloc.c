@@ -1331,6 +1331,63 @@ je_malloc_stats_print(void (*write_cb)(void *, const char *), void *cbopaque,
 	stats_print(write_cb, cbopaque, opts);
 }
 
+/*
+ * Defragmentation hint, added for the Redis active defragmentation.
+ *
+ * Returns 1 if 'ptr' is a small allocation living in a run that is not the
+ * current run of its bin, setting *bin_util and *run_util to the fraction
+ * of the regions in use in the bin and in the run, where 1<<16 means full.
+ * A run less used than the average of its bin is worth emptying: moving
+ * the allocation will take a region from the current run, that is the
+ * lowest non full run of the bin.  Returns 0 otherwise: large and huge
+ * allocations are never moved.
+ */
+int
+je_get_defrag_hint(void *ptr, int *bin_util, int *run_util)
+{
+	arena_chunk_t *chunk;
+	int defrag = 0;
+
+	assert(ptr != NULL);
+	if (config_stats == false)
+		return (0);
+
+	chunk = (arena_chunk_t *)CHUNK_ADDR2BASE(ptr);
+	if (chunk != ptr) {
+		size_t pageind, mapbits;
+
+		pageind = ((uintptr_t)ptr - (uintptr_t)chunk) >> LG_PAGE;
+		mapbits = arena_mapbits_get(chunk, pageind);
+		if ((mapbits & CHUNK_MAP_LARGE) == 0) {
+			arena_run_t *run;
+			arena_bin_t *bin;
+			arena_bin_info_t *bin_info;
+
+			run = (arena_run_t *)((uintptr_t)chunk +
+			    (uintptr_t)((pageind -
+			    arena_mapbits_small_runind_get(chunk, pageind)) <<
+			    LG_PAGE));
+			bin = run->bin;
+			bin_info = &arena_bin_info[arena_ptr_small_binind_get(ptr,
+			    mapbits)];
+			malloc_mutex_lock(&bin->lock);
+			if (run != bin->runcur && bin->stats.curruns > 0) {
+				size_t availregs, curregs;
+
+				availregs = bin_info->nregs * bin->stats.curruns;
+				curregs = bin->stats.allocated /
+				    bin_info->reg_size;
+				*bin_util = (int)((curregs << 16) / availregs);
+				*run_util = (int)(((size_t)(bin_info->nregs -
+				    run->nfree) << 16) / bin_info->nregs);
+				defrag = 1;
+			}
+			malloc_mutex_unlock(&bin->lock);
+		}
+	}
+	return (defrag);
+}
+
 int
 je_mallctl(const char *name, void *oldp, size_t *oldlenp, void *newp,
     size_t newlen)
@@ -30,6 +30,10 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#ifdef USE_IO_URING
+#include "fmacros.h" /* syscall(2) and MAP_POPULATE for ae_iouring.c */
+#endif
+
 #include <stdio.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -49,13 +53,17 @@
 #ifdef HAVE_EVPORT
 #include "ae_evport.c"
 #else
-    #ifdef HAVE_EPOLL
-    #include "ae_epoll.c"
+    #ifdef HAVE_IO_URING
+    #include "ae_iouring.c"
     #else
-        #ifdef HAVE_KQUEUE
-        #include "ae_kqueue.c"
+        #ifdef HAVE_EPOLL
+        #include "ae_epoll.c"
         #else
-        #include "ae_select.c"
+            #ifdef HAVE_KQUEUE
+            #include "ae_kqueue.c"
+            #else
+            #include "ae_select.c"
+            #endif
         #endif
     #endif
 #endif
@@ -70,7 +78,10 @@ aeEventLoop *aeCreateEventLoop(int setsize) {
     if (eventLoop->events == NULL || eventLoop->fired == NULL) goto err;
     eventLoop->setsize = setsize;
     eventLoop->lastTime = time(NULL);
-    eventLoop->timeEventHead = NULL;
+    eventLoop->timeEventHeap = NULL;
+    eventLoop->timeEventTable = NULL;
+    eventLoop->timeEventHeapSize = 0;
+    eventLoop->timeEventCapacity = 0;
     eventLoop->timeEventNextId = 0;
     eventLoop->stop = 0;
     eventLoop->maxfd = -1;
@@ -122,7 +133,13 @@ int aeResizeSetSize(aeEventLoop *eventLoop, int setsize) {
 }
 
 void aeDeleteEventLoop(aeEventLoop *eventLoop) {
+    int j;
+
     aeApiFree(eventLoop);
+    for (j = 0; j < eventLoop->timeEventHeapSize; j++)
+        zfree(eventLoop->timeEventHeap[j]);
+    zfree(eventLoop->timeEventHeap);
+    zfree(eventLoop->timeEventTable);
     zfree(eventLoop->events);
     zfree(eventLoop->fired);
     zfree(eventLoop);
@@ -201,13 +218,116 @@ static void aeAddMillisecondsToNow(long long milliseconds, long *sec, long *ms)
     *ms = when_ms;
 }
 
+/* Time events are stored in a binary min-heap ordered by fire time, so
+ * that the nearest timer is always at eventLoop->timeEventHeap[0], and
+ * indexed by id in a chained hash table, so that aeDeleteTimeEvent() does
+ * not need to scan all the registered timers. Both the heap array and the
+ * hash table are sized by eventLoop->timeEventCapacity, that is always a
+ * power of two, and grow together when the heap is full. */
+
+/* Return true if the time event 'a' should fire before 'b'. Events with
+ * the same fire time are ordered by id, so the oldest fires first. */
+static int aeTimeEventBefore(aeTimeEvent *a, aeTimeEvent *b) {
+    if (a->when_sec != b->when_sec) return a->when_sec < b->when_sec;
+    if (a->when_ms != b->when_ms) return a->when_ms < b->when_ms;
+    return a->id < b->id;
+}
+
+static void aeTimeEventHeapSet(aeEventLoop *eventLoop, int idx, aeTimeEvent *te) {
+    eventLoop->timeEventHeap[idx] = te;
+    te->heapIndex = idx;
+}
+
+/* Move the event at index 'idx' towards the root while it fires before
+ * its parent. */
+static void aeTimeEventHeapUp(aeEventLoop *eventLoop, int idx) {
+    aeTimeEvent *te = eventLoop->timeEventHeap[idx];
+
+    while(idx > 0) {
+        int parent = (idx-1)/2;
+
+        if (!aeTimeEventBefore(te,eventLoop->timeEventHeap[parent])) break;
+        aeTimeEventHeapSet(eventLoop,idx,eventLoop->timeEventHeap[parent]);
+        idx = parent;
+    }
+    aeTimeEventHeapSet(eventLoop,idx,te);
+}
+
+/* Move the event at index 'idx' towards the leaves while one of its
+ * children fires before it. */
+static void aeTimeEventHeapDown(aeEventLoop *eventLoop, int idx) {
+    aeTimeEvent *te = eventLoop->timeEventHeap[idx];
+    int size = eventLoop->timeEventHeapSize;
+
+    while(1) {
+        int child = idx*2+1;
+
+        if (child >= size) break;
+        if (child+1 < size &&
+            aeTimeEventBefore(eventLoop->timeEventHeap[child+1],
+                              eventLoop->timeEventHeap[child])) child++;
+        if (!aeTimeEventBefore(eventLoop->timeEventHeap[child],te)) break;
+        aeTimeEventHeapSet(eventLoop,idx,eventLoop->timeEventHeap[child]);
+        idx = child;
+    }
+    aeTimeEventHeapSet(eventLoop,idx,te);
+}
+
+/* Restore the heap property after the fire time of 'te' changed. */
+static void aeTimeEventHeapFix(aeEventLoop *eventLoop, aeTimeEvent *te) {
+    aeTimeEventHeapUp(eventLoop,te->heapIndex);
+    aeTimeEventHeapDown(eventLoop,te->heapIndex);
+}
+
+static unsigned long aeTimeEventBucket(aeEventLoop *eventLoop, long long id) {
+    return (unsigned long)id & (eventLoop->timeEventCapacity-1);
+}
+
+/* Double the capacity of the heap and of the id hash table. The table is
+ * rebuilt from the heap, that contains every registered event. */
+static int aeTimeEventGrow(aeEventLoop *eventLoop) {
+    int capacity = eventLoop->timeEventCapacity ?
+                   eventLoop->timeEventCapacity*2 : AE_TIME_EVENTS_INITIAL;
+    aeTimeEvent **heap, **table;
+    int j;
+
+    heap = zrealloc(eventLoop->timeEventHeap,sizeof(aeTimeEvent*)*capacity);
+    table = zcalloc(sizeof(aeTimeEvent*)*capacity);
+    if (heap == NULL || table == NULL) return AE_ERR;
+    eventLoop->timeEventHeap = heap;
+    zfree(eventLoop->timeEventTable);
+    eventLoop->timeEventTable = table;
+    eventLoop->timeEventCapacity = capacity;
+    for (j = 0; j < eventLoop->timeEventHeapSize; j++) {
+        aeTimeEvent *te = heap[j];
+        unsigned long b = aeTimeEventBucket(eventLoop,te->id);
+
+        te->next = table[b];
+        table[b] = te;
+    }
+    return AE_OK;
+}
+
+/* Return the time event with the specified id, or NULL if not found. */
+static aeTimeEvent *aeSearchTimeEvent(aeEventLoop *eventLoop, long long id) {
+    aeTimeEvent *te;
+
+    if (eventLoop->timeEventCapacity == 0) return NULL;
+    te = eventLoop->timeEventTable[aeTimeEventBucket(eventLoop,id)];
+    while(te && te->id != id) te = te->next;
+    return te;
+}
+
 long long aeCreateTimeEvent(aeEventLoop *eventLoop, long long milliseconds,
         aeTimeProc *proc, void *clientData,
         aeEventFinalizerProc *finalizerProc)
 {
     long long id = eventLoop->timeEventNextId++;//ʱ¼id𲽵
     aeTimeEvent *te;
+    unsigned long b;
 
+    if (eventLoop->timeEventHeapSize == eventLoop->timeEventCapacity &&
+        aeTimeEventGrow(eventLoop) == AE_ERR) return AE_ERR;
     te = zmalloc(sizeof(*te));
     if (te == NULL) return AE_ERR;
     te->id = id;
@@ -215,32 +335,46 @@ long long aeCreateTimeEvent(aeEventLoop *eventLoop, long long milliseconds,
     te->timeProc = proc; //ʱ¼
     te->finalizerProc = finalizerProc;
     te->clientData = clientData;
-    te->next = eventLoop->timeEventHead;
-    eventLoop->timeEventHead = te;
+    b = aeTimeEventBucket(eventLoop,id);
+    te->next = eventLoop->timeEventTable[b];
+    eventLoop->timeEventTable[b] = te;
+    aeTimeEventHeapSet(eventLoop,eventLoop->timeEventHeapSize++,te);
+    aeTimeEventHeapUp(eventLoop,te->heapIndex);
     return id;
 }
 
 //idɾһʱ¼
 int aeDeleteTimeEvent(aeEventLoop *eventLoop, long long id)
 {
-    aeTimeEvent *te, *prev = NULL;
-
-    te = eventLoop->timeEventHead;
-    while(te) {
-        if (te->id == id) {
-            if (prev == NULL)
-                eventLoop->timeEventHead = te->next;
-            else
-                prev->next = te->next;
-            if (te->finalizerProc)//
-                te->finalizerProc(eventLoop, te->clientData);
-            zfree(te);
-            return AE_OK;
-        }
+    aeTimeEvent *te, *prev = NULL, *last;
+    unsigned long b;
+
+    if (eventLoop->timeEventCapacity == 0) return AE_ERR;
+    b = aeTimeEventBucket(eventLoop,id);
+    te = eventLoop->timeEventTable[b];
+    while(te && te->id != id) {
         prev = te;
         te = te->next;
     }
-    return AE_ERR; /* NO event with the specified ID found */
+    if (te == NULL) return AE_ERR; /* NO event with the specified ID found */
+
+    /* Unlink from the hash table bucket. */
+    if (prev == NULL)
+        eventLoop->timeEventTable[b] = te->next;
+    else
+        prev->next = te->next;
+
+    /* Remove from the heap replacing it with the last element. */
+    last = eventLoop->timeEventHeap[--eventLoop->timeEventHeapSize];
+    if (last != te) {
+        aeTimeEventHeapSet(eventLoop,te->heapIndex,last);
+        aeTimeEventHeapFix(eventLoop,last);
+    }
+
+    if (te->finalizerProc)//
+        te->finalizerProc(eventLoop, te->clientData);
+    zfree(te);
+    return AE_OK;
 }
 
 /* Search the first timer to fire.
@@ -248,31 +382,16 @@ int aeDeleteTimeEvent(aeEventLoop *eventLoop, long long id)
  * put in sleep without to delay any event.
  * If there are no timers NULL is returned.
  *
- * Note that's O(N) since time events are unsorted.
- * Possible optimizations (not needed by Redis so far, but...):
- * 1) Insert the event in order, so that the nearest is just the head.
- *    Much better but still insertion or deletion of timers is O(N).
- * 2) Use a skiplist to have this operation as O(1) and insertion as O(log(N)).
- */
+ * This is O(1) since the nearest timer is the root of the heap. */
 static aeTimeEvent *aeSearchNearestTimer(aeEventLoop *eventLoop)
 {
-    aeTimeEvent *te = eventLoop->timeEventHead;
-    aeTimeEvent *nearest = NULL;
-
-    while(te) {
-        if (!nearest || te->when_sec < nearest->when_sec ||
-                (te->when_sec == nearest->when_sec &&
-                 te->when_ms < nearest->when_ms))
-            nearest = te;
-        te = te->next;
-    }
-    return nearest;
+    if (eventLoop->timeEventHeapSize == 0) return NULL;
+    return eventLoop->timeEventHeap[0];
 }
 
 /* Process time events */
 static int processTimeEvents(aeEventLoop *eventLoop) {
     int processed = 0;
-    aeTimeEvent *te;
     long long maxId;
     time_t now = time(NULL);
 
@@ -286,57 +405,52 @@ static int processTimeEvents(aeEventLoop *eventLoop) {
      * indefinitely, and practice suggests it is. */
     //¼еʱ
     if (now < eventLoop->lastTime) {
-        te = eventLoop->timeEventHead;
-        while(te) {
-            te->when_sec = 0;
-            te = te->next;
+        int j;
+
+        /* All the events get the same fire time, so now they are ordered
+         * just by id and the heap must be rebuilt. */
+        for (j = 0; j < eventLoop->timeEventHeapSize; j++) {
+            eventLoop->timeEventHeap[j]->when_sec = 0;
+            eventLoop->timeEventHeap[j]->when_ms = 0;
         }
+        for (j = eventLoop->timeEventHeapSize/2-1; j >= 0; j--)
+            aeTimeEventHeapDown(eventLoop,j);
     }
     eventLoop->lastTime = now;
 
-    te = eventLoop->timeEventHead;
+    /* Fire the events from the root of the heap as long as they are due.
+     *
+     * We make sure to don't process events registered by event handlers
+     * itself in order to don't loop forever: to do so we saved the max ID
+     * we want to handle. When such an event reaches the root we just stop,
+     * older events that are due as well will be processed at the next
+     * iteration, that will not block since the nearest timer is due. */
     maxId = eventLoop->timeEventNextId-1;
-    while(te) {
+    while(eventLoop->timeEventHeapSize) {
+        aeTimeEvent *te = eventLoop->timeEventHeap[0];
         long now_sec, now_ms;
         long long id;
+        int retval;
 
-        if (te->id > maxId) {//te->id  ʱ¼id
-            te = te->next;
-            continue;
-        }
+        if (te->id > maxId) break;
         //õǰʱ䣬ǰʱʱ¼¼Ҫô˵¼Ҫִ
         aeGetTime(&now_sec, &now_ms);
-        if (now_sec > te->when_sec ||
-            (now_sec == te->when_sec && now_ms >= te->when_ms))
-        {
-            int retval;
-
-            id = te->id;
-            retval = te->timeProc(eventLoop, id, te->clientData);
-            processed++;
-            /* After an event is processed our time event list may
-             * no longer be the same, so we restart from head.
-             * Still we make sure to don't process events registered
-             * by event handlers itself in order to don't loop forever.
-             * To do so we saved the max ID we want to handle.
-             *
-             * FUTURE OPTIMIZATIONS:
-             * Note that this is NOT great algorithmically. Redis uses
-             * a single time event so it's not a problem but the right
-             * way to do this is to add the new elements on head, and
-             * to flag deleted elements in a special way for later
-             * deletion (putting references to the nodes to delete into
-             * another linked list). */
-             //ǷҪѭִʱ¼
-            if (retval != AE_NOMORE) {
+        if (now_sec < te->when_sec ||
+            (now_sec == te->when_sec && now_ms < te->when_ms)) break;
+
+        id = te->id;
+        retval = te->timeProc(eventLoop, id, te->clientData);
+        processed++;
+        //ǷҪѭִʱ¼
+        if (retval != AE_NOMORE) {
+            /* The handler may have deleted its own event, so we look it
+             * up again instead of trusting 'te'. */
+            if ((te = aeSearchTimeEvent(eventLoop,id)) != NULL) {
                 aeAddMillisecondsToNow(retval,&te->when_sec,&te->when_ms);
-            } else {//Ҫѭִɾ
-                aeDeleteTimeEvent(eventLoop, id);
+                aeTimeEventHeapFix(eventLoop,te);
             }
-            //ִ¼Ѿı䣬Ҫͷʼѭ
-            te = eventLoop->timeEventHead;
-        } else {
-            te = te->next;
+        } else {//Ҫѭִɾ
+            aeDeleteTimeEvent(eventLoop, id);
         }
     }
     return processed;
@@ -473,3 +587,81 @@ char *aeGetApiName(void) {
 void aeSetBeforeSleepProc(aeEventLoop *eventLoop, aeBeforeSleepProc *beforesleep) {
     eventLoop->beforesleep = beforesleep;
 }
+
+#ifdef AE_BENCHMARK_MAIN
+/* Event loop overhead against the number of registered timers.
+ *
+ * Compile with:
+ *   cc -O2 -DAE_BENCHMARK_MAIN -o ae-benchmark ae.c zmalloc.c
+ *
+ * For every timers count the program reports the average time needed by
+ * a loop iteration that does not fire any timer (a file event is always
+ * ready, so the loop never sleeps), and the average time needed to create
+ * and delete a timer (deletions are in random order). */
+static long long ustime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return ((long long)tv.tv_sec)*1000000+tv.tv_usec;
+}
+
+static void benchFileProc(aeEventLoop *eventLoop, int fd, void *clientData, int mask) {
+    AE_NOTUSED(eventLoop);
+    AE_NOTUSED(fd);
+    AE_NOTUSED(clientData);
+    AE_NOTUSED(mask);
+}
+
+static int benchTimeProc(aeEventLoop *eventLoop, long long id, void *clientData) {
+    AE_NOTUSED(eventLoop);
+    AE_NOTUSED(id);
+    AE_NOTUSED(clientData);
+    return AE_NOMORE;
+}
+
+int main(void) {
+    int counts[] = {1, 10, 100, 1000, 10000, 100000};
+    int iterations = 1000, fds[2], j, k;
+
+    if (pipe(fds) == -1 || write(fds[1],"x",1) != 1) {
+        perror("pipe");
+        exit(1);
+    }
+    printf("%10s %16s %16s\n", "timers", "loop (us/iter)", "add+del (us)");
+    for (j = 0; j < (int)(sizeof(counts)/sizeof(counts[0])); j++) {
+        aeEventLoop *el = aeCreateEventLoop(64);
+        long long *ids = zmalloc(sizeof(long long)*counts[j]);
+        long long start, loop_us, adddel_us;
+
+        aeCreateFileEvent(el,fds[0],AE_READABLE,benchFileProc,NULL);
+        start = ustime();
+        for (k = 0; k < counts[j]; k++)
+            ids[k] = aeCreateTimeEvent(el,3600000+(rand()%3600000),
+                                       benchTimeProc,NULL,NULL);
+        adddel_us = ustime()-start;
+
+        loop_us = ustime();
+        for (k = 0; k < iterations; k++)
+            aeProcessEvents(el,AE_ALL_EVENTS);
+        loop_us = ustime()-loop_us;
+
+        /* Delete in random order. */
+        for (k = counts[j]-1; k > 0; k--) {
+            int r = rand()%(k+1);
+            long long tmp = ids[k];
+
+            ids[k] = ids[r];
+            ids[r] = tmp;
+        }
+        start = ustime();
+        for (k = 0; k < counts[j]; k++) aeDeleteTimeEvent(el,ids[k]);
+        adddel_us += ustime()-start;
+
+        printf("%10d %16.3f %16.3f\n", counts[j],
+            (double)loop_us/iterations, (double)adddel_us/counts[j]);
+        zfree(ids);
+        aeDeleteEventLoop(el);
+    }
+    return 0;
+}
+#endif
@@ -47,6 +47,9 @@
 
 #define AE_NOMORE -1
 
+/* Initial number of time events slots, doubled every time it is needed. */
+#define AE_TIME_EVENTS_INITIAL 16
+
 /* Macros */
 #define AE_NOTUSED(V) ((void) V)
 
@@ -74,7 +77,8 @@ typedef struct aeTimeEvent {
     aeTimeProc *timeProc;
     aeEventFinalizerProc *finalizerProc;
     void *clientData;
-    struct aeTimeEvent *next;
+    int heapIndex; /* position inside eventLoop->timeEventHeap */
+    struct aeTimeEvent *next; /* next event in the same id hash bucket */
 } aeTimeEvent;
 
 /* A fired event */
@@ -91,7 +95,10 @@ typedef struct aeEventLoop {
     time_t lastTime;     /* Used to detect system clock skew */
     aeFileEvent *events; /* Registered events */
     aeFiredEvent *fired; /* Fired events */
-    aeTimeEvent *timeEventHead;
+    aeTimeEvent **timeEventHeap;  /* Min-heap of time events by fire time */
+    aeTimeEvent **timeEventTable; /* Time events hash table indexed by id */
+    int timeEventHeapSize;        /* Number of registered time events */
+    int timeEventCapacity;        /* Slots of both heap and hash table */
     int stop;
     void *apidata; /* This is used for polling API specific data */
     aeBeforeSleepProc *beforesleep;
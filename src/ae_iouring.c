@@ -0,0 +1,485 @@
+/* Linux io_uring(7) based ae.c module, with epoll(2) fallback
+ *
+ * Copyright (c) 2009-2012, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* This backend uses io_uring one-shot poll requests (IORING_OP_POLL_ADD)
+ * to get readiness notifications with the same level triggered semantics
+ * of ae_epoll.c. The advantage is that arming, re-arming and removing the
+ * polls of all the file descriptors that changed during an event loop
+ * iteration, and waiting for new events, is performed with a single
+ * io_uring_enter(2) call, while epoll needs an epoll_ctl(2) call for every
+ * change plus the epoll_wait(2) call.
+ *
+ * The kernel must support IORING_FEAT_EXT_ARG (Linux 5.11), that is used
+ * to wait with a timeout without submitting timeout requests. If the ring
+ * can't be created (old kernel, io_uring disabled by the system, seccomp
+ * filters, ...) the event loop falls back to the epoll implementation. */
+
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/* Include the epoll backend, renaming it, for the fallback. */
+#define aeApiState aeEpollState
+#define aeApiCreate aeEpollCreate
+#define aeApiResize aeEpollResize
+#define aeApiFree aeEpollFree
+#define aeApiAddEvent aeEpollAddEvent
+#define aeApiDelEvent aeEpollDelEvent
+#define aeApiPoll aeEpollPoll
+#define aeApiName aeEpollName
+#include "ae_epoll.c"
+#undef aeApiState
+#undef aeApiCreate
+#undef aeApiResize
+#undef aeApiFree
+#undef aeApiAddEvent
+#undef aeApiDelEvent
+#undef aeApiPoll
+#undef aeApiName
+
+#define AE_URING_SQ_ENTRIES 1024
+#define AE_URING_MAX_CQ_ENTRIES 65536
+#define AE_URING_IGNORE_DATA UINT64_MAX /* user_data of POLL_REMOVE */
+
+/* Per file descriptor state. Every time the poll of a file descriptor is
+ * removed the generation is incremented, so that completions of removed
+ * polls that were already in the completion queue are ignored. */
+typedef struct aeUringFd {
+    unsigned int gen;   /* Generation of the current poll request */
+    int armed;          /* AE_(READABLE|WRITABLE) mask currently polled */
+    int queued;         /* True if in the list of fds to (re)arm */
+} aeUringFd;
+
+typedef struct aeApiState {
+    aeEpollState *epoll; /* Fallback state, NULL when using io_uring */
+    int ringfd;
+    /* Submission queue. */
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned sq_entries, sq_local_tail;
+    struct io_uring_sqe *sqes;
+    /* Completion queue. */
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+    /* Rings mappings, to unmap them on free. */
+    void *sq_ptr, *cq_ptr;
+    size_t sq_size, cq_size, sqes_size;
+    /* File descriptors state, and fds that need a new poll request. */
+    aeUringFd *fds;
+    int *rearm;
+    int rearm_count;
+    int setsize;
+    pid_t pid;                  /* Process that created the ring */
+    struct aeApiState *next;    /* Next ring in aeUringStates */
+} aeApiState;
+
+/* Set when the last event loop created had to fall back to epoll, just
+ * to report the right name in aeGetApiName(). */
+static int aeUringFallback = 0;
+
+/* List of the rings in use, see aeUringAtExit(). */
+static aeApiState *aeUringStates = NULL;
+
+static int aeUringEnter(aeApiState *state, unsigned to_submit,
+                        unsigned min_complete, unsigned flags, void *arg,
+                        size_t argsz)
+{
+    return (int) syscall(__NR_io_uring_enter,state->ringfd,to_submit,
+                         min_complete,flags,arg,argsz);
+}
+
+/* Number of sqes queued by us but not yet consumed by the kernel. */
+static unsigned aeUringPending(aeApiState *state) {
+    return state->sq_local_tail - __atomic_load_n(state->sq_head,__ATOMIC_ACQUIRE);
+}
+
+/* Make the queued sqes visible to the kernel and submit them. */
+static void aeUringSubmit(aeApiState *state) {
+    unsigned pending;
+
+    __atomic_store_n(state->sq_tail,state->sq_local_tail,__ATOMIC_RELEASE);
+    while((pending = aeUringPending(state)) != 0) {
+        if (aeUringEnter(state,pending,0,0,NULL,0) == -1 && errno != EINTR)
+            break;
+    }
+}
+
+/* Return a zeroed sqe, submitting the queue first if it is full. */
+static struct io_uring_sqe *aeUringGetSqe(aeApiState *state) {
+    struct io_uring_sqe *sqe;
+    unsigned idx;
+
+    if (aeUringPending(state) == state->sq_entries) aeUringSubmit(state);
+    idx = state->sq_local_tail & *state->sq_mask;
+    sqe = &state->sqes[idx];
+    memset(sqe,0,sizeof(*sqe));
+    state->sq_array[idx] = idx;
+    state->sq_local_tail++;
+    return sqe;
+}
+
+static uint64_t aeUringPollData(aeApiState *state, int fd) {
+    return ((uint64_t)state->fds[fd].gen << 32) | (uint32_t)fd;
+}
+
+/* Queue the removal of the current poll request of 'fd', if any. */
+static void aeUringDisarm(aeApiState *state, int fd) {
+    struct io_uring_sqe *sqe;
+
+    if (state->fds[fd].armed == AE_NONE) return;
+    sqe = aeUringGetSqe(state);
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = aeUringPollData(state,fd);
+    sqe->user_data = AE_URING_IGNORE_DATA;
+    state->fds[fd].gen++;
+    state->fds[fd].armed = AE_NONE;
+}
+
+/* Remember that 'fd' needs a new poll request before the next wait. */
+static void aeUringQueueRearm(aeApiState *state, int fd) {
+    if (state->fds[fd].queued) return;
+    state->fds[fd].queued = 1;
+    state->rearm[state->rearm_count++] = fd;
+}
+
+static void aeUringInitFds(aeApiState *state, int from, int to) {
+    int j;
+
+    for (j = from; j < to; j++) {
+        state->fds[j].gen = 0;
+        state->fds[j].armed = AE_NONE;
+        state->fds[j].queued = 0;
+    }
+}
+
+static void aeUringUnmap(aeApiState *state) {
+    if (state->sqes) munmap(state->sqes,state->sqes_size);
+    if (state->cq_ptr && state->cq_ptr != state->sq_ptr)
+        munmap(state->cq_ptr,state->cq_size);
+    if (state->sq_ptr) munmap(state->sq_ptr,state->sq_size);
+}
+
+/* Create the ring and map the queues. Returns -1 if io_uring can't be
+ * used, so that the caller can fall back to epoll. */
+static int aeUringSetup(aeApiState *state, int setsize) {
+    struct io_uring_params p;
+    unsigned cq_entries = AE_URING_SQ_ENTRIES*2; /* Can't be < sq entries */
+
+    while(cq_entries < (unsigned)setsize*2 &&
+          cq_entries < AE_URING_MAX_CQ_ENTRIES) cq_entries <<= 1;
+    memset(&p,0,sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = cq_entries;
+    state->ringfd = (int) syscall(__NR_io_uring_setup,AE_URING_SQ_ENTRIES,&p);
+    if (state->ringfd == -1) return -1;
+    if (!(p.features & IORING_FEAT_EXT_ARG) ||
+        !(p.features & IORING_FEAT_NODROP)) goto err;
+
+    state->sq_size = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+    state->cq_size = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (state->cq_size > state->sq_size) state->sq_size = state->cq_size;
+        state->cq_size = state->sq_size;
+    }
+    state->sq_ptr = mmap(NULL,state->sq_size,PROT_READ|PROT_WRITE,
+                         MAP_SHARED|MAP_POPULATE,state->ringfd,
+                         IORING_OFF_SQ_RING);
+    if (state->sq_ptr == MAP_FAILED) {
+        state->sq_ptr = NULL;
+        goto err;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        state->cq_ptr = state->sq_ptr;
+    } else {
+        state->cq_ptr = mmap(NULL,state->cq_size,PROT_READ|PROT_WRITE,
+                             MAP_SHARED|MAP_POPULATE,state->ringfd,
+                             IORING_OFF_CQ_RING);
+        if (state->cq_ptr == MAP_FAILED) {
+            state->cq_ptr = NULL;
+            goto err;
+        }
+    }
+    state->sqes_size = p.sq_entries*sizeof(struct io_uring_sqe);
+    state->sqes = mmap(NULL,state->sqes_size,PROT_READ|PROT_WRITE,
+                       MAP_SHARED|MAP_POPULATE,state->ringfd,
+                       IORING_OFF_SQES);
+    if (state->sqes == MAP_FAILED) {
+        state->sqes = NULL;
+        goto err;
+    }
+
+    state->sq_head = (unsigned*)((char*)state->sq_ptr+p.sq_off.head);
+    state->sq_tail = (unsigned*)((char*)state->sq_ptr+p.sq_off.tail);
+    state->sq_mask = (unsigned*)((char*)state->sq_ptr+p.sq_off.ring_mask);
+    state->sq_array = (unsigned*)((char*)state->sq_ptr+p.sq_off.array);
+    state->sq_entries = p.sq_entries;
+    state->sq_local_tail = *state->sq_tail;
+    state->cq_head = (unsigned*)((char*)state->cq_ptr+p.cq_off.head);
+    state->cq_tail = (unsigned*)((char*)state->cq_ptr+p.cq_off.tail);
+    state->cq_mask = (unsigned*)((char*)state->cq_ptr+p.cq_off.ring_mask);
+    state->cqes = (struct io_uring_cqe*)((char*)state->cq_ptr+p.cq_off.cqes);
+    return 0;
+
+err:
+    aeUringUnmap(state);
+    close(state->ringfd);
+    return -1;
+}
+
+/* Poll requests take a reference to the polled files, and on exit the
+ * kernel cancels the pending requests asynchronously, so for a short time
+ * after the process is gone a listening socket could still accept
+ * connections. To avoid this we cancel all the polls on exit, waiting
+ * for the kernel to complete the removal.
+ *
+ * Note that children created with fork() share the rings with the parent,
+ * that's why we don't touch rings not created by the current process. */
+static void aeUringAtExit(void) {
+    aeApiState *state;
+
+    for (state = aeUringStates; state; state = state->next) {
+        unsigned removed = 0;
+        int fd;
+
+        if (state->pid != getpid()) continue;
+        for (fd = 0; fd < state->setsize; fd++) {
+            if (state->fds[fd].armed == AE_NONE) continue;
+            aeUringDisarm(state,fd);
+            removed++;
+        }
+        __atomic_store_n(state->sq_tail,state->sq_local_tail,__ATOMIC_RELEASE);
+        aeUringEnter(state,aeUringPending(state),removed,
+                     IORING_ENTER_GETEVENTS,NULL,0);
+    }
+}
+
+static int aeApiCreate(aeEventLoop *eventLoop) {
+    static int atexit_registered = 0;
+    aeApiState *state = zcalloc(sizeof(aeApiState));
+
+    if (!state) return -1;
+    if (aeUringSetup(state,eventLoop->setsize) == -1) {
+        /* No io_uring support: use epoll. */
+        if (aeEpollCreate(eventLoop) == -1) {
+            zfree(state);
+            return -1;
+        }
+        state->epoll = eventLoop->apidata;
+        eventLoop->apidata = state;
+        aeUringFallback = 1;
+        return 0;
+    }
+    state->fds = zmalloc(sizeof(aeUringFd)*eventLoop->setsize);
+    state->rearm = zmalloc(sizeof(int)*eventLoop->setsize);
+    aeUringInitFds(state,0,eventLoop->setsize);
+    state->setsize = eventLoop->setsize;
+    state->pid = getpid();
+    state->next = aeUringStates;
+    aeUringStates = state;
+    if (!atexit_registered) {
+        atexit(aeUringAtExit);
+        atexit_registered = 1;
+    }
+    eventLoop->apidata = state;
+    aeUringFallback = 0;
+    return 0;
+}
+
+/* Call the epoll implementation of a backend function: it expects its own
+ * state in eventLoop->apidata. */
+#define aeEpollCall(eventLoop,state,call) do { \
+    (eventLoop)->apidata = (state)->epoll; \
+    call; \
+    (eventLoop)->apidata = (state); \
+} while(0)
+
+static int aeApiResize(aeEventLoop *eventLoop, int setsize) {
+    aeApiState *state = eventLoop->apidata;
+    int j, retval;
+
+    if (state->epoll) {
+        aeEpollCall(eventLoop,state,retval = aeEpollResize(eventLoop,setsize));
+        return retval;
+    }
+    state->fds = zrealloc(state->fds,sizeof(aeUringFd)*setsize);
+    if (setsize > eventLoop->setsize)
+        aeUringInitFds(state,eventLoop->setsize,setsize);
+    /* Drop queued fds that are no longer part of the set (they are all
+     * unused, otherwise ae.c would refuse to resize). */
+    for (j = 0; j < state->rearm_count; j++) {
+        if (state->rearm[j] >= setsize) {
+            state->rearm[j--] = state->rearm[--state->rearm_count];
+        }
+    }
+    state->rearm = zrealloc(state->rearm,sizeof(int)*setsize);
+    state->setsize = setsize;
+    return 0;
+}
+
+static void aeApiFree(aeEventLoop *eventLoop) {
+    aeApiState *state = eventLoop->apidata;
+
+    if (state->epoll) {
+        aeEpollCall(eventLoop,state,aeEpollFree(eventLoop));
+    } else {
+        aeApiState **prev = &aeUringStates;
+
+        while(*prev != state) prev = &(*prev)->next;
+        *prev = state->next;
+        aeUringUnmap(state);
+        close(state->ringfd);
+        zfree(state->fds);
+        zfree(state->rearm);
+    }
+    zfree(state);
+}
+
+static int aeApiAddEvent(aeEventLoop *eventLoop, int fd, int mask) {
+    aeApiState *state = eventLoop->apidata;
+    int retval;
+
+    if (state->epoll) {
+        aeEpollCall(eventLoop,state,retval = aeEpollAddEvent(eventLoop,fd,mask));
+        return retval;
+    }
+    /* The poll request is created (or replaced) lazily before waiting
+     * for events, using the mask the fd has at that time. */
+    mask |= eventLoop->events[fd].mask;
+    if (state->fds[fd].armed != mask) {
+        aeUringDisarm(state,fd);
+        aeUringQueueRearm(state,fd);
+    }
+    return 0;
+}
+
+static void aeApiDelEvent(aeEventLoop *eventLoop, int fd, int delmask) {
+    aeApiState *state = eventLoop->apidata;
+    int mask;
+
+    if (state->epoll) {
+        aeEpollCall(eventLoop,state,aeEpollDelEvent(eventLoop,fd,delmask));
+        return;
+    }
+    /* We can't leave a poll for events no longer requested, or it may
+     * fire over and over (think about a writable socket). */
+    mask = eventLoop->events[fd].mask & (~delmask);
+    aeUringDisarm(state,fd);
+    if (mask != AE_NONE) aeUringQueueRearm(state,fd);
+}
+
+static int aeApiPoll(aeEventLoop *eventLoop, struct timeval *tvp) {
+    aeApiState *state = eventLoop->apidata;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned head, tail, min_complete = 1;
+    int j, numevents = 0;
+
+    if (state->epoll) {
+        aeEpollCall(eventLoop,state,numevents = aeEpollPoll(eventLoop,tvp));
+        return numevents;
+    }
+
+    /* Queue a poll request for every fd that changed, or fired, since
+     * the last call. */
+    for (j = 0; j < state->rearm_count; j++) {
+        int fd = state->rearm[j];
+        int mask = eventLoop->events[fd].mask;
+        struct io_uring_sqe *sqe;
+
+        state->fds[fd].queued = 0;
+        if (mask == AE_NONE || state->fds[fd].armed != AE_NONE) continue;
+        sqe = aeUringGetSqe(state);
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        if (mask & AE_READABLE) sqe->poll_events |= POLLIN;
+        if (mask & AE_WRITABLE) sqe->poll_events |= POLLOUT;
+        sqe->user_data = aeUringPollData(state,fd);
+        state->fds[fd].armed = mask;
+    }
+    state->rearm_count = 0;
+
+    /* Submit everything and wait for at least one completion, unless
+     * the timeout is zero. */
+    memset(&arg,0,sizeof(arg));
+    if (tvp) {
+        ts.tv_sec = tvp->tv_sec;
+        ts.tv_nsec = tvp->tv_usec*1000;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+        if (tvp->tv_sec == 0 && tvp->tv_usec == 0) min_complete = 0;
+    }
+    arg.sigmask_sz = _NSIG/8;
+    __atomic_store_n(state->sq_tail,state->sq_local_tail,__ATOMIC_RELEASE);
+    if (aeUringEnter(state,aeUringPending(state),min_complete,
+                     IORING_ENTER_GETEVENTS|IORING_ENTER_EXT_ARG,
+                     &arg,sizeof(arg)) == -1 &&
+        errno != ETIME && errno != EINTR && errno != EBUSY)
+    {
+        return 0;
+    }
+    /* If the kernel was not able to consume all the sqes (EBUSY / EINTR)
+     * make sure they are submitted before returning. */
+    if (aeUringPending(state)) aeUringSubmit(state);
+
+    /* Reap completions. */
+    head = *state->cq_head;
+    tail = __atomic_load_n(state->cq_tail,__ATOMIC_ACQUIRE);
+    while(head != tail && numevents < eventLoop->setsize) {
+        struct io_uring_cqe *cqe = &state->cqes[head & *state->cq_mask];
+        uint64_t data = cqe->user_data;
+        int fd = (int)(data & 0xffffffff), mask = 0;
+
+        head++;
+        if (data == AE_URING_IGNORE_DATA || fd >= eventLoop->setsize ||
+            (unsigned)(data >> 32) != state->fds[fd].gen) continue;
+
+        /* One-shot poll: the fd needs a new request. */
+        state->fds[fd].armed = AE_NONE;
+        aeUringQueueRearm(state,fd);
+        if (cqe->res < 0) {
+            /* Let the handlers find the error themselves. */
+            mask = eventLoop->events[fd].mask;
+        } else {
+            if (cqe->res & POLLIN) mask |= AE_READABLE;
+            if (cqe->res & POLLOUT) mask |= AE_WRITABLE;
+            if (cqe->res & POLLERR) mask |= AE_WRITABLE;
+            if (cqe->res & POLLHUP) mask |= AE_WRITABLE;
+        }
+        eventLoop->fired[numevents].fd = fd;
+        eventLoop->fired[numevents].mask = mask;
+        numevents++;
+    }
+    __atomic_store_n(state->cq_head,head,__ATOMIC_RELEASE);
+    return numevents;
+}
+
+static char *aeApiName(void) {
+    return aeUringFallback ? aeEpollName() : "io_uring";
+}
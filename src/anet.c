@@ -46,6 +46,7 @@
 #include <stdio.h>
 
 #include "anet.h"
+#include "config.h"
 
 static void anetSetError(char *err, const char *fmt, ...)
 {
@@ -445,22 +446,43 @@ int anetUnixServer(char *err, char *path, mode_t perm)
     return s;
 }
 
+/* Accept a connection returning the new socket already in non blocking
+ * mode and with the close-on-exec flag set. Where accept4() is available
+ * this is done by the accept call itself, saving the fcntl(2) calls. */
 static int anetGenericAccept(char *err, int s, struct sockaddr *sa, socklen_t *len) {
     int fd;
     while(1) {
         //ûȴacceptֱһsockfdڷ򷵻-1
         //errnoΪEAGAINEWOULDBLOCK
+#ifdef HAVE_ACCEPT4
+        fd = accept4(s,sa,len,SOCK_NONBLOCK|SOCK_CLOEXEC);
+#else
         fd = accept(s,sa,len);
+#endif
         if (fd == -1) {
             if (errno == EINTR)
                 continue;
             else {
+                int saved_errno = errno;
+
                 anetSetError(err, "accept: %s", strerror(errno));
+                errno = saved_errno;
                 return ANET_ERR;
             }
         }
         break;
     }
+#ifndef HAVE_ACCEPT4
+    if (anetNonBlock(err,fd) == ANET_ERR) {
+        close(fd);
+        return ANET_ERR;
+    }
+    if (fcntl(fd,F_SETFD,FD_CLOEXEC) == -1) {
+        anetSetError(err, "fcntl(F_SETFD,FD_CLOEXEC): %s", strerror(errno));
+        close(fd);
+        return ANET_ERR;
+    }
+#endif
     return fd;
 }
 
@@ -176,6 +176,8 @@ void *bioProcessBackgroundJobs(void *arg) {
             close((long)job->arg1);
         } else if (type == REDIS_BIO_AOF_FSYNC) {
             aof_fsync((long)job->arg1);
+        } else if (type == REDIS_BIO_LAZY_FREE) {
+            lazyfreeFreeFromBioThread(job->arg1,job->arg2,job->arg3);
         } else {
             redisPanic("Wrong job type in bioProcessBackgroundJobs().");
         }
@@ -247,6 +247,10 @@ void loadServerConfigFromString(char *config) {
                 server.maxmemory_policy = REDIS_MAXMEMORY_ALLKEYS_LRU;
             } else if (!strcasecmp(argv[1],"allkeys-random")) {
                 server.maxmemory_policy = REDIS_MAXMEMORY_ALLKEYS_RANDOM;
+            } else if (!strcasecmp(argv[1],"volatile-lfu")) {
+                server.maxmemory_policy = REDIS_MAXMEMORY_VOLATILE_LFU;
+            } else if (!strcasecmp(argv[1],"allkeys-lfu")) {
+                server.maxmemory_policy = REDIS_MAXMEMORY_ALLKEYS_LFU;
             } else if (!strcasecmp(argv[1],"noeviction")) {
                 server.maxmemory_policy = REDIS_MAXMEMORY_NO_EVICTION;
             } else {
@@ -259,6 +263,98 @@ void loadServerConfigFromString(char *config) {
                 err = "maxmemory-samples must be 1 or greater";
                 goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"lfu-log-factor") && argc == 2) {
+            server.lfu_log_factor = atoi(argv[1]);
+            if (server.lfu_log_factor < 0) {
+                err = "lfu-log-factor must be 0 or greater";
+                goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"lfu-decay-time") && argc == 2) {
+            server.lfu_decay_time = atoi(argv[1]);
+            if (server.lfu_decay_time < 0) {
+                err = "lfu-decay-time must be 0 or greater";
+                goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"lazyfree-lazy-eviction") && argc == 2) {
+            if ((server.lazyfree_lazy_eviction = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"lazyfree-lazy-expire") && argc == 2) {
+            if ((server.lazyfree_lazy_expire = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"lazyfree-lazy-server-del") &&
+                   argc == 2)
+        {
+            if ((server.lazyfree_lazy_server_del = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"activedefrag") && argc == 2) {
+            if ((server.active_defrag_enabled = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+#ifndef HAVE_DEFRAG
+            if (server.active_defrag_enabled) {
+                err = "active defragmentation is not supported by the "
+                      "allocator, Redis must be compiled with the jemalloc "
+                      "in deps/";
+                goto loaderr;
+            }
+#endif
+        } else if (!strcasecmp(argv[0],"active-defrag-ignore-bytes") &&
+                   argc == 2)
+        {
+            server.active_defrag_ignore_bytes = memtoll(argv[1],NULL);
+        } else if (!strcasecmp(argv[0],"active-defrag-threshold-lower") &&
+                   argc == 2)
+        {
+            server.active_defrag_threshold_lower = atoi(argv[1]);
+            if (server.active_defrag_threshold_lower < 0 ||
+                server.active_defrag_threshold_lower > 1000)
+            {
+                err = "active-defrag-threshold-lower must be between 0 and 1000";
+                goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"active-defrag-threshold-upper") &&
+                   argc == 2)
+        {
+            server.active_defrag_threshold_upper = atoi(argv[1]);
+            if (server.active_defrag_threshold_upper < 0 ||
+                server.active_defrag_threshold_upper > 1000)
+            {
+                err = "active-defrag-threshold-upper must be between 0 and 1000";
+                goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"active-defrag-cycle-min") &&
+                   argc == 2)
+        {
+            server.active_defrag_cycle_min = atoi(argv[1]);
+            if (server.active_defrag_cycle_min < 1 ||
+                server.active_defrag_cycle_min > 99)
+            {
+                err = "active-defrag-cycle-min must be between 1 and 99";
+                goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"active-defrag-cycle-max") &&
+                   argc == 2)
+        {
+            server.active_defrag_cycle_max = atoi(argv[1]);
+            if (server.active_defrag_cycle_max < 1 ||
+                server.active_defrag_cycle_max > 99)
+            {
+                err = "active-defrag-cycle-max must be between 1 and 99";
+                goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"resp-cache-max-memory") && argc == 2) {
+            server.resp_cache_max_memory = memtoll(argv[1],NULL);
+        } else if (!strcasecmp(argv[0],"resp-cache-min-hits") && argc == 2) {
+            server.resp_cache_min_hits = atoi(argv[1]);
+            if (server.resp_cache_min_hits < 1 ||
+                server.resp_cache_min_hits > 255)
+            {
+                err = "resp-cache-min-hits must be between 1 and 255";
+                goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"slaveof") && argc == 3) {
             //从站的IP地址与端口号
             server.masterhost = sdsnew(argv[1]);
@@ -319,6 +415,32 @@ void loadServerConfigFromString(char *config) {
             if ((server.activerehashing = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"active-expire-index") && argc == 2) {
+            if ((server.active_expire_index = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"keyspace-hash-table") && argc == 2) {
+            if (!strcasecmp(argv[1],"chained")) {
+                server.keyspace_hash_table = REDIS_KEYSPACE_CHAINED;
+            } else if (!strcasecmp(argv[1],"open-addressing")) {
+                server.keyspace_hash_table = REDIS_KEYSPACE_OPEN_ADDRESSING;
+            } else if (!strcasecmp(argv[1],"linear")) {
+                server.keyspace_hash_table = REDIS_KEYSPACE_LINEAR;
+            } else {
+                err = "Invalid keyspace hash table type";
+                goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"io-threads") && argc == 2) {
+            server.io_threads_num = atoi(argv[1]);
+            if (server.io_threads_num < 1 ||
+                server.io_threads_num > REDIS_IO_THREADS_MAX_NUM)
+            {
+                err = "Invalid number of I/O threads"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"io-threads-do-reads") && argc == 2) {
+            if ((server.io_threads_do_reads = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"daemonize") && argc == 2) {
             //服务器是否后台运行
             if ((server.daemonize = yesnotoi(argv[1])) == -1) {
@@ -402,16 +524,39 @@ void loadServerConfigFromString(char *config) {
             server.hash_max_ziplist_entries = memtoll(argv[1], NULL);
         } else if (!strcasecmp(argv[0],"hash-max-ziplist-value") && argc == 2) {
             server.hash_max_ziplist_value = memtoll(argv[1], NULL);
-        } else if (!strcasecmp(argv[0],"list-max-ziplist-entries") && argc == 2){
-            server.list_max_ziplist_entries = memtoll(argv[1], NULL);
-        } else if (!strcasecmp(argv[0],"list-max-ziplist-value") && argc == 2) {
-            server.list_max_ziplist_value = memtoll(argv[1], NULL);
+        } else if (!strcasecmp(argv[0],"list-max-ziplist-size") && argc == 2) {
+            server.list_max_ziplist_size = atoi(argv[1]);
+            if (server.list_max_ziplist_size < -5 ||
+                server.list_max_ziplist_size == 0 ||
+                server.list_max_ziplist_size > QUICKLIST_MAX_FILL)
+            {
+                err = "list-max-ziplist-size must be between -5 and -1 or "
+                      "between 1 and 32768"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"list-compress-depth") && argc == 2) {
+            server.list_compress_depth = atoi(argv[1]);
+            if (server.list_compress_depth < 0 ||
+                server.list_compress_depth > QUICKLIST_MAX_COMPRESS)
+            {
+                err = "list-compress-depth must be between 0 and 65536";
+                goto loaderr;
+            }
+        } else if ((!strcasecmp(argv[0],"list-max-ziplist-entries") ||
+                    !strcasecmp(argv[0],"list-max-ziplist-value")) &&
+                   argc == 2)
+        {
+            /* Deprecated: lists are always encoded as quicklists, the size
+             * of their nodes is set by list-max-ziplist-size. */
         } else if (!strcasecmp(argv[0],"set-max-intset-entries") && argc == 2) {
             server.set_max_intset_entries = memtoll(argv[1], NULL);
         } else if (!strcasecmp(argv[0],"zset-max-ziplist-entries") && argc == 2) {
             server.zset_max_ziplist_entries = memtoll(argv[1], NULL);
         } else if (!strcasecmp(argv[0],"zset-max-ziplist-value") && argc == 2) {
             server.zset_max_ziplist_value = memtoll(argv[1], NULL);
+        } else if (!strcasecmp(argv[0],"zset-btree-index") && argc == 2) {
+            if ((server.zset_btree_index = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"rename-command") && argc == 3) {
             struct redisCommand *cmd = lookupCommand(argv[1]);
             int retval;
@@ -563,8 +708,8 @@ void loadServerConfig(char *filename, char *options) {
 void configSetCommand(redisClient *c) {
     robj *o;
     long long ll;
-    redisAssertWithInfo(c,c->argv[2],c->argv[2]->encoding == REDIS_ENCODING_RAW);
-    redisAssertWithInfo(c,c->argv[2],c->argv[3]->encoding == REDIS_ENCODING_RAW);
+    redisAssertWithInfo(c,c->argv[2],sdsEncodedObject(c->argv[2]));
+    redisAssertWithInfo(c,c->argv[2],sdsEncodedObject(c->argv[3]));
     o = c->argv[3];
 
     if (!strcasecmp(c->argv[2]->ptr,"dbfilename")) {
@@ -633,15 +778,85 @@ void configSetCommand(redisClient *c) {
             server.maxmemory_policy = REDIS_MAXMEMORY_ALLKEYS_LRU;
         } else if (!strcasecmp(o->ptr,"allkeys-random")) {
             server.maxmemory_policy = REDIS_MAXMEMORY_ALLKEYS_RANDOM;
+        } else if (!strcasecmp(o->ptr,"volatile-lfu")) {
+            server.maxmemory_policy = REDIS_MAXMEMORY_VOLATILE_LFU;
+        } else if (!strcasecmp(o->ptr,"allkeys-lfu")) {
+            server.maxmemory_policy = REDIS_MAXMEMORY_ALLKEYS_LFU;
         } else if (!strcasecmp(o->ptr,"noeviction")) {
             server.maxmemory_policy = REDIS_MAXMEMORY_NO_EVICTION;
         } else {
             goto badfmt;
         }
+        evictionPoolEmpty();
     } else if (!strcasecmp(c->argv[2]->ptr,"maxmemory-samples")) {
         if (getLongLongFromObject(o,&ll) == REDIS_ERR ||
             ll <= 0) goto badfmt;
         server.maxmemory_samples = ll;
+    } else if (!strcasecmp(c->argv[2]->ptr,"lfu-log-factor")) {
+        if (getLongLongFromObject(o,&ll) == REDIS_ERR ||
+            ll < 0 || ll > INT_MAX) goto badfmt;
+        server.lfu_log_factor = ll;
+    } else if (!strcasecmp(c->argv[2]->ptr,"lfu-decay-time")) {
+        if (getLongLongFromObject(o,&ll) == REDIS_ERR ||
+            ll < 0 || ll > INT_MAX) goto badfmt;
+        server.lfu_decay_time = ll;
+    } else if (!strcasecmp(c->argv[2]->ptr,"lazyfree-lazy-eviction")) {
+        int yn = yesnotoi(o->ptr);
+
+        if (yn == -1) goto badfmt;
+        server.lazyfree_lazy_eviction = yn;
+    } else if (!strcasecmp(c->argv[2]->ptr,"lazyfree-lazy-expire")) {
+        int yn = yesnotoi(o->ptr);
+
+        if (yn == -1) goto badfmt;
+        server.lazyfree_lazy_expire = yn;
+    } else if (!strcasecmp(c->argv[2]->ptr,"lazyfree-lazy-server-del")) {
+        int yn = yesnotoi(o->ptr);
+
+        if (yn == -1) goto badfmt;
+        server.lazyfree_lazy_server_del = yn;
+    } else if (!strcasecmp(c->argv[2]->ptr,"activedefrag")) {
+        int yn = yesnotoi(o->ptr);
+
+        if (yn == -1) goto badfmt;
+#ifndef HAVE_DEFRAG
+        if (yn) {
+            addReplyError(c,
+                "Active defragmentation is not supported by the allocator, "
+                "Redis must be compiled with the jemalloc in deps/");
+            return;
+        }
+#endif
+        server.active_defrag_enabled = yn;
+    } else if (!strcasecmp(c->argv[2]->ptr,"active-defrag-ignore-bytes")) {
+        if (getLongLongFromObject(o,&ll) == REDIS_ERR ||
+            ll < 0) goto badfmt;
+        server.active_defrag_ignore_bytes = ll;
+    } else if (!strcasecmp(c->argv[2]->ptr,"active-defrag-threshold-lower")) {
+        if (getLongLongFromObject(o,&ll) == REDIS_ERR ||
+            ll < 0 || ll > 1000) goto badfmt;
+        server.active_defrag_threshold_lower = ll;
+    } else if (!strcasecmp(c->argv[2]->ptr,"active-defrag-threshold-upper")) {
+        if (getLongLongFromObject(o,&ll) == REDIS_ERR ||
+            ll < 0 || ll > 1000) goto badfmt;
+        server.active_defrag_threshold_upper = ll;
+    } else if (!strcasecmp(c->argv[2]->ptr,"active-defrag-cycle-min")) {
+        if (getLongLongFromObject(o,&ll) == REDIS_ERR ||
+            ll < 1 || ll > 99) goto badfmt;
+        server.active_defrag_cycle_min = ll;
+    } else if (!strcasecmp(c->argv[2]->ptr,"active-defrag-cycle-max")) {
+        if (getLongLongFromObject(o,&ll) == REDIS_ERR ||
+            ll < 1 || ll > 99) goto badfmt;
+        server.active_defrag_cycle_max = ll;
+    } else if (!strcasecmp(c->argv[2]->ptr,"resp-cache-max-memory")) {
+        if (getLongLongFromObject(o,&ll) == REDIS_ERR ||
+            ll < 0) goto badfmt;
+        server.resp_cache_max_memory = ll;
+        respCacheResize();
+    } else if (!strcasecmp(c->argv[2]->ptr,"resp-cache-min-hits")) {
+        if (getLongLongFromObject(o,&ll) == REDIS_ERR ||
+            ll < 1 || ll > 255) goto badfmt;
+        server.resp_cache_min_hits = ll;
     } else if (!strcasecmp(c->argv[2]->ptr,"timeout")) {
         if (getLongLongFromObject(o,&ll) == REDIS_ERR ||
             ll < 0 || ll > LONG_MAX) goto badfmt;
@@ -650,6 +865,24 @@ void configSetCommand(redisClient *c) {
         if (getLongLongFromObject(o,&ll) == REDIS_ERR ||
             ll < 0 || ll > INT_MAX) goto badfmt;
         server.tcpkeepalive = ll;
+    } else if (!strcasecmp(c->argv[2]->ptr,"io-threads")) {
+        if (getLongLongFromObject(o,&ll) == REDIS_ERR ||
+            ll < 1 || ll > REDIS_IO_THREADS_MAX_NUM) goto badfmt;
+        if (setIOThreadsNum(ll) == REDIS_ERR) {
+            addReplyError(c,
+                "Unable to create the I/O threads. Check server logs.");
+            return;
+        }
+    } else if (!strcasecmp(c->argv[2]->ptr,"active-expire-index")) {
+        int yn = yesnotoi(o->ptr);
+
+        if (yn == -1) goto badfmt;
+        setExpiresIndex(yn);
+    } else if (!strcasecmp(c->argv[2]->ptr,"io-threads-do-reads")) {
+        int yn = yesnotoi(o->ptr);
+
+        if (yn == -1) goto badfmt;
+        server.io_threads_do_reads = yn;
     } else if (!strcasecmp(c->argv[2]->ptr,"appendfsync")) {
         if (!strcasecmp(o->ptr,"no")) {
             server.aof_fsync = AOF_FSYNC_NO;
@@ -744,12 +977,19 @@ void configSetCommand(redisClient *c) {
     } else if (!strcasecmp(c->argv[2]->ptr,"hash-max-ziplist-value")) {
         if (getLongLongFromObject(o,&ll) == REDIS_ERR || ll < 0) goto badfmt;
         server.hash_max_ziplist_value = ll;
-    } else if (!strcasecmp(c->argv[2]->ptr,"list-max-ziplist-entries")) {
-        if (getLongLongFromObject(o,&ll) == REDIS_ERR || ll < 0) goto badfmt;
-        server.list_max_ziplist_entries = ll;
-    } else if (!strcasecmp(c->argv[2]->ptr,"list-max-ziplist-value")) {
+    } else if (!strcasecmp(c->argv[2]->ptr,"list-max-ziplist-size")) {
+        if (getLongLongFromObject(o,&ll) == REDIS_ERR ||
+            ll < -5 || ll == 0 || ll > QUICKLIST_MAX_FILL) goto badfmt;
+        server.list_max_ziplist_size = ll;
+    } else if (!strcasecmp(c->argv[2]->ptr,"list-compress-depth")) {
+        if (getLongLongFromObject(o,&ll) == REDIS_ERR ||
+            ll < 0 || ll > QUICKLIST_MAX_COMPRESS) goto badfmt;
+        server.list_compress_depth = ll;
+    } else if (!strcasecmp(c->argv[2]->ptr,"list-max-ziplist-entries") ||
+               !strcasecmp(c->argv[2]->ptr,"list-max-ziplist-value")) {
+        /* Deprecated, accepted and ignored like in the config file, so
+         * that existing scripts setting them don't break. */
         if (getLongLongFromObject(o,&ll) == REDIS_ERR || ll < 0) goto badfmt;
-        server.list_max_ziplist_value = ll;
     } else if (!strcasecmp(c->argv[2]->ptr,"set-max-intset-entries")) {
         if (getLongLongFromObject(o,&ll) == REDIS_ERR || ll < 0) goto badfmt;
         server.set_max_intset_entries = ll;
@@ -759,6 +999,11 @@ void configSetCommand(redisClient *c) {
     } else if (!strcasecmp(c->argv[2]->ptr,"zset-max-ziplist-value")) {
         if (getLongLongFromObject(o,&ll) == REDIS_ERR || ll < 0) goto badfmt;
         server.zset_max_ziplist_value = ll;
+    } else if (!strcasecmp(c->argv[2]->ptr,"zset-btree-index")) {
+        int yn = yesnotoi(o->ptr);
+
+        if (yn == -1) goto badfmt;
+        server.zset_btree_index = yn;
     } else if (!strcasecmp(c->argv[2]->ptr,"lua-time-limit")) {
         if (getLongLongFromObject(o,&ll) == REDIS_ERR || ll < 0) goto badfmt;
         server.lua_time_limit = ll;
@@ -927,7 +1172,7 @@ void configGetCommand(redisClient *c) {
     char *pattern = o->ptr;
     char buf[128];
     int matches = 0;
-    redisAssertWithInfo(c,o,o->encoding == REDIS_ENCODING_RAW);
+    redisAssertWithInfo(c,o,sdsEncodedObject(o));
 
     /* String values */
     config_get_string_field("dbfilename",server.rdb_filename);
@@ -940,6 +1185,22 @@ void configGetCommand(redisClient *c) {
     /* Numerical values */
     config_get_numerical_field("maxmemory",server.maxmemory);
     config_get_numerical_field("maxmemory-samples",server.maxmemory_samples);
+    config_get_numerical_field("lfu-log-factor",server.lfu_log_factor);
+    config_get_numerical_field("lfu-decay-time",server.lfu_decay_time);
+    config_get_numerical_field("active-defrag-ignore-bytes",
+            server.active_defrag_ignore_bytes);
+    config_get_numerical_field("active-defrag-threshold-lower",
+            server.active_defrag_threshold_lower);
+    config_get_numerical_field("active-defrag-threshold-upper",
+            server.active_defrag_threshold_upper);
+    config_get_numerical_field("active-defrag-cycle-min",
+            server.active_defrag_cycle_min);
+    config_get_numerical_field("active-defrag-cycle-max",
+            server.active_defrag_cycle_max);
+    config_get_numerical_field("resp-cache-max-memory",
+            server.resp_cache_max_memory);
+    config_get_numerical_field("resp-cache-min-hits",
+            server.resp_cache_min_hits);
     config_get_numerical_field("timeout",server.maxidletime);
     config_get_numerical_field("tcp-keepalive",server.tcpkeepalive);
     config_get_numerical_field("auto-aof-rewrite-percentage",
@@ -950,10 +1211,10 @@ void configGetCommand(redisClient *c) {
             server.hash_max_ziplist_entries);
     config_get_numerical_field("hash-max-ziplist-value",
             server.hash_max_ziplist_value);
-    config_get_numerical_field("list-max-ziplist-entries",
-            server.list_max_ziplist_entries);
-    config_get_numerical_field("list-max-ziplist-value",
-            server.list_max_ziplist_value);
+    config_get_numerical_field("list-max-ziplist-size",
+            server.list_max_ziplist_size);
+    config_get_numerical_field("list-compress-depth",
+            server.list_compress_depth);
     config_get_numerical_field("set-max-intset-entries",
             server.set_max_intset_entries);
     config_get_numerical_field("zset-max-ziplist-entries",
@@ -977,6 +1238,7 @@ void configGetCommand(redisClient *c) {
     config_get_numerical_field("min-slaves-to-write",server.repl_min_slaves_to_write);
     config_get_numerical_field("min-slaves-max-lag",server.repl_min_slaves_max_lag);
     config_get_numerical_field("hz",server.hz);
+    config_get_numerical_field("io-threads",server.io_threads_num);
 
     /* Bool (yes/no) values */
     config_get_bool_field("no-appendfsync-on-rewrite",
@@ -991,10 +1253,21 @@ void configGetCommand(redisClient *c) {
     config_get_bool_field("rdbcompression", server.rdb_compression);
     config_get_bool_field("rdbchecksum", server.rdb_checksum);
     config_get_bool_field("activerehashing", server.activerehashing);
+    config_get_bool_field("active-expire-index", server.active_expire_index);
+    config_get_bool_field("lazyfree-lazy-eviction",
+            server.lazyfree_lazy_eviction);
+    config_get_bool_field("lazyfree-lazy-expire",
+            server.lazyfree_lazy_expire);
+    config_get_bool_field("lazyfree-lazy-server-del",
+            server.lazyfree_lazy_server_del);
+    config_get_bool_field("activedefrag",server.active_defrag_enabled);
+    config_get_bool_field("zset-btree-index",server.zset_btree_index);
     config_get_bool_field("repl-disable-tcp-nodelay",
             server.repl_disable_tcp_nodelay);
     config_get_bool_field("aof-rewrite-incremental-fsync",
             server.aof_rewrite_incremental_fsync);
+    config_get_bool_field("io-threads-do-reads",
+            server.io_threads_do_reads);
 
     /* Everything we can't handle with macros follows. */
 
@@ -1022,6 +1295,8 @@ void configGetCommand(redisClient *c) {
         case REDIS_MAXMEMORY_VOLATILE_RANDOM: s = "volatile-random"; break;
         case REDIS_MAXMEMORY_ALLKEYS_LRU: s = "allkeys-lru"; break;
         case REDIS_MAXMEMORY_ALLKEYS_RANDOM: s = "allkeys-random"; break;
+        case REDIS_MAXMEMORY_VOLATILE_LFU: s = "volatile-lfu"; break;
+        case REDIS_MAXMEMORY_ALLKEYS_LFU: s = "allkeys-lfu"; break;
         case REDIS_MAXMEMORY_NO_EVICTION: s = "noeviction"; break;
         default: s = "unknown"; break; /* too harmless to panic */
         }
@@ -1029,6 +1304,19 @@ void configGetCommand(redisClient *c) {
         addReplyBulkCString(c,s);
         matches++;
     }
+    if (stringmatch(pattern,"keyspace-hash-table",0)) {
+        char *s;
+
+        switch(server.keyspace_hash_table) {
+        case REDIS_KEYSPACE_CHAINED: s = "chained"; break;
+        case REDIS_KEYSPACE_OPEN_ADDRESSING: s = "open-addressing"; break;
+        case REDIS_KEYSPACE_LINEAR: s = "linear"; break;
+        default: s = "unknown"; break;
+        }
+        addReplyBulkCString(c,"keyspace-hash-table");
+        addReplyBulkCString(c,s);
+        matches++;
+    }
     if (stringmatch(pattern,"appendfsync",0)) {
         char *policy;
 
@@ -1692,9 +1980,24 @@ int rewriteConfig(char *path) {
         "volatile-random", REDIS_MAXMEMORY_VOLATILE_RANDOM,
         "allkeys-random", REDIS_MAXMEMORY_ALLKEYS_RANDOM,
         "volatile-ttl", REDIS_MAXMEMORY_VOLATILE_TTL,
+        "volatile-lfu", REDIS_MAXMEMORY_VOLATILE_LFU,
+        "allkeys-lfu", REDIS_MAXMEMORY_ALLKEYS_LFU,
         "noeviction", REDIS_MAXMEMORY_NO_EVICTION,
         NULL, REDIS_DEFAULT_MAXMEMORY_POLICY);
     rewriteConfigNumericalOption(state,"maxmemory-samples",server.maxmemory_samples,REDIS_DEFAULT_MAXMEMORY_SAMPLES);
+    rewriteConfigNumericalOption(state,"lfu-log-factor",server.lfu_log_factor,REDIS_DEFAULT_LFU_LOG_FACTOR);
+    rewriteConfigNumericalOption(state,"lfu-decay-time",server.lfu_decay_time,REDIS_DEFAULT_LFU_DECAY_TIME);
+    rewriteConfigYesNoOption(state,"lazyfree-lazy-eviction",server.lazyfree_lazy_eviction,REDIS_DEFAULT_LAZYFREE_LAZY_EVICTION);
+    rewriteConfigYesNoOption(state,"lazyfree-lazy-expire",server.lazyfree_lazy_expire,REDIS_DEFAULT_LAZYFREE_LAZY_EXPIRE);
+    rewriteConfigYesNoOption(state,"lazyfree-lazy-server-del",server.lazyfree_lazy_server_del,REDIS_DEFAULT_LAZYFREE_LAZY_SERVER_DEL);
+    rewriteConfigYesNoOption(state,"activedefrag",server.active_defrag_enabled,REDIS_DEFAULT_ACTIVE_DEFRAG);
+    rewriteConfigBytesOption(state,"active-defrag-ignore-bytes",server.active_defrag_ignore_bytes,REDIS_DEFAULT_DEFRAG_IGNORE_BYTES);
+    rewriteConfigNumericalOption(state,"active-defrag-threshold-lower",server.active_defrag_threshold_lower,REDIS_DEFAULT_DEFRAG_THRESHOLD_LOWER);
+    rewriteConfigNumericalOption(state,"active-defrag-threshold-upper",server.active_defrag_threshold_upper,REDIS_DEFAULT_DEFRAG_THRESHOLD_UPPER);
+    rewriteConfigNumericalOption(state,"active-defrag-cycle-min",server.active_defrag_cycle_min,REDIS_DEFAULT_DEFRAG_CYCLE_MIN);
+    rewriteConfigNumericalOption(state,"active-defrag-cycle-max",server.active_defrag_cycle_max,REDIS_DEFAULT_DEFRAG_CYCLE_MAX);
+    rewriteConfigBytesOption(state,"resp-cache-max-memory",server.resp_cache_max_memory,REDIS_DEFAULT_RESP_CACHE_MAX_MEMORY);
+    rewriteConfigNumericalOption(state,"resp-cache-min-hits",server.resp_cache_min_hits,REDIS_DEFAULT_RESP_CACHE_MIN_HITS);
     rewriteConfigAppendonlyOption(state);
     rewriteConfigEnumOption(state,"appendfsync",server.aof_fsync,
         "everysec", AOF_FSYNC_EVERYSEC,
@@ -1710,14 +2013,23 @@ int rewriteConfig(char *path) {
     rewriteConfigNotifykeyspaceeventsOption(state);
     rewriteConfigNumericalOption(state,"hash-max-ziplist-entries",server.hash_max_ziplist_entries,REDIS_HASH_MAX_ZIPLIST_ENTRIES);
     rewriteConfigNumericalOption(state,"hash-max-ziplist-value",server.hash_max_ziplist_value,REDIS_HASH_MAX_ZIPLIST_VALUE);
-    rewriteConfigNumericalOption(state,"list-max-ziplist-entries",server.list_max_ziplist_entries,REDIS_LIST_MAX_ZIPLIST_ENTRIES);
-    rewriteConfigNumericalOption(state,"list-max-ziplist-value",server.list_max_ziplist_value,REDIS_LIST_MAX_ZIPLIST_VALUE);
+    rewriteConfigNumericalOption(state,"list-max-ziplist-size",server.list_max_ziplist_size,REDIS_LIST_MAX_ZIPLIST_SIZE);
+    rewriteConfigNumericalOption(state,"list-compress-depth",server.list_compress_depth,REDIS_LIST_COMPRESS_DEPTH);
     rewriteConfigNumericalOption(state,"set-max-intset-entries",server.set_max_intset_entries,REDIS_SET_MAX_INTSET_ENTRIES);
     rewriteConfigNumericalOption(state,"zset-max-ziplist-entries",server.zset_max_ziplist_entries,REDIS_ZSET_MAX_ZIPLIST_ENTRIES);
     rewriteConfigNumericalOption(state,"zset-max-ziplist-value",server.zset_max_ziplist_value,REDIS_ZSET_MAX_ZIPLIST_VALUE);
+    rewriteConfigYesNoOption(state,"zset-btree-index",server.zset_btree_index,REDIS_DEFAULT_ZSET_BTREE_INDEX);
     rewriteConfigYesNoOption(state,"activerehashing",server.activerehashing,REDIS_DEFAULT_ACTIVE_REHASHING);
+    rewriteConfigYesNoOption(state,"active-expire-index",server.active_expire_index,REDIS_DEFAULT_ACTIVE_EXPIRE_INDEX);
+    rewriteConfigEnumOption(state,"keyspace-hash-table",server.keyspace_hash_table,
+        "chained", REDIS_KEYSPACE_CHAINED,
+        "open-addressing", REDIS_KEYSPACE_OPEN_ADDRESSING,
+        "linear", REDIS_KEYSPACE_LINEAR,
+        NULL, REDIS_DEFAULT_KEYSPACE_HASH_TABLE);
     rewriteConfigClientoutputbufferlimitOption(state);
     rewriteConfigNumericalOption(state,"hz",server.hz,REDIS_DEFAULT_HZ);
+    rewriteConfigNumericalOption(state,"io-threads",server.io_threads_num,REDIS_DEFAULT_IO_THREADS);
+    rewriteConfigYesNoOption(state,"io-threads-do-reads",server.io_threads_do_reads,REDIS_DEFAULT_IO_THREADS_DO_READS);
     rewriteConfigYesNoOption(state,"aof-rewrite-incremental-fsync",server.aof_rewrite_incremental_fsync,REDIS_DEFAULT_AOF_REWRITE_INCREMENTAL_FSYNC);
     if (server.sentinel_mode) rewriteConfigSentinelOption(state);
 
@@ -1754,7 +2066,19 @@ void configCommand(redisClient *c) {
         server.stat_numcommands = 0;
         server.stat_numconnections = 0;
         server.stat_expiredkeys = 0;
+        server.stat_expired_time_cap_reached_count = 0;
         server.stat_rejected_conn = 0;
+        server.stat_accept_events = 0;
+        server.stat_accept_batch_max = 0;
+        server.stat_reply_chunk_hits = 0;
+        server.stat_reply_chunk_misses = 0;
+        server.stat_resp_cache_hits = 0;
+        server.stat_resp_cache_misses = 0;
+        server.stat_active_defrag_hits = 0;
+        server.stat_active_defrag_misses = 0;
+        server.stat_active_defrag_key_hits = 0;
+        server.stat_active_defrag_key_misses = 0;
+        server.stat_active_defrag_bytes = 0;
         server.stat_fork_time = 0;
         server.aof_delayed_fsync = 0;
         resetCommandTableStats();
@@ -65,6 +65,12 @@
 #define HAVE_EPOLL 1
 #endif
 
+/* The io_uring backend is selected at build time with USE_IO_URING=yes,
+ * it falls back to epoll at runtime if the kernel lacks support. */
+#if defined(__linux__) && defined(USE_IO_URING)
+#define HAVE_IO_URING 1
+#endif
+
 #if (defined(__APPLE__) && defined(MAC_OS_X_VERSION_10_6)) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined (__NetBSD__)
 #define HAVE_KQUEUE 1
 #endif
@@ -76,6 +82,11 @@
 #endif
 #endif
 
+/* Test for accept4() */
+#ifdef __linux__
+#define HAVE_ACCEPT4 1
+#endif
+
 /* Define aof_fsync to fdatasync() in Linux and fsync() for all the rest */
 #ifdef __linux__
 #define aof_fsync fdatasync
@@ -34,6 +34,93 @@
 
 void SlotToKeyAdd(robj *key);
 void SlotToKeyDel(robj *key);
+static void expiresIndexDeleteKey(redisDb *db, robj *key, unsigned int h);
+
+/*-----------------------------------------------------------------------------
+ * Key hashes
+ *----------------------------------------------------------------------------*/
+
+/* The keyspace, the expires, the watched keys and the blocking keys
+ * dictionaries all hash the keys with the same function, so a single write
+ * against a key with a TTL, watched by some client, used to hash the same
+ * string four or five times.
+ *
+ * Before executing a command call() hashes the key arguments once, and
+ * stores the hashes in a small direct mapped table indexed by the object
+ * pointer. Objects having an entry are flagged with the 'hashcached' bit, so
+ * keyHash() costs a bit test for all the other objects. The entries are
+ * removed when the command returns, or before, when the object is freed
+ * (see decrRefCount()): a different object allocated at the same address
+ * can't get a stale hash. */
+
+#define REDIS_KEYHASH_SLOTS 256     /* Must be a power of two. */
+
+typedef struct keyHashEntry {
+    robj *key;              /* Key object, NULL if the slot is free. */
+    unsigned int hash;      /* Hash of the key, as computed by dictSdsHash. */
+} keyHashEntry;
+
+static keyHashEntry keyHashTable[REDIS_KEYHASH_SLOTS];
+static unsigned char keyHashUsed[REDIS_KEYHASH_SLOTS]; /* Slots to release. */
+static int keyHashUsedLen = 0;
+
+/* Objects are at least 16 bytes aligned, and the arguments of a command
+ * are usually allocated one after the other. */
+#define keyHashSlot(o) (((unsigned long)(o) >> 4) & (REDIS_KEYHASH_SLOTS-1))
+
+/* Return the hash of 'key', that must be sds encoded, for the lookups in the
+ * dictionaries of a redisDb. */
+unsigned int keyHash(robj *key) {
+    if (key->hashcached) return keyHashTable[keyHashSlot(key)].hash;
+    return dictGenHashFunction(key->ptr,sdslen(key->ptr));
+}
+
+static void keyHashAdd(robj *key) {
+    unsigned long slot = keyHashSlot(key);
+    keyHashEntry *e = keyHashTable+slot;
+
+    if (key->hashcached || keyHashUsedLen == REDIS_KEYHASH_SLOTS) return;
+    if (e->key) e->key->hashcached = 0;
+    e->key = key;
+    e->hash = dictGenHashFunction(key->ptr,sdslen(key->ptr));
+    key->hashcached = 1;
+    keyHashUsed[keyHashUsedLen++] = slot;
+}
+
+/* Cache the hashes of the key arguments of the command the client is about
+ * to execute. The returned value must be passed to keyHashReleaseArgs()
+ * once the command returned. Commands may be nested (EXEC, scripts), every
+ * call only releases the entries it created. */
+int keyHashCacheArgs(redisClient *c) {
+    struct redisCommand *cmd = c->cmd;
+    int mark = keyHashUsedLen, last, j;
+
+    if (cmd->firstkey == 0) return mark;
+    last = cmd->lastkey < 0 ? c->argc+cmd->lastkey : cmd->lastkey;
+    for (j = cmd->firstkey; j <= last && j < c->argc; j += cmd->keystep)
+        if (sdsEncodedObject(c->argv[j])) keyHashAdd(c->argv[j]);
+    return mark;
+}
+
+void keyHashReleaseArgs(int mark) {
+    while(keyHashUsedLen > mark) {
+        keyHashEntry *e = keyHashTable+keyHashUsed[--keyHashUsedLen];
+
+        if (e->key) {
+            e->key->hashcached = 0;
+            e->key = NULL;
+        }
+    }
+}
+
+/* Remove the entry of 'o', that must be flagged as cached. */
+void keyHashDelete(robj *o) {
+    keyHashEntry *e = keyHashTable+keyHashSlot(o);
+
+    redisAssertWithInfo(NULL,o,e->key == o);
+    e->key = NULL;
+    o->hashcached = 0;
+}
 
 /*-----------------------------------------------------------------------------
  * C-level DB API
@@ -41,7 +128,7 @@ void SlotToKeyDel(robj *key);
 
 //ݿֵвkey value
 robj *lookupKey(redisDb *db, robj *key) {
-    dictEntry *de = dictFind(db->dict,key->ptr);
+    dictEntry *de = dictFindWithHash(db->dict,key->ptr,keyHash(key));
     if (de) {
         robj *val = dictGetVal(de);
 
@@ -49,7 +136,7 @@ robj *lookupKey(redisDb *db, robj *key) {
          * Don't do it if we have a saving child, as this will trigger
          * a copy on write madness. */
         if (server.rdb_child_pid == -1 && server.aof_child_pid == -1)
-            val->lru = server.lruclock;
+            updateObjectAccess(val);
         return val;
     } else {
         return NULL;
@@ -85,15 +172,56 @@ robj *lookupKeyWriteOrReply(redisClient *c, robj *key, robj *reply) {
     return o;
 }
 
+/* Prefetch the memory touched by the lookup of the keys having the
+ * specified hashes, see dictPrefetchHashes(). The keys and the expires
+ * dictionaries use the same hash function. */
+void dbPrefetchHashes(redisDb *db, const unsigned int *hashes, int count) {
+    dictPrefetchHashes(db->dict,hashes,count,DICT_PREFETCH_VALS);
+    if (dictSize(db->expires))
+        dictPrefetchHashes(db->expires,hashes,count,0);
+}
+
+/* Commands looking up many keys call this function for the next batch of
+ * keys before looking them up one after the other: the cache misses of the
+ * different lookups then overlap instead of adding up. */
+void dbPrefetchKeys(redisDb *db, robj **keys, int count) {
+    unsigned int hashes[DICT_PREFETCH_BATCH];
+    int j, n = 0;
+
+    for (j = 0; j < count; j++) {
+        if (!sdsEncodedObject(keys[j])) continue;
+        hashes[n++] = keyHash(keys[j]);
+        if (n == DICT_PREFETCH_BATCH) {
+            dbPrefetchHashes(db,hashes,n);
+            n = 0;
+        }
+    }
+    if (n) dbPrefetchHashes(db,hashes,n);
+}
+
+/* Return true if the argument 'i' of a command called with 'argc'
+ * arguments is a key worth to prefetch before executing the command. Only
+ * read only commands are considered: their lookups are the ones that stall
+ * the execution of pipelines and transactions. */
+int isPrefetchableKeyArg(struct redisCommand *cmd, int argc, int i) {
+    int last;
+
+    if (!(cmd->flags & REDIS_CMD_READONLY) || cmd->firstkey == 0) return 0;
+    last = cmd->lastkey < 0 ? argc+cmd->lastkey : cmd->lastkey;
+    return i >= cmd->firstkey && i <= last &&
+           (i-cmd->firstkey) % cmd->keystep == 0;
+}
+
 /* Add the key to the DB. It's up to the caller to increment the reference
  * counter of the value if needed.
  *
- * The program is aborted if the key already exists. */
+ * The program is aborted if the key already exists. The key is copied
+ * by the dict (see dbDictType), it is up to the caller to release it. */
 void dbAdd(redisDb *db, robj *key, robj *val) {
-    sds copy = sdsdup(key->ptr);
-    int retval = dictAdd(db->dict, copy, val);
+    dictEntry *de = dictAddRawWithHash(db->dict,key->ptr,keyHash(key));
 
-    redisAssertWithInfo(NULL,key,retval == REDIS_OK);
+    redisAssertWithInfo(NULL,key,de != NULL);
+    dictSetVal(db->dict,de,val);
  }
 
 /* Overwrite an existing key with a new value. Incrementing the reference
@@ -102,10 +230,22 @@ void dbAdd(redisDb *db, robj *key, robj *val) {
  *
  * The program is aborted if the key was not already present. */
 void dbOverwrite(redisDb *db, robj *key, robj *val) {
-    struct dictEntry *de = dictFind(db->dict,key->ptr);
+    struct dictEntry *de = dictFindWithHash(db->dict,key->ptr,keyHash(key));
+    struct dictEntry auxentry;
 
     redisAssertWithInfo(NULL,key,de != NULL);
-    dictReplace(db->dict, key->ptr, val);
+    /* The access frequency belongs to the key, not to the value: keep it
+     * so that a hot key is not made cold by a SET. */
+    if (REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy))
+        val->lru = ((robj*)dictGetVal(de))->lru;
+    /* Set the new value before freeing the old one, exactly like
+     * dictReplace() does, they may be the same object. */
+    auxentry = *de;
+    dictSetVal(db->dict,de,val);
+    if (server.lazyfree_lazy_server_del)
+        freeObjAsync(dictGetVal(&auxentry));
+    else
+        dictFreeVal(db->dict,&auxentry);
 }
 
 /* High level Set operation. This function can be used in order to set
@@ -126,7 +266,7 @@ void setKey(redisDb *db, robj *key, robj *val) {
 }
 
 int dbExists(redisDb *db, robj *key) {
-    return dictFind(db->dict,key->ptr) != NULL;
+    return dictFindWithHash(db->dict,key->ptr,keyHash(key)) != NULL;
 }
 
 /* Return a random key, in form of a Redis object.
@@ -156,17 +296,30 @@ robj *dbRandomKey(redisDb *db) {
 }
 
 /* Delete a key, value, and associated expiration entry if any, from the DB */
-int dbDelete(redisDb *db, robj *key) {
+int dbSyncDelete(redisDb *db, robj *key) {
+    unsigned int h = keyHash(key);
+
     /* Deleting an entry from the expires dict will not free the sds of
      * the key, because it is shared with the main dictionary. */
-    if (dictSize(db->expires) > 0) dictDelete(db->expires,key->ptr);
-    if (dictDelete(db->dict,key->ptr) == DICT_OK) {
+    if (dictSize(db->expires) > 0) {
+        if (db->expires_index) expiresIndexDeleteKey(db,key,h);
+        dictDeleteWithHash(db->expires,key->ptr,h);
+    }
+    if (dictDeleteWithHash(db->dict,key->ptr,h) == DICT_OK) {
         return 1;
     } else {
         return 0;
     }
 }
 
+/* Delete a key as a side effect of a command, for instance because it was
+ * emptied or replaced by the result of a *STORE command. The value is
+ * freed in background if lazyfree-lazy-server-del is enabled. */
+int dbDelete(redisDb *db, robj *key) {
+    return server.lazyfree_lazy_server_del ? dbAsyncDelete(db,key) :
+                                             dbSyncDelete(db,key);
+}
+
 long long emptyDb() {
     int j;
     long long removed = 0;
@@ -175,6 +328,7 @@ long long emptyDb() {
         removed += dictSize(server.db[j].dict);
         dictEmpty(server.db[j].dict);
         dictEmpty(server.db[j].expires);
+        expiresIndexEmpty(server.db+j);
     }
     return removed;
 }
@@ -197,6 +351,7 @@ int selectDb(redisClient *c, int id) {
 
 void signalModifiedKey(redisDb *db, robj *key) {
     touchWatchedKey(db,key);
+    respCacheInvalidateKey(db,key);
 }
 
 void signalFlushedDb(int dbid) {
@@ -207,17 +362,46 @@ void signalFlushedDb(int dbid) {
  * Type agnostic commands operating on the key space
  *----------------------------------------------------------------------------*/
 
+/* Parse the optional ASYNC argument of FLUSHDB and FLUSHALL, that makes
+ * the dictionaries of the DBs to be freed in background. */
+static int getFlushAsyncOrReply(redisClient *c, int *async) {
+    *async = 0;
+    if (c->argc == 1) return REDIS_OK;
+    if (c->argc == 2 && !strcasecmp(c->argv[1]->ptr,"async")) {
+        *async = 1;
+        return REDIS_OK;
+    }
+    addReply(c,shared.syntaxerr);
+    return REDIS_ERR;
+}
+
 void flushdbCommand(redisClient *c) {
-    server.dirty += dictSize(c->db->dict);
+    int async;
+
+    if (getFlushAsyncOrReply(c,&async) == REDIS_ERR) return;
     signalFlushedDb(c->db->id);
-    dictEmpty(c->db->dict);
-    dictEmpty(c->db->expires);
+    if (async) {
+        server.dirty += emptyDbAsync(c->db);
+    } else {
+        server.dirty += dictSize(c->db->dict);
+        dictEmpty(c->db->dict);
+        dictEmpty(c->db->expires);
+        expiresIndexEmpty(c->db);
+    }
     addReply(c,shared.ok);
 }
 
 void flushallCommand(redisClient *c) {
+    int async, j;
+
+    if (getFlushAsyncOrReply(c,&async) == REDIS_ERR) return;
     signalFlushedDb(-1);
-    server.dirty += emptyDb();
+    if (async) {
+        for (j = 0; j < server.dbnum; j++)
+            server.dirty += emptyDbAsync(server.db+j);
+    } else {
+        server.dirty += emptyDb();
+    }
     addReply(c,shared.ok);
     if (server.rdb_child_pid != -1) {
         kill(server.rdb_child_pid,SIGUSR1);
@@ -233,11 +417,13 @@ void flushallCommand(redisClient *c) {
     server.dirty++;
 }
 
-void delCommand(redisClient *c) {
+void delGenericCommand(redisClient *c, int lazy) {
     int deleted = 0, j;
 
     for (j = 1; j < c->argc; j++) {
-        if (dbDelete(c->db,c->argv[j])) {
+        int removed = lazy ? dbAsyncDelete(c->db,c->argv[j]) :
+                             dbSyncDelete(c->db,c->argv[j]);
+        if (removed) {
             signalModifiedKey(c->db,c->argv[j]);
             notifyKeyspaceEvent(REDIS_NOTIFY_GENERIC,
                 "del",c->argv[j],c->db->id);
@@ -248,6 +434,15 @@ void delCommand(redisClient *c) {
     addReplyLongLong(c,deleted);
 }
 
+void delCommand(redisClient *c) {
+    delGenericCommand(c,0);
+}
+
+/* UNLINK is like DEL, but big values are freed in background. */
+void unlinkCommand(redisClient *c) {
+    delGenericCommand(c,1);
+}
+
 void existsCommand(redisClient *c) {
     expireIfNeeded(c->db,c->argv[1]);
     if (dbExists(c->db,c->argv[1])) {
@@ -332,7 +527,7 @@ void scanCallback(void *privdata, const dictEntry *de) {
     } else if (o->type == REDIS_ZSET) {
         key = dictGetKey(de);
         incrRefCount(key);
-        val = createStringObjectFromLongDouble(*(double*)dictGetVal(de));
+        val = createStringObjectFromLongDouble(zsetDictGetScore(o,de));
     } else {
         redisPanic("Type not handled in SCAN callback.");
     }
@@ -423,7 +618,7 @@ void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor) {
 
     /* Step 2: Iterate the collection.
      *
-     * Note that if the object is encoded with a ziplist, intset, or any other
+     * Note that if the object is encoded with a listpack, intset, or any other
      * representation that is not an hash table, we are sure that it is also
      * composed of a small number of elements. So to avoid taking state we
      * just return everything inside the object in a single call, setting the
@@ -438,7 +633,9 @@ void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor) {
     } else if (o->type == REDIS_HASH && o->encoding == REDIS_ENCODING_HT) {
         ht = o->ptr;
         count *= 2; /* We return key / value for this type. */
-    } else if (o->type == REDIS_ZSET && o->encoding == REDIS_ENCODING_SKIPLIST) {
+    } else if (o->type == REDIS_ZSET &&
+               (o->encoding == REDIS_ENCODING_SKIPLIST ||
+                o->encoding == REDIS_ENCODING_BTREE)) {
         zset *zs = o->ptr;
         ht = zs->dict;
         count *= 2; /* We return key / value for this type. */
@@ -463,17 +660,17 @@ void scanGenericCommand(redisClient *c, robj *o, unsigned long cursor) {
             listAddNodeTail(keys,createStringObjectFromLongLong(ll));
         cursor = 0;
     } else if (o->type == REDIS_HASH || o->type == REDIS_ZSET) {
-        unsigned char *p = ziplistIndex(o->ptr,0);
+        unsigned char *p = lpSeek(o->ptr,0);
         unsigned char *vstr;
         unsigned int vlen;
         long long vll;
 
         while(p) {
-            ziplistGet(p,&vstr,&vlen,&vll);
+            lpGet(p,&vstr,&vlen,&vll);
             listAddNodeTail(keys,
                 (vstr != NULL) ? createStringObject((char*)vstr,vlen) :
                                  createStringObjectFromLongLong(vll));
-            p = ziplistNext(o->ptr,p);
+            p = lpNext(o->ptr,p);
         }
         cursor = 0;
     } else {
@@ -695,6 +892,113 @@ void moveCommand(redisClient *c) {
     addReply(c,shared.cone);
 }
 
+/*-----------------------------------------------------------------------------
+ * Expires index
+ *----------------------------------------------------------------------------*/
+
+/* When active-expire-index is enabled every DB keeps, together with the
+ * expires dictionary, a skiplist of the keys with an expire ordered by
+ * expire time, so that activeExpireCycle() can reclaim exactly the keys
+ * that are due instead of sampling random keys.
+ *
+ * The skiplist is the one of the sorted sets: the score is the expire
+ * time, a unix time in milliseconds that a double represents exactly, and
+ * the element is a copy of the key (the keys of the main dictionary may be
+ * embedded into the dict entries, so they can't be referenced). Both are
+ * known every time an expire is changed or removed, so all the updates are
+ * O(log(N)). */
+
+static void expiresIndexAdd(redisDb *db, sds key, long long when) {
+    zslInsert(db->expires_index,when,createStringObject(key,sdslen(key)));
+}
+
+static void expiresIndexDelete(redisDb *db, sds key, long long when) {
+    robj keyobj;
+
+    initStaticStringObject(keyobj,key);
+    redisAssertWithInfo(NULL,&keyobj,
+        zslDelete(db->expires_index,when,&keyobj));
+}
+
+/* Remove 'key', having hash 'h', from the index if it has an expire. */
+static void expiresIndexDeleteKey(redisDb *db, robj *key, unsigned int h) {
+    dictEntry *de = dictFindWithHash(db->expires,key->ptr,h);
+
+    if (de) expiresIndexDelete(db,key->ptr,dictGetSignedIntegerVal(de));
+}
+
+static void expiresIndexCreate(redisDb *db) {
+    dictIterator *di;
+    dictEntry *de;
+
+    db->expires_index = zslCreate();
+    di = dictGetIterator(db->expires);
+    while((de = dictNext(di)) != NULL)
+        expiresIndexAdd(db,dictGetKey(de),dictGetSignedIntegerVal(de));
+    dictReleaseIterator(di);
+}
+
+/* Create or free the index of every DB. Creating the index of a DB having
+ * keys with an expire takes O(N). */
+void setExpiresIndex(int enabled) {
+    int j;
+
+    for (j = 0; j < server.dbnum; j++) {
+        redisDb *db = server.db+j;
+
+        if (enabled && db->expires_index == NULL) {
+            expiresIndexCreate(db);
+        } else if (!enabled && db->expires_index) {
+            zslFree(db->expires_index);
+            db->expires_index = NULL;
+        }
+    }
+    server.active_expire_index = enabled;
+}
+
+/* Called after the expires dictionary of 'db' was emptied. */
+void expiresIndexEmpty(redisDb *db) {
+    if (db->expires_index == NULL) return;
+    zslFree(db->expires_index);
+    db->expires_index = zslCreate();
+}
+
+/* Return the number of keys of 'db' that are already expired at 'now' but
+ * are still in memory. Uses the spans of the skiplist, so it's O(log(N)). */
+unsigned long expiresIndexCountDue(redisDb *db, long long now) {
+    zskiplist *zsl = db->expires_index;
+    zskiplistNode *x = zsl->header;
+    unsigned long count = 0;
+    int i;
+
+    for (i = zsl->level-1; i >= 0; i--) {
+        while (x->level[i].forward && x->level[i].forward->score < now) {
+            count += x->level[i].span;
+            x = x->level[i].forward;
+        }
+    }
+    return count;
+}
+
+/* Estimate the number of keys that are expired but still use memory: exact
+ * for the DBs having an expires index, otherwise computed from the ratio
+ * of expired keys found by activeExpireCycle() in its samples. */
+unsigned long long estimateStaleKeys(void) {
+    unsigned long long stale = 0;
+    long long now = mstime();
+    int j;
+
+    for (j = 0; j < server.dbnum; j++) {
+        redisDb *db = server.db+j;
+
+        if (db->expires_index)
+            stale += expiresIndexCountDue(db,now);
+        else
+            stale += dictSize(db->expires)*server.stat_expired_stale_perc;
+    }
+    return stale;
+}
+
 /*-----------------------------------------------------------------------------
  * Expires API
  *----------------------------------------------------------------------------*/
@@ -702,32 +1006,44 @@ void moveCommand(redisClient *c) {
 int removeExpire(redisDb *db, robj *key) {
     /* An expire may only be removed if there is a corresponding entry in the
      * main dict. Otherwise, the key will never be freed. */
-    redisAssertWithInfo(NULL,key,dictFind(db->dict,key->ptr) != NULL);
-    return dictDelete(db->expires,key->ptr) == DICT_OK;
+    unsigned int h = keyHash(key);
+
+    redisAssertWithInfo(NULL,key,dictFindWithHash(db->dict,key->ptr,h) != NULL);
+    if (db->expires_index) expiresIndexDeleteKey(db,key,h);
+    return dictDeleteWithHash(db->expires,key->ptr,h) == DICT_OK;
 }
 
 void setExpire(redisDb *db, robj *key, long long when) {
     dictEntry *kde, *de;
+    unsigned int h = keyHash(key);
 
     /* Reuse the sds from the main dict in the expire dict */
-    kde = dictFind(db->dict,key->ptr);
+    kde = dictFindWithHash(db->dict,key->ptr,h);
     redisAssertWithInfo(NULL,key,kde != NULL);
-    de = dictReplaceRaw(db->expires,dictGetKey(kde));
+    de = dictFindWithHash(db->expires,key->ptr,h);
+    if (de == NULL) {
+        de = dictAddRawWithHash(db->expires,dictGetKey(kde),h);
+    } else if (db->expires_index) {
+        expiresIndexDelete(db,key->ptr,dictGetSignedIntegerVal(de));
+    }
     dictSetSignedIntegerVal(de,when);
+    if (db->expires_index) expiresIndexAdd(db,key->ptr,when);
 }
 
 /* Return the expire time of the specified key, or -1 if no expire
  * is associated with this key (i.e. the key is non volatile) */
 long long getExpire(redisDb *db, robj *key) {
     dictEntry *de;
+    unsigned int h;
 
     /* No expire? return ASAP */
-    if (dictSize(db->expires) == 0 ||
-       (de = dictFind(db->expires,key->ptr)) == NULL) return -1;
+    if (dictSize(db->expires) == 0) return -1;
+    h = keyHash(key);
+    if ((de = dictFindWithHash(db->expires,key->ptr,h)) == NULL) return -1;
 
     /* The entry was found in the expire dict, this means it should also
      * be present in the main dict (safety check). */
-    redisAssertWithInfo(NULL,key,dictFind(db->dict,key->ptr) != NULL);
+    redisAssertWithInfo(NULL,key,dictFindWithHash(db->dict,key->ptr,h) != NULL);
     return dictGetSignedIntegerVal(de);
 }
 
@@ -791,7 +1107,8 @@ int expireIfNeeded(redisDb *db, robj *key) {
     propagateExpire(db,key);
     notifyKeyspaceEvent(REDIS_NOTIFY_EXPIRED,
         "expired",key,db->id);
-    return dbDelete(db,key);
+    return server.lazyfree_lazy_expire ? dbAsyncDelete(db,key) :
+                                         dbSyncDelete(db,key);
 }
 
 /*-----------------------------------------------------------------------------
@@ -900,7 +1217,7 @@ void pttlCommand(redisClient *c) {
 void persistCommand(redisClient *c) {
     dictEntry *de;
 
-    de = dictFind(c->db->dict,c->argv[1]->ptr);
+    de = dictFindWithHash(c->db->dict,c->argv[1]->ptr,keyHash(c->argv[1]));
     if (de == NULL) {
         addReply(c,shared.czero);
     } else {
@@ -166,7 +166,7 @@ void computeDatasetDigest(unsigned char *final) {
             } else if (o->type == REDIS_ZSET) {
                 unsigned char eledigest[20];
 
-                if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+                if (o->encoding == REDIS_ENCODING_LISTPACK) {
                     unsigned char *zl = o->ptr;
                     unsigned char *eptr, *sptr;
                     unsigned char *vstr;
@@ -174,13 +174,13 @@ void computeDatasetDigest(unsigned char *final) {
                     long long vll;
                     double score;
 
-                    eptr = ziplistIndex(zl,0);
+                    eptr = lpSeek(zl,0);
                     redisAssert(eptr != NULL);
-                    sptr = ziplistNext(zl,eptr);
+                    sptr = lpNext(zl,eptr);
                     redisAssert(sptr != NULL);
 
                     while (eptr != NULL) {
-                        redisAssert(ziplistGet(eptr,&vstr,&vlen,&vll));
+                        redisAssert(lpGet(eptr,&vstr,&vlen,&vll));
                         score = zzlGetScore(sptr);
 
                         memset(eledigest,0,20);
@@ -212,6 +212,19 @@ void computeDatasetDigest(unsigned char *final) {
                         xorDigest(digest,eledigest,20);
                     }
                     dictReleaseIterator(di);
+                } else if (o->encoding == REDIS_ENCODING_BTREE) {
+                    zbtreeLeaf *l = ((zset*)o->ptr)->zbt->head;
+                    unsigned int j;
+
+                    for (; l; l = l->next) {
+                        for (j = 0; j < l->count; j++) {
+                            snprintf(buf,sizeof(buf),"%.17g",l->score[j]);
+                            memset(eledigest,0,20);
+                            mixObjectDigest(eledigest,l->obj[j]);
+                            mixDigest(eledigest,buf,strlen(buf));
+                            xorDigest(digest,eledigest,20);
+                        }
+                    }
                 } else {
                     redisPanic("Unknown sorted set encoding");
                 }
@@ -281,6 +294,7 @@ void debugCommand(redisClient *c) {
         dictEntry *de;
         robj *val;
         char *strenc;
+        char extra[256] = {0};
 
         if ((de = dictFind(c->db->dict,c->argv[2]->ptr)) == NULL) {
             addReply(c,shared.nokeyerr);
@@ -289,13 +303,36 @@ void debugCommand(redisClient *c) {
         val = dictGetVal(de);
         strenc = strEncoding(val->encoding);
 
+        if (val->encoding == REDIS_ENCODING_QUICKLIST) {
+            quicklist *ql = val->ptr;
+            quicklistNode *node;
+            double avg = (double)ql->count/ql->len;
+            unsigned long used = 0, size = 0;
+
+            /* Bytes used by the listpacks, and how many they would take if
+             * no node was compressed. */
+            for (node = ql->head; node; node = node->next) {
+                void *lzf;
+
+                size += node->sz;
+                used += quicklistNodeIsCompressed(node) ?
+                        quicklistGetLzf(node,&lzf) : node->sz;
+            }
+            snprintf(extra,sizeof(extra)," ql_nodes:%u ql_avg_node:%.2f"
+                " ql_listpack_max:%d ql_compressed:%u"
+                " ql_uncompressed_size:%lu ql_compressed_size:%lu"
+                " ql_compression_ratio:%.2f",
+                ql->len,avg,ql->fill,ql->compress,size,used,
+                used ? (double)size/used : 1);
+        }
+
         addReplyStatusFormat(c,
             "Value at:%p refcount:%d "
             "encoding:%s serializedlength:%lld "
-            "lru:%d lru_seconds_idle:%lu",
+            "lru:%d lru_seconds_idle:%lu%s",
             (void*)val, val->refcount,
             strenc, (long long) rdbSavedObjectLen(val),
-            val->lru, estimateObjectIdleTime(val));
+            val->lru, estimateObjectIdleTime(val), extra);
     } else if (!strcasecmp(c->argv[1]->ptr,"sdslen") && c->argc == 3) {
         dictEntry *de;
         robj *val;
@@ -308,7 +345,7 @@ void debugCommand(redisClient *c) {
         val = dictGetVal(de);
         key = dictGetKey(de);
 
-        if (val->type != REDIS_STRING || val->encoding != REDIS_ENCODING_RAW) {
+        if (val->type != REDIS_STRING || !sdsEncodedObject(val)) {
             addReplyError(c,"Not an sds encoded string.");
         } else {
             addReplyStatusFormat(c,
@@ -397,7 +434,7 @@ void _redisAssertPrintClientInfo(redisClient *c) {
         char *arg;
 
         if (c->argv[j]->type == REDIS_STRING &&
-            c->argv[j]->encoding == REDIS_ENCODING_RAW)
+            sdsEncodedObject(c->argv[j]))
         {
             arg = (char*) c->argv[j]->ptr;
         } else {
@@ -414,7 +451,7 @@ void redisLogObjectDebugInfo(robj *o) {
     redisLog(REDIS_WARNING,"Object type: %d", o->type);
     redisLog(REDIS_WARNING,"Object encoding: %d", o->encoding);
     redisLog(REDIS_WARNING,"Object refcount: %d", o->refcount);
-    if (o->type == REDIS_STRING && o->encoding == REDIS_ENCODING_RAW) {
+    if (o->type == REDIS_STRING && sdsEncodedObject(o)) {
         redisLog(REDIS_WARNING,"Object raw string len: %zu", sdslen(o->ptr));
         if (sdslen(o->ptr) < 4096) {
             sds repr = sdscatrepr(sdsempty(),o->ptr,sdslen(o->ptr));
@@ -431,6 +468,8 @@ void redisLogObjectDebugInfo(robj *o) {
         redisLog(REDIS_WARNING,"Sorted set size: %d", (int) zsetLength(o));
         if (o->encoding == REDIS_ENCODING_SKIPLIST)
             redisLog(REDIS_WARNING,"Skiplist level: %d", (int) ((zset*)o->ptr)->zsl->level);
+        else if (o->encoding == REDIS_ENCODING_BTREE)
+            redisLog(REDIS_WARNING,"B+tree height: %d", ((zset*)o->ptr)->zbt->height);
     }
 }
 
@@ -827,6 +866,7 @@ void sigsegvHandler(int sig, siginfo_t *info, void *secret) {
     /* Test memory */
     redisLog(REDIS_WARNING, "--- FAST MEMORY TEST");
     bioKillThreads();
+    killIOThreads();
     if (memtest_test_linux_anonymous_maps()) {
         redisLog(REDIS_WARNING,
             "!!! MEMORY ERROR DETECTED! Check your memory ASAP !!!");
@@ -0,0 +1,470 @@
+/*
+ * Copyright (c) 2013, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "redis.h"
+
+/* Active defragmentation.
+ *
+ * After a lot of deletions the allocator ends with many runs (the pages
+ * hosting the allocations of a given size class) that are only partially
+ * used, and can't be returned to the operating system. Restarting and
+ * reloading the dataset is the only way to compact them, unless we move
+ * the allocations ourselves.
+ *
+ * jemalloc allocates from the lowest non full run of a size class, so an
+ * allocation living in a run less used than the average of its size class
+ * is moved allocating a copy and freeing the original: eventually the
+ * sparse runs are emptied and released. je_get_defrag_hint(), added to our
+ * copy of jemalloc, tells if an allocation is worth moving.
+ *
+ * The keyspace is scanned incrementally with dictScan() from serverCron(),
+ * moving keys, values, dict entries, listpacks, intsets, and the nodes and
+ * elements of lists and skiplists, fixing the pointers referencing them.
+ * The scan runs only when the fragmentation is above the configured
+ * thresholds, using more CPU the higher the fragmentation is. Every value
+ * is processed as a whole, so the time limit can be exceeded by the time
+ * needed to defrag a single big value.
+ *
+ * Objects are only moved when all the references to them are known: string
+ * objects referenced elsewhere (shared integers, MULTI queues, output
+ * buffers of slaves) and values cached by the RESP cache are left alone.
+ * Nothing is moved while a child is saving, as it would just duplicate the
+ * pages with copy on write. */
+
+#ifdef HAVE_DEFRAG
+
+#include <stdbool.h>
+
+/* Move the allocation 'ptr' if it lives in a run that is less used than the
+ * average of its size class. Returns the new pointer, and 'ptr' is no
+ * longer valid, or NULL if the allocation was not moved.
+ *
+ * The thread cache of the main thread is disabled while defragging, see
+ * activeDefragCycle(), so that the new allocation is taken from the lowest
+ * run and the old one is returned to its run. */
+static void *activeDefragAlloc(void *ptr) {
+    int bin_util, run_util;
+    size_t size;
+    void *newptr;
+
+    if (!je_get_defrag_hint(ptr,&bin_util,&run_util) ||
+        run_util > bin_util || run_util == 1<<16)
+    {
+        server.stat_active_defrag_misses++;
+        return NULL;
+    }
+    size = zmalloc_size(ptr);
+    newptr = zmalloc(size);
+    memcpy(newptr,ptr,size);
+    zfree(ptr);
+    server.stat_active_defrag_hits++;
+    server.stat_active_defrag_bytes += size;
+    return newptr;
+}
+
+static sds activeDefragSds(sds s) {
+    char *newptr = activeDefragAlloc(s-sizeof(struct sdshdr));
+
+    return newptr ? newptr+sizeof(struct sdshdr) : NULL;
+}
+
+/* Move a string object having exactly 'refs' references, all known by the
+ * caller, and its string. Returns the new object, or NULL if the object was
+ * not moved (its string may have been moved anyway). */
+static robj *activeDefragStringOb(robj *o, int refs) {
+    robj *newo;
+
+    if (o->refcount != refs || o->respcached) return NULL;
+    if (o->encoding == REDIS_ENCODING_RAW) {
+        sds newsds = activeDefragSds(o->ptr);
+
+        if (newsds) o->ptr = newsds;
+        return activeDefragAlloc(o);
+    } else if (o->encoding == REDIS_ENCODING_EMBSTR) {
+        size_t offset = (char*)o->ptr - (char*)o;
+
+        if ((newo = activeDefragAlloc(o)) != NULL)
+            newo->ptr = (char*)newo + offset;
+        return newo;
+    } else {
+        return activeDefragAlloc(o);
+    }
+}
+
+/* Keys collected by a dictScan() step, so that the entries are moved after
+ * the scan function returns. */
+typedef struct defragKeys {
+    void **keys;
+    unsigned long len, size;
+} defragKeys;
+
+static void defragCollectCallback(void *privdata, const dictEntry *de) {
+    defragKeys *dk = privdata;
+
+    if (dk->len == dk->size) {
+        dk->size = dk->size ? dk->size*2 : 16;
+        dk->keys = zrealloc(dk->keys,sizeof(void*)*dk->size);
+    }
+    dk->keys[dk->len++] = dictGetKey(de);
+}
+
+/* Defrag the entries of the dict of a set or of an hash, and the element
+ * objects: the keys, and the values as well if 'vals' is true. */
+static void activeDefragObjectDict(dict *d, int vals) {
+    defragKeys dk = {NULL, 0, 0};
+    unsigned long cursor = 0, j;
+
+    do {
+        dk.len = 0;
+        cursor = dictScan(d,cursor,defragCollectCallback,&dk);
+        for (j = 0; j < dk.len; j++) {
+            robj *ele = dk.keys[j], *newele;
+            unsigned int h = dictHashKey(d,ele);
+            dictEntry *de = dictFindWithHash(d,ele,h);
+
+            if ((newele = activeDefragStringOb(ele,1)) != NULL)
+                de->key = newele;
+            if (vals && (newele = activeDefragStringOb(dictGetVal(de),1)))
+                de->v.val = newele;
+            dictDefragEntry(d,de,h,activeDefragAlloc);
+        }
+    } while(cursor);
+    zfree(dk.keys);
+}
+
+/* Defrag the nodes of a quicklist and their listpacks. Returns the new
+ * quicklist structure, or NULL if it was not moved. */
+static quicklist *activeDefragQuicklist(quicklist *ql) {
+    quicklistNode *node, *newnode;
+    unsigned char *newlp;
+
+    for (node = ql->head; node; node = node->next) {
+        if ((newlp = activeDefragAlloc(node->entry)) != NULL)
+            node->entry = newlp;
+        if ((newnode = activeDefragAlloc(node)) != NULL) {
+            if (newnode->prev) newnode->prev->next = newnode;
+            else ql->head = newnode;
+            if (newnode->next) newnode->next->prev = newnode;
+            else ql->tail = newnode;
+            node = newnode;
+        }
+    }
+    return activeDefragAlloc(ql);
+}
+
+/* Defrag the nodes of the skiplist of a sorted set, the element objects,
+ * shared by the skiplist and the dict, and the dict entries. The skiplist
+ * is walked at level zero, remembering in update[i] the last node seen
+ * having level i, that is the node pointing to the current one at level i
+ * if the current node has that level. */
+static void activeDefragZset(zset *zs) {
+    zskiplist *zsl = zs->zsl;
+    zskiplistNode *update[ZSKIPLIST_MAXLEVEL], *x, *newx;
+    int i;
+
+    for (i = 0; i < zsl->level; i++) update[i] = zsl->header;
+    x = zsl->header->level[0].forward;
+    while(x) {
+        unsigned int h = dictHashKey(zs->dict,x->obj);
+        dictEntry *de = dictFindWithHash(zs->dict,x->obj,h);
+        robj *newele;
+
+        if ((newele = activeDefragStringOb(x->obj,2)) != NULL) {
+            x->obj = newele;
+            de->key = newele;
+        }
+        if ((newx = activeDefragAlloc(x)) != NULL) {
+            for (i = 0; i < zsl->level; i++) {
+                if (update[i]->level[i].forward == x)
+                    update[i]->level[i].forward = newx;
+            }
+            if (newx->level[0].forward)
+                newx->level[0].forward->backward = newx;
+            else
+                zsl->tail = newx;
+            de->v.val = &newx->score;
+            x = newx;
+        }
+        dictDefragEntry(zs->dict,de,h,activeDefragAlloc);
+        for (i = 0; i < zsl->level; i++) {
+            if (update[i]->level[i].forward == x) update[i] = x;
+        }
+        x = x->level[0].forward;
+    }
+}
+
+/* Defrag the subtree of a B+tree rooted at 'x', 'height' levels above the
+ * leaves, the dict entries and the element objects referenced only by a
+ * leaf and the dict: the ones also used as separators are skipped. Returns
+ * the new node, or NULL if it was not moved. */
+static void *activeDefragZbtreeNode(zset *zs, void *x, int height) {
+    unsigned int j;
+    void *newx;
+
+    if (height == 0) {
+        zbtreeLeaf *l = x;
+
+        for (j = 0; j < l->count; j++) {
+            unsigned int h = dictHashKey(zs->dict,l->obj[j]);
+            dictEntry *de = dictFindWithHash(zs->dict,l->obj[j],h);
+            robj *newele;
+
+            if ((newele = activeDefragStringOb(l->obj[j],2)) != NULL) {
+                l->obj[j] = newele;
+                de->key = newele;
+            }
+            dictDefragEntry(zs->dict,de,h,activeDefragAlloc);
+        }
+        if ((newx = activeDefragAlloc(l)) != NULL) {
+            l = newx;
+            if (l->prev) l->prev->next = l; else zs->zbt->head = l;
+            if (l->next) l->next->prev = l; else zs->zbt->tail = l;
+        }
+        return newx;
+    } else {
+        zbtreeNode *n = x;
+
+        for (j = 0; j < n->count; j++) {
+            newx = activeDefragZbtreeNode(zs,n->child[j],height-1);
+            if (newx) n->child[j] = newx;
+        }
+        return activeDefragAlloc(n);
+    }
+}
+
+/* Defrag a value and its elements. Returns the new object, or NULL if the
+ * object itself was not moved. */
+static robj *activeDefragValue(robj *o) {
+    void *newptr;
+
+    if (o->type == REDIS_STRING) return activeDefragStringOb(o,1);
+    if (o->refcount != 1) return NULL;
+
+    if (o->encoding == REDIS_ENCODING_LISTPACK ||
+        o->encoding == REDIS_ENCODING_INTSET)
+    {
+        if ((newptr = activeDefragAlloc(o->ptr)) != NULL) o->ptr = newptr;
+    } else if (o->encoding == REDIS_ENCODING_QUICKLIST) {
+        if ((newptr = activeDefragQuicklist(o->ptr)) != NULL) o->ptr = newptr;
+    } else if (o->type == REDIS_SET && o->encoding == REDIS_ENCODING_HT) {
+        activeDefragObjectDict(o->ptr,0);
+    } else if (o->type == REDIS_HASH && o->encoding == REDIS_ENCODING_HT) {
+        activeDefragObjectDict(o->ptr,1);
+    } else if (o->type == REDIS_ZSET &&
+               o->encoding == REDIS_ENCODING_SKIPLIST)
+    {
+        activeDefragZset(o->ptr);
+    } else if (o->type == REDIS_ZSET &&
+               o->encoding == REDIS_ENCODING_BTREE)
+    {
+        zset *zs = o->ptr;
+
+        if (zs->zbt->root) {
+            newptr = activeDefragZbtreeNode(zs,zs->zbt->root,zs->zbt->height);
+            if (newptr) zs->zbt->root = newptr;
+        }
+    } else {
+        redisPanic("Unknown object type or encoding");
+    }
+    return activeDefragAlloc(o);
+}
+
+/* Defrag a key of the keyspace, its value and its entries in the main and
+ * expires dicts. Keys are embedded in the main dict entries, or shared by
+ * the two dicts otherwise, so the expire entry is looked up before moving
+ * anything, and updated with the final key pointer. */
+static void activeDefragKey(redisDb *db, sds key) {
+    unsigned int h = dictHashKey(db->dict,key);
+    dictEntry *de = dictFindWithHash(db->dict,key,h), *exde = NULL;
+    long long hits = server.stat_active_defrag_hits;
+    robj *newval;
+    sds newkey;
+
+    if (de == NULL) return;
+    if (dictSize(db->expires)) exde = dictFindWithHash(db->expires,key,h);
+    if (!dictEmbedsKeys(db->dict) && (newkey = activeDefragSds(key)))
+        de->key = newkey;
+    if ((newval = activeDefragValue(dictGetVal(de))) != NULL)
+        de->v.val = newval;
+    de = dictDefragEntry(db->dict,de,h,activeDefragAlloc);
+    if (exde) {
+        exde->key = dictGetKey(de);
+        dictDefragEntry(db->expires,exde,h,activeDefragAlloc);
+    }
+
+    if (server.stat_active_defrag_hits != hits)
+        server.stat_active_defrag_key_hits++;
+    else
+        server.stat_active_defrag_key_misses++;
+}
+
+/* Return the fragmentation of the allocator as the percentage of the
+ * memory in the active pages that is not allocated, and in
+ * '*out_frag_bytes' the same in bytes. */
+float getAllocatorFragmentation(size_t *out_frag_bytes) {
+    size_t allocated = 0, active = 0, sz;
+    uint64_t epoch = 1;
+
+    /* Refresh the statistics cached by jemalloc. */
+    sz = sizeof(epoch);
+    je_mallctl("epoch",&epoch,&sz,&epoch,sz);
+    sz = sizeof(size_t);
+    je_mallctl("stats.active",&active,&sz,NULL,0);
+    je_mallctl("stats.allocated",&allocated,&sz,NULL,0);
+    if (out_frag_bytes)
+        *out_frag_bytes = active > allocated ? active-allocated : 0;
+    if (allocated == 0) return 0;
+    return active > allocated ? ((float)active/allocated-1)*100 : 0;
+}
+
+/* Enable or disable the jemalloc thread cache of the calling thread. */
+static void activeDefragSetThreadCache(int enabled) {
+    bool b = enabled;
+
+    je_mallctl("thread.tcache.enabled",NULL,NULL,&b,sizeof(b));
+}
+
+/* Called by databasesCron(): start a scan of the keyspace if the allocator
+ * fragmentation is over active-defrag-threshold-lower, and continue the
+ * scan in progress for a time proportional to the CPU percentage, going
+ * from active-defrag-cycle-min to active-defrag-cycle-max as the
+ * fragmentation goes from the lower to the upper threshold. */
+void activeDefragCycle(void) {
+    static int current_db = -1;
+    static unsigned long cursor = 0;
+    static long long start_scan, start_hits;
+    static defragKeys dk = {NULL, 0, 0};
+    long long start, timelimit, hits = server.stat_active_defrag_hits;
+    unsigned int iterations = 0;
+    unsigned long j;
+
+    if (!server.active_defrag_enabled) {
+        /* Abort the scan in progress, if any. */
+        if (server.active_defrag_running) {
+            server.active_defrag_running = 0;
+            current_db = -1;
+            cursor = 0;
+        }
+        return;
+    }
+    if (server.rdb_child_pid != -1 || server.aof_child_pid != -1) return;
+
+    /* Once a second check if the fragmentation justifies starting a scan,
+     * or making the scan in progress more aggressive. */
+    run_with_period(1000) {
+        size_t frag_bytes;
+        float frag_pct = getAllocatorFragmentation(&frag_bytes);
+        int cpu_pct, lower = server.active_defrag_threshold_lower,
+            upper = server.active_defrag_threshold_upper;
+
+        if (!server.active_defrag_running &&
+            (frag_pct < lower ||
+             frag_bytes < server.active_defrag_ignore_bytes)) return;
+
+        if (frag_pct >= upper || upper <= lower) {
+            cpu_pct = server.active_defrag_cycle_max;
+        } else {
+            cpu_pct = server.active_defrag_cycle_min +
+                      (int)((frag_pct-lower) *
+                            (server.active_defrag_cycle_max-
+                             server.active_defrag_cycle_min) / (upper-lower));
+        }
+        if (cpu_pct < server.active_defrag_cycle_min)
+            cpu_pct = server.active_defrag_cycle_min;
+        if (cpu_pct < 1) cpu_pct = 1;
+
+        /* The scan in progress can get more aggressive, never less. */
+        if (cpu_pct > server.active_defrag_running) {
+            if (!server.active_defrag_running) {
+                start_scan = ustime();
+                start_hits = server.stat_active_defrag_hits;
+            }
+            server.active_defrag_running = cpu_pct;
+            redisLog(REDIS_VERBOSE,
+                "Active defrag: frag=%.0f%%, frag_bytes=%zu, cpu=%d%%",
+                frag_pct, frag_bytes, cpu_pct);
+        }
+    }
+    if (!server.active_defrag_running) return;
+
+    /* See activeExpireCycle() for how the time limit is computed. */
+    start = ustime();
+    timelimit = 1000000*server.active_defrag_running/server.hz/100;
+    if (timelimit <= 0) timelimit = 1;
+
+    activeDefragSetThreadCache(0);
+    while(1) {
+        redisDb *db;
+
+        if (cursor == 0) {
+            /* Move to the next DB, and stop after the last one. */
+            if (++current_db >= server.dbnum) {
+                size_t frag_bytes;
+                float frag_pct = getAllocatorFragmentation(&frag_bytes);
+
+                redisLog(REDIS_VERBOSE,
+                    "Active defrag done in %lldms, reallocated=%lld, "
+                    "frag=%.0f%%, frag_bytes=%zu",
+                    (ustime()-start_scan)/1000,
+                    server.stat_active_defrag_hits-start_hits,
+                    frag_pct, frag_bytes);
+                current_db = -1;
+                server.active_defrag_running = 0;
+                break;
+            }
+        }
+        db = server.db+current_db;
+
+        dk.len = 0;
+        cursor = dictScan(db->dict,cursor,defragCollectCallback,&dk);
+        for (j = 0; j < dk.len; j++) activeDefragKey(db,dk.keys[j]);
+
+        /* Check the time limit once every 16 scan steps, or every 1000
+         * allocations moved, since a step can move a big value. */
+        if (++iterations > 16 || server.stat_active_defrag_hits-hits > 1000) {
+            if (ustime()-start > timelimit) break;
+            iterations = 0;
+            hits = server.stat_active_defrag_hits;
+        }
+    }
+    activeDefragSetThreadCache(1);
+}
+
+#else /* HAVE_DEFRAG */
+
+void activeDefragCycle(void) {
+    /* Not supported by the allocator. */
+}
+
+float getAllocatorFragmentation(size_t *out_frag_bytes) {
+    if (out_frag_bytes) *out_frag_bytes = 0;
+    return 0;
+}
+
+#endif
@@ -58,13 +58,52 @@
 static int dict_can_resize = 1;
 static unsigned int dict_force_resize_ratio = 5;
 
+#if defined(__GNUC__)
+#define dictPrefetchAddr(p) __builtin_prefetch(p)
+#else
+#define dictPrefetchAddr(p) ((void)(p))
+#endif
+
 /* -------------------------- private prototypes ---------------------------- */
 
 static int _dictExpandIfNeeded(dict *ht);
 static unsigned long _dictNextPower(unsigned long size);
-static int _dictKeyIndex(dict *ht, const void *key);
+static int _dictKeyIndex(dict *ht, const void *key, unsigned int h);
 static int _dictInit(dict *ht, dictType *type, void *privDataPtr);
 
+/* Open addressing tables, implemented in dict_oa.c. */
+static int _dictOaExpand(dict *d, unsigned long size);
+static int _dictOaRehash(dict *d, int n);
+static dictEntry *_dictOaAddRaw(dict *d, void *key, unsigned int h);
+static int _dictOaGenericDelete(dict *d, const void *key, unsigned int h,
+                                int nofree);
+static dictEntry *_dictOaFind(dict *d, const void *key, unsigned int h);
+static int _dictOaClear(dict *d, dictht *ht);
+static dictEntry *_dictOaNext(dictIterator *iter);
+static dictEntry *_dictOaGetRandomKey(dict *d);
+static unsigned int _dictOaGetSomeKeys(dict *d, dictEntry **des,
+                                       unsigned int count);
+static void _dictOaPrefetch(dict *d, const unsigned int *hashes,
+                            unsigned int count, int flags);
+static unsigned long _dictOaScan(dict *d, unsigned long v,
+                                 dictScanFunction *fn, void *privdata);
+
+/* Linear hashing tables, implemented in dict_lh.c. */
+static int _dictLhFit(dict *d);
+static int _dictLhExpand(dict *d, unsigned long size);
+static dictEntry *_dictLhAddRaw(dict *d, void *key, unsigned int h);
+static int _dictLhGenericDelete(dict *d, const void *key, unsigned int h,
+                                int nofree);
+static dictEntry *_dictLhFind(dict *d, const void *key, unsigned int h);
+static int _dictLhClear(dict *d, dictht *ht);
+static dictEntry *_dictLhNext(dictIterator *iter);
+static dictEntry *_dictLhGetRandomKey(dict *d);
+static unsigned int _dictLhGetSomeKeys(dict *d, dictEntry **des,
+                                       unsigned int count);
+static dictEntry **_dictLhHashBucket(dict *d, unsigned int h);
+static unsigned long _dictLhScan(dict *d, unsigned long v,
+                                 dictScanFunction *fn, void *privdata);
+
 /* -------------------------- hash functions -------------------------------- */
 
 /* Thomas Wang's 32 bit Mix Function */
@@ -180,6 +219,26 @@ dict *dictCreate(dictType *type, void *privDataPtr)
     return d;
 }
 
+/* Create a new hash table storing the entries in open addressing tables,
+ * see dict_oa.c for the details. */
+dict *dictCreateOpenAddressing(dictType *type, void *privDataPtr)
+{
+    dict *d = dictCreate(type,privDataPtr);
+
+    d->oa = 1;
+    return d;
+}
+
+/* Create a new hash table growing and shrinking one bucket at a time,
+ * see dict_lh.c for the details. */
+dict *dictCreateLinear(dictType *type, void *privDataPtr)
+{
+    dict *d = dictCreate(type,privDataPtr);
+
+    d->lh = 1;
+    return d;
+}
+
 /* Initialize the hash table */
 int _dictInit(dict *d, dictType *type,
         void *privDataPtr)
@@ -190,6 +249,8 @@ int _dictInit(dict *d, dictType *type,
     d->privdata = privDataPtr;
     d->rehashidx = -1;
     d->iterators = 0;
+    d->oa = 0;
+    d->lh = 0;
     return DICT_OK;
 }
 
@@ -201,6 +262,7 @@ int dictResize(dict *d)
 
     //ֵ䲻resize  ֵrehash
     if (!dict_can_resize || dictIsRehashing(d)) return DICT_ERR;
+    if (d->lh) return _dictLhFit(d);
     minimal = d->ht[0].used;
     if (minimal < DICT_HT_INITIAL_SIZE)
         minimal = DICT_HT_INITIAL_SIZE;
@@ -213,6 +275,9 @@ int dictExpand(dict *d, unsigned long size)
     dictht n; /* the new hash table */
     unsigned long realsize = _dictNextPower(size); //õҪչsize
 
+    if (d->oa) return _dictOaExpand(d,size);
+    if (d->lh) return _dictLhExpand(d,size);
+
     /* the size is invalid if it is smaller than the number of
      * elements already inside the hash table */
     if (dictIsRehashing(d) || d->ht[0].used > size)
@@ -245,6 +310,7 @@ int dictExpand(dict *d, unsigned long size)
 //Nʽrehash
 int dictRehash(dict *d, int n) {
     if (!dictIsRehashing(d)) return 0;
+    if (d->oa) return _dictOaRehash(d,n);
 
     while(n--) {
         dictEntry *de, *nextde;
@@ -330,6 +396,22 @@ int dictAdd(dict *d, void *key, void *val)
     return DICT_OK;
 }
 
+/* Allocate a new entry for 'key'. Dicts embedding keys copy the key right
+ * after the entry, so that comparing it with the looked up key does not
+ * need to access another cache line, and save an allocation per key. */
+static dictEntry *_dictCreateEntry(dict *d, void *key) {
+    dictEntry *de;
+
+    if (dictEmbedsKeys(d)) {
+        de = zmalloc(sizeof(*de)+d->type->keyEmbedLen(key));
+        de->key = d->type->keyEmbed(de+1,key);
+    } else {
+        de = zmalloc(sizeof(*de));
+        dictSetKey(d, de, key);
+    }
+    return de;
+}
+
 /* Low level add. This function adds the entry but instead of setting
  * a value returns the dictEntry structure to the user, that will make
  * sure to fill the value field as he wishes.
@@ -346,31 +428,38 @@ int dictAdd(dict *d, void *key, void *val)
  * If key was added, the hash entry is returned to be manipulated by the caller.
  */
 dictEntry *dictAddRaw(dict *d, void *key)
+{
+    return dictAddRawWithHash(d,key,dictHashKey(d,key));
+}
+
+/* Like dictAddRaw() but 'h' is the hash of the key, as returned by the hash
+ * function of the dict type: callers looking up the same key in many dicts
+ * using the same hash function can compute it just once. */
+dictEntry *dictAddRawWithHash(dict *d, void *key, unsigned int h)
 {
     int index;
     dictEntry *entry;
     dictht *ht;
 
+    if (d->oa) return _dictOaAddRaw(d,key,h);
+    if (d->lh) return _dictLhAddRaw(d,key,h);
     if (dictIsRehashing(d)) _dictRehashStep(d);// Խʽ rehash ͰһԪ
 
     /* Get the index of the new element, or -1 if
      * the element already exists. */
     // ҿԪصλ
     // ԪѴڣ index Ϊ -1
-    if ((index = _dictKeyIndex(d, key)) == -1)
+    if ((index = _dictKeyIndex(d, key, h)) == -1)
         return NULL;
 
     /* Allocate the memory and store the new entry */
     ht = dictIsRehashing(d) ? &d->ht[1] : &d->ht[0];
     // ðԪطǸϣ
-    entry = zmalloc(sizeof(*entry));
+    entry = _dictCreateEntry(d,key);
     //ͷ巨ڵ
     entry->next = ht->table[index];
     ht->table[index] = entry;
     ht->used++;
-
-    /* Set the hash entry fields. */
-    dictSetKey(d, entry, key);//key
     return entry;
 }
 
@@ -413,15 +502,17 @@ dictEntry *dictReplaceRaw(dict *d, void *key) {
 }
 
 /* Search and remove an element */
-static int dictGenericDelete(dict *d, const void *key, int nofree)
+static int dictGenericDelete(dict *d, const void *key, unsigned int h,
+                             int nofree)
 {
-    unsigned int h, idx;
+    unsigned int idx;
     dictEntry *he, *prevHe;
     int table;
 
     if (d->ht[0].size == 0) return DICT_ERR; /* d->ht[0].table is NULL */
+    if (d->oa) return _dictOaGenericDelete(d,key,h,nofree);
+    if (d->lh) return _dictLhGenericDelete(d,key,h,nofree);
     if (dictIsRehashing(d)) _dictRehashStep(d);
-    h = dictHashKey(d, key);
 
     for (table = 0; table <= 1; table++) {
         idx = h & d->ht[table].sizemask;
@@ -451,11 +542,17 @@ static int dictGenericDelete(dict *d, const void *key, int nofree)
 }
 
 int dictDelete(dict *ht, const void *key) {
-    return dictGenericDelete(ht,key,0);
+    if (ht->ht[0].size == 0) return DICT_ERR;
+    return dictGenericDelete(ht,key,dictHashKey(ht,key),0);
+}
+
+int dictDeleteWithHash(dict *ht, const void *key, unsigned int h) {
+    return dictGenericDelete(ht,key,h,0);
 }
 
 int dictDeleteNoFree(dict *ht, const void *key) {
-    return dictGenericDelete(ht,key,1);
+    if (ht->ht[0].size == 0) return DICT_ERR;
+    return dictGenericDelete(ht,key,dictHashKey(ht,key),1);
 }
 
 /* Destroy an entire dictionary */
@@ -463,6 +560,8 @@ int _dictClear(dict *d, dictht *ht)
 {
     unsigned long i;
 
+    if (d->oa) return _dictOaClear(d,ht);
+    if (d->lh) return _dictLhClear(d,ht);
     /* Free all the elements */
     for (i = 0; i < ht->size && ht->used > 0; i++) {
         dictEntry *he, *nextHe;
@@ -494,13 +593,21 @@ void dictRelease(dict *d)
 
 //keyһEntry
 dictEntry *dictFind(dict *d, const void *key)
+{
+    if (d->ht[0].size == 0) return NULL; /* We don't have a table at all */
+    return dictFindWithHash(d,key,dictHashKey(d,key));//õhashֵ
+}
+
+/* Like dictFind() but 'h' is the hash of the key, see dictAddRawWithHash(). */
+dictEntry *dictFindWithHash(dict *d, const void *key, unsigned int h)
 {
     dictEntry *he;
-    unsigned int h, idx, table;
+    unsigned int idx, table;
 
-    if (d->ht[0].size == 0) return NULL; /* We don't have a table at all */
+    if (d->ht[0].size == 0) return NULL;
+    if (d->oa) return _dictOaFind(d,key,h);
+    if (d->lh) return _dictLhFind(d,key,h);
     if (dictIsRehashing(d)) _dictRehashStep(d);//rehash
-    h = dictHashKey(d, key);//õhashֵ
     for (table = 0; table <= 1; table++) {
         idx = h & d->ht[table].sizemask;
         he = d->ht[table].table[idx];
@@ -583,6 +690,8 @@ dictIterator *dictGetSafeIterator(dict *d) {
 
 dictEntry *dictNext(dictIterator *iter)
 {
+    if (iter->d->oa) return _dictOaNext(iter);
+    if (iter->d->lh) return _dictLhNext(iter);
     while (1) {
         if (iter->entry == NULL) {
             dictht *ht = &iter->d->ht[iter->table];//õdict hash table
@@ -637,6 +746,8 @@ dictEntry *dictGetRandomKey(dict *d)
     unsigned int h;
     int listlen, listele;
 
+    if (d->oa) return _dictOaGetRandomKey(d);
+    if (d->lh) return _dictLhGetRandomKey(d);
     if (dictSize(d) == 0) return NULL;
     if (dictIsRehashing(d)) _dictRehashStep(d);
     //ȵõĸbucket
@@ -672,6 +783,136 @@ dictEntry *dictGetRandomKey(dict *d)
     return he;
 }
 
+static unsigned int _dictGetSomeKeys(dict *d, dictEntry **des,
+                                     unsigned int count)
+{
+    unsigned long i, j, tables, maxsizemask, maxsteps;
+    unsigned int stored = 0;
+
+    /* Do some rehashing work proportional to 'count'. */
+    for (j = 0; j < count && dictIsRehashing(d); j++) _dictRehashStep(d);
+
+    tables = dictIsRehashing(d) ? 2 : 1;
+    maxsizemask = d->ht[0].sizemask;
+    if (tables > 1 && d->ht[1].sizemask > maxsizemask)
+        maxsizemask = d->ht[1].sizemask;
+    maxsteps = (unsigned long)count*10;
+    if (maxsteps > maxsizemask+1) maxsteps = maxsizemask+1;
+
+    i = random() & maxsizemask;
+    while(maxsteps--) {
+        for (j = 0; j < tables; j++) {
+            dictEntry *he;
+
+            /* The buckets of ht[0] below rehashidx are already empty. */
+            if (j == 0 && tables == 2 && i < (unsigned long) d->rehashidx)
+                continue;
+            if (i >= d->ht[j].size) continue;
+            for (he = d->ht[j].table[i]; he; he = he->next) {
+                des[stored++] = he;
+                if (stored == count) return stored;
+            }
+        }
+        i = (i+1) & maxsizemask;
+    }
+    return stored;
+}
+
+/* Sample up to 'count' entries of the dict, storing them into 'des', and
+ * return the number of entries stored.
+ *
+ * The entries are collected walking the table from a random bucket, and no
+ * more than count*10 buckets are visited, so unlike calling
+ * dictGetRandomKey() 'count' times the cost does not depend on how sparse
+ * the table is. The returned entries are all distinct but they are not a
+ * uniformly distributed sample, and less than 'count' entries may be
+ * returned: this is only meant for algorithms that need some keys to
+ * sample, like the eviction and the active expire cycle. At least one
+ * entry is returned if the dict is not empty. */
+unsigned int dictGetSomeKeys(dict *d, dictEntry **des, unsigned int count) {
+    unsigned int stored;
+
+    if (dictSize(d) < count) count = dictSize(d);
+    if (count == 0) return 0;
+    if (d->oa)
+        stored = _dictOaGetSomeKeys(d,des,count);
+    else if (d->lh)
+        stored = _dictLhGetSomeKeys(d,des,count);
+    else
+        stored = _dictGetSomeKeys(d,des,count);
+
+    /* Tables so sparse that the walk found nothing. */
+    if (stored == 0) {
+        des[0] = dictGetRandomKey(d);
+        stored = 1;
+    }
+    return stored;
+}
+
+/* Return the bucket where the key with hash 'h' is stored. */
+static dictEntry **_dictHashBucket(dict *d, unsigned int h) {
+    unsigned long idx = h & d->ht[0].sizemask;
+
+    if (d->lh) return _dictLhHashBucket(d,h);
+    /* Buckets of ht[0] below rehashidx were already moved to ht[1]. */
+    if (dictIsRehashing(d) && idx < (unsigned long) d->rehashidx)
+        return d->ht[1].table + (h & d->ht[1].sizemask);
+    return d->ht[0].table + idx;
+}
+
+/* Prefetch the memory that looking up the keys having the specified hashes
+ * is going to touch. Every lookup is a chain of dependent loads (bucket,
+ * entry, key and value), each one a likely cache miss with big tables:
+ * performing every step for all the keys before moving to the next step
+ * makes the misses of the different keys overlap, instead of paying them
+ * one after the other when the keys are looked up.
+ *
+ * Only the first entry of every bucket is prefetched. With the
+ * DICT_PREFETCH_VALS flag the value of the entry is prefetched as well,
+ * so it must be a pointer. Nothing is modified, so the function can be
+ * called at any time, but the memory prefetched is only useful if the
+ * keys are looked up soon after. */
+void dictPrefetchHashes(dict *d, const unsigned int *hashes,
+                        unsigned int count, int flags)
+{
+    dictEntry **buckets[DICT_PREFETCH_BATCH], *des[DICT_PREFETCH_BATCH];
+    unsigned int j, n;
+
+    if (dictSize(d) == 0) return;
+    if (d->oa) {
+        _dictOaPrefetch(d,hashes,count,flags);
+        return;
+    }
+    for (; count; count -= n, hashes += n) {
+        n = count > DICT_PREFETCH_BATCH ? DICT_PREFETCH_BATCH : count;
+        for (j = 0; j < n; j++) {
+            buckets[j] = _dictHashBucket(d,hashes[j]);
+            dictPrefetchAddr(buckets[j]);
+        }
+        for (j = 0; j < n; j++) {
+            des[j] = *buckets[j];
+            if (des[j]) dictPrefetchAddr(des[j]);
+        }
+        for (j = 0; j < n; j++) {
+            if (des[j] == NULL) continue;
+            dictPrefetchAddr(des[j]->key);
+            if (flags & DICT_PREFETCH_VALS) dictPrefetchAddr(des[j]->v.val);
+        }
+    }
+}
+
+/* Like dictPrefetchHashes(), hashing the keys with the dict type. */
+void dictPrefetch(dict *d, void **keys, unsigned int count, int flags) {
+    unsigned int hashes[DICT_PREFETCH_BATCH], j, n;
+
+    if (dictSize(d) == 0) return;
+    for (; count; count -= n, keys += n) {
+        n = count > DICT_PREFETCH_BATCH ? DICT_PREFETCH_BATCH : count;
+        for (j = 0; j < n; j++) hashes[j] = dictHashKey(d,keys[j]);
+        dictPrefetchHashes(d,hashes,n,flags);
+    }
+}
+
 /* Function to reverse bits. Algorithm from:
  * http://graphics.stanford.edu/~seander/bithacks.html#ReverseParallel */
 static unsigned long rev(unsigned long v) {
@@ -777,6 +1018,8 @@ unsigned long dictScan(dict *d,
     const dictEntry *de;
     unsigned long m0, m1;
 
+    if (d->oa) return _dictOaScan(d,v,fn,privdata);
+    if (d->lh) return _dictLhScan(d,v,fn,privdata);
     if (dictSize(d) == 0) return 0;
 
     if (!dictIsRehashing(d)) {
@@ -888,16 +1131,14 @@ static unsigned long _dictNextPower(unsigned long size)
  *
  * Note that if we are in the process of rehashing the hash table, the
  * index is always returned in the context of the second (new) hash table. */
-static int _dictKeyIndex(dict *d, const void *key)
+static int _dictKeyIndex(dict *d, const void *key, unsigned int h)
 {
-    unsigned int h, idx, table;
+    unsigned int idx, table;
     dictEntry *he;
 
     /* Expand the hash table if needed */
     if (_dictExpandIfNeeded(d) == DICT_ERR)
         return -1;
-    /* Compute the key hash value */
-    h = dictHashKey(d, key);//ͨhashõkeyڵbucketλ
     //ֵǷ˸key
     for (table = 0; table <= 1; table++) {
         idx = h & d->ht[table].sizemask;
@@ -929,6 +1170,72 @@ void dictDisableResize(void) {
     dict_can_resize = 0;
 }
 
+#include "dict_oa.c"
+#include "dict_lh.c"
+
+/* Return the memory used by the dictionary itself: the structure, the
+ * tables and the entries. Keys and values are not accounted, even when
+ * the keys are embedded in the entries, see dictEntryMemUsage(). */
+size_t dictMemUsage(dict *d) {
+    size_t mem = sizeof(*d);
+    int j;
+
+    for (j = 0; j <= 1; j++) {
+        dictht *ht = &d->ht[j];
+
+        if (ht->table == NULL) continue;
+        if (d->oa) {
+            mem += _dictOaTableMemUsage(ht);
+        } else if (d->lh) {
+            mem += _dictLhTableMemUsage(ht);
+        } else {
+            mem += ht->size*sizeof(dictEntry*);
+        }
+        /* Open addressing tables store the entries in the table. */
+        if (!d->oa) mem += ht->used*sizeof(dictEntry);
+    }
+    return mem;
+}
+
+/* Return the memory used by a single entry of the dictionary, including
+ * the key if it is embedded in the entry. */
+size_t dictEntryMemUsage(dict *d, dictEntry *de) {
+    if (d->oa) return DICT_OA_SLOT+1; /* Slot + control byte. */
+    if (dictEmbedsKeys(d)) return zmalloc_size(de);
+    return sizeof(*de);
+}
+
+/* Reallocate the entry 'de', having hash 'h', calling 'defragfn', that
+ * returns the new pointer or NULL if the allocation was not moved, and fix
+ * the reference to the entry in its bucket. The entry is returned, moved
+ * or not. Open addressing tables store the entries in the table itself, so
+ * their entries are never moved. */
+dictEntry *dictDefragEntry(dict *d, dictEntry *de, unsigned int h,
+                           dictDefragAllocFunction *defragfn)
+{
+    dictEntry **ref = NULL, *newde;
+    int table;
+
+    if (d->oa) return de;
+    if (d->lh) {
+        ref = _dictLhHashBucket(d,h);
+        while(*ref && *ref != de) ref = &(*ref)->next;
+    } else {
+        for (table = 0; table <= 1; table++) {
+            if (d->ht[table].table == NULL) continue;
+            ref = &d->ht[table].table[h & d->ht[table].sizemask];
+            while(*ref && *ref != de) ref = &(*ref)->next;
+            if (*ref) break;
+        }
+    }
+    if (ref == NULL || *ref == NULL) return de;
+    if ((newde = defragfn(de)) == NULL) return de;
+    if (dictEmbedsKeys(d))
+        newde->key = (char*)newde + ((char*)newde->key - (char*)de);
+    *ref = newde;
+    return newde;
+}
+
 #if 0
 
 /* The following is code that we don't use for Redis currently, but that is part
@@ -1053,3 +1360,154 @@ dictType dictTypeHeapStringCopyKeyValue = {
     _dictStringDestructor,         /* val destructor */
 };
 #endif
+
+#ifdef DICT_BENCHMARK_MAIN
+/* Chained, open addressing and linear hashing tables.
+ *
+ * Compile with:
+ *   cc -O2 -DDICT_BENCHMARK_MAIN -o dict-benchmark dict.c zmalloc.c
+ *
+ * For every dataset size the program reports the memory used by the table
+ * (keys excluded), the biggest memory increment caused by a single
+ * insertion (that is, the allocation needed to grow the table), and the
+ * average time of insertions, successful lookups and unsuccessful lookups,
+ * both performed in random order. The second line reports the time needed
+ * to sample 5 keys, as the eviction does, calling dictGetRandomKey() five
+ * times or dictGetSomeKeys() once, with the table half full and after
+ * most of the keys were deleted. */
+static long long ustime(void) {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return ((long long)tv.tv_sec)*1000000+tv.tv_usec;
+}
+
+void _redisAssert(char *estr, char *file, int line) {
+    fprintf(stderr,"=== ASSERTION FAILED === %s:%d '%s'\n",file,line,estr);
+}
+
+static unsigned int benchHash(const void *key) {
+    return dictGenHashFunction(key, strlen(key));
+}
+
+static int benchKeyCompare(void *privdata, const void *key1,
+        const void *key2)
+{
+    DICT_NOTUSED(privdata);
+    return strcmp(key1, key2) == 0;
+}
+
+static dictType benchDictType = {
+    benchHash, NULL, NULL, benchKeyCompare, NULL, NULL
+};
+
+static void benchScanCallback(void *privdata, const dictEntry *de) {
+    DICT_NOTUSED(de);
+    (*(unsigned long*)privdata)++;
+}
+
+static void benchSample(dict *d, double *random_ns, double *some_ns) {
+    dictEntry *des[5];
+    long long start;
+    int j, k;
+
+    start = ustime();
+    for (j = 0; j < 100000; j++)
+        for (k = 0; k < 5; k++) des[k] = dictGetRandomKey(d);
+    *random_ns = (double)(ustime()-start)*1000/100000;
+    start = ustime();
+    for (j = 0; j < 100000; j++) dictGetSomeKeys(d,des,5);
+    *some_ns = (double)(ustime()-start)*1000/100000;
+}
+
+int main(void) {
+    unsigned long sizes[] = {10000, 100000, 1000000, 4000000}, n, j;
+    char *names[] = {"chained", "open", "linear"};
+    int k, type;
+
+    for (k = 0; k < (int)(sizeof(sizes)/sizeof(sizes[0])); k++) {
+        char *keys;
+        unsigned long *order;
+
+        n = sizes[k];
+        keys = malloc(n*2*16);
+        order = malloc(sizeof(unsigned long)*n);
+        /* The second half of the keys is never inserted. */
+        for (j = 0; j < n*2; j++) snprintf(keys+j*16,16,"key:%lu",j);
+        for (j = 0; j < n; j++) order[j] = j;
+        for (j = n-1; j > 0; j--) {
+            unsigned long r = random() % (j+1), t = order[j];
+            order[j] = order[r];
+            order[r] = t;
+        }
+
+        for (type = 0; type < 3; type++) {
+            size_t base = zmalloc_used_memory(), mem, last = base, spike = 0;
+            dict *d;
+            long long start, add, hit, miss;
+            unsigned long cursor = 0, scanned = 0;
+            double half_random, half_some, sparse_random, sparse_some;
+
+            if (type == 1)
+                d = dictCreateOpenAddressing(&benchDictType,NULL);
+            else if (type == 2)
+                d = dictCreateLinear(&benchDictType,NULL);
+            else
+                d = dictCreate(&benchDictType,NULL);
+
+            start = ustime();
+            for (j = 0; j < n; j++) {
+                dictEntry *de = dictAddRaw(d,keys+j*16);
+                dictSetUnsignedIntegerVal(de,j);
+                mem = zmalloc_used_memory();
+                if (mem > last && mem-last > spike) spike = mem-last;
+                last = mem;
+            }
+            add = ustime()-start;
+            while(dictRehash(d,100));
+            mem = zmalloc_used_memory()-base;
+
+            start = ustime();
+            for (j = 0; j < n; j++) {
+                dictEntry *de = dictFind(d,keys+order[j]*16);
+                assert(de && de->v.u64 == order[j]);
+            }
+            hit = ustime()-start;
+
+            start = ustime();
+            for (j = 0; j < n; j++)
+                assert(dictFind(d,keys+(n+order[j])*16) == NULL);
+            miss = ustime()-start;
+
+            do {
+                cursor = dictScan(d,cursor,benchScanCallback,&scanned);
+            } while(cursor);
+            assert(scanned >= n);
+            for (j = 0; j < n; j += 2)
+                assert(dictDelete(d,keys+order[j]*16) == DICT_OK);
+            assert(dictSize(d) == n/2);
+            benchSample(d,&half_random,&half_some);
+            for (j = 1; j < n; j += 2)
+                if (j % 64 != 1)
+                    assert(dictDelete(d,keys+order[j]*16) == DICT_OK);
+            benchSample(d,&sparse_random,&sparse_some);
+            for (j = 0; j < 1000; j++) dictResize(d);
+            for (j = 1; j < n; j += 64)
+                assert(dictFind(d,keys+order[j]*16) != NULL);
+
+            printf("%-8lu %-8s %5.1f bytes/key  growth alloc %8zu KB  "
+                   "add %6.1f ns  hit %6.1f ns  miss %6.1f ns\n",
+                n, names[type], (double)mem/n, spike/1024,
+                (double)add*1000/n, (double)hit*1000/n,
+                (double)miss*1000/n);
+            printf("%17s sample 5 keys: half full random %7.1f ns  "
+                   "some %6.1f ns, sparse random %7.1f ns  some %6.1f ns\n",
+                "", half_random, half_some, sparse_random, sparse_some);
+            dictRelease(d);
+        }
+        free(keys);
+        free(order);
+    }
+    return 0;
+}
+#endif
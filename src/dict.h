@@ -33,6 +33,7 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifndef __DICT_H
@@ -50,6 +51,7 @@ typedef struct dictEntry {//
         void *val;
         uint64_t u64;
         int64_t s64;
+        double d;
     } v;
     struct dictEntry *next;//һڵָ
 } dictEntry;
@@ -61,6 +63,12 @@ typedef struct dictType {
     int (*keyCompare)(void *privdata, const void *key1, const void *key2); //ȽϺָ
     void (*keyDestructor)(void *privdata, void *key); //캯ָ
     void (*valDestructor)(void *privdata, void *obj); //ֵ캯ָ
+    /* Optional: when keyEmbed is set, chained and linear dicts store a copy
+     * of the key in the same allocation of the entry, see dictEmbedsKeys().
+     * keyEmbedLen returns the bytes needed, keyEmbed copies the key at
+     * 'buf' and returns the pointer to store in the entry. */
+    size_t (*keyEmbedLen)(const void *key);
+    void *(*keyEmbed)(void *buf, const void *key);
 } dictType;
 
 /* This is our hash table structure. Every dictionary has two of this as we
@@ -78,6 +86,8 @@ typedef struct dict {
     dictht ht[2];   //hash table
     int rehashidx; /* rehashing not in progress if rehashidx == -1 */ //rehash 
     int iterators; /* number of iterators currently running */ //ǰֵ
+    int oa; /* open addressing tables, see dict_oa.c */
+    int lh; /* linear hashing table, see dict_lh.c */
 } dict;
 
 /* If safe is set to 1 this is a safe iterator, that means, you can call
@@ -92,10 +102,15 @@ typedef struct dictIterator {
 } dictIterator;
 
 typedef void (dictScanFunction)(void *privdata, const dictEntry *de);
+typedef void *(dictDefragAllocFunction)(void *ptr);
 
 /* This is the initial size of every hash table */
 #define DICT_HT_INITIAL_SIZE     4
 
+/* Max keys prefetched at once by dictPrefetch(), and its flags. */
+#define DICT_PREFETCH_BATCH 16
+#define DICT_PREFETCH_VALS 1    /* Values are pointers: prefetch them too. */
+
 /* ------------------------------- Macros ------------------------------------*/
 #define dictFreeVal(d, entry) \
     if ((d)->type->valDestructor) \
@@ -114,8 +129,15 @@ typedef void (dictScanFunction)(void *privdata, const dictEntry *de);
 #define dictSetUnsignedIntegerVal(entry, _val_) \
     do { entry->v.u64 = _val_; } while(0)
 
+#define dictSetDoubleVal(entry, _val_) \
+    do { entry->v.d = _val_; } while(0)
+
+/* Embedded keys are released together with their entry. Open addressing
+ * tables move entries around, so they never embed keys. */
+#define dictEmbedsKeys(d) ((d)->type->keyEmbed != NULL && !(d)->oa)
+
 #define dictFreeKey(d, entry) \
-    if ((d)->type->keyDestructor) \
+    if ((d)->type->keyDestructor && !dictEmbedsKeys(d)) \
         (d)->type->keyDestructor((d)->privdata, (entry)->key)
 
 #define dictSetKey(d, entry, _key_) do { \
@@ -135,21 +157,28 @@ typedef void (dictScanFunction)(void *privdata, const dictEntry *de);
 #define dictGetVal(he) ((he)->v.val)
 #define dictGetSignedIntegerVal(he) ((he)->v.s64)
 #define dictGetUnsignedIntegerVal(he) ((he)->v.u64)
+#define dictGetDoubleVal(he) ((he)->v.d)
 #define dictSlots(d) ((d)->ht[0].size+(d)->ht[1].size)
 #define dictSize(d) ((d)->ht[0].used+(d)->ht[1].used)
 #define dictIsRehashing(ht) ((ht)->rehashidx != -1)
+#define dictIsLinear(d) ((d)->lh)
 
 /* API */
 dict *dictCreate(dictType *type, void *privDataPtr);
+dict *dictCreateOpenAddressing(dictType *type, void *privDataPtr);
+dict *dictCreateLinear(dictType *type, void *privDataPtr);
 int dictExpand(dict *d, unsigned long size);
 int dictAdd(dict *d, void *key, void *val);
 dictEntry *dictAddRaw(dict *d, void *key);
+dictEntry *dictAddRawWithHash(dict *d, void *key, unsigned int h);
 int dictReplace(dict *d, void *key, void *val);
 dictEntry *dictReplaceRaw(dict *d, void *key);
 int dictDelete(dict *d, const void *key);
+int dictDeleteWithHash(dict *d, const void *key, unsigned int h);
 int dictDeleteNoFree(dict *d, const void *key);
 void dictRelease(dict *d);
 dictEntry * dictFind(dict *d, const void *key);
+dictEntry *dictFindWithHash(dict *d, const void *key, unsigned int h);
 void *dictFetchValue(dict *d, const void *key);
 int dictResize(dict *d);
 dictIterator *dictGetIterator(dict *d);
@@ -157,6 +186,10 @@ dictIterator *dictGetSafeIterator(dict *d);
 dictEntry *dictNext(dictIterator *iter);
 void dictReleaseIterator(dictIterator *iter);
 dictEntry *dictGetRandomKey(dict *d);
+unsigned int dictGetSomeKeys(dict *d, dictEntry **des, unsigned int count);
+void dictPrefetch(dict *d, void **keys, unsigned int count, int flags);
+void dictPrefetchHashes(dict *d, const unsigned int *hashes,
+                        unsigned int count, int flags);
 void dictPrintStats(dict *d);
 unsigned int dictGenHashFunction(const void *key, int len);
 unsigned int dictGenCaseHashFunction(const unsigned char *buf, int len);
@@ -168,6 +201,10 @@ int dictRehashMilliseconds(dict *d, int ms);
 void dictSetHashFunctionSeed(unsigned int initval);
 unsigned int dictGetHashFunctionSeed(void);
 unsigned long dictScan(dict *d, unsigned long v, dictScanFunction *fn, void *privdata);
+size_t dictMemUsage(dict *d);
+size_t dictEntryMemUsage(dict *d, dictEntry *de);
+dictEntry *dictDefragEntry(dict *d, dictEntry *de, unsigned int h,
+                           dictDefragAllocFunction *defragfn);
 
 /* Hash table types */
 extern dictType dictTypeHeapStringCopyKey;
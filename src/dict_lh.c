@@ -0,0 +1,339 @@
+/* Linear hashing for dict.c.
+ *
+ * This file is included by dict.c and implements the table layout used by
+ * dicts created with dictCreateLinear(). Entries are chained exactly like
+ * in the default implementation, but the table never grows by allocating
+ * a new table twice the size and rehashing into it: with big datasets that
+ * single allocation is huge, may push the instance over maxmemory, and
+ * when a child is saving the dataset the rehashing touches every page of
+ * both tables.
+ *
+ * Instead the table grows and shrinks one bucket at a time. With 2^L
+ * addressable buckets plus 'split' buckets already split, a key goes into
+ * bucket h & (2^L-1), or into h & (2^(L+1)-1) if the former is below the
+ * split point. Growing splits the bucket at the split point between
+ * itself and the new last bucket, shrinking merges the last bucket back
+ * into its sibling. Once 'split' reaches 2^L, L is incremented.
+ *
+ * Buckets are stored in segments of DICT_LH_SEGMENT pointers referenced by
+ * a small directory, so growing allocates at most one segment at a time.
+ * The first segment grows by doubling up to its full size, so that small
+ * dicts stay small.
+ *
+ * Only ht[0] is used: ht[0].size is the number of buckets, ht[0].sizemask
+ * is 2^L-1 and ht[0].table is the segments directory. The dict is never
+ * rehashing, so everything in dict.c and redis.c looking at rehashidx
+ * just works. Buckets are not split while safe iterators are running.
+ */
+
+#define DICT_LH_SEGMENT 4096        /* Buckets per segment. */
+#define DICT_LH_SPLITS 2            /* Max splits per insertion. */
+#define DICT_LH_RESIZE_STEPS 4096   /* Max splits or merges per dictResize(). */
+
+#define lhSegments(ht) ((dictEntry***)(ht)->table)
+#define lhSplitPoint(ht) ((ht)->size - ((ht)->sizemask+1))
+
+static dictEntry **_dictLhBucket(dictht *ht, unsigned long idx) {
+    return lhSegments(ht)[idx/DICT_LH_SEGMENT] + idx%DICT_LH_SEGMENT;
+}
+
+static unsigned long _dictLhIndex(dictht *ht, unsigned int h) {
+    unsigned long idx = h & ht->sizemask;
+
+    if (idx < lhSplitPoint(ht)) idx = h & (ht->sizemask*2+1);
+    return idx;
+}
+
+/* Append an empty bucket to the table, allocating memory as needed. */
+static void _dictLhAddBucket(dictht *ht) {
+    unsigned long idx = ht->size, seg = idx/DICT_LH_SEGMENT;
+
+    if (idx < DICT_LH_SEGMENT) {
+        if (idx >= DICT_HT_INITIAL_SIZE && (idx & (idx-1)) == 0)
+            lhSegments(ht)[0] = zrealloc(lhSegments(ht)[0],
+                                         sizeof(dictEntry*)*idx*2);
+    } else if (idx % DICT_LH_SEGMENT == 0) {
+        /* The directory size is the next power of two of the segments
+         * count: double it when it's full. */
+        if ((seg & (seg-1)) == 0)
+            ht->table = zrealloc(ht->table,sizeof(dictEntry**)*seg*2);
+        lhSegments(ht)[seg] = zmalloc(sizeof(dictEntry*)*DICT_LH_SEGMENT);
+    }
+    *_dictLhBucket(ht,idx) = NULL;
+    ht->size++;
+}
+
+/* Memory used by the directory and the segments of the table. Both the
+ * directory and the first segment are never shrunk, so this is a lower
+ * bound after the table shrinks. */
+static size_t _dictLhTableMemUsage(dictht *ht) {
+    unsigned long segs = (ht->size+DICT_LH_SEGMENT-1)/DICT_LH_SEGMENT;
+    unsigned long dirsize = 1, first = DICT_HT_INITIAL_SIZE;
+
+    while(dirsize < segs) dirsize *= 2;
+    if (segs > 1) {
+        first = DICT_LH_SEGMENT;
+    } else {
+        while(first < ht->size) first *= 2;
+    }
+    return dirsize*sizeof(dictEntry**) +
+           (first+(segs-1)*DICT_LH_SEGMENT)*sizeof(dictEntry*);
+}
+
+static void _dictLhSplit(dict *d) {
+    dictht *ht = &d->ht[0];
+    unsigned long src = lhSplitPoint(ht), dst = ht->size;
+    unsigned long mask = ht->sizemask*2+1;
+    dictEntry **from, **to, *de, *nextde;
+
+    _dictLhAddBucket(ht);
+    from = _dictLhBucket(ht,src);
+    to = _dictLhBucket(ht,dst);
+    de = *from;
+    *from = NULL;
+    while(de) {
+        dictEntry **bucket;
+
+        nextde = de->next;
+        bucket = ((dictHashKey(d,de->key) & mask) == dst) ? to : from;
+        de->next = *bucket;
+        *bucket = de;
+        de = nextde;
+    }
+    if (ht->size == mask+1) ht->sizemask = mask;
+}
+
+static void _dictLhMerge(dict *d) {
+    dictht *ht = &d->ht[0];
+    unsigned long last = ht->size-1, dst;
+    dictEntry **from, **to;
+
+    if (ht->size == ht->sizemask+1) ht->sizemask >>= 1;
+    dst = last - (ht->sizemask+1);
+    from = _dictLhBucket(ht,last);
+    to = _dictLhBucket(ht,dst);
+    if (*from) {
+        dictEntry *tail = *from;
+
+        while(tail->next) tail = tail->next;
+        tail->next = *to;
+        *to = *from;
+    }
+    if (last >= DICT_LH_SEGMENT && last % DICT_LH_SEGMENT == 0)
+        zfree(lhSegments(ht)[last/DICT_LH_SEGMENT]);
+    ht->size--;
+}
+
+/* Split or merge buckets, at most 'steps' times, so that the table gets
+ * closer to 'size' buckets. */
+static void _dictLhResize(dict *d, unsigned long size, unsigned long steps) {
+    dictht *ht = &d->ht[0];
+
+    if (size < DICT_HT_INITIAL_SIZE) size = DICT_HT_INITIAL_SIZE;
+    while(steps && ht->size < size) {
+        _dictLhSplit(d);
+        steps--;
+    }
+    while(steps && ht->size > size) {
+        _dictLhMerge(d);
+        steps--;
+    }
+}
+
+/* Called by dictResize(): move a few buckets closer to the 1:1 ratio. */
+static int _dictLhFit(dict *d) {
+    if (d->iterators) return DICT_ERR;
+    _dictLhResize(d,d->ht[0].used,DICT_LH_RESIZE_STEPS);
+    return DICT_OK;
+}
+
+static int _dictLhExpand(dict *d, unsigned long size) {
+    dictht *ht = &d->ht[0];
+
+    if (ht->used > size || d->iterators) return DICT_ERR;
+    if (ht->table == NULL) {
+        ht->table = zmalloc(sizeof(dictEntry**));
+        lhSegments(ht)[0] = zcalloc(sizeof(dictEntry*)*DICT_HT_INITIAL_SIZE);
+        ht->size = DICT_HT_INITIAL_SIZE;
+        ht->sizemask = DICT_HT_INITIAL_SIZE-1;
+    }
+    if (ht->size < size) _dictLhResize(d,size,ULONG_MAX);
+    return DICT_OK;
+}
+
+static dictEntry *_dictLhAddRaw(dict *d, void *key, unsigned int h) {
+    dictht *ht = &d->ht[0];
+    dictEntry **bucket, *de;
+
+    if (ht->size == 0) {
+        dictExpand(d,DICT_HT_INITIAL_SIZE);
+    } else if (ht->used >= ht->size && d->iterators == 0 &&
+               (dict_can_resize ||
+                ht->used/ht->size > dict_force_resize_ratio))
+    {
+        int j;
+
+        for (j = 0; j < DICT_LH_SPLITS && ht->used >= ht->size; j++)
+            _dictLhSplit(d);
+    }
+
+    bucket = _dictLhBucket(ht,_dictLhIndex(ht,h));
+    for (de = *bucket; de; de = de->next)
+        if (dictCompareKeys(d, key, de->key)) return NULL;
+
+    de = _dictCreateEntry(d,key);
+    de->next = *bucket;
+    *bucket = de;
+    ht->used++;
+    return de;
+}
+
+static int _dictLhGenericDelete(dict *d, const void *key, unsigned int h,
+                                int nofree)
+{
+    dictht *ht = &d->ht[0];
+    dictEntry **bucket, *de, *prevde = NULL;
+
+    bucket = _dictLhBucket(ht,_dictLhIndex(ht,h));
+    for (de = *bucket; de; prevde = de, de = de->next) {
+        if (dictCompareKeys(d, key, de->key)) {
+            if (prevde)
+                prevde->next = de->next;
+            else
+                *bucket = de->next;
+            if (!nofree) {
+                dictFreeKey(d, de);
+                dictFreeVal(d, de);
+            }
+            zfree(de);
+            ht->used--;
+            return DICT_OK;
+        }
+    }
+    return DICT_ERR;
+}
+
+static dictEntry *_dictLhFind(dict *d, const void *key, unsigned int h) {
+    dictht *ht = &d->ht[0];
+    dictEntry *de;
+
+    de = *_dictLhBucket(ht,_dictLhIndex(ht,h));
+    while(de) {
+        if (dictCompareKeys(d, key, de->key)) return de;
+        de = de->next;
+    }
+    return NULL;
+}
+
+static int _dictLhClear(dict *d, dictht *ht) {
+    unsigned long i;
+
+    for (i = 0; i < ht->size && ht->used > 0; i++) {
+        dictEntry *de = *_dictLhBucket(ht,i), *nextde;
+
+        while(de) {
+            nextde = de->next;
+            dictFreeKey(d, de);
+            dictFreeVal(d, de);
+            zfree(de);
+            ht->used--;
+            de = nextde;
+        }
+    }
+    for (i = 0; i < ht->size; i += DICT_LH_SEGMENT)
+        zfree(lhSegments(ht)[i/DICT_LH_SEGMENT]);
+    zfree(ht->table);
+    _dictReset(ht);
+    return DICT_OK;
+}
+
+static dictEntry *_dictLhNext(dictIterator *iter) {
+    while (1) {
+        if (iter->entry == NULL) {
+            dictht *ht = &iter->d->ht[0];
+
+            if (iter->index == -1) {
+                if (iter->safe)
+                    iter->d->iterators++;
+                else
+                    iter->fingerprint = dictFingerprint(iter->d);
+            }
+            iter->index++;
+            if (iter->index >= (signed) ht->size) break;
+            iter->entry = *_dictLhBucket(ht,iter->index);
+        } else {
+            iter->entry = iter->nextEntry;
+        }
+        if (iter->entry) {
+            iter->nextEntry = iter->entry->next;
+            return iter->entry;
+        }
+    }
+    return NULL;
+}
+
+static dictEntry *_dictLhGetRandomKey(dict *d) {
+    dictht *ht = &d->ht[0];
+    dictEntry *de, *orig;
+    int len = 0;
+
+    if (dictSize(d) == 0) return NULL;
+    do {
+        de = *_dictLhBucket(ht,random() % ht->size);
+    } while(de == NULL);
+
+    for (orig = de; de; de = de->next) len++;
+    len = random() % len;
+    de = orig;
+    while(len--) de = de->next;
+    return de;
+}
+
+static dictEntry **_dictLhHashBucket(dict *d, unsigned int h) {
+    return _dictLhBucket(&d->ht[0],_dictLhIndex(&d->ht[0],h));
+}
+
+static unsigned int _dictLhGetSomeKeys(dict *d, dictEntry **des,
+                                       unsigned int count)
+{
+    dictht *ht = &d->ht[0];
+    unsigned long i = random() % ht->size, maxsteps = (unsigned long)count*10;
+    unsigned int stored = 0;
+
+    if (maxsteps > ht->size) maxsteps = ht->size;
+    while(maxsteps--) {
+        dictEntry *de;
+
+        for (de = *_dictLhBucket(ht,i); de; de = de->next) {
+            des[stored++] = de;
+            if (stored == count) return stored;
+        }
+        if (++i == ht->size) i = 0;
+    }
+    return stored;
+}
+
+/* The cursor works on the 2^L buckets of the table: a bucket that was
+ * already split is emitted together with its split image, exactly like
+ * dictScan() does with the bigger table when rehashing. */
+static unsigned long _dictLhScan(dict *d, unsigned long v,
+                                 dictScanFunction *fn, void *privdata)
+{
+    dictht *ht = &d->ht[0];
+    unsigned long m0 = ht->sizemask, idx = v & m0;
+    const dictEntry *de;
+
+    if (dictSize(d) == 0) return 0;
+
+    for (de = *_dictLhBucket(ht,idx); de; de = de->next) fn(privdata, de);
+    if (idx < lhSplitPoint(ht)) {
+        de = *_dictLhBucket(ht,idx+m0+1);
+        for (; de; de = de->next) fn(privdata, de);
+    }
+
+    v |= ~m0;
+    v = rev(v);
+    v++;
+    v = rev(v);
+    return v;
+}
@@ -0,0 +1,543 @@
+/* Open addressing hash tables for dict.c.
+ *
+ * This file is included by dict.c and implements the table layout used by
+ * dicts created with dictCreateOpenAddressing(). The API, the incremental
+ * rehashing and the dictType callbacks are exactly the ones of the chained
+ * implementation, only the way entries are stored inside a dictht changes.
+ *
+ * Instead of an array of pointers to separately allocated dictEntry
+ * structures, every table is a single allocation with the following layout:
+ *
+ *   +--------+--------------------+------------------------------+
+ *   | header | ctrl[size] (bytes) | slots[size] (key + value)    |
+ *   +--------+--------------------+------------------------------+
+ *
+ * Every slot has a control byte: EMPTY, DELETED (a tombstone) or, when the
+ * slot is in use, a 7 bit tag taken from the hash of the key. Slots are
+ * organized in groups of DICT_OA_GROUP entries: the lookup starts from the
+ * group selected by the hash, compares the tag against the control bytes of
+ * the whole group at once (with SSE2 when available) and only touches the
+ * slots with a matching tag. If the group contains an EMPTY slot the key is
+ * not in the table, otherwise the next group is probed.
+ *
+ * So a lookup in a big keyspace costs about two cache misses (control bytes
+ * and slot) instead of the bucket pointer plus one miss per chained entry,
+ * and the 24 bytes dictEntry allocation per key (32 with the allocator
+ * overhead) plus the 8 bytes bucket pointer become 17 bytes per slot.
+ *
+ * Slots are accessed as dictEntry pointers, but only the key and v fields
+ * exist: the 'next' field must never be touched for open addressing dicts.
+ *
+ * A deleted slot becomes EMPTY if its group already contains an EMPTY
+ * slot (no probe sequence can go past such a group), otherwise it becomes
+ * a tombstone. Tombstones count against the load factor and are dropped
+ * when the table is rehashed.
+ *
+ * Incremental rehashing moves one group at a time. Moved slots are marked
+ * as DELETED in the old table so that lookups for keys still to be moved
+ * keep working. Differently from the chained implementation, moving
+ * entries invalidates the dictEntry pointers to them, so dictFind() does
+ * not perform a rehashing step: a pointer returned by dictFind() is valid
+ * until the next insertion or deletion in the same dict.
+ */
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include <stddef.h>
+
+#define DICT_OA_GROUP 16            /* Slots per probing group. */
+#define DICT_OA_EMPTY 0x80          /* Control byte of a free slot. */
+#define DICT_OA_DELETED 0xfe        /* Control byte of a tombstone. */
+#define DICT_OA_HEADER 16           /* Table header, holds the tombstones count. */
+#define DICT_OA_SLOT offsetof(dictEntry,next)
+
+#define oaCtrl(ht) ((unsigned char*)(ht)->table + DICT_OA_HEADER)
+#define oaDeleted(ht) (*(unsigned long*)(ht)->table)
+#define oaSlot(ht,i) ((dictEntry*)(oaCtrl(ht)+(ht)->size+(i)*DICT_OA_SLOT))
+#define oaGroupMask(ht) ((ht)->sizemask / DICT_OA_GROUP)
+#define oaTag(h) ((unsigned char)((h) >> 25))
+#define oaIsFull(c) (((c) & 0x80) == 0)
+
+/* Return a bitmap of the slots of the group 'g' having control byte 'c'. */
+static inline unsigned int oaMatch(const unsigned char *g, unsigned char c) {
+#if defined(__SSE2__)
+    __m128i group = _mm_loadu_si128((const __m128i*)g);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(group,_mm_set1_epi8((char)c)));
+#else
+    unsigned int mask = 0;
+    int j;
+
+    for (j = 0; j < DICT_OA_GROUP; j++)
+        if (g[j] == c) mask |= 1<<j;
+    return mask;
+#endif
+}
+
+/* Return a bitmap of the EMPTY or DELETED slots of the group 'g'. */
+static inline unsigned int oaMatchFree(const unsigned char *g) {
+#if defined(__SSE2__)
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)g));
+#else
+    unsigned int mask = 0;
+    int j;
+
+    for (j = 0; j < DICT_OA_GROUP; j++)
+        if (g[j] & 0x80) mask |= 1<<j;
+    return mask;
+#endif
+}
+
+#define oaMatchFull(g) (oaMatchFree(g) ^ 0xffff)
+
+/* Number of slots needed to store 'size' elements without exceeding the
+ * max load factor of 7/8. */
+static unsigned long _dictOaSlots(unsigned long size) {
+    unsigned long i = DICT_OA_GROUP;
+
+    while (i - i/8 < size) {
+        if (i >= LONG_MAX/2) break;
+        i *= 2;
+    }
+    return i;
+}
+
+/* Memory used by a table, see _dictOaExpand(). */
+static size_t _dictOaTableMemUsage(dictht *ht) {
+    return DICT_OA_HEADER + ht->size + ht->size*DICT_OA_SLOT +
+           sizeof(dictEntry);
+}
+
+/* Allocate an empty table of 'realsize' slots. */
+static void _dictOaInitTable(dictht *n, unsigned long realsize) {
+    /* The allocation is padded so that copying a slot as a whole
+     * dictEntry (see dictReplace()) never reads past the end. */
+    n->size = realsize;
+    n->sizemask = realsize-1;
+    n->used = 0;
+    n->table = zmalloc(DICT_OA_HEADER + realsize + realsize*DICT_OA_SLOT +
+                       sizeof(dictEntry));
+    oaDeleted(n) = 0;
+    memset(oaCtrl(n),DICT_OA_EMPTY,realsize);
+}
+
+static int _dictOaExpand(dict *d, unsigned long size) {
+    dictht n;
+
+    if (dictIsRehashing(d) || d->ht[0].used > size)
+        return DICT_ERR;
+
+    _dictOaInitTable(&n,_dictOaSlots(size));
+    if (d->ht[0].table == NULL) {
+        d->ht[0] = n;
+        return DICT_OK;
+    }
+    d->ht[1] = n;
+    d->rehashidx = 0;
+    return DICT_OK;
+}
+
+/* Search 'key' with hash 'h' in the table. On success the slot is returned
+ * and its index stored in *idx if not NULL. */
+static dictEntry *_dictOaFindIn(dict *d, dictht *ht, const void *key,
+                                unsigned int h, unsigned long *idx)
+{
+    unsigned char *ctrl = oaCtrl(ht);
+    unsigned char tag = oaTag(h);
+    unsigned long gmask = oaGroupMask(ht), g = h & gmask, probes = 0;
+
+    while(1) {
+        unsigned char *group = ctrl+g*DICT_OA_GROUP;
+        unsigned int m = oaMatch(group,tag);
+
+        while(m) {
+            unsigned long i = g*DICT_OA_GROUP + __builtin_ctz(m);
+            dictEntry *de = oaSlot(ht,i);
+
+            if (dictCompareKeys(d, key, de->key)) {
+                if (idx) *idx = i;
+                return de;
+            }
+            m &= m-1;
+        }
+        if (oaMatch(group,DICT_OA_EMPTY)) return NULL;
+        /* A table being rehashed may have no EMPTY slot at all. */
+        if (++probes > gmask) return NULL;
+        g = (g+1) & gmask;
+    }
+}
+
+/* Take the first free slot in the probe sequence of 'h' and return its
+ * index. The caller makes sure the table is not full. */
+static unsigned long _dictOaInsertSlot(dictht *ht, unsigned int h) {
+    unsigned char *ctrl = oaCtrl(ht);
+    unsigned long gmask = oaGroupMask(ht), g = h & gmask, i;
+    unsigned int m;
+
+    while((m = oaMatchFree(ctrl+g*DICT_OA_GROUP)) == 0)
+        g = (g+1) & gmask;
+    i = g*DICT_OA_GROUP + __builtin_ctz(m);
+    if (ctrl[i] == DICT_OA_DELETED) oaDeleted(ht)--;
+    ctrl[i] = oaTag(h);
+    ht->used++;
+    return i;
+}
+
+/* Release the slot 'i' of the table. */
+static void _dictOaClearSlot(dictht *ht, unsigned long i) {
+    unsigned char *ctrl = oaCtrl(ht);
+
+    if (oaMatch(ctrl+(i & ~(unsigned long)(DICT_OA_GROUP-1)),DICT_OA_EMPTY)) {
+        ctrl[i] = DICT_OA_EMPTY;
+    } else {
+        ctrl[i] = DICT_OA_DELETED;
+        oaDeleted(ht)++;
+    }
+    ht->used--;
+}
+
+/* Fill limit of a table, that will receive 'pending' more entries from the
+ * table being rehashed: 7/8 of the slots, or 15/16 when resizing is
+ * disabled because of a child process saving the dataset. */
+static int _dictOaOverLimit(dictht *ht, unsigned long pending, int hard) {
+    unsigned long fill = ht->used + oaDeleted(ht) + pending + 1;
+
+    return fill > ht->size - ht->size/(hard ? 16 : 8);
+}
+
+/* Move the entries of both tables to a new table sized for twice the
+ * elements, completing the rehashing at once. Every entry changes slot, so
+ * this must not be called while safe iterators exist. */
+static void _dictOaRebuild(dict *d) {
+    dictht n;
+    int table;
+
+    _dictOaInitTable(&n,_dictOaSlots((d->ht[0].used+d->ht[1].used)*2));
+    for (table = 0; table <= 1; table++) {
+        dictht *ht = &d->ht[table];
+        unsigned long i;
+
+        for (i = 0; i < ht->size && ht->used > 0; i++) {
+            if (oaIsFull(oaCtrl(ht)[i])) {
+                dictEntry *de = oaSlot(ht,i);
+                unsigned long j = _dictOaInsertSlot(&n,dictHashKey(d,de->key));
+
+                memcpy(oaSlot(&n,j),de,DICT_OA_SLOT);
+                ht->used--;
+            }
+        }
+        zfree(ht->table);
+        _dictReset(ht);
+    }
+    d->ht[0] = n;
+    d->rehashidx = -1;
+}
+
+static int _dictOaExpandIfNeeded(dict *d) {
+    if (dictIsRehashing(d)) {
+        /* The new table is sized for twice the elements, and all the ones
+         * still in the old table will end up there, so this can only
+         * happen when safe iterators kept the rehashing paused for a long
+         * time. Rehashing would move the entries under the iterators: while
+         * they exist the insertion fails instead of running out of slots,
+         * otherwise everything is moved to a table big enough. */
+        if (!_dictOaOverLimit(&d->ht[1],d->ht[0].used,1)) return DICT_OK;
+        if (d->iterators) return DICT_ERR;
+        _dictOaRebuild(d);
+        return DICT_OK;
+    }
+    if (d->ht[0].size == 0) return dictExpand(d, DICT_HT_INITIAL_SIZE);
+    if (_dictOaOverLimit(&d->ht[0],0,0) &&
+        (dict_can_resize || _dictOaOverLimit(&d->ht[0],0,1)))
+    {
+        /* Tables full of tombstones are rebuilt with the same or a smaller
+         * size, so tombstones are always recycled this way. */
+        return dictExpand(d, d->ht[0].used*2);
+    }
+    return DICT_OK;
+}
+
+static int _dictOaRehash(dict *d, int n) {
+    dictht *t0 = &d->ht[0], *t1 = &d->ht[1];
+
+    while(n--) {
+        unsigned char *group;
+        unsigned long base;
+        unsigned int m;
+
+        if (t0->used == 0 ||
+            (unsigned long)d->rehashidx*DICT_OA_GROUP >= t0->size)
+        {
+            zfree(t0->table);
+            *t0 = *t1;
+            _dictReset(t1);
+            d->rehashidx = -1;
+            return 0;
+        }
+        base = (unsigned long)d->rehashidx*DICT_OA_GROUP;
+        group = oaCtrl(t0)+base;
+        m = oaMatchFull(group);
+        while(m) {
+            int j = __builtin_ctz(m);
+            dictEntry *de = oaSlot(t0,base+j);
+            unsigned long i = _dictOaInsertSlot(t1,dictHashKey(d,de->key));
+
+            memcpy(oaSlot(t1,i),de,DICT_OA_SLOT);
+            group[j] = DICT_OA_DELETED;
+            oaDeleted(t0)++;
+            t0->used--;
+            m &= m-1;
+        }
+        d->rehashidx++;
+    }
+    return 1;
+}
+
+static dictEntry *_dictOaAddRaw(dict *d, void *key, unsigned int h) {
+    dictht *ht;
+    dictEntry *de;
+
+    if (dictIsRehashing(d)) _dictRehashStep(d);
+    if (_dictOaExpandIfNeeded(d) == DICT_ERR) return NULL;
+    if (_dictOaFindIn(d,&d->ht[0],key,h,NULL) ||
+        (dictIsRehashing(d) && _dictOaFindIn(d,&d->ht[1],key,h,NULL)))
+        return NULL;
+
+    ht = dictIsRehashing(d) ? &d->ht[1] : &d->ht[0];
+    de = oaSlot(ht,_dictOaInsertSlot(ht,h));
+    dictSetKey(d, de, key);
+    return de;
+}
+
+static int _dictOaGenericDelete(dict *d, const void *key, unsigned int h,
+                                int nofree)
+{
+    unsigned long idx;
+    int table;
+
+    if (dictIsRehashing(d)) _dictRehashStep(d);
+
+    for (table = 0; table <= 1; table++) {
+        dictEntry *de = _dictOaFindIn(d,&d->ht[table],key,h,&idx);
+
+        if (de) {
+            if (!nofree) {
+                dictFreeKey(d, de);
+                dictFreeVal(d, de);
+            }
+            _dictOaClearSlot(&d->ht[table],idx);
+            return DICT_OK;
+        }
+        if (!dictIsRehashing(d)) break;
+    }
+    return DICT_ERR;
+}
+
+static dictEntry *_dictOaFind(dict *d, const void *key, unsigned int h) {
+    dictEntry *de = _dictOaFindIn(d,&d->ht[0],key,h,NULL);
+
+    if (de || !dictIsRehashing(d)) return de;
+    return _dictOaFindIn(d,&d->ht[1],key,h,NULL);
+}
+
+static int _dictOaClear(dict *d, dictht *ht) {
+    unsigned long i;
+
+    for (i = 0; i < ht->size && ht->used > 0; i++) {
+        if (oaIsFull(oaCtrl(ht)[i])) {
+            dictEntry *de = oaSlot(ht,i);
+
+            dictFreeKey(d, de);
+            dictFreeVal(d, de);
+            ht->used--;
+        }
+    }
+    zfree(ht->table);
+    _dictReset(ht);
+    return DICT_OK;
+}
+
+static dictEntry *_dictOaNext(dictIterator *iter) {
+    while (1) {
+        dictht *ht = &iter->d->ht[iter->table];
+
+        if (iter->index == -1 && iter->table == 0) {
+            if (iter->safe)
+                iter->d->iterators++;
+            else
+                iter->fingerprint = dictFingerprint(iter->d);
+        }
+        iter->index++;
+        if (iter->index >= (signed) ht->size) {
+            if (dictIsRehashing(iter->d) && iter->table == 0) {
+                iter->table++;
+                iter->index = 0;
+                ht = &iter->d->ht[1];
+            } else {
+                break;
+            }
+        }
+        if (oaIsFull(oaCtrl(ht)[iter->index]))
+            return oaSlot(ht,iter->index);
+    }
+    return NULL;
+}
+
+static dictEntry *_dictOaGetRandomKey(dict *d) {
+    dictht *ht;
+    unsigned long h;
+
+    if (dictSize(d) == 0) return NULL;
+    if (dictIsRehashing(d)) _dictRehashStep(d);
+    do {
+        ht = &d->ht[0];
+        if (dictIsRehashing(d)) {
+            h = random() % (d->ht[0].size+d->ht[1].size);
+            if (h >= d->ht[0].size) {
+                h -= d->ht[0].size;
+                ht = &d->ht[1];
+            }
+        } else {
+            h = random() & d->ht[0].sizemask;
+        }
+    } while(!oaIsFull(oaCtrl(ht)[h]));
+    return oaSlot(ht,h);
+}
+
+/* Same as the chained implementation, walking groups instead of buckets:
+ * 'count' groups hold 16*count slots, about the 10*count buckets visited
+ * by the chained implementation given the higher load factor. */
+static unsigned int _dictOaGetSomeKeys(dict *d, dictEntry **des,
+                                       unsigned int count)
+{
+    unsigned long g, j, tables, maxgmask, maxsteps;
+    unsigned int stored = 0;
+
+    for (j = 0; j < count && dictIsRehashing(d); j++) _dictRehashStep(d);
+
+    tables = dictIsRehashing(d) ? 2 : 1;
+    maxgmask = oaGroupMask(&d->ht[0]);
+    if (tables > 1 && oaGroupMask(&d->ht[1]) > maxgmask)
+        maxgmask = oaGroupMask(&d->ht[1]);
+    maxsteps = count;
+    if (maxsteps > maxgmask+1) maxsteps = maxgmask+1;
+
+    g = random() & maxgmask;
+    while(maxsteps--) {
+        for (j = 0; j < tables; j++) {
+            dictht *ht = &d->ht[j];
+            unsigned int m;
+
+            if (g > oaGroupMask(ht)) continue;
+            m = oaMatchFull(oaCtrl(ht)+g*DICT_OA_GROUP);
+            while(m) {
+                des[stored++] = oaSlot(ht,g*DICT_OA_GROUP+__builtin_ctz(m));
+                if (stored == count) return stored;
+                m &= m-1;
+            }
+        }
+        g = (g+1) & maxgmask;
+    }
+    return stored;
+}
+
+/* Same as dictPrefetchHashes(): control bytes of the home group, then the
+ * first slot with a matching tag, then its key and value. */
+static void _dictOaPrefetch(dict *d, const unsigned int *hashes,
+                            unsigned int count, int flags)
+{
+    unsigned char *groups[DICT_PREFETCH_BATCH];
+    dictEntry *slots[DICT_PREFETCH_BATCH];
+    dictht *hts[DICT_PREFETCH_BATCH];
+    unsigned int j, n;
+
+    for (; count; count -= n, hashes += n) {
+        n = count > DICT_PREFETCH_BATCH ? DICT_PREFETCH_BATCH : count;
+        for (j = 0; j < n; j++) {
+            dictht *ht = &d->ht[0];
+            unsigned long g = hashes[j] & oaGroupMask(ht);
+
+            /* Groups of ht[0] below rehashidx were already moved. */
+            if (dictIsRehashing(d) && g < (unsigned long) d->rehashidx) {
+                ht = &d->ht[1];
+                g = hashes[j] & oaGroupMask(ht);
+            }
+            hts[j] = ht;
+            groups[j] = oaCtrl(ht)+g*DICT_OA_GROUP;
+            dictPrefetchAddr(groups[j]);
+        }
+        for (j = 0; j < n; j++) {
+            unsigned int m = oaMatch(groups[j],oaTag(hashes[j]));
+
+            slots[j] = NULL;
+            if (m == 0) continue;
+            slots[j] = oaSlot(hts[j],
+                (groups[j]-oaCtrl(hts[j])) + __builtin_ctz(m));
+            dictPrefetchAddr(slots[j]);
+        }
+        for (j = 0; j < n; j++) {
+            if (slots[j] == NULL) continue;
+            dictPrefetchAddr(slots[j]->key);
+            if (flags & DICT_PREFETCH_VALS) dictPrefetchAddr(slots[j]->v.val);
+        }
+    }
+}
+
+/* Emit all the entries whose home group is 'g'. They can only be stored
+ * from 'g' up to the first group having an EMPTY slot. */
+static void _dictOaScanGroup(dict *d, dictht *ht, unsigned long g,
+                             dictScanFunction *fn, void *privdata)
+{
+    unsigned long gmask = oaGroupMask(ht), j = g;
+
+    do {
+        unsigned char *group = oaCtrl(ht)+j*DICT_OA_GROUP;
+        unsigned int m = oaMatchFull(group);
+
+        while(m) {
+            dictEntry *de = oaSlot(ht,j*DICT_OA_GROUP+__builtin_ctz(m));
+
+            if ((dictHashKey(d,de->key) & gmask) == g) fn(privdata,de);
+            m &= m-1;
+        }
+        if (oaMatch(group,DICT_OA_EMPTY)) break;
+        j = (j+1) & gmask;
+    } while(j != g);
+}
+
+/* Same algorithm of dictScan(), using the home group of the entries in
+ * place of the bucket, so the cursor guarantees are the same. */
+static unsigned long _dictOaScan(dict *d, unsigned long v,
+                                 dictScanFunction *fn, void *privdata)
+{
+    dictht *t0, *t1;
+    unsigned long m0, m1;
+
+    if (dictSize(d) == 0) return 0;
+
+    if (!dictIsRehashing(d)) {
+        t0 = &(d->ht[0]);
+        m0 = oaGroupMask(t0);
+        _dictOaScanGroup(d,t0,v & m0,fn,privdata);
+    } else {
+        t0 = &d->ht[0];
+        t1 = &d->ht[1];
+        if (t0->size > t1->size) {
+            t0 = &d->ht[1];
+            t1 = &d->ht[0];
+        }
+        m0 = oaGroupMask(t0);
+        m1 = oaGroupMask(t1);
+        _dictOaScanGroup(d,t0,v & m0,fn,privdata);
+        do {
+            _dictOaScanGroup(d,t1,v & m1,fn,privdata);
+            v = (((v | m0) + 1) & ~m0) | (v & m0);
+        } while (v & (m0 ^ m1));
+    }
+
+    v |= ~m0;
+    v = rev(v);
+    v++;
+    v = rev(v);
+    return v;
+}
@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2013, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "redis.h"
+#include "bio.h"
+
+/* Lazy freeing of values.
+ *
+ * Freeing a value made of millions of elements takes seconds, blocking the
+ * server. With UNLINK, FLUSHDB ASYNC, FLUSHALL ASYNC and the lazyfree-lazy-*
+ * options the value is only unlinked from the keyspace, that is O(1), and
+ * it is released by the REDIS_BIO_LAZY_FREE background thread.
+ *
+ * The elements of sets, sorted sets and hashes are Redis objects,
+ * that may be referenced elsewhere as well: shared integers, the arguments
+ * of commands queued by MULTI, the slow log, or the output buffers of the
+ * slaves. So while the thread is releasing references, the reference count
+ * of all the objects is updated with atomic operations, see incrRefCount()
+ * and decrRefCount(). Only the main thread sets lazyfree_atomic_refcount,
+ * before queueing a job, and clears it in serverCron() once no job is
+ * pending, so the plain increments are never used while the thread runs.
+ *
+ * Without atomic operations values are always freed synchronously. */
+
+/* Values requiring less allocations than this to be freed are freed
+ * synchronously, as queueing the job would be more costly. */
+#define LAZYFREE_THRESHOLD 64
+
+int lazyfree_atomic_refcount = 0;
+static volatile size_t lazyfree_objects = 0; /* Objects queued for freeing. */
+
+#ifdef HAVE_ATOMIC
+static void lazyfreeIncrObjects(size_t count) {
+    __sync_add_and_fetch(&lazyfree_objects,count);
+}
+
+static void lazyfreeDecrObjects(size_t count) {
+    __sync_sub_and_fetch(&lazyfree_objects,count);
+}
+
+/* Return the number of objects the lazy free thread still has to free. */
+size_t lazyfreeGetPendingObjectsCount(void) {
+    return __sync_add_and_fetch(&lazyfree_objects,0);
+}
+#else
+size_t lazyfreeGetPendingObjectsCount(void) {
+    return 0;
+}
+#endif
+
+/* Return the number of allocations needed to free the object, more or less:
+ * the number of nodes of lists and of elements of sets, sorted sets and
+ * hashes that are not stored in a single allocation, otherwise 1. */
+size_t lazyfreeGetFreeEffort(robj *o) {
+    if (o->type == REDIS_LIST && o->encoding == REDIS_ENCODING_QUICKLIST) {
+        return ((quicklist*)o->ptr)->len;
+    } else if (o->type == REDIS_SET && o->encoding == REDIS_ENCODING_HT) {
+        return dictSize((dict*)o->ptr);
+    } else if (o->type == REDIS_ZSET &&
+               o->encoding == REDIS_ENCODING_SKIPLIST) {
+        return ((zset*)o->ptr)->zsl->length;
+    } else if (o->type == REDIS_ZSET &&
+               o->encoding == REDIS_ENCODING_BTREE) {
+        return ((zset*)o->ptr)->zbt->length;
+    } else if (o->type == REDIS_HASH && o->encoding == REDIS_ENCODING_HT) {
+        return dictSize((dict*)o->ptr);
+    } else {
+        return 1;
+    }
+}
+
+/* Start using atomic reference counts and queue a job for the thread. */
+static void lazyfreeCreateJob(size_t objects, void *arg1, void *arg2,
+                              void *arg3)
+{
+#ifdef HAVE_ATOMIC
+    lazyfree_atomic_refcount = 1;
+    __sync_synchronize();
+    lazyfreeIncrObjects(objects);
+    bioCreateBackgroundJob(REDIS_BIO_LAZY_FREE,arg1,arg2,arg3);
+#else
+    REDIS_NOTUSED(objects);
+    REDIS_NOTUSED(arg1);
+    REDIS_NOTUSED(arg2);
+    REDIS_NOTUSED(arg3);
+#endif
+}
+
+/* Return true if the object, that the caller is going to release, is
+ * worth freeing in the background. Objects referenced elsewhere are not,
+ * releasing the reference is all it takes. */
+static int lazyfreeShouldFreeAsync(robj *o) {
+#ifdef HAVE_ATOMIC
+    return o->refcount == 1 && lazyfreeGetFreeEffort(o) > LAZYFREE_THRESHOLD;
+#else
+    REDIS_NOTUSED(o);
+    return 0;
+#endif
+}
+
+/* Release a reference to the object, freeing it in the background if
+ * it is big enough. */
+void freeObjAsync(robj *o) {
+    if (lazyfreeShouldFreeAsync(o))
+        lazyfreeCreateJob(lazyfreeGetFreeEffort(o),o,NULL,NULL);
+    else
+        decrRefCount(o);
+}
+
+/* Delete a key, value, and associated expiration entry if any, from the
+ * DB, like dbSyncDelete(), but freeing the value in the background if it
+ * is big enough. */
+int dbAsyncDelete(redisDb *db, robj *key) {
+    dictEntry *de = dictFindWithHash(db->dict,key->ptr,keyHash(key));
+    robj *val;
+
+    if (de == NULL) return 0;
+    if (dictSize(db->expires) > 0) removeExpire(db,key);
+
+    /* Take the value out of the entry, so that deleting the entry will
+     * not free it. */
+    val = dictGetVal(de);
+    if (lazyfreeShouldFreeAsync(val)) {
+        lazyfreeCreateJob(lazyfreeGetFreeEffort(val),val,NULL,NULL);
+        dictSetVal(db->dict,de,NULL);
+    }
+    redisAssertWithInfo(NULL,key,
+        dictDeleteWithHash(db->dict,key->ptr,keyHash(key)) == DICT_OK);
+    return 1;
+}
+
+/* Empty a DB, replacing its dictionaries with new ones and freeing the old
+ * ones in the background. Returns the number of keys removed. */
+long long emptyDbAsync(redisDb *db) {
+    long long removed = dictSize(db->dict);
+#ifdef HAVE_ATOMIC
+    dict *oldkeys = db->dict, *oldexpires = db->expires;
+
+    /* The RESP cache references string values of the DB, its entries must
+     * be released by the main thread. */
+    respCacheEmpty();
+
+    db->dict = createKeyspaceDict(&dbDictType);
+    db->expires = createKeyspaceDict(&keyptrDictType);
+    lazyfreeCreateJob(removed,NULL,oldkeys,oldexpires);
+    if (db->expires_index && db->expires_index->length) {
+        lazyfreeCreateJob(db->expires_index->length,NULL,NULL,
+                          db->expires_index);
+        db->expires_index = zslCreate();
+    }
+#else
+    dictEmpty(db->dict);
+    dictEmpty(db->expires);
+    expiresIndexEmpty(db);
+#endif
+    return removed;
+}
+
+/* Called by serverCron(): go back to plain reference counts once the
+ * thread is idle. */
+void lazyfreeCron(void) {
+#ifdef HAVE_ATOMIC
+    if (lazyfree_atomic_refcount &&
+        bioPendingJobsOfType(REDIS_BIO_LAZY_FREE) == 0)
+    {
+        __sync_synchronize();
+        lazyfree_atomic_refcount = 0;
+    }
+#endif
+}
+
+/* Process a REDIS_BIO_LAZY_FREE job in the background thread. The job is
+ * either an object to free (arg1), the dictionaries of a DB (arg2 and
+ * arg3), or the expires index of a DB (arg3 alone). */
+void lazyfreeFreeFromBioThread(void *arg1, void *arg2, void *arg3) {
+#ifdef HAVE_ATOMIC
+    if (arg1) {
+        robj *o = arg1;
+        size_t count = lazyfreeGetFreeEffort(o);
+
+        decrRefCount(o);
+        lazyfreeDecrObjects(count);
+    } else if (arg2) {
+        dict *keys = arg2, *expires = arg3;
+        size_t count = dictSize(keys);
+
+        /* The keys of the expires dict are owned by the main dict. */
+        dictRelease(expires);
+        dictRelease(keys);
+        lazyfreeDecrObjects(count);
+    } else {
+        zskiplist *zsl = arg3;
+        size_t count = zsl->length;
+
+        zslFree(zsl);
+        lazyfreeDecrObjects(count);
+    }
+#else
+    REDIS_NOTUSED(arg1);
+    REDIS_NOTUSED(arg2);
+    REDIS_NOTUSED(arg3);
+#endif
+}
@@ -0,0 +1,811 @@
+/* listpack.c - A compact list of strings and integers, without cascading
+ * updates.
+ *
+ * Copyright (c) 2017, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* The listpack is a serialized list of strings and integers, like the
+ * ziplist, that it replaces for small hashes, sorted sets and the nodes of
+ * quicklists. The layout is:
+ *
+ * <tot-bytes> <num-elements> <element-1> ... <element-N> <end>
+ *
+ * <tot-bytes> is a 32 bit unsigned integer with the size of the whole
+ * listpack, and <num-elements> a 16 bit unsigned integer with the number of
+ * elements, or 65535 if there are more, in which case they are counted when
+ * needed. Both are little endian. <end> is the byte 0xFF.
+ *
+ * Every element is:
+ *
+ * <encoding-type> <element-data> <element-tot-len>
+ *
+ * The encoding type and the data are the same of the ziplist entries,
+ * modulo the exact bits, while <element-tot-len> is the length of the
+ * encoding type plus the data, encoded from right to left in 1 to 5 bytes:
+ * the lower 7 bits of every byte hold the value, the highest bit is set if
+ * there is another byte on the left. So the element before 'p' can be
+ * reached reading the byte at p-1, and so on.
+ *
+ * The ziplist instead stores the length of the previous entry in every
+ * entry: when an entry grows past 253 bytes, the length of the next entry
+ * needs 5 bytes instead of 1, that may make the next entry grow past 253
+ * bytes as well, and so on, possibly reallocating the whole ziplist for
+ * every entry (see __ziplistCascadeUpdate()). Since every listpack element
+ * only stores its own length, inserting, deleting or replacing an element
+ * never touches the other elements.
+ *
+ * Encodings, the first byte of every element:
+ *
+ * 0xxxxxxx                  7 bit unsigned integer.
+ * 10xxxxxx                  string of up to 63 bytes.
+ * 110xxxxx yyyyyyyy         13 bit signed integer.
+ * 1110xxxx yyyyyyyy         string of up to 4095 bytes.
+ * 11110000 <4 bytes len>    string of up to 2^32-1 bytes.
+ * 11110001 <2 bytes>        16 bit signed integer.
+ * 11110010 <3 bytes>        24 bit signed integer.
+ * 11110011 <4 bytes>        32 bit signed integer.
+ * 11110100 <8 bytes>        64 bit signed integer.
+ * 11111111                  end of the listpack.
+ *
+ * Multi byte integers and lengths are little endian, negative integers are
+ * stored in two's complement. */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "listpack.h"
+#include "zmalloc.h"
+#include "ziplist.h"
+#include "util.h"
+
+#define LP_HDR_SIZE 6       /* 32 bit total len + 16 bit number of elements. */
+#define LP_HDR_NUMELE_UNKNOWN UINT16_MAX
+#define LP_EOF 0xFF
+
+#define LP_ENCODING_7BIT_UINT 0
+#define LP_ENCODING_7BIT_UINT_MASK 0x80
+#define LP_ENCODING_IS_7BIT_UINT(byte) \
+    (((byte)&LP_ENCODING_7BIT_UINT_MASK) == LP_ENCODING_7BIT_UINT)
+
+#define LP_ENCODING_6BIT_STR 0x80
+#define LP_ENCODING_6BIT_STR_MASK 0xC0
+#define LP_ENCODING_IS_6BIT_STR(byte) \
+    (((byte)&LP_ENCODING_6BIT_STR_MASK) == LP_ENCODING_6BIT_STR)
+
+#define LP_ENCODING_13BIT_INT 0xC0
+#define LP_ENCODING_13BIT_INT_MASK 0xE0
+#define LP_ENCODING_IS_13BIT_INT(byte) \
+    (((byte)&LP_ENCODING_13BIT_INT_MASK) == LP_ENCODING_13BIT_INT)
+
+#define LP_ENCODING_12BIT_STR 0xE0
+#define LP_ENCODING_12BIT_STR_MASK 0xF0
+#define LP_ENCODING_IS_12BIT_STR(byte) \
+    (((byte)&LP_ENCODING_12BIT_STR_MASK) == LP_ENCODING_12BIT_STR)
+
+#define LP_ENCODING_32BIT_STR 0xF0
+#define LP_ENCODING_16BIT_INT 0xF1
+#define LP_ENCODING_24BIT_INT 0xF2
+#define LP_ENCODING_32BIT_INT 0xF3
+#define LP_ENCODING_64BIT_INT 0xF4
+
+/* Max bytes of the encoding type and data of an integer element. */
+#define LP_MAX_INT_ENCODING_LEN 9
+
+#define lpGetTotalBytes(lp) \
+    ((uint32_t)(lp)[0] | ((uint32_t)(lp)[1] << 8) | \
+     ((uint32_t)(lp)[2] << 16) | ((uint32_t)(lp)[3] << 24))
+#define lpGetNumElements(lp) \
+    ((uint32_t)(lp)[4] | ((uint32_t)(lp)[5] << 8))
+
+static void lpSetTotalBytes(unsigned char *lp, uint32_t v) {
+    lp[0] = v & 0xff;
+    lp[1] = (v >> 8) & 0xff;
+    lp[2] = (v >> 16) & 0xff;
+    lp[3] = (v >> 24) & 0xff;
+}
+
+static void lpSetNumElements(unsigned char *lp, uint32_t v) {
+    if (v > LP_HDR_NUMELE_UNKNOWN) v = LP_HDR_NUMELE_UNKNOWN;
+    lp[4] = v & 0xff;
+    lp[5] = (v >> 8) & 0xff;
+}
+
+/* Add 'delta' to the number of elements in the header, if it is known. */
+static void lpIncrNumElements(unsigned char *lp, long delta) {
+    uint32_t numele = lpGetNumElements(lp);
+
+    if (numele != LP_HDR_NUMELE_UNKNOWN) lpSetNumElements(lp,numele+delta);
+}
+
+/* Create a new empty listpack. */
+unsigned char *lpNew(void) {
+    unsigned char *lp = zmalloc(LP_HDR_SIZE+1);
+
+    lpSetTotalBytes(lp,LP_HDR_SIZE+1);
+    lpSetNumElements(lp,0);
+    lp[LP_HDR_SIZE] = LP_EOF;
+    return lp;
+}
+
+/* If 's' is the canonical representation of an integer, encode the integer
+ * in 'intenc' and return 1, otherwise return 0. In both cases '*enclen' is
+ * set to the length of the encoding type plus the data. */
+static int lpEncodeGetType(unsigned char *s, unsigned int slen,
+                           unsigned char *intenc, uint64_t *enclen) {
+    long long v;
+
+    if (slen > 20 || !string2ll((char*)s,slen,&v)) {
+        if (slen < 64) *enclen = 1+slen;
+        else if (slen < 4096) *enclen = 2+slen;
+        else *enclen = 5+(uint64_t)slen;
+        return 0;
+    }
+
+    if (v >= 0 && v <= 127) {
+        intenc[0] = v;
+        *enclen = 1;
+    } else if (v >= -4096 && v <= 4095) {
+        if (v < 0) v = ((int64_t)1<<13)+v;
+        intenc[0] = (v>>8)|LP_ENCODING_13BIT_INT;
+        intenc[1] = v&0xff;
+        *enclen = 2;
+    } else if (v >= -32768 && v <= 32767) {
+        if (v < 0) v = ((int64_t)1<<16)+v;
+        intenc[0] = LP_ENCODING_16BIT_INT;
+        intenc[1] = v&0xff;
+        intenc[2] = v>>8;
+        *enclen = 3;
+    } else if (v >= -8388608 && v <= 8388607) {
+        if (v < 0) v = ((int64_t)1<<24)+v;
+        intenc[0] = LP_ENCODING_24BIT_INT;
+        intenc[1] = v&0xff;
+        intenc[2] = (v>>8)&0xff;
+        intenc[3] = v>>16;
+        *enclen = 4;
+    } else if (v >= -2147483648LL && v <= 2147483647LL) {
+        if (v < 0) v = ((int64_t)1<<32)+v;
+        intenc[0] = LP_ENCODING_32BIT_INT;
+        intenc[1] = v&0xff;
+        intenc[2] = (v>>8)&0xff;
+        intenc[3] = (v>>16)&0xff;
+        intenc[4] = v>>24;
+        *enclen = 5;
+    } else {
+        uint64_t uv = v;
+        int j;
+
+        intenc[0] = LP_ENCODING_64BIT_INT;
+        for (j = 1; j <= 8; j++) {
+            intenc[j] = uv&0xff;
+            uv >>= 8;
+        }
+        *enclen = 9;
+    }
+    return 1;
+}
+
+/* Write the encoding type and the data of the string 's' at 'buf'. */
+static void lpEncodeString(unsigned char *buf, unsigned char *s,
+                           uint32_t len) {
+    if (len < 64) {
+        buf[0] = len|LP_ENCODING_6BIT_STR;
+        memcpy(buf+1,s,len);
+    } else if (len < 4096) {
+        buf[0] = (len>>8)|LP_ENCODING_12BIT_STR;
+        buf[1] = len&0xff;
+        memcpy(buf+2,s,len);
+    } else {
+        buf[0] = LP_ENCODING_32BIT_STR;
+        buf[1] = len&0xff;
+        buf[2] = (len>>8)&0xff;
+        buf[3] = (len>>16)&0xff;
+        buf[4] = (len>>24)&0xff;
+        memcpy(buf+5,s,len);
+    }
+}
+
+/* Encode the element length 'l' in 'buf', if not NULL, so that it can be
+ * read from right to left. Returns the number of bytes used, 1 to 5. */
+static unsigned long lpEncodeBacklen(unsigned char *buf, uint64_t l) {
+    unsigned long len, j;
+
+    if (l <= 127) len = 1;
+    else if (l < 16383) len = 2;
+    else if (l < 2097151) len = 3;
+    else if (l < 268435455) len = 4;
+    else len = 5;
+
+    if (buf) {
+        /* The rightmost byte holds the lower 7 bits, every byte on its left
+         * the next 7 bits. All the bytes but the leftmost have the high bit
+         * set, meaning that there is more on the left. */
+        for (j = len; j > 0; j--) {
+            buf[j-1] = l&127;
+            if (j != 1) buf[j-1] |= 128;
+            l >>= 7;
+        }
+    }
+    return len;
+}
+
+/* Decode the element length written by lpEncodeBacklen(), reading from 'p',
+ * the last byte of the element, to the left. */
+static uint64_t lpDecodeBacklen(unsigned char *p) {
+    uint64_t val = 0;
+    uint64_t shift = 0;
+
+    do {
+        val |= (uint64_t)(p[0]&127) << shift;
+        if (!(p[0]&128)) break;
+        shift += 7;
+        p--;
+    } while (shift <= 28);
+    return val;
+}
+
+/* Return the length of the encoding type plus the data of the element 'p'. */
+static uint32_t lpCurrentEncodedSize(unsigned char *p) {
+    if (LP_ENCODING_IS_7BIT_UINT(p[0])) return 1;
+    if (LP_ENCODING_IS_6BIT_STR(p[0])) return 1+(p[0]&0x3f);
+    if (LP_ENCODING_IS_13BIT_INT(p[0])) return 2;
+    if (LP_ENCODING_IS_12BIT_STR(p[0])) return 2+(((p[0]&0xf)<<8)|p[1]);
+    switch(p[0]) {
+    case LP_ENCODING_16BIT_INT: return 3;
+    case LP_ENCODING_24BIT_INT: return 4;
+    case LP_ENCODING_32BIT_INT: return 5;
+    case LP_ENCODING_64BIT_INT: return 9;
+    case LP_ENCODING_32BIT_STR:
+        return 5+((uint32_t)p[1] | ((uint32_t)p[2] << 8) |
+                  ((uint32_t)p[3] << 16) | ((uint32_t)p[4] << 24));
+    case LP_EOF: return 1;
+    }
+    return 0;
+}
+
+/* Return the element after 'p', or the end of the listpack. */
+static unsigned char *lpSkip(unsigned char *p) {
+    uint32_t entrylen = lpCurrentEncodedSize(p);
+
+    entrylen += lpEncodeBacklen(NULL,entrylen);
+    return p+entrylen;
+}
+
+/* Return the first element of the listpack, or NULL if it is empty. */
+unsigned char *lpFirst(unsigned char *lp) {
+    unsigned char *p = lp+LP_HDR_SIZE;
+
+    return (p[0] == LP_EOF) ? NULL : p;
+}
+
+/* Return the element after 'p', or NULL if 'p' is the last one. */
+unsigned char *lpNext(unsigned char *lp, unsigned char *p) {
+    ((void) lp);
+    if (p[0] == LP_EOF) return NULL;
+    p = lpSkip(p);
+    return (p[0] == LP_EOF) ? NULL : p;
+}
+
+/* Return the element before 'p', or NULL if 'p' is the first one. 'p' may
+ * be the end of the listpack, to get the last element. */
+unsigned char *lpPrev(unsigned char *lp, unsigned char *p) {
+    uint64_t prevlen;
+
+    if (p-lp == LP_HDR_SIZE) return NULL;
+    p--;
+    prevlen = lpDecodeBacklen(p);
+    prevlen += lpEncodeBacklen(NULL,prevlen);
+    return p-prevlen+1;
+}
+
+/* Return the last element of the listpack, or NULL if it is empty. */
+unsigned char *lpLast(unsigned char *lp) {
+    return lpPrev(lp,lp+lpGetTotalBytes(lp)-1);
+}
+
+/* Return the number of elements of the listpack. */
+unsigned long lpLength(unsigned char *lp) {
+    uint32_t numele = lpGetNumElements(lp);
+    unsigned long count = 0;
+    unsigned char *p;
+
+    if (numele != LP_HDR_NUMELE_UNKNOWN) return numele;
+
+    /* Too many elements for the header: count them, and store the count
+     * if it fits after some deletion. */
+    p = lpFirst(lp);
+    while (p) {
+        count++;
+        p = lpNext(lp,p);
+    }
+    if (count < LP_HDR_NUMELE_UNKNOWN) lpSetNumElements(lp,count);
+    return count;
+}
+
+/* Return the size of the listpack in bytes. */
+size_t lpBytes(unsigned char *lp) {
+    return lpGetTotalBytes(lp);
+}
+
+/* Get the element 'p', like ziplistGet(): a string is returned in '*sval'
+ * and '*slen', an integer in '*lval', with '*sval' set to NULL.
+ *
+ * Returns 0 if 'p' is NULL or the end of the listpack, 1 otherwise. */
+unsigned int lpGet(unsigned char *p, unsigned char **sval, unsigned int *slen,
+                   long long *lval) {
+    uint64_t uval, negstart, negmax;
+    int64_t val;
+
+    if (p == NULL || p[0] == LP_EOF) return 0;
+    if (sval) *sval = NULL;
+
+    if (LP_ENCODING_IS_7BIT_UINT(p[0])) {
+        uval = p[0]&0x7f;
+        negstart = UINT64_MAX;  /* Always positive. */
+        negmax = 0;
+    } else if (LP_ENCODING_IS_6BIT_STR(p[0])) {
+        *slen = p[0]&0x3f;
+        *sval = p+1;
+        return 1;
+    } else if (LP_ENCODING_IS_13BIT_INT(p[0])) {
+        uval = ((uint64_t)(p[0]&0x1f) << 8) | p[1];
+        negstart = (uint64_t)1<<12;
+        negmax = 8191;
+    } else if (LP_ENCODING_IS_12BIT_STR(p[0])) {
+        *slen = ((p[0]&0xf)<<8) | p[1];
+        *sval = p+2;
+        return 1;
+    } else if (p[0] == LP_ENCODING_16BIT_INT) {
+        uval = (uint64_t)p[1] | ((uint64_t)p[2] << 8);
+        negstart = (uint64_t)1<<15;
+        negmax = UINT16_MAX;
+    } else if (p[0] == LP_ENCODING_24BIT_INT) {
+        uval = (uint64_t)p[1] | ((uint64_t)p[2] << 8) | ((uint64_t)p[3] << 16);
+        negstart = (uint64_t)1<<23;
+        negmax = UINT32_MAX>>8;
+    } else if (p[0] == LP_ENCODING_32BIT_INT) {
+        uval = (uint64_t)p[1] | ((uint64_t)p[2] << 8) |
+               ((uint64_t)p[3] << 16) | ((uint64_t)p[4] << 24);
+        negstart = (uint64_t)1<<31;
+        negmax = UINT32_MAX;
+    } else if (p[0] == LP_ENCODING_64BIT_INT) {
+        int j;
+
+        uval = 0;
+        for (j = 8; j >= 1; j--) uval = (uval << 8) | p[j];
+        negstart = (uint64_t)1<<63;
+        negmax = UINT64_MAX;
+    } else if (p[0] == LP_ENCODING_32BIT_STR) {
+        *slen = (uint32_t)p[1] | ((uint32_t)p[2] << 8) |
+                ((uint32_t)p[3] << 16) | ((uint32_t)p[4] << 24);
+        *sval = p+5;
+        return 1;
+    } else {
+        return 0;
+    }
+
+    /* Values from 'negstart' up are negative, in two's complement. */
+    if (uval >= negstart) {
+        uval = negmax-uval;
+        val = uval;
+        val = -val-1;
+    } else {
+        val = uval;
+    }
+    if (lval) *lval = val;
+    return 1;
+}
+
+/* Write the element 's' at 'p', that has room for it: 'intenc' and 'enclen'
+ * are the output of lpEncodeGetType(). */
+static void lpWriteElement(unsigned char *p, int isint, unsigned char *intenc,
+                           uint64_t enclen, unsigned char *s,
+                           unsigned int slen) {
+    if (isint) {
+        memcpy(p,intenc,enclen);
+    } else {
+        lpEncodeString(p,s,slen);
+    }
+    lpEncodeBacklen(p+enclen,enclen);
+}
+
+/* Insert the string 's' before the element 'p', that may be the end of the
+ * listpack to append it. Strings that are integers are stored as integers.
+ * Returns the new listpack: all the pointers to the old one are invalid. */
+unsigned char *lpInsert(unsigned char *lp, unsigned char *p, unsigned char *s,
+                        unsigned int slen) {
+    unsigned char intenc[LP_MAX_INT_ENCODING_LEN];
+    uint64_t enclen, entrylen;
+    uint32_t old_bytes = lpGetTotalBytes(lp);
+    unsigned long poff = p-lp;
+    int isint;
+
+    isint = lpEncodeGetType(s,slen,intenc,&enclen);
+    entrylen = enclen+lpEncodeBacklen(NULL,enclen);
+
+    lp = zrealloc(lp,old_bytes+entrylen);
+    p = lp+poff;
+    memmove(p+entrylen,p,old_bytes-poff);
+    lpWriteElement(p,isint,intenc,enclen,s,slen);
+
+    lpSetTotalBytes(lp,old_bytes+entrylen);
+    lpIncrNumElements(lp,1);
+    return lp;
+}
+
+/* Add 's' at the head or at the tail of the listpack. */
+unsigned char *lpPush(unsigned char *lp, unsigned char *s, unsigned int slen,
+                      int where) {
+    unsigned char *p;
+
+    if (where == LP_HEAD)
+        p = lp+LP_HDR_SIZE;
+    else
+        p = lp+lpGetTotalBytes(lp)-1;
+    return lpInsert(lp,p,s,slen);
+}
+
+/* Replace the element '*p' with the string 's'. If the old and the new
+ * elements have the same size it is done in place, otherwise only the
+ * elements after '*p' are moved. '*p' is updated to the new element. */
+unsigned char *lpReplace(unsigned char *lp, unsigned char **p, unsigned char *s,
+                         unsigned int slen) {
+    unsigned char intenc[LP_MAX_INT_ENCODING_LEN];
+    uint64_t enclen, entrylen;
+    uint32_t old_bytes = lpGetTotalBytes(lp);
+    unsigned long poff = *p-lp;
+    unsigned long oldlen = lpSkip(*p)-*p;
+    unsigned long tail;
+    int isint;
+
+    isint = lpEncodeGetType(s,slen,intenc,&enclen);
+    entrylen = enclen+lpEncodeBacklen(NULL,enclen);
+    tail = old_bytes-poff-oldlen;
+
+    if (entrylen > oldlen) {
+        lp = zrealloc(lp,old_bytes-oldlen+entrylen);
+        memmove(lp+poff+entrylen,lp+poff+oldlen,tail);
+    } else if (entrylen < oldlen) {
+        memmove(lp+poff+entrylen,lp+poff+oldlen,tail);
+        lp = zrealloc(lp,old_bytes-oldlen+entrylen);
+    }
+    *p = lp+poff;
+    lpWriteElement(*p,isint,intenc,enclen,s,slen);
+    lpSetTotalBytes(lp,old_bytes-oldlen+entrylen);
+    return lp;
+}
+
+/* Delete the element '*p'. '*p' is updated to the element that followed
+ * it, that may be the end of the listpack, to delete while iterating. */
+unsigned char *lpDelete(unsigned char *lp, unsigned char **p) {
+    uint32_t old_bytes = lpGetTotalBytes(lp);
+    unsigned long poff = *p-lp;
+    unsigned long len = lpSkip(*p)-*p;
+
+    memmove(*p,*p+len,old_bytes-poff-len);
+    lp = zrealloc(lp,old_bytes-len);
+    lpSetTotalBytes(lp,old_bytes-len);
+    lpIncrNumElements(lp,-1);
+    *p = lp+poff;
+    return lp;
+}
+
+/* Delete up to 'num' elements starting at the element '*p'. Like for
+ * lpDelete(), '*p' is updated to the element that followed the deleted
+ * ones, that may be the end of the listpack. */
+unsigned char *lpDeleteRangeWithEntry(unsigned char *lp, unsigned char **p,
+                                      unsigned long num) {
+    uint32_t old_bytes = lpGetTotalBytes(lp);
+    unsigned long poff = *p-lp;
+    unsigned char *tail = *p;
+    unsigned long deleted = 0, len;
+
+    while (deleted < num && tail[0] != LP_EOF) {
+        tail = lpSkip(tail);
+        deleted++;
+    }
+    if (deleted == 0) return lp;
+    len = tail-*p;
+    memmove(*p,tail,old_bytes-(tail-lp));
+    lp = zrealloc(lp,old_bytes-len);
+    lpSetTotalBytes(lp,old_bytes-len);
+    lpIncrNumElements(lp,-(long)deleted);
+    *p = lp+poff;
+    return lp;
+}
+
+/* Delete 'num' elements starting at the element at 'index', that may be
+ * negative to count from the tail. */
+unsigned char *lpDeleteRange(unsigned char *lp, long index,
+                             unsigned long num) {
+    unsigned char *first;
+
+    if (num == 0 || (first = lpSeek(lp,index)) == NULL) return lp;
+    return lpDeleteRangeWithEntry(lp,&first,num);
+}
+
+/* Append the elements of 'second' to 'first', that is returned, while
+ * 'second' is left untouched. Since the elements do not refer to the ones
+ * before them, this is a single copy of their bytes. */
+unsigned char *lpMerge(unsigned char *first, unsigned char *second) {
+    uint32_t first_bytes = lpGetTotalBytes(first);
+    uint32_t second_bytes = lpGetTotalBytes(second);
+    uint32_t first_numele = lpGetNumElements(first);
+    uint32_t second_numele = lpGetNumElements(second);
+    uint32_t tot_bytes = first_bytes+second_bytes-LP_HDR_SIZE-1;
+
+    first = zrealloc(first,tot_bytes);
+    memcpy(first+first_bytes-1,second+LP_HDR_SIZE,second_bytes-LP_HDR_SIZE);
+    lpSetTotalBytes(first,tot_bytes);
+    if (first_numele == LP_HDR_NUMELE_UNKNOWN ||
+        second_numele == LP_HDR_NUMELE_UNKNOWN)
+        lpSetNumElements(first,LP_HDR_NUMELE_UNKNOWN);
+    else
+        lpSetNumElements(first,first_numele+second_numele);
+    return first;
+}
+
+/* Return the element at 'index', where 0 is the head and -1 the tail, or
+ * NULL if out of range. The list is walked from the nearest end. */
+unsigned char *lpSeek(unsigned char *lp, long index) {
+    long numele = lpLength(lp);
+    unsigned char *p;
+
+    if (index < 0) index += numele;
+    if (index < 0 || index >= numele) return NULL;
+
+    if (index <= numele/2) {
+        p = lpFirst(lp);
+        while (index-- > 0) p = lpNext(lp,p);
+    } else {
+        index = numele-1-index;
+        p = lpLast(lp);
+        while (index-- > 0) p = lpPrev(lp,p);
+    }
+    return p;
+}
+
+/* Return 1 if the element 'p' is equal to the string 's', 0 otherwise. */
+unsigned int lpCompare(unsigned char *p, unsigned char *s, unsigned int slen) {
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long vll, sll;
+
+    if (!lpGet(p,&vstr,&vlen,&vll)) return 0;
+    if (vstr) return vlen == slen && memcmp(vstr,s,slen) == 0;
+
+    /* Integer elements are equal only to the canonical string of the
+     * integer, since other strings are not stored as integers. */
+    if (slen > 20 || !string2ll((char*)s,slen,&sll)) return 0;
+    return vll == sll;
+}
+
+/* Find the element equal to 's' starting from 'p', comparing only one
+ * element every 'skip'+1, like ziplistFind(). Returns NULL if not found. */
+unsigned char *lpFind(unsigned char *lp, unsigned char *p, unsigned char *s,
+                      unsigned int slen, unsigned int skip) {
+    unsigned int skipcnt = 0;
+    int sisint = -1;    /* Unknown until the first integer element. */
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long vll, sll = 0;
+
+    while (p) {
+        if (skipcnt == 0) {
+            lpGet(p,&vstr,&vlen,&vll);
+            if (vstr) {
+                if (vlen == slen && memcmp(vstr,s,slen) == 0) return p;
+            } else {
+                if (sisint == -1)
+                    sisint = slen <= 20 && string2ll((char*)s,slen,&sll);
+                if (sisint && vll == sll) return p;
+            }
+            skipcnt = skip;
+        } else {
+            skipcnt--;
+        }
+        p = lpNext(lp,p);
+    }
+    return NULL;
+}
+
+/* Return a listpack with the same elements of the ziplist 'zl', that is
+ * not freed. Used to convert the ziplists of old RDB files. */
+unsigned char *lpFromZiplist(unsigned char *zl) {
+    unsigned char *lp = lpNew();
+    unsigned char *p = ziplistIndex(zl,0);
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long vlong;
+    char buf[32];
+
+    while (p != NULL) {
+        ziplistGet(p,&vstr,&vlen,&vlong);
+        if (vstr == NULL) {
+            vlen = ll2string(buf,sizeof(buf),vlong);
+            vstr = (unsigned char*)buf;
+        }
+        lp = lpPush(lp,vstr,vlen,LP_TAIL);
+        p = ziplistNext(zl,p);
+    }
+    return lp;
+}
+
+#ifdef LISTPACK_TEST_MAIN
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+/* Check the listpack against an array of strings. */
+static void verify(unsigned char *lp, char **ele, long len) {
+    unsigned char *p, *vstr;
+    unsigned int vlen;
+    long long vll;
+    char buf[32];
+    long j;
+
+    assert(lpLength(lp) == (unsigned long)len);
+    p = lpFirst(lp);
+    for (j = 0; j < len; j++) {
+        assert(lpGet(p,&vstr,&vlen,&vll));
+        if (!vstr) {
+            vlen = ll2string(buf,sizeof(buf),vll);
+            vstr = (unsigned char*)buf;
+        }
+        assert(vlen == strlen(ele[j]) && !memcmp(vstr,ele[j],vlen));
+        assert(lpCompare(p,(unsigned char*)ele[j],strlen(ele[j])));
+        assert(lpSeek(lp,j) == p && lpSeek(lp,j-len) == p);
+        p = lpNext(lp,p);
+    }
+    assert(p == NULL);
+    p = lpLast(lp);
+    for (j = len-1; j >= 0; j--) {
+        assert(lpCompare(p,(unsigned char*)ele[j],strlen(ele[j])));
+        p = lpPrev(lp,p);
+    }
+    assert(p == NULL);
+}
+
+static char *randomElement(void) {
+    static char buf[70000];
+    long long v;
+    int len, j;
+
+    switch(rand() % 4) {
+    case 0:
+        /* Integers of every width, positive and negative. */
+        v = ((long long)rand() << 32 | rand()) >> (rand() % 63);
+        if (rand() % 2) v = -v;
+        ll2string(buf,sizeof(buf),v);
+        return strdup(buf);
+    case 1: len = rand() % 64; break;
+    case 2: len = rand() % 5000; break;
+    default: len = rand() % 3 ? rand() % 300 : rand() % 70000; break;
+    }
+    for (j = 0; j < len; j++) buf[j] = 'a'+rand()%26;
+    buf[len] = '\0';
+    return strdup(buf);
+}
+
+int main(void) {
+    int iter, op, j;
+
+    srand(1234);
+
+    /* More elements than the header can count. */
+    {
+        unsigned char *lp = lpNew();
+        char buf[32];
+
+        for (j = 0; j < 70000; j++) {
+            int len = ll2string(buf,sizeof(buf),j);
+            lp = lpPush(lp,(unsigned char*)buf,len,LP_TAIL);
+        }
+        assert(lpLength(lp) == 70000);
+        assert(lpCompare(lpSeek(lp,69999),(unsigned char*)"69999",5));
+        lp = lpDeleteRange(lp,0,10000);
+        assert(lpLength(lp) == 60000);
+        assert(lpCompare(lpFirst(lp),(unsigned char*)"10000",5));
+        zfree(lp);
+    }
+
+    for (iter = 0; iter < 100; iter++) {
+        unsigned char *lp = lpNew();
+        char *ele[2000];
+        long len = 0, idx;
+
+        for (op = 0; op < 1000; op++) {
+            char *e = randomElement();
+            unsigned char *p;
+
+            switch(rand() % 5) {
+            case 0:
+            case 1:
+                /* Insert at a random position, tail included. */
+                idx = rand() % (len+1);
+                p = (idx == len) ? lp+lpBytes(lp)-1 : lpSeek(lp,idx);
+                lp = lpInsert(lp,p,(unsigned char*)e,strlen(e));
+                memmove(ele+idx+1,ele+idx,sizeof(char*)*(len-idx));
+                ele[idx] = e;
+                len++;
+                break;
+            case 2:
+                if (len == 0) { free(e); break; }
+                idx = rand() % len;
+                p = lpSeek(lp,idx);
+                lp = lpReplace(lp,&p,(unsigned char*)e,strlen(e));
+                assert(lpCompare(p,(unsigned char*)e,strlen(e)));
+                free(ele[idx]);
+                ele[idx] = e;
+                break;
+            case 3:
+                free(e);
+                if (len == 0) break;
+                idx = rand() % len;
+                p = lpSeek(lp,idx);
+                lp = lpDelete(lp,&p);
+                free(ele[idx]);
+                memmove(ele+idx,ele+idx+1,sizeof(char*)*(len-idx-1));
+                len--;
+                break;
+            case 4:
+                free(e);
+                if (len == 0) break;
+                idx = rand() % len;
+                j = rand() % 4;
+                if (rand() % 2) {
+                    lp = lpDeleteRange(lp,idx,j);
+                } else {
+                    p = lpSeek(lp,idx);
+                    lp = lpDeleteRangeWithEntry(lp,&p,j);
+                    assert(p == lpSeek(lp,idx) ||
+                           (p[0] == LP_EOF && (unsigned long)idx == lpLength(lp)));
+                }
+                if (j > len-idx) j = len-idx;
+                while (j--) {
+                    free(ele[idx]);
+                    memmove(ele+idx,ele+idx+1,sizeof(char*)*(len-idx-1));
+                    len--;
+                }
+                break;
+            }
+            if (len >= 1900) break;
+        }
+        verify(lp,ele,len);
+        for (idx = 0; idx < len; idx++) {
+            unsigned char *p = lpFind(lp,lpFirst(lp),(unsigned char*)ele[idx],
+                                      strlen(ele[idx]),0);
+            assert(p && lpCompare(p,(unsigned char*)ele[idx],
+                                  strlen(ele[idx])));
+            free(ele[idx]);
+        }
+        zfree(lp);
+    }
+    printf("listpack: all tests passed\n");
+    return 0;
+}
+#endif
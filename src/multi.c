@@ -103,6 +103,25 @@ void discardCommand(redisClient *c) {
     addReply(c,shared.ok);
 }
 
+/* Prefetch the keys of the read only commands of the transaction starting
+ * from the command 'first', up to DICT_PREFETCH_BATCH commands or keys. */
+static void execPrefetchKeys(redisClient *c, int first) {
+    robj *keys[DICT_PREFETCH_BATCH];
+    int j, i, n = 0;
+
+    for (j = first; j < c->mstate.count && j < first+DICT_PREFETCH_BATCH;
+         j++)
+    {
+        multiCmd *mc = c->mstate.commands+j;
+
+        for (i = 1; i < mc->argc && n < DICT_PREFETCH_BATCH; i++) {
+            if (isPrefetchableKeyArg(mc->cmd,mc->argc,i))
+                keys[n++] = mc->argv[i];
+        }
+    }
+    if (n > 1) dbPrefetchKeys(c->db,keys,n);
+}
+
 /* Send a MULTI command to all the slaves and AOF file. Check the execCommand
  * implementation for more information. */
 void execCommandPropagateMulti(redisClient *c) {
@@ -117,7 +136,7 @@ void execCommand(redisClient *c) {
     int j;
     //ڱִĲͲĸ
     robj **orig_argv;
-    int orig_argc;
+    int orig_argc, orig_argv_len;
     struct redisCommand *orig_cmd;
     int must_propagate = 0; /* Need to propagate MULTI/EXEC to AOF / slaves? */
 
@@ -151,9 +170,11 @@ void execCommand(redisClient *c) {
     // ԭʼ
     orig_argv = c->argv;
     orig_argc = c->argc;
+    orig_argv_len = c->argv_len;
     orig_cmd = c->cmd;
     addReplyMultiBulkLen(c,c->mstate.count);
     for (j = 0; j < c->mstate.count; j++) {
+        if (j % DICT_PREFETCH_BATCH == 0) execPrefetchKeys(c,j);
         // Ϊ call ޸Ҫ͸ͬڵ
         // ｫҪִеȱ
         c->argc = c->mstate.commands[j].argc;
@@ -179,6 +200,7 @@ void execCommand(redisClient *c) {
     }
     c->argv = orig_argv;
     c->argc = orig_argc;
+    c->argv_len = orig_argv_len;
     c->cmd = orig_cmd;
     discardTransaction(c);
     /* Make sure the EXEC command will be propagated as well if MULTI
@@ -219,7 +241,9 @@ void watchForKey(redisClient *c, robj *key) {
     list *clients = NULL;
     listIter li;
     listNode *ln;
+    dictEntry *de;
     watchedKey *wk;
+    unsigned int h;
 
     /* Check if we are already watching for this key */
     //жkeyǷѾ
@@ -231,10 +255,14 @@ void watchForKey(redisClient *c, robj *key) {
     }
     /* This key is not already watched in this DB. Let's add it */
     //keyǷڵǰݿд
-    clients = dictFetchValue(c->db->watched_keys,key);
-    if (!clients) {
+    h = keyHash(key);
+    de = dictFindWithHash(c->db->watched_keys,key,h);
+    if (de) {
+        clients = dictGetVal(de);
+    } else {
         clients = listCreate();
-        dictAdd(c->db->watched_keys,key,clients);
+        de = dictAddRawWithHash(c->db->watched_keys,key,h);
+        dictSetVal(c->db->watched_keys,de,clients);
         incrRefCount(key);
     }
     listAddNodeTail(clients,c);
@@ -287,11 +315,13 @@ void touchWatchedKey(redisDb *db, robj *key) {
     list *clients;
     listIter li;
     listNode *ln;
+    dictEntry *de;
 
     if (dictSize(db->watched_keys) == 0) return;
     // ȡݿмӸ key Ŀͻ
-    clients = dictFetchValue(db->watched_keys, key);
-    if (!clients) return;
+    de = dictFindWithHash(db->watched_keys,key,keyHash(key));
+    if (!de) return;
+    clients = dictGetVal(de);
 
     /* Mark all the clients watching this key as REDIS_DIRTY_CAS */
     /* Check if we are already watching for this key */
@@ -31,7 +31,15 @@
 #include <sys/uio.h>
 #include <math.h>
 
+/* Max number of buffers gathered by a single writev() call. */
+#if defined(IOV_MAX) && IOV_MAX < 128
+#define REDIS_WRITEV_IOV_MAX IOV_MAX
+#else
+#define REDIS_WRITEV_IOV_MAX 128
+#endif
+
 static void setProtocolError(redisClient *c, int pos);
+static int clientInstallWriteHandler(redisClient *c);
 
 /* To evaluate the output buffer size of a client we need to get size of
  * allocated objects, however we can't used zmalloc_size() directly on sds
@@ -46,6 +54,129 @@ void *dupClientReplyValue(void *o) {
     return o;
 }
 
+/* -----------------------------------------------------------------------------
+ * Reply chunks pool.
+ *
+ * When the static output buffer of a client is full, the reply is
+ * accumulated in a list of objects, every object holding up to
+ * REDIS_REPLY_CHUNK_BYTES bytes. Allocating these objects with the exact
+ * size of the first reply, and growing them with realloc() as more data is
+ * appended, creates a lot of allocator churn (and fragmentation) when many
+ * clients receive big replies. So the list nodes are instead created
+ * using chunks able to hold REDIS_REPLY_CHUNK_BYTES bytes from the start,
+ * and when the chunks are no longer needed they are returned to a pool
+ * shared by all the clients, up to REDIS_REPLY_CHUNK_POOL_MAX chunks.
+ *
+ * Only the nodes expected to fill a chunk are created this way, that is,
+ * nodes receiving a big payload or appended after a full node. A small
+ * reply spilling out of the static buffer still gets a right-sized node,
+ * otherwise it would pin a whole chunk, counted against the client output
+ * buffer limits.
+ *
+ * The pool is shrunk by serverCron() when chunks are not used, and
+ * emptied when we are over the maxmemory limit. It is only accessed by
+ * the main thread: the I/O threads may also create and free reply nodes
+ * (for instance replying to a protocol error), and in this case they
+ * just bypass the pool.
+ * -------------------------------------------------------------------------- */
+
+/* Return true if called by the main thread, the only one allowed to
+ * access the pool. */
+static int canUseReplyChunkPool(void) {
+    return pthread_equal(pthread_self(),server.main_thread_id);
+}
+
+/* Return true if the sds string is a reply chunk, that is, it has room
+ * for exactly REDIS_REPLY_CHUNK_BYTES bytes. */
+static int isReplyChunk(sds s) {
+    return sdslen(s)+sdsavail(s) == REDIS_REPLY_CHUNK_BYTES;
+}
+
+/* Get an empty reply chunk from the pool, or allocate a new one. */
+static sds getReplyChunk(void) {
+    sds s;
+
+    if (server.reply_chunk_pool_len) {
+        server.stat_reply_chunk_hits++;
+        s = server.reply_chunk_pool[--server.reply_chunk_pool_len];
+        if (server.reply_chunk_pool_len < server.reply_chunk_pool_min)
+            server.reply_chunk_pool_min = server.reply_chunk_pool_len;
+        return s;
+    }
+    server.stat_reply_chunk_misses++;
+    s = sdsnewlen(NULL,REDIS_REPLY_CHUNK_BYTES);
+    sdsclear(s);
+    return s;
+}
+
+/* Return a chunk to the pool, or free it if the pool is full. */
+static void releaseReplyChunk(sds s) {
+    if (server.reply_chunk_pool_len == REDIS_REPLY_CHUNK_POOL_MAX) {
+        sdsfree(s);
+        return;
+    }
+    sdsclear(s);
+    server.reply_chunk_pool[server.reply_chunk_pool_len++] = s;
+}
+
+/* Create a reply list object holding a copy of 's', that must not be
+ * longer than REDIS_REPLY_CHUNK_BYTES, in a pooled chunk. Outside the
+ * main thread a plain object is created instead. */
+static robj *createReplyChunkObject(char *s, size_t len) {
+    sds chunk;
+
+    if (!canUseReplyChunkPool()) return createRawStringObject(s,len);
+    chunk = getReplyChunk();
+    chunk = sdscatlen(chunk,s,len);
+    return createObject(REDIS_STRING,chunk);
+}
+
+/* Free method of the reply list: when the list is the only owner of the
+ * object, a chunk sds is returned to the pool instead of being freed. */
+void freeClientReplyValue(void *o) {
+    robj *obj = o;
+
+    if (obj->refcount == 1 && obj->encoding == REDIS_ENCODING_RAW &&
+        obj->ptr != NULL && isReplyChunk(obj->ptr) &&
+        canUseReplyChunkPool())
+    {
+        releaseReplyChunk(obj->ptr);
+        obj->ptr = NULL;
+    }
+    decrRefCount(obj);
+}
+
+/* Free half of the chunks that were not used since the last call, so
+ * that the memory held by the pool follows the actual need. Called by
+ * serverCron() every second. */
+void shrinkReplyChunkPool(void) {
+    int tofree = (server.reply_chunk_pool_min+1)/2;
+
+    while(tofree--)
+        sdsfree(server.reply_chunk_pool[--server.reply_chunk_pool_len]);
+    server.reply_chunk_pool_min = server.reply_chunk_pool_len;
+}
+
+/* Free all the chunks in the pool. Returns the number of bytes freed. */
+size_t emptyReplyChunkPool(void) {
+    size_t freed = 0;
+
+    while(server.reply_chunk_pool_len) {
+        sds s = server.reply_chunk_pool[--server.reply_chunk_pool_len];
+
+        freed += zmalloc_size_sds(s);
+        sdsfree(s);
+    }
+    server.reply_chunk_pool_min = 0;
+    return freed;
+}
+
+/* Memory used by the chunks in the pool. */
+size_t replyChunkPoolMemory(void) {
+    return server.reply_chunk_pool_len ?
+        server.reply_chunk_pool_len*zmalloc_size_sds(server.reply_chunk_pool[0]) : 0;
+}
+
 int listMatchObjects(void *a, void *b) {
     return equalStringObjects(a,b);
 }
@@ -69,8 +200,9 @@ redisClient *createClient(int fd) {
          fd == -1 ʱĿͻΪαն
      */
     if (fd != -1) {
-        //socket
-        anetNonBlock(NULL,fd);//
+        /* The socket is expected to be already in non blocking mode:
+         * accepted sockets are created this way by anetGenericAccept(),
+         * and the link with the master uses a non blocking connect. */
         anetEnableTcpNoDelay(NULL,fd);//no delay
         if (server.tcpkeepalive)
             anetKeepAlive(NULL,fd,server.tcpkeepalive);//keep alive
@@ -95,6 +227,8 @@ redisClient *createClient(int fd) {
     c->argc = 0;//
     c->argv = NULL;//
     c->cmd = c->lastcmd = NULL;//ָ
+    c->argv_len = 0;
+    c->argv_pool_len = 0;
     c->multibulklen = 0;
     c->bulklen = -1;
     c->sentlen = 0;
@@ -108,8 +242,9 @@ redisClient *createClient(int fd) {
     c->slave_listening_port = 0;
     c->reply = listCreate();
     c->reply_bytes = 0;
+    c->io_written = 0;
     c->obuf_soft_limit_reached_time = 0;
-    listSetFreeMethod(c->reply,decrRefCountVoid);
+    listSetFreeMethod(c->reply,freeClientReplyValue);
     listSetDupMethod(c->reply,dupClientReplyValue);
     c->bpop.keys = dictCreate(&setDictType,NULL);
     c->bpop.timeout = 0;
@@ -140,7 +275,12 @@ redisClient *createClient(int fd) {
  *
  * Typically gets called every time a reply is built, before adding more
  * data to the clients output buffers. If the function returns REDIS_ERR no
- * data should be appended to the output buffers. */
+ * data should be appended to the output buffers.
+ *
+ * Note that while an I/O thread is reading from the client (the
+ * REDIS_PENDING_READ flag is set) nothing is installed: the thread may only
+ * emit protocol errors, and the main thread takes care of the output once
+ * the threaded read is completed. */
 int prepareClientToWrite(redisClient *c) {
     if (c->flags & REDIS_LUA_CLIENT) return REDIS_OK;
     if ((c->flags & REDIS_MASTER) &&
@@ -149,7 +289,30 @@ int prepareClientToWrite(redisClient *c) {
     if (c->bufpos == 0 && listLength(c->reply) == 0 &&
         (c->replstate == REDIS_REPL_NONE ||
          c->replstate == REDIS_REPL_ONLINE) &&
-        aeCreateFileEvent(server.el, c->fd, AE_WRITABLE,
+        !(c->flags & (REDIS_PENDING_WRITE|REDIS_PENDING_READ)) &&
+        clientInstallWriteHandler(c) == REDIS_ERR) return REDIS_ERR;
+    return REDIS_OK;
+}
+
+/* Arrange for the output of the client to be written to the socket.
+ * Normally this just means installing the write handler in the event loop,
+ * however when I/O threads are configured normal clients are queued into
+ * server.clients_pending_write instead, so that all the writes can be
+ * performed at once in beforeSleep(), possibly by the I/O threads.
+ *
+ * We don't defer writes while processing events in the middle of a slow
+ * script or of a loading operation, since beforeSleep() is not called
+ * in such contexts. */
+static int clientInstallWriteHandler(redisClient *c) {
+    if (server.io_threads_num > 1 &&
+        !(c->flags & (REDIS_SLAVE|REDIS_MASTER)) &&
+        !server.loading && !server.lua_timedout)
+    {
+        c->flags |= REDIS_PENDING_WRITE;
+        listAddNodeTail(server.clients_pending_write,c);
+        return REDIS_OK;
+    }
+    if (aeCreateFileEvent(server.el, c->fd, AE_WRITABLE,
         sendReplyToClient, c) == AE_ERR) return REDIS_ERR;
     return REDIS_OK;
 }
@@ -162,8 +325,15 @@ robj *dupLastObjectIfNeeded(list *reply) {
     redisAssert(listLength(reply) > 0);
     ln = listLast(reply);
     cur = listNodeValue(ln);
-    if (cur->refcount > 1) {
-        new = dupStringObject(cur);
+    if (cur->refcount > 1 || cur->encoding != REDIS_ENCODING_RAW) {
+        /* We are going to append to the object, so use a chunk when it
+         * is already big enough to likely fill it. EMBSTR objects can't
+         * grow, so they are always replaced by a raw copy as well. */
+        if (sdslen(cur->ptr) >= REDIS_REPLY_CHUNK_BYTES/2 &&
+            sdslen(cur->ptr) <= REDIS_REPLY_CHUNK_BYTES)
+            new = createReplyChunkObject(cur->ptr,sdslen(cur->ptr));
+        else
+            new = createRawStringObject(cur->ptr,sdslen(cur->ptr));
         decrRefCount(cur);
         listNodeValue(ln) = new;
     }
@@ -219,7 +389,7 @@ void _addReplyObjectToList(redisClient *c, robj *o) {
     if (listLength(c->reply) == 0) {
         incrRefCount(o);//ô
         listAddNodeTail(c->reply,o);//ӵĩβ
-        c->reply_bytes += zmalloc_size_sds(o->ptr); //o->ptrռڴС
+        c->reply_bytes += getStringObjectSdsUsedMemory(o); //o->ptrռڴС
     } else {
         //ȡβе
         tail = listNodeValue(listLast(c->reply));
@@ -230,20 +400,54 @@ void _addReplyObjectToList(redisClient *c, robj *o) {
         if (tail->ptr != NULL &&
             sdslen(tail->ptr)+sdslen(o->ptr) <= REDIS_REPLY_CHUNK_BYTES)
         {
-            c->reply_bytes -= zmalloc_size_sds(tail->ptr);
+            c->reply_bytes -= getStringObjectSdsUsedMemory(tail);
             tail = dupLastObjectIfNeeded(c->reply);
             tail->ptr = sdscatlen(tail->ptr,o->ptr,sdslen(o->ptr));
             c->reply_bytes += zmalloc_size_sds(tail->ptr);
         } else {//Ϊ»ظһڵ
             incrRefCount(o);
             listAddNodeTail(c->reply,o);
-            c->reply_bytes += zmalloc_size_sds(o->ptr);
+            c->reply_bytes += getStringObjectSdsUsedMemory(o);
         }
     }
     // ͻ˿ͻ˵󻺴ƣôرտͻ
     asyncCloseClientOnOutputBufferLimitReached(c);
 }
 
+/* Return true if a new reply list node receiving 'len' bytes is expected
+ * to fill a pooled chunk: that is when the string is big, or when the list
+ * already has nodes, since a new node is only needed after the tail node
+ * is full. */
+static int replyNodeFillsChunk(redisClient *c, size_t len) {
+    return len <= REDIS_REPLY_CHUNK_BYTES &&
+           (len >= REDIS_REPLY_CHUNK_BYTES/2 || listLength(c->reply) > 0);
+}
+
+/* Append a new node to the reply list with a copy of the string, using a
+ * pooled chunk when the node is expected to fill it, so that the next
+ * replies can be appended to the node without reallocations. */
+static void addReplyStringNodeToList(redisClient *c, char *s, size_t len) {
+    robj *o;
+
+    if (replyNodeFillsChunk(c,len))
+        o = createReplyChunkObject(s,len);
+    else
+        o = createRawStringObject(s,len);
+    listAddNodeTail(c->reply,o);
+    c->reply_bytes += zmalloc_size_sds(o->ptr);
+}
+
+/* Like addReplyStringNodeToList() but takes ownership of the sds. */
+static void addReplySdsNodeToList(redisClient *c, sds s) {
+    if (replyNodeFillsChunk(c,sdslen(s))) {
+        addReplyStringNodeToList(c,s,sdslen(s));
+        sdsfree(s);
+    } else {
+        listAddNodeTail(c->reply,createObject(REDIS_STRING,s));
+        c->reply_bytes += zmalloc_size_sds(s);
+    }
+}
+
 /* This method takes responsibility over the sds. When it is no longer
  * needed it will be free'd, otherwise it ends up in a robj. */
  /**
@@ -258,8 +462,7 @@ void _addReplySdsToList(redisClient *c, sds s) {
     }
 
     if (listLength(c->reply) == 0) {
-        listAddNodeTail(c->reply,createObject(REDIS_STRING,s));
-        c->reply_bytes += zmalloc_size_sds(s);
+        addReplySdsNodeToList(c,s);
     } else {
         tail = listNodeValue(listLast(c->reply));
 
@@ -267,14 +470,13 @@ void _addReplySdsToList(redisClient *c, sds s) {
         if (tail->ptr != NULL &&
             sdslen(tail->ptr)+sdslen(s) <= REDIS_REPLY_CHUNK_BYTES)
         {
-            c->reply_bytes -= zmalloc_size_sds(tail->ptr);
+            c->reply_bytes -= getStringObjectSdsUsedMemory(tail);
             tail = dupLastObjectIfNeeded(c->reply);
             tail->ptr = sdscatlen(tail->ptr,s,sdslen(s));
             c->reply_bytes += zmalloc_size_sds(tail->ptr);
             sdsfree(s);
         } else {
-            listAddNodeTail(c->reply,createObject(REDIS_STRING,s));
-            c->reply_bytes += zmalloc_size_sds(s);
+            addReplySdsNodeToList(c,s);
         }
     }
     asyncCloseClientOnOutputBufferLimitReached(c);
@@ -289,10 +491,7 @@ void _addReplyStringToList(redisClient *c, char *s, size_t len) {
     if (c->flags & REDIS_CLOSE_AFTER_REPLY) return;
 
     if (listLength(c->reply) == 0) {
-        robj *o = createStringObject(s,len);
-
-        listAddNodeTail(c->reply,o);
-        c->reply_bytes += zmalloc_size_sds(o->ptr);
+        addReplyStringNodeToList(c,s,len);
     } else {
         tail = listNodeValue(listLast(c->reply));
 
@@ -300,15 +499,12 @@ void _addReplyStringToList(redisClient *c, char *s, size_t len) {
         if (tail->ptr != NULL &&
             sdslen(tail->ptr)+len <= REDIS_REPLY_CHUNK_BYTES)
         {
-            c->reply_bytes -= zmalloc_size_sds(tail->ptr);
+            c->reply_bytes -= getStringObjectSdsUsedMemory(tail);
             tail = dupLastObjectIfNeeded(c->reply);
             tail->ptr = sdscatlen(tail->ptr,s,len);
             c->reply_bytes += zmalloc_size_sds(tail->ptr);
         } else {
-            robj *o = createStringObject(s,len);
-
-            listAddNodeTail(c->reply,o);
-            c->reply_bytes += zmalloc_size_sds(o->ptr);
+            addReplyStringNodeToList(c,s,len);
         }
     }
     asyncCloseClientOnOutputBufferLimitReached(c);
@@ -329,7 +525,7 @@ void addReply(redisClient *c, robj *obj) {
      * If the encoding is RAW and there is room in the static buffer
      * we'll be able to send the object to the client without
      * messing with its page. */
-    if (obj->encoding == REDIS_ENCODING_RAW) {//ַ
+    if (sdsEncodedObject(obj)) {//ַ
         //Ƿܽ׷ӵc->buf
         if (_addReplyToBuffer(c,obj->ptr,sdslen(obj->ptr)) != REDIS_OK)
             _addReplyObjectToList(c,obj);//ӵc->reply
@@ -462,7 +658,7 @@ void setDeferredMultiBulkLength(redisClient *c, void *node, long length) {
         /* Only glue when the next node is non-NULL (an sds in this case) */
         if (next->ptr != NULL) {
             c->reply_bytes -= zmalloc_size_sds(len->ptr);
-            c->reply_bytes -= zmalloc_size_sds(next->ptr);
+            c->reply_bytes -= getStringObjectSdsUsedMemory(next);
             len->ptr = sdscatlen(len->ptr,next->ptr,sdslen(next->ptr));
             c->reply_bytes += zmalloc_size_sds(len->ptr);
             listDelNode(c->reply,ln->next);
@@ -534,7 +730,7 @@ void addReplyMultiBulkLen(redisClient *c, long length) {
 void addReplyBulkLen(redisClient *c, robj *obj) {
     size_t len;
 
-    if (obj->encoding == REDIS_ENCODING_RAW) {
+    if (sdsEncodedObject(obj)) {
         len = sdslen(obj->ptr);
     } else {
         long n = (long)obj->ptr;
@@ -642,45 +838,142 @@ static void acceptCommonHandler(int fd, int flags) {
     c->flags |= flags;
 }
 
+/* Update the accept stats after an accept handler call that accepted
+ * 'accepted' new connections. */
+static void updateAcceptStats(int accepted) {
+    server.stat_accept_events++;
+    if (accepted > server.stat_accept_batch_max)
+        server.stat_accept_batch_max = accepted;
+}
+
+/* The accept handlers drain up to REDIS_MAX_ACCEPTS_PER_CALL pending
+ * connections every time the listening socket is readable, so that when a
+ * lot of clients connect at the same time (think about all the application
+ * servers reconnecting after a deploy) the backlog is emptied in a few
+ * event loop iterations, without waiting a full iteration for every new
+ * client. The limit makes sure the clients already connected are served
+ * anyway. */
 void acceptTcpHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
-    int cport, cfd;
+    int cport, cfd, accepted = 0;
     char cip[REDIS_IP_STR_LEN];
     REDIS_NOTUSED(el);//
     REDIS_NOTUSED(mask);
     REDIS_NOTUSED(privdata);
 
-    //cfdΪacceptصĿͻļ
-    cfd = anetTcpAccept(server.neterr, fd, cip, sizeof(cip), &cport);
-    if (cfd == AE_ERR) {
-        redisLog(REDIS_WARNING,"Accepting client connection: %s", server.neterr);
-        return;
+    while(accepted < REDIS_MAX_ACCEPTS_PER_CALL) {
+        //cfdΪacceptصĿͻļ
+        cfd = anetTcpAccept(server.neterr, fd, cip, sizeof(cip), &cport);
+        if (cfd == ANET_ERR) {
+            if (errno != EWOULDBLOCK && errno != EAGAIN)
+                redisLog(REDIS_WARNING,
+                    "Accepting client connection: %s", server.neterr);
+            break;
+        }
+        accepted++;
+        redisLog(REDIS_VERBOSE,"Accepted %s:%d", cip, cport);
+        acceptCommonHandler(cfd,0);
     }
-    redisLog(REDIS_VERBOSE,"Accepted %s:%d", cip, cport);
-    acceptCommonHandler(cfd,0);
+    updateAcceptStats(accepted);
 }
 
 void acceptUnixHandler(aeEventLoop *el, int fd, void *privdata, int mask) {
-    int cfd;
+    int cfd, accepted = 0;
     REDIS_NOTUSED(el);
     REDIS_NOTUSED(mask);
     REDIS_NOTUSED(privdata);
 
-    cfd = anetUnixAccept(server.neterr, fd);
-    if (cfd == AE_ERR) {
-        redisLog(REDIS_WARNING,"Accepting client connection: %s", server.neterr);
-        return;
+    while(accepted < REDIS_MAX_ACCEPTS_PER_CALL) {
+        cfd = anetUnixAccept(server.neterr, fd);
+        if (cfd == ANET_ERR) {
+            if (errno != EWOULDBLOCK && errno != EAGAIN)
+                redisLog(REDIS_WARNING,
+                    "Accepting client connection: %s", server.neterr);
+            break;
+        }
+        accepted++;
+        redisLog(REDIS_VERBOSE,"Accepted connection to %s", server.unixsocket);
+        acceptCommonHandler(cfd,REDIS_UNIX_SOCKET);
     }
-    redisLog(REDIS_VERBOSE,"Accepted connection to %s", server.unixsocket);
-    acceptCommonHandler(cfd,REDIS_UNIX_SOCKET);
+    updateAcceptStats(accepted);
 }
 
 
+/* Argument objects that are still referenced only by the client argv at the
+ * end of the command (that is, they were not stored in the keyspace, queued
+ * in a MULTI block, sent to slaves by reference and so forth) are not freed
+ * but moved into a small per client pool, so that the next command can reuse
+ * both the robj and the sds buffer instead of paying a malloc/free pair for
+ * every argument of every command.
+ *
+ * Objects are pushed in reverse order so that the next command gets back,
+ * argument by argument, the buffers of the previous one: pipelines of the
+ * same command end up reusing buffers of exactly the right size. */
 static void freeClientArgv(redisClient *c) {
     int j;
-    for (j = 0; j < c->argc; j++)
-        decrRefCount(c->argv[j]);
+
+    for (j = c->argc-1; j >= 0; j--) {
+        robj *o = c->argv[j];
+
+        if (o->refcount == 1 &&
+            sdsEncodedObject(o) &&
+            c->argv_pool_len < REDIS_ARGV_POOL_SIZE &&
+            getStringObjectSdsUsedMemory(o) <= REDIS_ARGV_POOL_MAX_ALLOC)
+        {
+            c->argv_pool[c->argv_pool_len++] = o;
+        } else {
+            decrRefCount(o);
+        }
+    }
     c->argc = 0;
     c->cmd = NULL;
+    if (c->argv_len > REDIS_ARGV_MAX_KEEP) {
+        zfree(c->argv);
+        c->argv = NULL;
+        c->argv_len = 0;
+    }
+}
+
+/* Free the argument objects pooled by freeClientArgv(). */
+static void freeClientArgvPool(redisClient *c) {
+    while(c->argv_pool_len) decrRefCount(c->argv_pool[--c->argv_pool_len]);
+}
+
+/* Return a string object for a command argument, taking it from the client
+ * pool when possible. The sds buffer of the pooled object is reused only if
+ * the argument fits without leaving too much free space: the argument may be
+ * stored in the keyspace as it is, so it should not be different from an
+ * object returned by createStringObject(). Pooled EMBSTR objects can't be
+ * reallocated, so they are reused only when the argument fits. */
+static robj *createClientArgvObject(redisClient *c, char *ptr, size_t len) {
+    robj *o;
+    sds s;
+
+    if (c->argv_pool_len == 0) return createStringObject(ptr,len);
+    o = c->argv_pool[--c->argv_pool_len];
+    s = o->ptr;
+    if (sdslen(s)+sdsavail(s) >= len &&
+        (o->encoding == REDIS_ENCODING_EMBSTR ||
+         sdslen(s)+sdsavail(s) <= len+len/4+8))
+    {
+        memcpy(s,ptr,len);
+        sdsIncrLen(s,len-sdslen(s));
+    } else if (o->encoding == REDIS_ENCODING_EMBSTR) {
+        decrRefCount(o);
+        return createStringObject(ptr,len);
+    } else {
+        sdsfree(s);
+        o->ptr = sdsnewlen(ptr,len);
+    }
+    o->lru = objectInitialLRU();
+    return o;
+}
+
+/* Make sure the client argv array can hold 'argc' arguments. */
+static void ensureClientArgvLen(redisClient *c, int argc) {
+    if (c->argv_len >= argc) return;
+    zfree(c->argv);
+    c->argv = zmalloc(sizeof(robj*)*argc);
+    c->argv_len = argc;
 }
 
 /* Close all the slaves connections. This is useful in chained replication
@@ -757,6 +1050,7 @@ void freeClient(redisClient *c) {
     }
     listRelease(c->reply);
     freeClientArgv(c);
+    freeClientArgvPool(c);
     /* Remove from the list of clients */
     if (c->fd != -1) {
         ln = listSearchKey(server.clients,c);
@@ -799,6 +1093,18 @@ void freeClient(redisClient *c) {
         listDelNode(server.clients_to_close,ln);
     }
 
+    /* The same for the queues of clients with deferred reads or writes. */
+    if (c->flags & REDIS_PENDING_READ) {
+        ln = listSearchKey(server.clients_pending_read,c);
+        redisAssert(ln != NULL);
+        listDelNode(server.clients_pending_read,ln);
+    }
+    if (c->flags & REDIS_PENDING_WRITE) {
+        ln = listSearchKey(server.clients_pending_write,c);
+        redisAssert(ln != NULL);
+        listDelNode(server.clients_pending_write,ln);
+    }
+
     /* Release memory */
     if (c->name) decrRefCount(c->name);
     zfree(c->argv);
@@ -809,11 +1115,22 @@ void freeClient(redisClient *c) {
 /* Schedule a client to free it at a safe time in the serverCron() function.
  * This function is useful when we need to terminate a client but we are in
  * a context where calling freeClient() is not possible, because the client
- * should be valid for the continuation of the flow of the program. */
+ * should be valid for the continuation of the flow of the program.
+ *
+ * This is also the only way an I/O thread has to get rid of a client, so
+ * the queue is protected by a mutex when I/O threads are configured. */
 void freeClientAsync(redisClient *c) {
+    static pthread_mutex_t async_free_queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+
     if (c->flags & REDIS_CLOSE_ASAP) return;
     c->flags |= REDIS_CLOSE_ASAP;
+    if (server.io_threads_num == 1) {
+        listAddNodeTail(server.clients_to_close,c);
+        return;
+    }
+    pthread_mutex_lock(&async_free_queue_mutex);
     listAddNodeTail(server.clients_to_close,c);
+    pthread_mutex_unlock(&async_free_queue_mutex);
 }
 
 void freeClientsInAsyncFreeQueue(void) {
@@ -827,73 +1144,133 @@ void freeClientsInAsyncFreeQueue(void) {
     }
 }
 
-void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask) {
-    redisClient *c = privdata;
-    int nwritten = 0, totwritten = 0, objlen;
-    size_t objmem;
-    robj *o;
-    REDIS_NOTUSED(el);
-    REDIS_NOTUSED(mask);
+/* Write to the client socket as much as possible of the pending output.
+ * The static buffer and the objects of the reply list are gathered into
+ * an iovec array and transmitted with a single writev() call, so that
+ * big multi bulk replies, spanning many objects, don't cost a write()
+ * for every object.
+ *
+ * The client output buffers are not modified: the caller is responsible
+ * of calling consumeClientOutput() with the number of bytes written.
+ * Keeping the two steps separated is what makes it possible to perform
+ * the write inside an I/O thread, since the reply list may reference
+ * objects shared with the keyspace, whose reference count can only be
+ * touched by the main thread.
+ *
+ * On write errors other than EAGAIN '*err' is set to errno, otherwise
+ * it is set to zero. The number of bytes written is returned. */
+static size_t writeClientOutput(redisClient *c, int *err) {
+    struct iovec iov[REDIS_WRITEV_IOV_MAX];
+    listNode *ln = listFirst(c->reply);
+    size_t sentlen = c->sentlen, totwritten = 0;
+    int bufpos = c->bufpos, nolimit;
+
+    /* Note that we avoid to send more than REDIS_MAX_WRITE_PER_EVENT
+     * bytes, in a single threaded server it's a good idea to serve
+     * other clients as well, even if a very large request comes from
+     * super fast link that is always able to accept data (in real world
+     * scenario think about 'KEYS *' against the loopback interface).
+     *
+     * However if we are over the maxmemory limit we ignore that and
+     * just deliver as much data as it is possible to deliver. */
+    nolimit = server.maxmemory &&
+              zmalloc_used_memory() >= server.maxmemory;
+
+    *err = 0;
+    while(bufpos > 0 || ln != NULL) {
+        size_t batch = 0;
+        ssize_t nwritten;
+        int iovcnt = 0;
+
+        /* Gather the static buffer, if any, and as many objects as
+         * possible starting from the first one not yet sent. */
+        if (bufpos > 0) {
+            iov[iovcnt].iov_base = c->buf+sentlen;
+            iov[iovcnt].iov_len = bufpos-sentlen;
+            batch += iov[iovcnt++].iov_len;
+            sentlen = 0;
+        }
+        while(ln != NULL && iovcnt < REDIS_WRITEV_IOV_MAX &&
+              (nolimit || totwritten+batch < REDIS_MAX_WRITE_PER_EVENT))
+        {
+            robj *o = listNodeValue(ln);
+            size_t len = sdslen(o->ptr)-sentlen;
+
+            if (len) {
+                iov[iovcnt].iov_base = ((char*)o->ptr)+sentlen;
+                iov[iovcnt].iov_len = len;
+                batch += len;
+                iovcnt++;
+            }
+            sentlen = 0;
+            ln = listNextNode(ln);
+        }
+        if (batch == 0) break;
+
+        nwritten = writev(c->fd,iov,iovcnt);
+        if (nwritten <= 0) {
+            if (nwritten == -1 && errno != EAGAIN) *err = errno;
+            break;
+        }
+        totwritten += nwritten;
+
+        /* On short writes the socket buffer is full: there is no point
+         * in trying again, consumeClientOutput() will work out where we
+         * arrived. Otherwise continue with what was not gathered. */
+        if ((size_t)nwritten < batch) break;
+        bufpos = 0;
+        if (!nolimit && totwritten >= REDIS_MAX_WRITE_PER_EVENT) break;
+    }
+    return totwritten;
+}
 
+/* Remove 'nwritten' already transmitted bytes from the head of the client
+ * output buffers, releasing the reply objects fully sent. */
+static void consumeClientOutput(redisClient *c, size_t nwritten) {
     while(c->bufpos > 0 || listLength(c->reply)) {
+        size_t len;
+
         if (c->bufpos > 0) {
-            //͵ͻ
-            nwritten = write(fd,c->buf+c->sentlen,c->bufpos-c->sentlen);
-            if (nwritten <= 0) break;
-            c->sentlen += nwritten;
-            totwritten += nwritten;
-
-            /* If the buffer was sent, set bufpos to zero to continue with
-             * the remainder of the reply. */
-            if (c->sentlen == c->bufpos) {
-                c->bufpos = 0;
-                c->sentlen = 0;
+            len = c->bufpos-c->sentlen;
+            if (nwritten < len) {
+                c->sentlen += nwritten;
+                return;
             }
+            c->bufpos = 0;
         } else {
-            o = listNodeValue(listFirst(c->reply));
-            objlen = sdslen(o->ptr);
-            objmem = zmalloc_size_sds(o->ptr);
-
-            if (objlen == 0) {
-                listDelNode(c->reply,listFirst(c->reply));
-                continue;
-            }
+            robj *o = listNodeValue(listFirst(c->reply));
+            size_t objmem = getStringObjectSdsUsedMemory(o);
 
-            nwritten = write(fd, ((char*)o->ptr)+c->sentlen,objlen-c->sentlen);
-            if (nwritten <= 0) break;
-            c->sentlen += nwritten;
-            totwritten += nwritten;
-
-            /* If we fully sent the object on head go to the next one */
-            if (c->sentlen == objlen) {
-                listDelNode(c->reply,listFirst(c->reply));
-                c->sentlen = 0;
-                c->reply_bytes -= objmem;
+            len = sdslen(o->ptr)-c->sentlen;
+            if (nwritten < len) {
+                c->sentlen += nwritten;
+                return;
             }
+            listDelNode(c->reply,listFirst(c->reply));
+            c->reply_bytes -= objmem;
         }
-        /* Note that we avoid to send more than REDIS_MAX_WRITE_PER_EVENT
-         * bytes, in a single threaded server it's a good idea to serve
-         * other clients as well, even if a very large request comes from
-         * super fast link that is always able to accept data (in real world
-         * scenario think about 'KEYS *' against the loopback interface).
-         *
-         * However if we are over the maxmemory limit we ignore that and
-         * just deliver as much data as it is possible to deliver. */
-        if (totwritten > REDIS_MAX_WRITE_PER_EVENT &&
-            (server.maxmemory == 0 ||
-             zmalloc_used_memory() < server.maxmemory)) break;
-    }
-    if (nwritten == -1) {
-        if (errno == EAGAIN) {
-            nwritten = 0;
-        } else {
-            redisLog(REDIS_VERBOSE,
-                "Error writing to client: %s", strerror(errno));
-            freeClient(c);
-            return;
-        }
+        nwritten -= len;
+        c->sentlen = 0;
+    }
+}
+
+/* Update the client state after 'nwritten' bytes of its output were
+ * written to the socket by writeClientOutput(). If the whole output was
+ * transmitted the write handler is removed (when 'handler_installed' is
+ * true), otherwise it is installed (when 'handler_installed' is false) so
+ * that the event loop will continue the work.
+ *
+ * Returns REDIS_ERR if the client was freed or scheduled to be freed. */
+static int afterClientWrite(redisClient *c, size_t nwritten, int err,
+                            int handler_installed)
+{
+    consumeClientOutput(c,nwritten);
+    if (err) {
+        redisLog(REDIS_VERBOSE,"Error writing to client: %s", strerror(err));
+        freeClient(c);
+        return REDIS_ERR;
     }
-    if (totwritten > 0) {
+    if (nwritten > 0) {
         /* For clients representing masters we don't count sending data
          * as an interaction, since we always send REPLCONF ACK commands
          * that take some time to just fill the socket output buffer.
@@ -902,11 +1279,39 @@ void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask) {
     }
     if (c->bufpos == 0 && listLength(c->reply) == 0) {
         c->sentlen = 0;
-        aeDeleteFileEvent(server.el,c->fd,AE_WRITABLE);
+        if (handler_installed) aeDeleteFileEvent(server.el,c->fd,AE_WRITABLE);
 
         /* Close connection after entire reply has been sent. */
-        if (c->flags & REDIS_CLOSE_AFTER_REPLY) freeClient(c);
+        if (c->flags & REDIS_CLOSE_AFTER_REPLY) {
+            freeClient(c);
+            return REDIS_ERR;
+        }
+    } else if (!handler_installed) {
+        if (aeCreateFileEvent(server.el,c->fd,AE_WRITABLE,
+            sendReplyToClient,c) == AE_ERR)
+        {
+            freeClientAsync(c);
+            return REDIS_ERR;
+        }
     }
+    return REDIS_OK;
+}
+
+/* Write the client output to its socket from the main thread. */
+static int writeToClient(redisClient *c, int handler_installed) {
+    size_t nwritten;
+    int err;
+
+    nwritten = writeClientOutput(c,&err);
+    return afterClientWrite(c,nwritten,err,handler_installed);
+}
+
+void sendReplyToClient(aeEventLoop *el, int fd, void *privdata, int mask) {
+    REDIS_NOTUSED(el);
+    REDIS_NOTUSED(fd);
+    REDIS_NOTUSED(mask);
+
+    writeToClient(privdata,1);
 }
 
 /* resetClient prepare the client to process the next command */
@@ -951,8 +1356,7 @@ int processInlineBuffer(redisClient *c) {
     sdsrange(c->querybuf,querylen+2,-1);//Ӧǽquerybuf
 
     /* Setup argv array on client structure */
-    if (c->argv) zfree(c->argv);
-    c->argv = zmalloc(sizeof(robj*)*argc);
+    ensureClientArgvLen(c,argc);
 
     /* Create redis objects for all arguments. */
     for (c->argc = 0, j = 0; j < argc; j++) {
@@ -1031,8 +1435,7 @@ int processMultibulkBuffer(redisClient *c) {
         c->multibulklen = ll;//
 
         /* Setup argv array on client structure */
-        if (c->argv) zfree(c->argv);
-        c->argv = zmalloc(sizeof(robj*) * c->multibulklen);//ڴռ
+        ensureClientArgvLen(c,c->multibulklen);
     }
 
     redisAssertWithInfo(c,NULL,c->multibulklen > 0);
@@ -1122,7 +1525,7 @@ int processMultibulkBuffer(redisClient *c) {
             } else {
                 //ȡַ,SET,һstringObject
                 c->argv[c->argc++] =
-                    createStringObject(c->querybuf+pos,c->bulklen);
+                    createClientArgvObject(c,c->querybuf+pos,c->bulklen);
                 pos += c->bulklen+2;//\r\n
             }
             c->bulklen = -1;
@@ -1157,7 +1560,63 @@ int processMultibulkBuffer(redisClient *c) {
     EXISTSclient͵ֽڡEXISTS mykey\r\n
 */
 
+/* Look ahead in the query buffer for the commands pipelined after the one
+ * about to be parsed, and prefetch the keys of the read only ones, see
+ * dbPrefetchHashes(): executing them will not stall on a cache miss for
+ * every key. Only complete multi bulk commands are examined, up to
+ * DICT_PREFETCH_BATCH commands or keys.
+ *
+ * Returns the number of commands examined, so that the caller can look
+ * ahead again once they are executed. */
+static int prefetchPipelinedKeys(redisClient *c) {
+    static sds name = NULL;
+    unsigned int hashes[DICT_PREFETCH_BATCH];
+    char *p = c->querybuf, *end = c->querybuf+sdslen(c->querybuf), *nl;
+    int cmds = 0, n = 0;
+
+    if (name == NULL) name = sdsempty();
+    while(p < end && *p == '*' &&
+          cmds < DICT_PREFETCH_BATCH && n < DICT_PREFETCH_BATCH)
+    {
+        struct redisCommand *cmd = NULL;
+        long long argc, len;
+        int i;
+
+        nl = memchr(p,'\r',end-p);
+        if (nl == NULL || nl+1 >= end ||
+            !string2ll(p+1,nl-(p+1),&argc) || argc <= 0 || argc > INT_MAX)
+            break;
+        p = nl+2;
+        for (i = 0; i < argc; i++) {
+            if (p >= end || *p != '$') goto done;
+            nl = memchr(p,'\r',end-p);
+            if (nl == NULL || nl+1 >= end ||
+                !string2ll(p+1,nl-(p+1),&len) || len < 0) goto done;
+            p = nl+2;
+            if (end-p < len+2) goto done;
+            /* The first command is executed right away: prefetching its
+             * keys would be useless, so it is just skipped. */
+            if (i == 0 && cmds > 0) {
+                name = sdscpylen(name,p,len);
+                cmd = lookupCommand(name);
+            } else if (cmd && n < DICT_PREFETCH_BATCH &&
+                       isPrefetchableKeyArg(cmd,argc,i))
+            {
+                /* The same hash of dictSdsHash(), used by the keyspace. */
+                hashes[n++] = dictGenHashFunction((unsigned char*)p,len);
+            }
+            p += len+2;
+        }
+        cmds++;
+    }
+done:
+    if (n) dbPrefetchHashes(c->db,hashes,n);
+    return cmds;
+}
+
 void processInputBuffer(redisClient *c) {
+    int lookahead = 0;
+
     /* Keep processing while there is something in the input buffer */
     while(sdslen(c->querybuf)) {
         /* Immediately abort if the client is in the middle of something. */
@@ -1168,6 +1627,16 @@ void processInputBuffer(redisClient *c) {
          * this flag has been set (i.e. don't process more commands). */
         if (c->flags & REDIS_CLOSE_AFTER_REPLY) return;
 
+        /* Prefetch the keys of the next pipelined commands. I/O threads
+         * can't access the keyspace, and transactions prefetch the keys
+         * of the queued commands on EXEC. */
+        if (lookahead == 0 && c->querybuf[0] == '*' &&
+            c->multibulklen == 0 &&
+            !(c->flags & (REDIS_MULTI|REDIS_PENDING_READ)))
+        {
+            lookahead = prefetchPipelinedKeys(c);
+        }
+
         /* Determine request type when unknown. */
         //δ֪ʱȷ
         if (!c->reqtype) {
@@ -1186,10 +1655,19 @@ void processInputBuffer(redisClient *c) {
             redisPanic("Unknown request type");
         }
 
+        if (lookahead) lookahead--;
+
         /* Multibulk processing could see a <= 0 length. */
         if (c->argc == 0) {
             resetClient(c);
         } else {
+            /* Commands can't be executed by I/O threads: flag the client
+             * so that the main thread will execute the command once the
+             * threaded read is completed. */
+            if (c->flags & REDIS_PENDING_READ) {
+                c->flags |= REDIS_PENDING_COMMAND;
+                break;
+            }
             /* Only reset the client when the command was executed. */
             //ִӦָ
             if (processCommand(c) == REDIS_OK)
@@ -1198,14 +1676,17 @@ void processInputBuffer(redisClient *c) {
     }
 }
 
-void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
-    redisClient *c = (redisClient*) privdata;
+/* Read from the client socket into the query buffer. This is the part of
+ * readQueryFromClient() that can be performed by I/O threads as well, so
+ * on errors the client is scheduled for asynchronous freeing if 'threaded'
+ * is true, and freed synchronously otherwise.
+ *
+ * Returns the number of bytes read, or -1 if the client was (or is going
+ * to be) freed. */
+static int readClientSocket(redisClient *c, int threaded) {
     int nread, readlen;
     size_t qblen;
-    REDIS_NOTUSED(el);
-    REDIS_NOTUSED(mask);
 
-    server.current_client = c;
     readlen = REDIS_IOBUF_LEN; //1024 * 16
     /* If this is a multi bulk request, and we are processing a bulk reply
      * that is large enough, try to maximize the probability that the query
@@ -1226,29 +1707,20 @@ void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
     //querybufĿռչ
     c->querybuf = sdsMakeRoomFor(c->querybuf, readlen);
     //ȡͻ˷Ĳָ
-    nread = read(fd, c->querybuf+qblen, readlen);
+    nread = read(c->fd, c->querybuf+qblen, readlen);
     if (nread == -1) {
-        if (errno == EAGAIN) {
-            nread = 0;
-        } else {
-            redisLog(REDIS_VERBOSE, "Reading from client: %s",strerror(errno));
-            freeClient(c);
-            return;
-        }
+        if (errno == EAGAIN) return 0;
+        redisLog(REDIS_VERBOSE, "Reading from client: %s",strerror(errno));
+        goto err;
     } else if (nread == 0) {
         redisLog(REDIS_VERBOSE, "Client closed connection");
-        freeClient(c);
-        return;
-    }
-    if (nread) {
-        //ıquerybufʵʳȺͿгȣlen += nread, free -= nread;
-        sdsIncrLen(c->querybuf,nread);
-        c->lastinteraction = server.unixtime;
-        if (c->flags & REDIS_MASTER) c->reploff += nread;
-    } else {
-        server.current_client = NULL;
-        return;
+        goto err;
     }
+    //ıquerybufʵʳȺͿгȣlen += nread, free -= nread;
+    sdsIncrLen(c->querybuf,nread);
+    c->lastinteraction = server.unixtime;
+    if (c->flags & REDIS_MASTER) c->reploff += nread;
+
     //ͻַȴڷ󳤶ֵ
     if (sdslen(c->querybuf) > server.client_max_querybuf_len) {
         sds ci = getClientInfoString(c), bytes = sdsempty();
@@ -1257,11 +1729,53 @@ void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
         redisLog(REDIS_WARNING,"Closing client that reached max query buffer length: %s (qbuf initial bytes: %s)", ci, bytes);
         sdsfree(ci);
         sdsfree(bytes);
+        goto err;
+    }
+    return nread;
+
+err:
+    if (threaded)
+        freeClientAsync(c);
+    else
         freeClient(c);
-        return;
+    return -1;
+}
+
+/* When the I/O threads are running, instead of reading from the socket
+ * we just queue the client into server.clients_pending_read: the read
+ * and the parsing of the query are performed later by the I/O threads,
+ * see handleClientsWithPendingReadsUsingThreads().
+ *
+ * Masters, slaves and blocked clients are always served by the main thread,
+ * and so are all the clients while processing events in the middle of a
+ * slow script or of a loading operation.
+ *
+ * Returns 1 if the read was deferred (or is already pending). */
+static int postponeClientRead(redisClient *c) {
+    if (c->flags & REDIS_PENDING_READ) return 1;
+    if (server.io_threads_active && server.io_threads_do_reads &&
+        !server.loading && !server.lua_timedout &&
+        !(c->flags & (REDIS_MASTER|REDIS_SLAVE|REDIS_BLOCKED|
+                      REDIS_CLOSE_ASAP)))
+    {
+        c->flags |= REDIS_PENDING_READ;
+        listAddNodeTail(server.clients_pending_read,c);
+        return 1;
     }
+    return 0;
+}
+
+void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
+    redisClient *c = (redisClient*) privdata;
+    REDIS_NOTUSED(el);
+    REDIS_NOTUSED(fd);
+    REDIS_NOTUSED(mask);
+
+    if (postponeClientRead(c)) return;
+
+    server.current_client = c;
     //
-    processInputBuffer(c);
+    if (readClientSocket(c,0) > 0) processInputBuffer(c);
     server.current_client = NULL;
 }
 
@@ -1483,6 +1997,7 @@ void rewriteClientCommandVector(redisClient *c, int argc, ...) {
     /* Replace argv and argc with our new versions. */
     c->argv = argv;
     c->argc = argc;
+    c->argv_len = argc;
     c->cmd = lookupCommandOrOriginal(c->argv[0]->ptr);
     redisAssertWithInfo(c,NULL,c->cmd != NULL);
     va_end(ap);
@@ -1635,3 +2150,387 @@ void flushSlavesOutputBuffers(void) {
         }
     }
 }
+
+/* -----------------------------------------------------------------------------
+ * Threaded I/O
+ *
+ * When io-threads is greater than one, reading and parsing the queries and
+ * writing the replies can be performed by a pool of I/O threads. Commands
+ * are still executed by the main thread only: the threads are only used
+ * inside beforeSleep(), where the main thread distributes the clients with
+ * pending reads or writes among them, handles its own share, and waits for
+ * all of them to finish before going on. While doing their work the threads
+ * can only touch the socket and the private state of their clients.
+ *
+ * Idle threads spin for some time waiting for new work, and are parked on
+ * their mutex (held by the main thread) when the threads are stopped. They
+ * are stopped when there are too few clients to serve to make the work
+ * worthwhile, see stopThreadedIOIfNeeded().
+ * -------------------------------------------------------------------------- */
+
+#define IO_THREADS_OP_READ 0
+#define IO_THREADS_OP_WRITE 1
+
+typedef struct ioThreadStats {
+    unsigned long long reads;           /* Clients read by the thread. */
+    unsigned long long writes;          /* Clients written by the thread. */
+    unsigned long long read_bytes;      /* Bytes read from the sockets. */
+    unsigned long long written_bytes;   /* Bytes written to the sockets. */
+} ioThreadStats;
+
+static pthread_t io_threads[REDIS_IO_THREADS_MAX_NUM];
+static pthread_mutex_t io_threads_mutex[REDIS_IO_THREADS_MAX_NUM];
+static volatile unsigned long io_threads_pending[REDIS_IO_THREADS_MAX_NUM];
+static list *io_threads_list[REDIS_IO_THREADS_MAX_NUM];
+static ioThreadStats io_threads_stats[REDIS_IO_THREADS_MAX_NUM];
+static int io_threads_created = 1;  /* Thread 0 is the main thread. */
+static int io_threads_op;           /* IO_THREADS_OP_READ or _WRITE. */
+
+#ifndef HAVE_ATOMIC
+static pthread_mutex_t io_threads_pending_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static unsigned long getIOPendingCount(int id) {
+#ifdef HAVE_ATOMIC
+    return __sync_add_and_fetch(&io_threads_pending[id],0);
+#else
+    unsigned long count;
+
+    pthread_mutex_lock(&io_threads_pending_mutex);
+    count = io_threads_pending[id];
+    pthread_mutex_unlock(&io_threads_pending_mutex);
+    return count;
+#endif
+}
+
+static void setIOPendingCount(int id, unsigned long count) {
+#ifdef HAVE_ATOMIC
+    __sync_synchronize();
+    io_threads_pending[id] = count;
+    __sync_synchronize();
+#else
+    pthread_mutex_lock(&io_threads_pending_mutex);
+    io_threads_pending[id] = count;
+    pthread_mutex_unlock(&io_threads_pending_mutex);
+#endif
+}
+
+/* Perform the current I/O operation on behalf of the client. This is
+ * called by the I/O threads, and by the main thread for its own share. */
+static void ioThreadHandleClient(redisClient *c, ioThreadStats *stats) {
+    if (io_threads_op == IO_THREADS_OP_WRITE) {
+        int err;
+
+        c->io_written = writeClientOutput(c,&err);
+        if (err) {
+            redisLog(REDIS_VERBOSE,
+                "Error writing to client: %s", strerror(err));
+            freeClientAsync(c);
+        }
+        stats->writes++;
+        stats->written_bytes += c->io_written;
+    } else {
+        int nread = readClientSocket(c,1);
+
+        /* Only the first command is parsed here, the main thread will
+         * take care of the rest of the query buffer after executing it. */
+        if (nread > 0) {
+            stats->read_bytes += nread;
+            processInputBuffer(c);
+        }
+        stats->reads++;
+    }
+}
+
+static void *IOThreadMain(void *arg) {
+    long id = (long) arg;
+    sigset_t sigset;
+
+    /* Make the thread killable at any time, so that killIOThreads()
+     * can work reliably. */
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+    pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
+
+    /* Block SIGALRM so we are sure that only the main thread will
+     * receive the watchdog signal. */
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGALRM);
+    if (pthread_sigmask(SIG_BLOCK, &sigset, NULL))
+        redisLog(REDIS_WARNING,
+            "Warning: can't mask SIGALRM in I/O thread: %s", strerror(errno));
+
+    while(1) {
+        listIter li;
+        listNode *ln;
+        int j;
+
+        /* Busy wait for some time before checking if we should park. */
+        for (j = 0; j < 1000000; j++) {
+            if (getIOPendingCount(id) != 0) break;
+        }
+
+        /* Give the main thread a chance to stop this thread. */
+        if (getIOPendingCount(id) == 0) {
+            pthread_mutex_lock(&io_threads_mutex[id]);
+            pthread_mutex_unlock(&io_threads_mutex[id]);
+            continue;
+        }
+
+        /* The main thread will not touch our list until the pending
+         * count drops to zero. */
+        listRewind(io_threads_list[id],&li);
+        while((ln = listNext(&li)))
+            ioThreadHandleClient(listNodeValue(ln),&io_threads_stats[id]);
+        while(listLength(io_threads_list[id]))
+            listDelNode(io_threads_list[id],listFirst(io_threads_list[id]));
+        setIOPendingCount(id,0);
+    }
+    return NULL;
+}
+
+/* Spawn the I/O thread 'id'. The thread starts parked. */
+static int createIOThread(int id) {
+    pthread_t tid;
+
+    pthread_mutex_lock(&io_threads_mutex[id]);
+    setIOPendingCount(id,0);
+    if (pthread_create(&tid,NULL,IOThreadMain,(void*)(long)id) != 0) {
+        redisLog(REDIS_WARNING,"Can't create I/O thread #%d: %s",
+            id, strerror(errno));
+        pthread_mutex_unlock(&io_threads_mutex[id]);
+        return REDIS_ERR;
+    }
+    io_threads[id] = tid;
+    return REDIS_OK;
+}
+
+static void startThreadedIO(void) {
+    int j;
+
+    for (j = 1; j < server.io_threads_num; j++)
+        pthread_mutex_unlock(&io_threads_mutex[j]);
+    server.io_threads_active = 1;
+}
+
+static void stopThreadedIO(void) {
+    int j;
+
+    for (j = 1; j < server.io_threads_num; j++)
+        pthread_mutex_lock(&io_threads_mutex[j]);
+    server.io_threads_active = 0;
+}
+
+/* With too few clients with pending writes it is not worth to wake up the
+ * I/O threads, that would just burn CPU busy waiting: in this case the
+ * threads are stopped and 1 is returned, so that the caller performs all
+ * the work in the main thread. */
+static int stopThreadedIOIfNeeded(void) {
+    int pending = listLength(server.clients_pending_write);
+
+    if (server.io_threads_num == 1) return 1;
+    if (pending < server.io_threads_num*2) {
+        if (server.io_threads_active) stopThreadedIO();
+        return 1;
+    }
+    return 0;
+}
+
+/* Called at startup to create the I/O threads configured with io-threads. */
+void initThreadedIO(void) {
+    int j;
+
+    server.io_threads_active = 0;
+    for (j = 0; j < REDIS_IO_THREADS_MAX_NUM; j++) {
+        io_threads_list[j] = listCreate();
+        pthread_mutex_init(&io_threads_mutex[j],NULL);
+    }
+    if (setIOThreadsNum(server.io_threads_num) == REDIS_ERR) {
+        redisLog(REDIS_WARNING,"Fatal: Can't initialize I/O threads.");
+        exit(1);
+    }
+}
+
+/* Change the number of I/O threads (the main thread included), spawning
+ * the missing ones. Threads are never destroyed: when the number is reduced
+ * the extra threads just remain parked. Returns REDIS_ERR if it was not
+ * possible to create the threads. */
+int setIOThreadsNum(int num) {
+    if (server.io_threads_active) stopThreadedIO();
+    while (io_threads_created < num) {
+        if (createIOThread(io_threads_created) == REDIS_ERR) return REDIS_ERR;
+        io_threads_created++;
+    }
+    server.io_threads_num = num;
+    return REDIS_OK;
+}
+
+/* Used by the crash report to stop the I/O threads before the memory test. */
+void killIOThreads(void) {
+    int err, j;
+
+    for (j = 1; j < io_threads_created; j++) {
+        if (pthread_cancel(io_threads[j]) == 0) {
+            if ((err = pthread_join(io_threads[j],NULL)) != 0) {
+                redisLog(REDIS_WARNING,
+                    "I/O thread #%d can't be joined: %s", j, strerror(err));
+            } else {
+                redisLog(REDIS_WARNING,"I/O thread #%d terminated",j);
+            }
+        }
+    }
+}
+
+/* Distribute the clients in 'clients' among the first 'nthreads' threads,
+ * perform the I/O operation 'op' on all of them, and wait for all the
+ * threads to finish. Clients scheduled to be closed are skipped. */
+static void runThreadedIO(list *clients, int op, int nthreads) {
+    listIter li;
+    listNode *ln;
+    int j, item_id = 0;
+
+    listRewind(clients,&li);
+    while((ln = listNext(&li))) {
+        redisClient *c = listNodeValue(ln);
+
+        if (c->flags & REDIS_CLOSE_ASAP) continue;
+        listAddNodeTail(io_threads_list[item_id % nthreads],c);
+        item_id++;
+    }
+
+    io_threads_op = op;
+    for (j = 1; j < nthreads; j++)
+        setIOPendingCount(j,listLength(io_threads_list[j]));
+
+    /* Also the main thread processes its share of clients. */
+    listRewind(io_threads_list[0],&li);
+    while((ln = listNext(&li)))
+        ioThreadHandleClient(listNodeValue(ln),&io_threads_stats[0]);
+    while(listLength(io_threads_list[0]))
+        listDelNode(io_threads_list[0],listFirst(io_threads_list[0]));
+
+    /* Wait for the other threads to end their work. */
+    while(1) {
+        unsigned long pending = 0;
+
+        for (j = 1; j < nthreads; j++) pending += getIOPendingCount(j);
+        if (pending == 0) break;
+    }
+}
+
+/* Called by beforeSleep() to perform the reads deferred by
+ * postponeClientRead(), and then execute the commands parsed by the
+ * I/O threads. Returns the number of clients processed. */
+int handleClientsWithPendingReadsUsingThreads(void) {
+    int processed = listLength(server.clients_pending_read);
+
+    if (processed == 0) return 0;
+
+    /* If the threads were stopped after the reads were queued, the main
+     * thread does all the work by itself. */
+    runThreadedIO(server.clients_pending_read,IO_THREADS_OP_READ,
+        server.io_threads_active ? server.io_threads_num : 1);
+
+    /* Back in the main thread: execute the commands and process what
+     * remains in the query buffers. Note that we consume the list one
+     * client at a time, since executing a command may free other clients. */
+    while(listLength(server.clients_pending_read)) {
+        listNode *ln = listFirst(server.clients_pending_read);
+        redisClient *c = listNodeValue(ln);
+
+        c->flags &= ~REDIS_PENDING_READ;
+        listDelNode(server.clients_pending_read,ln);
+        if (c->flags & REDIS_CLOSE_ASAP) continue;
+
+        server.current_client = c;
+        if (c->flags & REDIS_PENDING_COMMAND) {
+            c->flags &= ~REDIS_PENDING_COMMAND;
+            if (processCommand(c) == REDIS_OK) resetClient(c);
+        }
+        processInputBuffer(c);
+        server.current_client = NULL;
+
+        /* Replies emitted while the client was flagged REDIS_PENDING_READ
+         * (protocol errors, but also messages published by the commands
+         * of other clients) did not arrange for the output to be written. */
+        if ((c->bufpos || listLength(c->reply)) &&
+            !(c->flags & REDIS_PENDING_WRITE) &&
+            !(aeGetFileEvents(server.el,c->fd) & AE_WRITABLE) &&
+            (c->replstate == REDIS_REPL_NONE ||
+             c->replstate == REDIS_REPL_ONLINE) &&
+            clientInstallWriteHandler(c) == REDIS_ERR)
+        {
+            freeClientAsync(c);
+        }
+    }
+
+    /* Free ASAP the clients the threads could not free by themselves. */
+    freeClientsInAsyncFreeQueue();
+    return processed;
+}
+
+/* Called by beforeSleep() to write the output of the clients queued by
+ * clientInstallWriteHandler(), using the I/O threads when they are worth
+ * it. Returns the number of clients processed. */
+int handleClientsWithPendingWritesUsingThreads(void) {
+    int processed = listLength(server.clients_pending_write);
+    int threaded;
+
+    if (processed == 0) return 0;
+
+    threaded = !stopThreadedIOIfNeeded();
+    if (threaded) {
+        if (!server.io_threads_active) startThreadedIO();
+        runThreadedIO(server.clients_pending_write,IO_THREADS_OP_WRITE,
+            server.io_threads_num);
+    }
+
+    while(listLength(server.clients_pending_write)) {
+        listNode *ln = listFirst(server.clients_pending_write);
+        redisClient *c = listNodeValue(ln);
+
+        c->flags &= ~REDIS_PENDING_WRITE;
+        listDelNode(server.clients_pending_write,ln);
+        if (threaded) {
+            size_t nwritten = c->io_written;
+
+            c->io_written = 0;
+            if (c->flags & REDIS_CLOSE_ASAP) continue;
+            afterClientWrite(c,nwritten,0,0);
+        } else {
+            writeToClient(c,0);
+        }
+    }
+
+    if (threaded) freeClientsInAsyncFreeQueue();
+    return processed;
+}
+
+/* Append the "threads" INFO section fields to 'info'. */
+sds genIOThreadsInfoString(sds info) {
+    unsigned long long reads = 0, writes = 0;
+    int j;
+
+    for (j = 0; j < io_threads_created; j++) {
+        reads += io_threads_stats[j].reads;
+        writes += io_threads_stats[j].writes;
+    }
+    info = sdscatprintf(info,
+        "io_threads:%d\r\n"
+        "io_threads_active:%d\r\n"
+        "io_threads_do_reads:%d\r\n"
+        "io_threaded_reads_processed:%llu\r\n"
+        "io_threaded_writes_processed:%llu\r\n",
+        server.io_threads_num,
+        server.io_threads_active,
+        server.io_threads_do_reads,
+        reads, writes);
+    for (j = 0; j < server.io_threads_num; j++) {
+        ioThreadStats *st = io_threads_stats+j;
+
+        info = sdscatprintf(info,
+            "io_thread_%d:reads=%llu,writes=%llu,"
+            "read_bytes=%llu,written_bytes=%llu\r\n",
+            j, st->reads, st->writes, st->read_bytes, st->written_bytes);
+    }
+    return info;
+}
@@ -38,16 +38,56 @@ robj *createObject(int type, void *ptr) {
     o->encoding = REDIS_ENCODING_RAW;
     o->ptr = ptr;
     o->refcount = 1;
+    o->respcached = 0;
+    o->hashcached = 0;
 
-    /* Set the LRU to the current lruclock (minutes resolution). */
-    o->lru = server.lruclock;
+    /* Set the LRU to the current lruclock, or initialize the LFU counter. */
+    o->lru = objectInitialLRU();
     return o;
 }
 
-robj *createStringObject(char *ptr, size_t len) {
+/* Create a string object with encoding REDIS_ENCODING_RAW, that is a plain
+ * string object where o->ptr points to a proper sds string. */
+robj *createRawStringObject(char *ptr, size_t len) {
     return createObject(REDIS_STRING,sdsnewlen(ptr,len));
 }
 
+/* Create a string object with encoding REDIS_ENCODING_EMBSTR, that is
+ * an object where the sds string is actually an unmodifiable string
+ * allocated in the same chunk as the object itself. */
+robj *createEmbeddedStringObject(char *ptr, size_t len) {
+    robj *o = zmalloc(sizeof(robj)+sizeof(struct sdshdr)+len+1);
+    struct sdshdr *sh = (void*)(o+1);
+
+    o->type = REDIS_STRING;
+    o->encoding = REDIS_ENCODING_EMBSTR;
+    o->ptr = sh+1;
+    o->refcount = 1;
+    o->respcached = 0;
+    o->hashcached = 0;
+    o->lru = objectInitialLRU();
+
+    sh->len = len;
+    sh->free = 0;
+    if (ptr) {
+        memcpy(sh->buf,ptr,len);
+        sh->buf[len] = '\0';
+    } else {
+        memset(sh->buf,0,len+1);
+    }
+    return o;
+}
+
+/* Create a string object with EMBSTR encoding if it is smaller than
+ * REDIS_ENCODING_EMBSTR_SIZE_LIMIT, otherwise the RAW encoding is
+ * used. */
+robj *createStringObject(char *ptr, size_t len) {
+    if (len <= REDIS_ENCODING_EMBSTR_SIZE_LIMIT)
+        return createEmbeddedStringObject(ptr,len);
+    else
+        return createRawStringObject(ptr,len);
+}
+
 robj *createStringObjectFromLongLong(long long value) {
     robj *o;
     if (value >= 0 && value < REDIS_SHARED_INTEGERS) {
@@ -89,23 +129,44 @@ robj *createStringObjectFromLongDouble(long double value) {
     return createStringObject(buf,len);
 }
 
+/* Duplicate a string object, with the guarantee that the returned object
+ * has the same encoding as the original one.
+ *
+ * The resulting object always has refcount set to 1. */
 robj *dupStringObject(robj *o) {
-    redisAssertWithInfo(NULL,o,o->encoding == REDIS_ENCODING_RAW);
-    return createStringObject(o->ptr,sdslen(o->ptr));
+    robj *d;
+
+    switch(o->encoding) {
+    case REDIS_ENCODING_RAW:
+        return createRawStringObject(o->ptr,sdslen(o->ptr));
+    case REDIS_ENCODING_EMBSTR:
+        return createEmbeddedStringObject(o->ptr,sdslen(o->ptr));
+    case REDIS_ENCODING_INT:
+        d = createObject(REDIS_STRING, NULL);
+        d->encoding = REDIS_ENCODING_INT;
+        d->ptr = o->ptr;
+        return d;
+    default:
+        redisPanic("Wrong encoding.");
+        break;
+    }
 }
 
-robj *createListObject(void) {
-    list *l = listCreate();
-    robj *o = createObject(REDIS_LIST,l);
-    listSetFreeMethod(l,decrRefCountVoid);
-    o->encoding = REDIS_ENCODING_LINKEDLIST;
-    return o;
+/* Memory used by the sds string of a RAW or EMBSTR string object, as
+ * accounted by the client output buffers. */
+size_t getStringObjectSdsUsedMemory(robj *o) {
+    redisAssertWithInfo(NULL,o,o->type == REDIS_STRING);
+    switch(o->encoding) {
+    case REDIS_ENCODING_RAW: return zmalloc_size_sds(o->ptr);
+    case REDIS_ENCODING_EMBSTR: return zmalloc_size(o)-sizeof(robj);
+    default: return 0; /* Just integer encoding for now. */
+    }
 }
 
-robj *createZiplistObject(void) {
-    unsigned char *zl = ziplistNew();
-    robj *o = createObject(REDIS_LIST,zl);
-    o->encoding = REDIS_ENCODING_ZIPLIST;
+robj *createQuicklistObject(void) {
+    quicklist *l = quicklistCreate();
+    robj *o = createObject(REDIS_LIST,l);
+    o->encoding = REDIS_ENCODING_QUICKLIST;
     return o;
 }
 
@@ -124,27 +185,34 @@ robj *createIntsetObject(void) {
 }
 
 robj *createHashObject(void) {
-    unsigned char *zl = ziplistNew();
-    robj *o = createObject(REDIS_HASH, zl);
-    o->encoding = REDIS_ENCODING_ZIPLIST;
+    unsigned char *lp = lpNew();
+    robj *o = createObject(REDIS_HASH, lp);
+    o->encoding = REDIS_ENCODING_LISTPACK;
     return o;
 }
 
+/* Create a sorted set indexed by a skiplist, or by a B+tree when
+ * zset-btree-index is enabled. */
 robj *createZsetObject(void) {
     zset *zs = zmalloc(sizeof(*zs));
     robj *o;
 
     zs->dict = dictCreate(&zsetDictType,NULL);
-    zs->zsl = zslCreate();
+    zs->zsl = NULL;
+    zs->zbt = NULL;
     o = createObject(REDIS_ZSET,zs);
-    o->encoding = REDIS_ENCODING_SKIPLIST;
+    o->encoding = zsetIndexEncoding();
+    if (o->encoding == REDIS_ENCODING_BTREE)
+        zs->zbt = zbtCreate();
+    else
+        zs->zsl = zslCreate();
     return o;
 }
 
-robj *createZsetZiplistObject(void) {
-    unsigned char *zl = ziplistNew();
-    robj *o = createObject(REDIS_ZSET,zl);
-    o->encoding = REDIS_ENCODING_ZIPLIST;
+robj *createZsetListpackObject(void) {
+    unsigned char *lp = lpNew();
+    robj *o = createObject(REDIS_ZSET,lp);
+    o->encoding = REDIS_ENCODING_LISTPACK;
     return o;
 }
 
@@ -156,11 +224,8 @@ void freeStringObject(robj *o) {
 
 void freeListObject(robj *o) {
     switch (o->encoding) {
-    case REDIS_ENCODING_LINKEDLIST:
-        listRelease((list*) o->ptr);
-        break;
-    case REDIS_ENCODING_ZIPLIST:
-        zfree(o->ptr);
+    case REDIS_ENCODING_QUICKLIST:
+        quicklistRelease(o->ptr);
         break;
     default:
         redisPanic("Unknown list encoding type");
@@ -189,7 +254,13 @@ void freeZsetObject(robj *o) {
         zslFree(zs->zsl);
         zfree(zs);
         break;
-    case REDIS_ENCODING_ZIPLIST:
+    case REDIS_ENCODING_BTREE:
+        zs = o->ptr;
+        dictRelease(zs->dict);
+        zbtFree(zs->zbt);
+        zfree(zs);
+        break;
+    case REDIS_ENCODING_LISTPACK:
         zfree(o->ptr);
         break;
     default:
@@ -202,7 +273,7 @@ void freeHashObject(robj *o) {
     case REDIS_ENCODING_HT:
         dictRelease((dict*) o->ptr);
         break;
-    case REDIS_ENCODING_ZIPLIST:
+    case REDIS_ENCODING_LISTPACK:
         zfree(o->ptr);
         break;
     default:
@@ -211,22 +282,42 @@ void freeHashObject(robj *o) {
     }
 }
 
+/* While the lazy free thread is releasing references the reference counts
+ * are updated atomically, see lazyfree.c. */
 void incrRefCount(robj *o) {
+#ifdef HAVE_ATOMIC
+    if (lazyfree_atomic_refcount) {
+        __sync_add_and_fetch(&o->refcount,1);
+        return;
+    }
+#endif
     o->refcount++;
 }
 
+static void freeObject(robj *o) {
+    if (o->respcached) respCacheDelete(o);
+    if (o->hashcached) keyHashDelete(o);
+    switch(o->type) {
+    case REDIS_STRING: freeStringObject(o); break;
+    case REDIS_LIST: freeListObject(o); break;
+    case REDIS_SET: freeSetObject(o); break;
+    case REDIS_ZSET: freeZsetObject(o); break;
+    case REDIS_HASH: freeHashObject(o); break;
+    default: redisPanic("Unknown object type"); break;
+    }
+    zfree(o);
+}
+
 void decrRefCount(robj *o) {
     if (o->refcount <= 0) redisPanic("decrRefCount against refcount <= 0");
+#ifdef HAVE_ATOMIC
+    if (lazyfree_atomic_refcount) {
+        if (__sync_sub_and_fetch(&o->refcount,1) == 0) freeObject(o);
+        return;
+    }
+#endif
     if (o->refcount == 1) {
-        switch(o->type) {
-        case REDIS_STRING: freeStringObject(o); break;
-        case REDIS_LIST: freeListObject(o); break;
-        case REDIS_SET: freeSetObject(o); break;
-        case REDIS_ZSET: freeZsetObject(o); break;
-        case REDIS_HASH: freeHashObject(o); break;
-        default: redisPanic("Unknown object type"); break;
-        }
-        zfree(o);
+        freeObject(o);
     } else {
         o->refcount--;
     }
@@ -280,7 +371,7 @@ robj *tryObjectEncoding(robj *o) {
     sds s = o->ptr;
     size_t len;
 
-    if (o->encoding != REDIS_ENCODING_RAW)//Ѿԭʼַ
+    if (!sdsEncodedObject(o))//Ѿԭʼַ
         return o; /* Already encoded */
 
     /* It's not safe to encode shared objects: shared objects can be shared
@@ -293,7 +384,21 @@ robj *tryObjectEncoding(robj *o) {
 
     /* Check if we can represent this string as a long integer */
     len = sdslen(s);
-    if (len > 21 || !string2l(s,len,&value)) {//len > 21  תΪ
+    if (len > 21 || !string2l(s,len,&value)) {
+        /* If the string is small and is still RAW encoded,
+         * try the EMBSTR encoding which is more efficient.
+         * In this representation the object and the SDS string are
+         * allocated in the same chunk of memory to save space and
+         * cache misses. */
+        if (len <= REDIS_ENCODING_EMBSTR_SIZE_LIMIT) {
+            robj *emb;
+
+            if (o->encoding == REDIS_ENCODING_EMBSTR) return o;
+            emb = createEmbeddedStringObject(s,len);
+            decrRefCount(o);
+            return emb;
+        }
+//len > 21  תΪ
         /* We can't encode the object...
          *
          * Do the last try, and at least optimize the SDS string inside
@@ -326,11 +431,15 @@ robj *tryObjectEncoding(robj *o) {
         decrRefCount(o);
         incrRefCount(shared.integers[value]);
         return shared.integers[value];
-    } else {//תΪint
+    } else if (o->encoding == REDIS_ENCODING_RAW) {//תΪint
         o->encoding = REDIS_ENCODING_INT;
         sdsfree(o->ptr);
         o->ptr = (void*) value;
         return o;
+    } else {
+        /* EMBSTR objects can't release the sds: create a new object. */
+        decrRefCount(o);
+        return createStringObjectFromLongLong(value);
     }
 }
 
@@ -339,7 +448,7 @@ robj *tryObjectEncoding(robj *o) {
 robj *getDecodedObject(robj *o) {
     robj *dec;
 
-    if (o->encoding == REDIS_ENCODING_RAW) {
+    if (sdsEncodedObject(o)) {
         incrRefCount(o);
         return o;
     }
@@ -371,14 +480,14 @@ int compareStringObjectsWithFlags(robj *a, robj *b, int flags) {
     size_t alen, blen, minlen;
 
     if (a == b) return 0;
-    if (a->encoding != REDIS_ENCODING_RAW) {
+    if (!sdsEncodedObject(a)) {
         alen = ll2string(bufa,sizeof(bufa),(long) a->ptr);
         astr = bufa;
     } else {
         astr = a->ptr;
         alen = sdslen(astr);
     }
-    if (b->encoding != REDIS_ENCODING_RAW) {
+    if (!sdsEncodedObject(b)) {
         blen = ll2string(bufb,sizeof(bufb),(long) b->ptr);
         bstr = bufb;
     } else {
@@ -412,7 +521,7 @@ int collateStringObjects(robj *a, robj *b) {
  * this function is faster then checking for (compareStringObject(a,b) == 0)
  * because it can perform some more optimization. */
 int equalStringObjects(robj *a, robj *b) {
-    if (a->encoding != REDIS_ENCODING_RAW && b->encoding != REDIS_ENCODING_RAW){
+    if (!sdsEncodedObject(a) && !sdsEncodedObject(b)){
         return a->ptr == b->ptr;
     } else {
         return compareStringObjects(a,b) == 0;
@@ -421,7 +530,7 @@ int equalStringObjects(robj *a, robj *b) {
 
 size_t stringObjectLen(robj *o) {
     redisAssertWithInfo(NULL,o,o->type == REDIS_STRING);
-    if (o->encoding == REDIS_ENCODING_RAW) {
+    if (sdsEncodedObject(o)) {
         return sdslen(o->ptr);
     } else {
         char buf[32];
@@ -438,7 +547,7 @@ int getDoubleFromObject(robj *o, double *target) {
         value = 0;
     } else {
         redisAssertWithInfo(NULL,o,o->type == REDIS_STRING);
-        if (o->encoding == REDIS_ENCODING_RAW) {
+        if (sdsEncodedObject(o)) {
             errno = 0;
             value = strtod(o->ptr, &eptr);
             if (isspace(((char*)o->ptr)[0]) ||
@@ -480,7 +589,7 @@ int getLongDoubleFromObject(robj *o, long double *target) {
         value = 0;
     } else {
         redisAssertWithInfo(NULL,o,o->type == REDIS_STRING);
-        if (o->encoding == REDIS_ENCODING_RAW) {
+        if (sdsEncodedObject(o)) {
             errno = 0;
             value = strtold(o->ptr, &eptr);
             if (isspace(((char*)o->ptr)[0]) || eptr[0] != '\0' ||
@@ -518,7 +627,7 @@ int getLongLongFromObject(robj *o, long long *target) {
         value = 0;
     } else {
         redisAssertWithInfo(NULL,o,o->type == REDIS_STRING);
-        if (o->encoding == REDIS_ENCODING_RAW) {
+        if (sdsEncodedObject(o)) {
             errno = 0;
             value = strtoll(o->ptr, &eptr, 10);
             if (isspace(((char*)o->ptr)[0]) || eptr[0] != '\0' ||
@@ -568,11 +677,15 @@ char *strEncoding(int encoding) {
     switch(encoding) {
     case REDIS_ENCODING_RAW: return "raw";
     case REDIS_ENCODING_INT: return "int";
+    case REDIS_ENCODING_EMBSTR: return "embstr";
     case REDIS_ENCODING_HT: return "hashtable";
     case REDIS_ENCODING_LINKEDLIST: return "linkedlist";
     case REDIS_ENCODING_ZIPLIST: return "ziplist";
     case REDIS_ENCODING_INTSET: return "intset";
     case REDIS_ENCODING_SKIPLIST: return "skiplist";
+    case REDIS_ENCODING_BTREE: return "btree";
+    case REDIS_ENCODING_QUICKLIST: return "quicklist";
+    case REDIS_ENCODING_LISTPACK: return "listpack";
     default: return "unknown";
     }
 }
@@ -588,6 +701,67 @@ unsigned long estimateObjectIdleTime(robj *o) {
     }
 }
 
+/* Return the current time in minutes, truncated to the LFU time bits. */
+static unsigned long LFUGetTimeInMinutes(void) {
+    return (server.unixtime/60) & REDIS_LFU_TIME_MAX;
+}
+
+/* Return the minutes elapsed since the LFU access time 'ldt', taking care
+ * of the wrap around of the clock (every ~11 days). */
+static unsigned long LFUTimeElapsed(unsigned long ldt) {
+    unsigned long now = LFUGetTimeInMinutes();
+
+    if (now >= ldt) return now-ldt;
+    return REDIS_LFU_TIME_MAX+1-ldt+now;
+}
+
+/* Increment the LFU counter logarithmically: the greater the counter and
+ * lfu-log-factor, the less likely an access increments it. With the default
+ * factor of 10 it takes about one million accesses to reach 255. */
+static unsigned long LFULogIncr(unsigned long counter) {
+    double r, baseval, p;
+
+    if (counter == REDIS_LFU_COUNTER_MAX) return counter;
+    r = (double)random()/RAND_MAX;
+    baseval = (double)counter - REDIS_LFU_INIT_VAL;
+    if (baseval < 0) baseval = 0;
+    p = 1.0/(baseval*server.lfu_log_factor+1);
+    if (r < p) counter++;
+    return counter;
+}
+
+/* Return the LFU counter of the object decremented by one for every
+ * lfu-decay-time minutes elapsed since the last access, so that keys that
+ * were hot a long time ago can be evicted. The object is not modified. */
+unsigned long LFUDecrAndReturn(robj *o) {
+    unsigned long ldt = o->lru >> 8;
+    unsigned long counter = o->lru & 255;
+    unsigned long periods = 0;
+
+    if (server.lfu_decay_time)
+        periods = LFUTimeElapsed(ldt) / server.lfu_decay_time;
+    return (periods > counter) ? 0 : counter-periods;
+}
+
+/* Return the value of the lru field of a new object: the LRU clock, or the
+ * current time and the initial counter if an LFU policy is selected. */
+unsigned int objectInitialLRU(void) {
+    if (REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy))
+        return (LFUGetTimeInMinutes()<<8) | REDIS_LFU_INIT_VAL;
+    return server.lruclock;
+}
+
+/* Update the LRU clock or the LFU counter of an accessed object. */
+void updateObjectAccess(robj *o) {
+    if (REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy)) {
+        unsigned long counter = LFULogIncr(LFUDecrAndReturn(o));
+
+        o->lru = (LFUGetTimeInMinutes()<<8) | counter;
+    } else {
+        o->lru = server.lruclock;
+    }
+}
+
 /* This is an helper function for the DEBUG command. We need to lookup keys
  * without any modification of LRU or other parameters. */
 robj *objectCommandLookup(redisClient *c, robj *key) {
@@ -620,9 +794,344 @@ void objectCommand(redisClient *c) {
     } else if (!strcasecmp(c->argv[1]->ptr,"idletime") && c->argc == 3) {
         if ((o = objectCommandLookupOrReply(c,c->argv[2],shared.nullbulk))
                 == NULL) return;
+        if (REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy)) {
+            addReplyError(c,"An LFU maxmemory policy is selected, "
+                            "idle time not tracked");
+            return;
+        }
         addReplyLongLong(c,estimateObjectIdleTime(o));
+    } else if (!strcasecmp(c->argv[1]->ptr,"freq") && c->argc == 3) {
+        if ((o = objectCommandLookupOrReply(c,c->argv[2],shared.nullbulk))
+                == NULL) return;
+        if (!REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy)) {
+            addReplyError(c,"An LFU maxmemory policy is not selected, "
+                            "access frequency not tracked");
+            return;
+        }
+        addReplyLongLong(c,LFUDecrAndReturn(o));
+    } else {
+        addReplyError(c,"Syntax error. Try OBJECT (refcount|encoding|idletime|freq)");
+    }
+}
+
+
+/* ======================= The MEMORY command =============================== */
+
+/* Elements sampled by MEMORY USAGE when no SAMPLES option is given. */
+#define OBJ_COMPUTE_SIZE_DEF_SAMPLES 5
+
+/* Memory used by a string object: the object itself, plus the sds string
+ * unless it lives in the same allocation or the value is an integer. */
+static size_t objectStringSize(robj *o) {
+    if (o->encoding == REDIS_ENCODING_INT) return sizeof(*o);
+    if (o->encoding == REDIS_ENCODING_EMBSTR) return zmalloc_size(o);
+    return sizeof(*o)+zmalloc_size_sds(o->ptr);
+}
+
+/* Estimate the memory used by the string objects stored in the dict, as
+ * keys and optionally as values, from the average of 'samples' entries. */
+static size_t dictElementsComputeSize(dict *d, size_t samples, int vals) {
+    dictIterator *di;
+    dictEntry *de;
+    size_t elesize = 0, sampled = 0;
+
+    di = dictGetIterator(d);
+    while(sampled < samples && (de = dictNext(di)) != NULL) {
+        elesize += objectStringSize(dictGetKey(de));
+        if (vals) elesize += objectStringSize(dictGetVal(de));
+        sampled++;
+    }
+    dictReleaseIterator(di);
+    return sampled ? (double)elesize/sampled*dictSize(d) : 0;
+}
+
+/* Memory used by the cached Lua scripts bodies: the dict maps the SHA1 of
+ * every script, as a plain sds string, to the script body object. */
+static size_t luaScriptsComputeSize(void) {
+    dictIterator *di;
+    dictEntry *de;
+    size_t mem = dictMemUsage(server.lua_scripts);
+
+    di = dictGetIterator(server.lua_scripts);
+    while((de = dictNext(di)) != NULL) {
+        mem += zmalloc_size_sds(dictGetKey(de));
+        mem += objectStringSize(dictGetVal(de));
+    }
+    dictReleaseIterator(di);
+    return mem;
+}
+
+/* Estimate the memory used by a skiplist, nodes and element objects, from
+ * the average of the first 'samples' nodes. */
+static size_t zslComputeSize(zskiplist *zsl, size_t samples) {
+    zskiplistNode *x = zsl->header->level[0].forward;
+    size_t asize, elesize = 0, sampled = 0;
+
+    asize = zmalloc_size(zsl)+zmalloc_size(zsl->header);
+    while(x && sampled < samples) {
+        elesize += zmalloc_size(x)+objectStringSize(x->obj);
+        sampled++;
+        x = x->level[0].forward;
+    }
+    if (sampled) asize += (double)elesize/sampled*zsl->length;
+    return asize;
+}
+
+/* Estimate the memory used by a B+tree and its element objects from the
+ * first leaves holding at least 'samples' elements. The inner nodes, a few
+ * percent of the size of the leaves, are not accounted. */
+static size_t zbtComputeSize(zbtree *zbt, size_t samples) {
+    zbtreeLeaf *l = zbt->head;
+    size_t asize, elesize = 0, sampled = 0;
+    unsigned int j;
+
+    asize = zmalloc_size(zbt);
+    while(l && sampled < samples) {
+        elesize += zmalloc_size(l);
+        for (j = 0; j < l->count; j++)
+            elesize += objectStringSize(l->obj[j]);
+        sampled += l->count;
+        l = l->next;
+    }
+    if (sampled) asize += (double)elesize/sampled*zbt->length;
+    return asize;
+}
+
+/* Estimate the memory used by the value 'o', as allocated by zmalloc().
+ * Values stored as a single blob (listpacks, intsets, strings) are measured
+ * exactly, while for the other encodings the size of the elements is
+ * computed averaging 'samples' elements, so that the function is O(1)
+ * for a given number of samples. The entry of the key in the keyspace is
+ * not accounted. */
+size_t objectComputeSize(robj *o, size_t samples) {
+    size_t asize = 0, elesize = 0, sampled = 0;
+
+    if (o->type == REDIS_STRING) {
+        asize = objectStringSize(o);
+    } else if (o->encoding == REDIS_ENCODING_LISTPACK ||
+               o->encoding == REDIS_ENCODING_INTSET)
+    {
+        asize = sizeof(*o)+zmalloc_size(o->ptr);
+    } else if (o->type == REDIS_LIST &&
+               o->encoding == REDIS_ENCODING_QUICKLIST)
+    {
+        quicklist *ql = o->ptr;
+        quicklistNode *node = ql->head;
+
+        asize = sizeof(*o)+zmalloc_size(ql);
+        while(node && sampled < samples) {
+            elesize += zmalloc_size(node)+zmalloc_size(node->entry);
+            sampled++;
+            node = node->next;
+        }
+        if (sampled) asize += (double)elesize/sampled*ql->len;
+    } else if (o->type == REDIS_SET && o->encoding == REDIS_ENCODING_HT) {
+        asize = sizeof(*o)+dictMemUsage(o->ptr)+
+                dictElementsComputeSize(o->ptr,samples,0);
+    } else if (o->type == REDIS_ZSET &&
+               o->encoding == REDIS_ENCODING_SKIPLIST)
+    {
+        zset *zs = o->ptr;
+
+        /* The elements are shared by the dict and the skiplist, and the
+         * dict values point to the scores inside the nodes. */
+        asize = sizeof(*o)+zmalloc_size(zs)+dictMemUsage(zs->dict)+
+                zslComputeSize(zs->zsl,samples);
+    } else if (o->type == REDIS_ZSET &&
+               o->encoding == REDIS_ENCODING_BTREE)
+    {
+        zset *zs = o->ptr;
+
+        /* The elements are shared by the dict and the leaves, and the
+         * scores are stored in both. */
+        asize = sizeof(*o)+zmalloc_size(zs)+dictMemUsage(zs->dict)+
+                zbtComputeSize(zs->zbt,samples);
+    } else if (o->type == REDIS_HASH && o->encoding == REDIS_ENCODING_HT) {
+        asize = sizeof(*o)+dictMemUsage(o->ptr)+
+                dictElementsComputeSize(o->ptr,samples,1);
     } else {
-        addReplyError(c,"Syntax error. Try OBJECT (refcount|encoding|idletime)");
+        redisPanic("Unknown object type or encoding");
     }
+    return asize;
 }
 
+/* Memory used by a client: the structure, the query buffer and the output
+ * buffer. */
+static size_t clientComputeSize(redisClient *c) {
+    size_t mem = zmalloc_size(c)+getClientOutputBufferMemoryUsage(c);
+
+    if (c->querybuf) mem += zmalloc_size_sds(c->querybuf);
+    return mem;
+}
+
+static void addReplyMemoryStat(redisClient *c, char *name, size_t value) {
+    addReplyBulkCString(c,name);
+    addReplyLongLong(c,value);
+}
+
+/* MEMORY STATS: break down the memory reported by zmalloc_used_memory()
+ * into the overhead of the server, and the dataset. The overhead is the
+ * memory used at startup, the replication backlog, the clients, the AOF
+ * buffers, the Lua scripts cache, the reply chunks pool, the RESP cache
+ * and the hash tables of the databases. Everything else is the dataset. */
+static void memoryStatsCommand(redisClient *c) {
+    size_t total = zmalloc_used_memory(), peak = server.stat_peak_memory;
+    size_t overhead = 0, keys = 0, mem, net, dataset;
+    size_t slaves = 0, clients = 0;
+    void *replylen = addDeferredMultiBulkLength(c);
+    long fields = 0;
+    listIter li;
+    listNode *ln;
+    int j;
+
+    if (total > peak) peak = total;
+    addReplyMemoryStat(c,"peak.allocated",peak);
+    addReplyMemoryStat(c,"total.allocated",total);
+    addReplyMemoryStat(c,"startup.allocated",server.initial_memory_usage);
+    overhead += server.initial_memory_usage;
+    fields += 3;
+
+    mem = server.repl_backlog ? zmalloc_size(server.repl_backlog) : 0;
+    addReplyMemoryStat(c,"replication.backlog",mem);
+    overhead += mem;
+    fields++;
+
+    /* Slaves output buffers hold the replication stream, so they are
+     * reported apart from the ones of the normal clients. */
+    listRewind(server.clients,&li);
+    while((ln = listNext(&li)) != NULL) {
+        redisClient *cl = listNodeValue(ln);
+
+        if ((cl->flags & REDIS_SLAVE) && !(cl->flags & REDIS_MONITOR))
+            slaves += clientComputeSize(cl);
+        else
+            clients += clientComputeSize(cl);
+    }
+    addReplyMemoryStat(c,"clients.slaves",slaves);
+    addReplyMemoryStat(c,"clients.normal",clients);
+    overhead += slaves+clients;
+    fields += 2;
+
+    mem = 0;
+    if (server.aof_state != REDIS_AOF_OFF)
+        mem = zmalloc_size_sds(server.aof_buf)+aofRewriteBufferSize();
+    addReplyMemoryStat(c,"aof.buffer",mem);
+    overhead += mem;
+    fields++;
+
+    /* The Lua interpreter uses its own allocator, only the scripts bodies
+     * stored by the server are accounted by zmalloc. */
+    mem = luaScriptsComputeSize();
+    addReplyMemoryStat(c,"lua.caches",mem);
+    overhead += mem;
+    fields++;
+
+    mem = replyChunkPoolMemory();
+    addReplyMemoryStat(c,"reply.chunk.pool",mem);
+    overhead += mem;
+    fields++;
+
+    addReplyMemoryStat(c,"resp.cache",server.resp_cache_memory);
+    overhead += server.resp_cache_memory;
+    fields++;
+
+    for (j = 0; j < server.dbnum; j++) {
+        redisDb *db = server.db+j;
+        size_t main, expires;
+        char dbname[32];
+
+        if (dictSize(db->dict) == 0) continue;
+        keys += dictSize(db->dict);
+        main = dictMemUsage(db->dict);
+        expires = dictMemUsage(db->expires);
+        if (db->expires_index)
+            expires += zslComputeSize(db->expires_index,
+                                      OBJ_COMPUTE_SIZE_DEF_SAMPLES);
+        snprintf(dbname,sizeof(dbname),"db.%d",j);
+        addReplyBulkCString(c,dbname);
+        addReplyMultiBulkLen(c,4);
+        addReplyMemoryStat(c,"overhead.hashtable.main",main);
+        addReplyMemoryStat(c,"overhead.hashtable.expires",expires);
+        overhead += main+expires;
+        fields++;
+    }
+
+    dataset = total > overhead ? total-overhead : 0;
+    net = total > server.initial_memory_usage ?
+          total-server.initial_memory_usage : 0;
+    addReplyMemoryStat(c,"overhead.total",overhead);
+    addReplyMemoryStat(c,"keys.count",keys);
+    addReplyMemoryStat(c,"keys.bytes-per-key",keys ? net/keys : 0);
+    addReplyMemoryStat(c,"dataset.bytes",dataset);
+    addReplyBulkCString(c,"dataset.percentage");
+    addReplyDouble(c,net ? (double)dataset*100/net : 0);
+    addReplyBulkCString(c,"peak.percentage");
+    addReplyDouble(c,(double)total*100/peak);
+    addReplyBulkCString(c,"fragmentation");
+    addReplyDouble(c,zmalloc_get_fragmentation_ratio());
+    fields += 7;
+    setDeferredMultiBulkLength(c,replylen,fields*2);
+}
+
+#if defined(USE_JEMALLOC)
+static void memoryMallocStatsWrite(void *privdata, const char *msg) {
+    sds *info = privdata;
+
+    *info = sdscat(*info,msg);
+}
+#endif
+
+void memoryCommand(redisClient *c) {
+    if (!strcasecmp(c->argv[1]->ptr,"usage") && c->argc >= 3) {
+        redisDb *db = c->db;
+        robj *key = c->argv[2];
+        long long samples = OBJ_COMPUTE_SIZE_DEF_SAMPLES;
+        dictEntry *de;
+        size_t usage;
+        int j;
+
+        for (j = 3; j < c->argc; j++) {
+            if (!strcasecmp(c->argv[j]->ptr,"samples") && j+1 < c->argc) {
+                if (getLongLongFromObjectOrReply(c,c->argv[j+1],&samples,
+                                                 NULL) != REDIS_OK) return;
+                if (samples < 0) {
+                    addReply(c,shared.syntaxerr);
+                    return;
+                }
+                /* SAMPLES 0 means to look at every element. */
+                if (samples == 0) samples = LLONG_MAX;
+                j++;
+            } else {
+                addReply(c,shared.syntaxerr);
+                return;
+            }
+        }
+
+        de = dictFindWithHash(db->dict,key->ptr,keyHash(key));
+        if (de == NULL) {
+            addReply(c,shared.nullbulk);
+            return;
+        }
+        usage = objectComputeSize(dictGetVal(de),samples)+
+                dictEntryMemUsage(db->dict,de);
+        if (!dictEmbedsKeys(db->dict))
+            usage += zmalloc_size_sds(dictGetKey(de));
+        de = dictFindWithHash(db->expires,key->ptr,keyHash(key));
+        if (de) usage += dictEntryMemUsage(db->expires,de);
+        addReplyLongLong(c,usage);
+    } else if (!strcasecmp(c->argv[1]->ptr,"stats") && c->argc == 2) {
+        memoryStatsCommand(c);
+    } else if (!strcasecmp(c->argv[1]->ptr,"malloc-stats") && c->argc == 2) {
+#if defined(USE_JEMALLOC)
+        sds info = sdsempty();
+
+        je_malloc_stats_print(memoryMallocStatsWrite,&info,NULL);
+        addReplyBulkCBuffer(c,info,sdslen(info));
+        sdsfree(info);
+#else
+        addReplyBulkCString(c,"Stats not supported for the current allocator");
+#endif
+    } else {
+        addReplyError(c,"Syntax error. Try MEMORY (usage <key> [samples <count>]|stats|malloc-stats)");
+    }
+}
@@ -0,0 +1,925 @@
+/* quicklist.c - A doubly linked list of listpacks
+ *
+ * Copyright (c) 2014, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* A quicklist is a doubly linked list of listpacks. A listpack is very memory
+ * efficient, but every insertion or deletion reallocates and moves the whole
+ * list, so it is only usable for small lists. A linked list of objects
+ * supports O(1) pushes and pops of any length, but costs a list node, an
+ * object and a string, more than 70 bytes, for every element.
+ *
+ * The quicklist takes the best of both: the elements are stored in listpacks
+ * of bounded size (see the 'fill' field of the quicklist), linked together.
+ * Pushing and popping only touch the listpack at the head or the tail, a
+ * new node is created when that listpack is full, and a node is freed as
+ * soon as its listpack is empty.
+ *
+ * Long lists are mostly accessed at the ends, so the listpacks of the inner
+ * nodes can be compressed with LZF (see the 'compress' field of the
+ * quicklist): the 'compress' nodes nearest to each end are always kept
+ * uncompressed, the others are compressed, and decompressed only while an
+ * operation reads or modifies them. */
+
+#include <string.h>
+
+#include "quicklist.h"
+#include "zmalloc.h"
+#include "listpack.h"
+#include "ziplist.h"
+#include "util.h"
+#include "lzf.h"
+
+/* Max listpack size of the negative fill values, from -1 to -5. */
+static const size_t optimization_level[] = {4096, 8192, 16384, 32768, 65536};
+
+/* With a positive fill, listpacks are not allowed to grow bigger than this
+ * anyway, unless a single element is bigger than the limit. */
+#define SIZE_SAFETY_LIMIT 8192
+
+/* Bytes of the header and end marker of a listpack. */
+#define LISTPACK_OVERHEAD 7
+
+/* Listpacks smaller than this are not worth compressing, and compression
+ * must save at least MIN_COMPRESS_IMPROVE bytes to be kept. */
+#define MIN_COMPRESS_BYTES 48
+#define MIN_COMPRESS_IMPROVE 8
+
+#define quicklistNodeUpdateSz(node) \
+    do { (node)->sz = lpBytes((node)->entry); } while (0)
+
+/* Create a new quicklist. Free with quicklistRelease(). */
+quicklist *quicklistCreate(void) {
+    quicklist *quicklist;
+
+    quicklist = zmalloc(sizeof(*quicklist));
+    quicklist->head = quicklist->tail = NULL;
+    quicklist->len = 0;
+    quicklist->count = 0;
+    quicklist->fill = -2;
+    quicklist->compress = 0;
+    return quicklist;
+}
+
+/* Set the number of nodes to keep uncompressed at each end of the list.
+ * Nodes that are already in the list are compressed or decompressed only
+ * when they are next modified. */
+void quicklistSetCompressDepth(quicklist *quicklist, int compress) {
+    if (compress > QUICKLIST_MAX_COMPRESS) {
+        compress = QUICKLIST_MAX_COMPRESS;
+    } else if (compress < 0) {
+        compress = 0;
+    }
+    quicklist->compress = compress;
+}
+
+void quicklistSetFill(quicklist *quicklist, int fill) {
+    if (fill > QUICKLIST_MAX_FILL) {
+        fill = QUICKLIST_MAX_FILL;
+    } else if (fill < -5) {
+        fill = -5;
+    } else if (fill == 0) {
+        fill = 1;
+    }
+    quicklist->fill = fill;
+}
+
+void quicklistSetOptions(quicklist *quicklist, int fill, int compress) {
+    quicklistSetFill(quicklist,fill);
+    quicklistSetCompressDepth(quicklist,compress);
+}
+
+/* Create a new quicklist with the specified fill and compress depth. */
+quicklist *quicklistNew(int fill, int compress) {
+    quicklist *quicklist = quicklistCreate();
+    quicklistSetOptions(quicklist,fill,compress);
+    return quicklist;
+}
+
+static quicklistNode *quicklistCreateNode(void) {
+    quicklistNode *node;
+
+    node = zmalloc(sizeof(*node));
+    node->entry = NULL;
+    node->count = 0;
+    node->sz = 0;
+    node->encoding = QUICKLIST_NODE_ENCODING_RAW;
+    node->next = node->prev = NULL;
+    return node;
+}
+
+/* Compress the listpack of 'node' with LZF.
+ *
+ * Returns 1 if the node was compressed, 0 if the listpack is too small or
+ * does not compress well enough, and it was left as it was. */
+static int __quicklistCompressNode(quicklistNode *node) {
+    quicklistLZF *lzf;
+
+    if (node->sz < MIN_COMPRESS_BYTES) return 0;
+
+    lzf = zmalloc(sizeof(*lzf)+node->sz);
+    lzf->sz = lzf_compress(node->entry,node->sz,lzf->compressed,node->sz);
+    if (lzf->sz == 0 || lzf->sz+MIN_COMPRESS_IMPROVE >= node->sz) {
+        zfree(lzf);
+        return 0;
+    }
+    lzf = zrealloc(lzf,sizeof(*lzf)+lzf->sz);
+    zfree(node->entry);
+    node->entry = (unsigned char*)lzf;
+    node->encoding = QUICKLIST_NODE_ENCODING_LZF;
+    return 1;
+}
+
+/* Decompress the listpack of a compressed 'node'. */
+static void __quicklistDecompressNode(quicklistNode *node) {
+    quicklistLZF *lzf = (quicklistLZF*)node->entry;
+    unsigned char *lp = zmalloc(node->sz);
+
+    if (lzf_decompress(lzf->compressed,lzf->sz,lp,node->sz) == 0) {
+        /* The listpack was compressed by us: this can't happen. */
+        zfree(lp);
+        return;
+    }
+    zfree(lzf);
+    node->entry = lp;
+    node->encoding = QUICKLIST_NODE_ENCODING_RAW;
+}
+
+#define quicklistCompressNode(node) do { \
+    if ((node) && (node)->encoding == QUICKLIST_NODE_ENCODING_RAW) \
+        __quicklistCompressNode(node); \
+} while (0)
+
+#define quicklistDecompressNode(node) do { \
+    if ((node) && (node)->encoding == QUICKLIST_NODE_ENCODING_LZF) \
+        __quicklistDecompressNode(node); \
+} while (0)
+
+/* Make sure the 'compress' nodes at each end of the list are uncompressed,
+ * and compress the two nodes just after them, the only ones that may have
+ * just left the uncompressed ends. Then compress 'node', if it is not one
+ * of the end nodes: the operations that decompress an inner node call this
+ * function when they are done with it. 'node' may be NULL. */
+static void quicklistCompress(const quicklist *quicklist, quicklistNode *node) {
+    quicklistNode *forward, *reverse;
+    unsigned int depth = 0;
+    int in_depth = 0;
+
+    /* If the list is not longer than the two ends, no node is compressed. */
+    if (quicklist->compress == 0 || quicklist->len < quicklist->compress*2)
+        return;
+
+    forward = quicklist->head;
+    reverse = quicklist->tail;
+    while (depth++ < quicklist->compress) {
+        quicklistDecompressNode(forward);
+        quicklistDecompressNode(reverse);
+        if (forward == node || reverse == node) in_depth = 1;
+
+        /* The two ends met: every node is uncompressed. */
+        if (forward == reverse || forward->next == reverse) return;
+
+        forward = forward->next;
+        reverse = reverse->prev;
+    }
+
+    if (!in_depth) quicklistCompressNode(node);
+    quicklistCompressNode(forward);
+    quicklistCompressNode(reverse);
+}
+
+/* Return the compressed listpack of a compressed 'node' in '*data', and its
+ * length. Used to save compressed nodes without decompressing them. */
+size_t quicklistGetLzf(const quicklistNode *node, void **data) {
+    quicklistLZF *lzf = (quicklistLZF*)node->entry;
+
+    *data = lzf->compressed;
+    return lzf->sz;
+}
+
+/* Free the whole quicklist. */
+void quicklistRelease(quicklist *quicklist) {
+    quicklistNode *current, *next;
+
+    current = quicklist->head;
+    while (current) {
+        next = current->next;
+        zfree(current->entry);
+        zfree(current);
+        current = next;
+    }
+    zfree(quicklist);
+}
+
+/* Link 'new_node' after 'old_node' if 'after' is true, otherwise before.
+ * 'old_node' may only be NULL when the quicklist is empty. */
+static void __quicklistInsertNode(quicklist *quicklist, quicklistNode *old_node,
+                                  quicklistNode *new_node, int after) {
+    if (after) {
+        new_node->prev = old_node;
+        if (old_node) {
+            new_node->next = old_node->next;
+            if (old_node->next) old_node->next->prev = new_node;
+            old_node->next = new_node;
+        }
+        if (quicklist->tail == old_node) quicklist->tail = new_node;
+    } else {
+        new_node->next = old_node;
+        if (old_node) {
+            new_node->prev = old_node->prev;
+            if (old_node->prev) old_node->prev->next = new_node;
+            old_node->prev = new_node;
+        }
+        if (quicklist->head == old_node) quicklist->head = new_node;
+    }
+    if (quicklist->len == 0) quicklist->head = quicklist->tail = new_node;
+    quicklist->len++;
+    quicklistCompress(quicklist,new_node);
+}
+
+/* Unlink and free the node, with the entries of its listpack. */
+static void __quicklistDelNode(quicklist *quicklist, quicklistNode *node) {
+    if (node->next) node->next->prev = node->prev;
+    if (node->prev) node->prev->next = node->next;
+    if (node == quicklist->tail) quicklist->tail = node->prev;
+    if (node == quicklist->head) quicklist->head = node->next;
+    quicklist->len--;
+    quicklist->count -= node->count;
+    zfree(node->entry);
+    zfree(node);
+
+    /* If the node was one of the uncompressed ends, the next node inwards
+     * has to be decompressed. */
+    quicklistCompress(quicklist,NULL);
+}
+
+/* Return true if a listpack of 'sz' bytes is within the negative fill. */
+static int _quicklistNodeSizeMeetsOptimizationRequirement(const size_t sz,
+                                                          const int fill) {
+    size_t offset;
+
+    if (fill >= 0) return 0;
+    offset = (-fill) - 1;
+    if (offset < sizeof(optimization_level)/sizeof(*optimization_level))
+        return sz <= optimization_level[offset];
+    return 0;
+}
+
+#define sizeMeetsSafetyLimit(sz) ((sz) <= SIZE_SAFETY_LIMIT)
+
+/* Return true if an element of 'sz' bytes can be added to the listpack of
+ * 'node' without exceeding the fill. */
+static int _quicklistNodeAllowInsert(const quicklistNode *node, const int fill,
+                                     const size_t sz) {
+    size_t new_sz;
+    int lp_overhead;
+
+    if (node == NULL) return 0;
+
+    /* Estimate the size of the encoding type and of the element length
+     * stored after the data of the new element. */
+    if (sz < 64)
+        lp_overhead = 1;
+    else if (sz < 4096)
+        lp_overhead = 2;
+    else
+        lp_overhead = 5;
+    lp_overhead += (sz+lp_overhead < 128) ? 1 : (sz+lp_overhead < 16384) ? 2 : 5;
+    new_sz = node->sz + sz + lp_overhead;
+
+    if (_quicklistNodeSizeMeetsOptimizationRequirement(new_sz,fill))
+        return 1;
+    else if (!sizeMeetsSafetyLimit(new_sz))
+        return 0;
+    else if ((int)node->count < fill)
+        return 1;
+    else
+        return 0;
+}
+
+/* Return true if the listpacks of 'a' and 'b' can be merged without
+ * exceeding the fill. */
+static int _quicklistNodeAllowMerge(const quicklistNode *a,
+                                    const quicklistNode *b, const int fill) {
+    size_t merge_sz;
+
+    if (!a || !b) return 0;
+    merge_sz = a->sz + b->sz - LISTPACK_OVERHEAD;
+    if (_quicklistNodeSizeMeetsOptimizationRequirement(merge_sz,fill))
+        return 1;
+    else if (!sizeMeetsSafetyLimit(merge_sz))
+        return 0;
+    else if ((int)(a->count + b->count) <= fill)
+        return 1;
+    else
+        return 0;
+}
+
+/* Add the entry at the head or the tail of the listpack of 'node'. */
+static void _quicklistNodePush(quicklistNode *node, void *value,
+                               const size_t sz, int where) {
+    node->entry = lpPush(node->entry,value,sz,where);
+    node->count++;
+    quicklistNodeUpdateSz(node);
+}
+
+/* Create a node holding only the specified entry. */
+static quicklistNode *_quicklistCreateNodeWith(void *value, const size_t sz) {
+    quicklistNode *node = quicklistCreateNode();
+
+    node->entry = lpNew();
+    _quicklistNodePush(node,value,sz,LP_TAIL);
+    return node;
+}
+
+/* Add a new entry to the head of the quicklist.
+ *
+ * Returns 0 if an existing head was used.
+ * Returns 1 if a new head was created. */
+int quicklistPushHead(quicklist *quicklist, void *value, size_t sz) {
+    quicklistNode *orig_head = quicklist->head;
+
+    if (_quicklistNodeAllowInsert(quicklist->head,quicklist->fill,sz)) {
+        _quicklistNodePush(quicklist->head,value,sz,LP_HEAD);
+    } else {
+        quicklistNode *node = _quicklistCreateNodeWith(value,sz);
+        __quicklistInsertNode(quicklist,quicklist->head,node,0);
+    }
+    quicklist->count++;
+    return (orig_head != quicklist->head);
+}
+
+/* Add a new entry to the tail of the quicklist.
+ *
+ * Returns 0 if an existing tail was used.
+ * Returns 1 if a new tail was created. */
+int quicklistPushTail(quicklist *quicklist, void *value, size_t sz) {
+    quicklistNode *orig_tail = quicklist->tail;
+
+    if (_quicklistNodeAllowInsert(quicklist->tail,quicklist->fill,sz)) {
+        _quicklistNodePush(quicklist->tail,value,sz,LP_TAIL);
+    } else {
+        quicklistNode *node = _quicklistCreateNodeWith(value,sz);
+        __quicklistInsertNode(quicklist,quicklist->tail,node,1);
+    }
+    quicklist->count++;
+    return (orig_tail != quicklist->tail);
+}
+
+/* Wrapper to allow argument-based switching between HEAD/TAIL pop */
+void quicklistPush(quicklist *quicklist, void *value, const size_t sz,
+                   int where) {
+    if (where == QUICKLIST_HEAD) {
+        quicklistPushHead(quicklist,value,sz);
+    } else if (where == QUICKLIST_TAIL) {
+        quicklistPushTail(quicklist,value,sz);
+    }
+}
+
+/* Append the listpack 'lp' as a new tail node, whatever its size. The
+ * quicklist takes ownership of 'lp'. Used to load lists from RDB files. */
+void quicklistAppendListpack(quicklist *quicklist, unsigned char *lp) {
+    quicklistNode *node = quicklistCreateNode();
+
+    node->entry = lp;
+    node->count = lpLength(node->entry);
+    node->sz = lpBytes(lp);
+    __quicklistInsertNode(quicklist,quicklist->tail,node,1);
+    quicklist->count += node->count;
+}
+
+/* Append the entry 'p' of a ziplist to the tail of the quicklist. */
+static void _quicklistPushZiplistEntry(quicklist *quicklist, unsigned char *p) {
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long vlong;
+    char buf[32];
+
+    ziplistGet(p,&vstr,&vlen,&vlong);
+    if (vstr == NULL) {
+        vlen = ll2string(buf,sizeof(buf),vlong);
+        vstr = (unsigned char*)buf;
+    }
+    quicklistPushTail(quicklist,vstr,vlen);
+}
+
+/* Create a quicklist with the entries of the ziplist 'zl', that is freed,
+ * splitting them in nodes according to 'fill'. */
+quicklist *quicklistCreateFromZiplist(int fill, int compress,
+                                      unsigned char *zl) {
+    quicklist *quicklist = quicklistNew(fill,compress);
+    unsigned char *p = ziplistIndex(zl,0);
+
+    while (p != NULL) {
+        _quicklistPushZiplistEntry(quicklist,p);
+        p = ziplistNext(zl,p);
+    }
+    zfree(zl);
+    return quicklist;
+}
+
+/* Delete the entry 'p' of the uncompressed 'node', freeing the node if it
+ * is left empty. '*p' is updated to the entry following the deleted one.
+ *
+ * Returns 1 if the node was freed, 0 otherwise. */
+static int quicklistDelIndex(quicklist *quicklist, quicklistNode *node,
+                             unsigned char **p) {
+    int gone = 0;
+
+    node->entry = lpDelete(node->entry,p);
+    node->count--;
+    if (node->count == 0) {
+        gone = 1;
+        __quicklistDelNode(quicklist,node);
+    } else {
+        quicklistNodeUpdateSz(node);
+    }
+    quicklist->count--;
+    return gone;
+}
+
+/* Delete the entry returned by quicklistNext(), so that the next call to
+ * quicklistNext() returns the entry that followed it. */
+void quicklistDelEntry(quicklistIter *iter, quicklistEntry *entry) {
+    quicklistNode *prev = entry->node->prev;
+    quicklistNode *next = entry->node->next;
+    int deleted_node = quicklistDelIndex((quicklist *)entry->quicklist,
+                                         entry->node,&entry->zi);
+
+    /* The iterator seeks its offset again at the next call. Forward
+     * iterators use offsets from the start of the listpack and backward
+     * iterators offsets from its end, so the offset of the deleted entry is
+     * the offset of the next one, or it is out of range when the deleted
+     * entry was the last of its node in the iteration direction. */
+    iter->zi = NULL;
+    if (deleted_node) {
+        if (iter->direction == AL_START_HEAD) {
+            iter->current = next;
+            iter->offset = 0;
+        } else {
+            iter->current = prev;
+            iter->offset = -1;
+        }
+    }
+}
+
+/* Replace the entry at 'index' with 'data'.
+ *
+ * Returns 1 if the entry was replaced, 0 if the index is out of range. */
+int quicklistReplaceAtIndex(quicklist *quicklist, long index, void *data,
+                            size_t sz) {
+    quicklistEntry entry;
+
+    if (quicklistIndex(quicklist,index,&entry)) {
+        entry.node->entry = lpReplace(entry.node->entry,&entry.zi,data,sz);
+        quicklistNodeUpdateSz(entry.node);
+        quicklistCompress(quicklist,entry.node);
+        return 1;
+    }
+    return 0;
+}
+
+/* Move all the entries of 'b' at the end of 'a', and free 'b'. */
+static void _quicklistMergeInto(quicklist *quicklist, quicklistNode *a,
+                                quicklistNode *b) {
+    quicklistDecompressNode(a);
+    quicklistDecompressNode(b);
+    a->entry = lpMerge(a->entry,b->entry);
+    a->count += b->count;
+    quicklistNodeUpdateSz(a);
+
+    /* The entries were moved, not deleted. */
+    b->count = 0;
+    __quicklistDelNode(quicklist,b);
+    quicklistCompress(quicklist,a);
+}
+
+/* Merge the nodes around 'center' where the fill allows it, so that
+ * inserting in the middle of full nodes does not leave behind a trail of
+ * small nodes:
+ *   - (center->prev->prev, center->prev)
+ *   - (center->next, center->next->next)
+ *   - (center->prev, center)
+ *   - (center, center->next) */
+static void _quicklistMergeNodes(quicklist *quicklist, quicklistNode *center) {
+    int fill = quicklist->fill;
+    quicklistNode *prev = NULL, *prev_prev = NULL, *next = NULL;
+    quicklistNode *next_next = NULL, *target;
+
+    if (center->prev) {
+        prev = center->prev;
+        if (center->prev->prev) prev_prev = center->prev->prev;
+    }
+    if (center->next) {
+        next = center->next;
+        if (center->next->next) next_next = center->next->next;
+    }
+
+    if (_quicklistNodeAllowMerge(prev_prev,prev,fill)) {
+        _quicklistMergeInto(quicklist,prev_prev,prev);
+        prev = prev_prev = NULL;
+    }
+    if (_quicklistNodeAllowMerge(next,next_next,fill)) {
+        _quicklistMergeInto(quicklist,next,next_next);
+        next = next_next = NULL;
+    }
+
+    target = center;
+    if (_quicklistNodeAllowMerge(center->prev,center,fill)) {
+        target = center->prev;
+        _quicklistMergeInto(quicklist,target,center);
+    }
+    if (_quicklistNodeAllowMerge(target,target->next,fill))
+        _quicklistMergeInto(quicklist,target,target->next);
+}
+
+/* Split the uncompressed 'node' in two at 'offset', returning the new node,
+ * that is not linked yet. If 'after' is true the new node gets the entries after
+ * 'offset' and the original node keeps [0, offset], otherwise the new node
+ * gets [0, offset) and the original node keeps the rest. */
+static quicklistNode *_quicklistSplitNode(quicklistNode *node, long offset,
+                                          int after) {
+    quicklistNode *new_node = quicklistCreateNode();
+    unsigned int count = node->count;
+
+    new_node->entry = zmalloc(node->sz);
+    memcpy(new_node->entry,node->entry,node->sz);
+
+    if (after) {
+        node->entry = lpDeleteRange(node->entry,offset+1,count-offset-1);
+        new_node->entry = lpDeleteRange(new_node->entry,0,offset+1);
+    } else {
+        node->entry = lpDeleteRange(node->entry,0,offset);
+        new_node->entry = lpDeleteRange(new_node->entry,offset,count-offset);
+    }
+    node->count = lpLength(node->entry);
+    quicklistNodeUpdateSz(node);
+    new_node->count = lpLength(new_node->entry);
+    quicklistNodeUpdateSz(new_node);
+    return new_node;
+}
+
+/* Insert a new entry before or after the existing 'entry', returned by
+ * quicklistNext() on 'iter'.
+ *
+ * If 'after' is true the new value is inserted after 'entry', otherwise
+ * before it. When the node of 'entry' is full the value goes to the
+ * neighbour node if it has room, or to a new node, splitting the full node
+ * if the entry is in the middle.
+ *
+ * The nodes may be split or merged, so 'iter' can't be used any longer,
+ * other than to release it. */
+static void _quicklistInsert(quicklistIter *iter, quicklistEntry *entry,
+                             void *value, const size_t sz, int after) {
+    quicklist *quicklist = (struct quicklist *)entry->quicklist;
+    int full = 0, at_tail = 0, at_head = 0;
+    int full_next = 0, full_prev = 0;
+    int fill = quicklist->fill;
+    quicklistNode *node = entry->node;
+    quicklistNode *new_node = NULL;
+
+    iter->current = NULL;
+    iter->zi = NULL;
+
+    if (!node) {
+        /* No entry: the list is empty. */
+        new_node = _quicklistCreateNodeWith(value,sz);
+        __quicklistInsertNode(quicklist,NULL,new_node,after);
+        quicklist->count++;
+        return;
+    }
+    quicklistDecompressNode(node);
+
+    if (!_quicklistNodeAllowInsert(node,fill,sz)) full = 1;
+    if (after && lpNext(node->entry,entry->zi) == NULL) {
+        at_tail = 1;
+        if (!_quicklistNodeAllowInsert(node->next,fill,sz)) full_next = 1;
+    }
+    if (!after && lpPrev(node->entry,entry->zi) == NULL) {
+        at_head = 1;
+        if (!_quicklistNodeAllowInsert(node->prev,fill,sz)) full_prev = 1;
+    }
+
+    if (!full && after) {
+        unsigned char *next = lpNext(node->entry,entry->zi);
+
+        if (next == NULL) {
+            node->entry = lpPush(node->entry,value,sz,LP_TAIL);
+        } else {
+            node->entry = lpInsert(node->entry,next,value,sz);
+        }
+        node->count++;
+        quicklistNodeUpdateSz(node);
+        quicklistCompress(quicklist,node);
+    } else if (!full && !after) {
+        node->entry = lpInsert(node->entry,entry->zi,value,sz);
+        node->count++;
+        quicklistNodeUpdateSz(node);
+        quicklistCompress(quicklist,node);
+    } else if (full && at_tail && node->next && !full_next && after) {
+        /* The next node has room: insert at its head. */
+        quicklistCompress(quicklist,node);
+        quicklistDecompressNode(node->next);
+        _quicklistNodePush(node->next,value,sz,LP_HEAD);
+        quicklistCompress(quicklist,node->next);
+    } else if (full && at_head && node->prev && !full_prev && !after) {
+        /* The previous node has room: insert at its tail. */
+        quicklistCompress(quicklist,node);
+        quicklistDecompressNode(node->prev);
+        _quicklistNodePush(node->prev,value,sz,LP_TAIL);
+        quicklistCompress(quicklist,node->prev);
+    } else if (full && ((at_tail && after) || (at_head && !after))) {
+        /* The neighbour is full as well: create a new node in between. */
+        new_node = _quicklistCreateNodeWith(value,sz);
+        __quicklistInsertNode(quicklist,node,new_node,after);
+        quicklistCompress(quicklist,node);
+    } else {
+        /* The entry is in the middle of a full node: split it, and add
+         * the value to the half that is on the side of the insertion. */
+        long offset = entry->offset;
+
+        if (offset < 0) offset += node->count;
+        new_node = _quicklistSplitNode(node,offset,after);
+        _quicklistNodePush(new_node,value,sz,
+                           after ? LP_HEAD : LP_TAIL);
+        __quicklistInsertNode(quicklist,node,new_node,after);
+        quicklistCompress(quicklist,node);
+        _quicklistMergeNodes(quicklist,node);
+    }
+    quicklist->count++;
+}
+
+void quicklistInsertBefore(quicklistIter *iter, quicklistEntry *entry,
+                           void *value, const size_t sz) {
+    _quicklistInsert(iter,entry,value,sz,0);
+}
+
+void quicklistInsertAfter(quicklistIter *iter, quicklistEntry *entry,
+                          void *value, const size_t sz) {
+    _quicklistInsert(iter,entry,value,sz,1);
+}
+
+/* Delete 'count' entries starting from the entry at index 'start', that
+ * may be negative. Whole nodes are freed without touching their listpacks.
+ *
+ * Returns 1 if entries were deleted, 0 if nothing was deleted. */
+int quicklistDelRange(quicklist *quicklist, const long start,
+                      const long count) {
+    quicklistEntry entry;
+    quicklistNode *node;
+    unsigned long extent;
+    long offset;
+
+    if (count <= 0) return 0;
+
+    /* Limit the range to the entries that exist after 'start'. */
+    extent = count;
+    if (start >= 0 && extent > (quicklist->count - start)) {
+        extent = quicklist->count - start;
+    } else if (start < 0 && extent > (unsigned long)(-start)) {
+        extent = -start;
+    }
+
+    if (!quicklistIndex(quicklist,start,&entry)) return 0;
+
+    node = entry.node;
+    offset = entry.offset;
+    if (offset < 0) offset += node->count;
+
+    while (extent) {
+        quicklistNode *next = node->next;
+        unsigned long del = node->count - offset;
+
+        if (del > extent) del = extent;
+        if (offset == 0 && del == node->count) {
+            __quicklistDelNode(quicklist,node);
+        } else {
+            quicklistDecompressNode(node);
+            node->entry = lpDeleteRange(node->entry,offset,del);
+            node->count -= del;
+            quicklist->count -= del;
+            quicklistNodeUpdateSz(node);
+            quicklistCompress(quicklist,node);
+        }
+        extent -= del;
+        node = next;
+        offset = 0;
+    }
+    return 1;
+}
+
+/* Passthrough to lpCompare() */
+int quicklistCompare(unsigned char *p1, unsigned char *p2, int p2_len) {
+    return lpCompare(p1,p2,p2_len);
+}
+
+/* Returns a quicklist iterator 'iter'. After the initialization every
+ * call to quicklistNext() will return the next element of the quicklist. */
+quicklistIter *quicklistGetIterator(const quicklist *quicklist, int direction) {
+    quicklistIter *iter;
+
+    iter = zmalloc(sizeof(*iter));
+    if (direction == AL_START_HEAD) {
+        iter->current = quicklist->head;
+        iter->offset = 0;
+    } else {
+        iter->current = quicklist->tail;
+        iter->offset = -1;
+    }
+    iter->direction = direction;
+    iter->quicklist = quicklist;
+    iter->zi = NULL;
+    return iter;
+}
+
+/* Initialize an iterator at a specific offset 'idx' and make the iterator
+ * return nodes in 'direction' direction. Returns NULL if 'idx' is out of
+ * range. */
+quicklistIter *quicklistGetIteratorAtIdx(const quicklist *quicklist,
+                                         const int direction,
+                                         const long long idx) {
+    quicklistEntry entry;
+    quicklistIter *iter;
+
+    if (!quicklistIndex(quicklist,idx,&entry)) return NULL;
+
+    iter = quicklistGetIterator(quicklist,direction);
+    iter->current = entry.node;
+    iter->offset = entry.offset;
+    /* See quicklistDelEntry() for the sign of the offset. */
+    if (direction == AL_START_HEAD && iter->offset < 0)
+        iter->offset += entry.node->count;
+    else if (direction == AL_START_TAIL && iter->offset >= 0)
+        iter->offset -= entry.node->count;
+    return iter;
+}
+
+/* Release the iterator, compressing again the node it was visiting. 'iter'
+ * may be NULL, as returned by quicklistGetIteratorAtIdx(). */
+void quicklistReleaseIterator(quicklistIter *iter) {
+    if (iter == NULL) return;
+    if (iter->current) quicklistCompress(iter->quicklist,iter->current);
+    zfree(iter);
+}
+
+/* Get the next element of the quicklist, returning 1 and populating 'entry',
+ * or 0 when the iteration is over.
+ *
+ * The list must not be modified while iterating, other than deleting the
+ * returned entry with quicklistDelEntry(). */
+int quicklistNext(quicklistIter *iter, quicklistEntry *entry) {
+    entry->quicklist = NULL;
+    entry->node = NULL;
+    entry->value = NULL;
+
+    while (iter && iter->current) {
+        quicklistNode *node = iter->current;
+
+        if (!iter->zi) {
+            quicklistDecompressNode(node);
+            iter->zi = lpSeek(node->entry,iter->offset);
+        } else if (iter->direction == AL_START_HEAD) {
+            iter->zi = lpNext(node->entry,iter->zi);
+            iter->offset++;
+        } else {
+            iter->zi = lpPrev(node->entry,iter->zi);
+            iter->offset--;
+        }
+
+        if (iter->zi) {
+            entry->quicklist = iter->quicklist;
+            entry->node = node;
+            entry->zi = iter->zi;
+            entry->offset = iter->offset;
+            lpGet(entry->zi,&entry->value,&entry->sz,&entry->longval);
+            return 1;
+        }
+
+        /* We ran out of listpack entries: move to the next node. */
+        quicklistCompress(iter->quicklist,node);
+        if (iter->direction == AL_START_HEAD) {
+            iter->current = node->next;
+            iter->offset = 0;
+        } else {
+            iter->current = node->prev;
+            iter->offset = -1;
+        }
+    }
+    return 0;
+}
+
+/* Populate 'entry' with the element at the specified zero-based index,
+ * where 0 is the head, 1 is the element next to head and so on. Negative
+ * integers are used in order to count from the tail, -1 is the last
+ * element, -2 the penultimate and so on.
+ *
+ * The node of the element is left uncompressed, so that the returned value
+ * can be used: call quicklistCompressEntry() when done with it.
+ *
+ * Returns 1 if the element was found, 0 if the index is out of range. */
+int quicklistIndex(const quicklist *quicklist, const long long idx,
+                   quicklistEntry *entry) {
+    quicklistNode *n;
+    unsigned long long accum = 0;
+    unsigned long long index;
+    int forward = idx < 0 ? 0 : 1;
+
+    entry->quicklist = quicklist;
+    entry->node = NULL;
+    entry->value = NULL;
+
+    index = forward ? idx : (-idx) - 1;
+    if (index >= quicklist->count) return 0;
+
+    /* Skip whole nodes, from the side of the list that is nearest. */
+    n = forward ? quicklist->head : quicklist->tail;
+    while (n) {
+        if ((accum + n->count) > index) break;
+        accum += n->count;
+        n = forward ? n->next : n->prev;
+    }
+    if (!n) return 0;
+
+    entry->node = n;
+    if (forward) {
+        entry->offset = index - accum;
+    } else {
+        entry->offset = (-index) - 1 + accum;
+    }
+    quicklistDecompressNode(n);
+    entry->zi = lpSeek(entry->node->entry,entry->offset);
+    lpGet(entry->zi,&entry->value,&entry->sz,&entry->longval);
+    return 1;
+}
+
+/* Compress again the node of an entry returned by quicklistIndex(), if it
+ * is one of the inner nodes of the list. */
+void quicklistCompressEntry(quicklistEntry *entry) {
+    if (entry->node) quicklistCompress(entry->quicklist,entry->node);
+}
+
+/* Pop from the quicklist head or tail. A string element is returned in
+ * '*data' and '*sz' as the value returned by 'saver', an integer element in
+ * '*sval', with '*data' set to NULL.
+ *
+ * Returns 0 if the quicklist is empty, 1 otherwise. */
+int quicklistPopCustom(quicklist *quicklist, int where, unsigned char **data,
+                       unsigned int *sz, long long *sval,
+                       void *(*saver)(unsigned char *data, unsigned int sz)) {
+    unsigned char *p;
+    unsigned char *vstr;
+    unsigned int vlen;
+    long long vlong;
+    int pos = (where == QUICKLIST_HEAD) ? 0 : -1;
+    quicklistNode *node;
+
+    if (quicklist->count == 0) return 0;
+
+    if (data) *data = NULL;
+    if (sz) *sz = 0;
+    if (sval) *sval = -123456789;
+
+    node = (where == QUICKLIST_HEAD) ? quicklist->head : quicklist->tail;
+    p = lpSeek(node->entry,pos);
+    if (lpGet(p,&vstr,&vlen,&vlong)) {
+        if (vstr) {
+            if (data) *data = saver(vstr,vlen);
+            if (sz) *sz = vlen;
+        } else {
+            if (sval) *sval = vlong;
+        }
+        quicklistDelIndex(quicklist,node,&p);
+        return 1;
+    }
+    return 0;
+}
+
+/* Return the number of entries of the quicklist. */
+unsigned long quicklistCount(const quicklist *ql) {
+    return ql->count;
+}
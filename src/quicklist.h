@@ -0,0 +1,144 @@
+/* quicklist.h - A doubly linked list of listpacks
+ *
+ * Copyright (c) 2014, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __QUICKLIST_H__
+#define __QUICKLIST_H__
+
+/* Every node holds a listpack of 'count' entries, 'sz' bytes long. When the
+ * node is compressed 'entry' points to a quicklistLZF instead, and 'sz' is
+ * still the size of the uncompressed listpack. */
+typedef struct quicklistNode {
+    struct quicklistNode *prev;
+    struct quicklistNode *next;
+    unsigned char *entry;
+    unsigned int sz;            /* Listpack size in bytes. */
+    unsigned int count : 30;    /* Number of entries of the listpack. */
+    unsigned int encoding : 2;  /* RAW==1 or LZF==2 */
+} quicklistNode;
+
+/* A listpack compressed with LZF: 'sz' is the length of 'compressed'. */
+typedef struct quicklistLZF {
+    unsigned int sz;
+    char compressed[];
+} quicklistLZF;
+
+/* 'fill' is the user requested limit of every node: when positive, the
+ * max number of entries of the listpack, when negative (-1 to -5) the max
+ * size of the listpack, from 4 kb to 64 kb.
+ *
+ * 'compress' is the number of nodes at each end of the list that are never
+ * compressed, 0 means that no node is compressed. */
+typedef struct quicklist {
+    quicklistNode *head;
+    quicklistNode *tail;
+    unsigned long count;        /* Total number of entries of all listpacks. */
+    unsigned int len;           /* Number of nodes. */
+    int fill;
+    unsigned int compress;
+} quicklist;
+
+typedef struct quicklistIter {
+    const quicklist *quicklist;
+    quicklistNode *current;
+    unsigned char *zi;          /* NULL: seek 'offset' in 'current'. */
+    long offset;                /* Offset of 'zi' inside the listpack. */
+    int direction;
+} quicklistIter;
+
+/* An element of the list. Strings are returned in 'value' and 'sz', integers
+ * in 'longval', with 'value' set to NULL. 'offset' is relative to the start
+ * of the listpack of 'node' when positive, to its end when negative. */
+typedef struct quicklistEntry {
+    const quicklist *quicklist;
+    quicklistNode *node;
+    unsigned char *zi;
+    unsigned char *value;
+    long long longval;
+    unsigned int sz;
+    long offset;
+} quicklistEntry;
+
+#define QUICKLIST_HEAD 0
+#define QUICKLIST_TAIL -1
+
+#define QUICKLIST_NODE_ENCODING_RAW 1
+#define QUICKLIST_NODE_ENCODING_LZF 2
+
+#define quicklistNodeIsCompressed(node) \
+    ((node)->encoding == QUICKLIST_NODE_ENCODING_LZF)
+
+/* Directions of the iterators, the same of adlist.h. */
+#ifndef AL_START_HEAD
+#define AL_START_HEAD 0
+#define AL_START_TAIL 1
+#endif
+
+/* Max value of a positive fill, and of the compress depth. */
+#define QUICKLIST_MAX_FILL (1<<15)
+#define QUICKLIST_MAX_COMPRESS (1<<16)
+
+/* Prototypes */
+quicklist *quicklistCreate(void);
+quicklist *quicklistNew(int fill, int compress);
+void quicklistSetFill(quicklist *quicklist, int fill);
+void quicklistSetCompressDepth(quicklist *quicklist, int depth);
+void quicklistSetOptions(quicklist *quicklist, int fill, int depth);
+void quicklistRelease(quicklist *quicklist);
+int quicklistPushHead(quicklist *quicklist, void *value, const size_t sz);
+int quicklistPushTail(quicklist *quicklist, void *value, const size_t sz);
+void quicklistPush(quicklist *quicklist, void *value, const size_t sz,
+                   int where);
+void quicklistAppendListpack(quicklist *quicklist, unsigned char *lp);
+quicklist *quicklistCreateFromZiplist(int fill, int compress,
+                                      unsigned char *zl);
+void quicklistInsertAfter(quicklistIter *iter, quicklistEntry *entry,
+                          void *value, const size_t sz);
+void quicklistInsertBefore(quicklistIter *iter, quicklistEntry *entry,
+                           void *value, const size_t sz);
+void quicklistDelEntry(quicklistIter *iter, quicklistEntry *entry);
+int quicklistReplaceAtIndex(quicklist *quicklist, long index, void *data,
+                            size_t sz);
+int quicklistDelRange(quicklist *quicklist, const long start, const long count);
+quicklistIter *quicklistGetIterator(const quicklist *quicklist, int direction);
+quicklistIter *quicklistGetIteratorAtIdx(const quicklist *quicklist,
+                                         int direction, const long long idx);
+int quicklistNext(quicklistIter *iter, quicklistEntry *node);
+void quicklistReleaseIterator(quicklistIter *iter);
+int quicklistIndex(const quicklist *quicklist, const long long index,
+                   quicklistEntry *entry);
+void quicklistCompressEntry(quicklistEntry *entry);
+int quicklistPopCustom(quicklist *quicklist, int where, unsigned char **data,
+                       unsigned int *sz, long long *sval,
+                       void *(*saver)(unsigned char *data, unsigned int sz));
+unsigned long quicklistCount(const quicklist *ql);
+int quicklistCompare(unsigned char *p1, unsigned char *p2, int p2_len);
+size_t quicklistGetLzf(const quicklistNode *node, void **data);
+
+#endif /* __QUICKLIST_H__ */
@@ -209,10 +209,31 @@ int rdbTryIntegerEncoding(char *s, size_t len, unsigned char *enc) {
     return rdbEncodeInteger(value,enc);
 }
 
-int rdbSaveLzfStringObject(rio *rdb, unsigned char *s, size_t len) {
-    size_t comprlen, outlen;
+/* Save 'comprlen' bytes of LZF compressed data, that decompress to 'len'
+ * bytes, as a string. */
+int rdbSaveLzfBlob(rio *rdb, void *data, size_t comprlen, size_t len) {
     unsigned char byte;
     int n, nwritten = 0;
+
+    byte = (REDIS_RDB_ENCVAL<<6)|REDIS_RDB_ENC_LZF;
+    if ((n = rdbWriteRaw(rdb,&byte,1)) == -1) return -1;
+    nwritten += n;
+
+    if ((n = rdbSaveLen(rdb,comprlen)) == -1) return -1;
+    nwritten += n;
+
+    if ((n = rdbSaveLen(rdb,len)) == -1) return -1;
+    nwritten += n;
+
+    if ((n = rdbWriteRaw(rdb,data,comprlen)) == -1) return -1;
+    nwritten += n;
+
+    return nwritten;
+}
+
+int rdbSaveLzfStringObject(rio *rdb, unsigned char *s, size_t len) {
+    size_t comprlen, outlen;
+    int nwritten;
     void *out;
 
     /* We require at least four bytes compression for this to be worth it */
@@ -225,25 +246,9 @@ int rdbSaveLzfStringObject(rio *rdb, unsigned char *s, size_t len) {
         return 0;
     }
     /* Data compressed! Let's save it on disk */
-    byte = (REDIS_RDB_ENCVAL<<6)|REDIS_RDB_ENC_LZF;
-    if ((n = rdbWriteRaw(rdb,&byte,1)) == -1) goto writeerr;
-    nwritten += n;
-
-    if ((n = rdbSaveLen(rdb,comprlen)) == -1) goto writeerr;
-    nwritten += n;
-
-    if ((n = rdbSaveLen(rdb,len)) == -1) goto writeerr;
-    nwritten += n;
-
-    if ((n = rdbWriteRaw(rdb,out,comprlen)) == -1) goto writeerr;
-    nwritten += n;
-
+    nwritten = rdbSaveLzfBlob(rdb,out,comprlen,len);
     zfree(out);
     return nwritten;
-
-writeerr:
-    zfree(out);
-    return -1;
 }
 
 robj *rdbLoadLzfStringObject(rio *rdb) {
@@ -325,7 +330,7 @@ int rdbSaveStringObject(rio *rdb, robj *obj) {
     if (obj->encoding == REDIS_ENCODING_INT) {
         return rdbSaveLongLongAsStringObject(rdb,(long)obj->ptr);
     } else {
-        redisAssertWithInfo(NULL,obj,obj->encoding == REDIS_ENCODING_RAW);
+        redisAssertWithInfo(NULL,obj,sdsEncodedObject(obj));
         return rdbSaveRawString(rdb,obj->ptr,sdslen(obj->ptr));
     }
 }
@@ -432,10 +437,8 @@ int rdbSaveObjectType(rio *rdb, robj *o) {
     case REDIS_STRING:
         return rdbSaveType(rdb,REDIS_RDB_TYPE_STRING);
     case REDIS_LIST:
-        if (o->encoding == REDIS_ENCODING_ZIPLIST)
-            return rdbSaveType(rdb,REDIS_RDB_TYPE_LIST_ZIPLIST);
-        else if (o->encoding == REDIS_ENCODING_LINKEDLIST)
-            return rdbSaveType(rdb,REDIS_RDB_TYPE_LIST);
+        if (o->encoding == REDIS_ENCODING_QUICKLIST)
+            return rdbSaveType(rdb,REDIS_RDB_TYPE_LIST_QUICKLIST_2);
         else
             redisPanic("Unknown list encoding");
     case REDIS_SET:
@@ -446,15 +449,16 @@ int rdbSaveObjectType(rio *rdb, robj *o) {
         else
             redisPanic("Unknown set encoding");
     case REDIS_ZSET:
-        if (o->encoding == REDIS_ENCODING_ZIPLIST)
-            return rdbSaveType(rdb,REDIS_RDB_TYPE_ZSET_ZIPLIST);
-        else if (o->encoding == REDIS_ENCODING_SKIPLIST)
+        if (o->encoding == REDIS_ENCODING_LISTPACK)
+            return rdbSaveType(rdb,REDIS_RDB_TYPE_ZSET_LISTPACK);
+        else if (o->encoding == REDIS_ENCODING_SKIPLIST ||
+                 o->encoding == REDIS_ENCODING_BTREE)
             return rdbSaveType(rdb,REDIS_RDB_TYPE_ZSET);
         else
             redisPanic("Unknown sorted set encoding");
     case REDIS_HASH:
-        if (o->encoding == REDIS_ENCODING_ZIPLIST)
-            return rdbSaveType(rdb,REDIS_RDB_TYPE_HASH_ZIPLIST);
+        if (o->encoding == REDIS_ENCODING_LISTPACK)
+            return rdbSaveType(rdb,REDIS_RDB_TYPE_HASH_LISTPACK);
         else if (o->encoding == REDIS_ENCODING_HT)
             return rdbSaveType(rdb,REDIS_RDB_TYPE_HASH);
         else
@@ -483,25 +487,29 @@ int rdbSaveObject(rio *rdb, robj *o) {
         if ((n = rdbSaveStringObject(rdb,o)) == -1) return -1;
         nwritten += n;
     } else if (o->type == REDIS_LIST) {
-        /* Save a list value */
-        if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-            size_t l = ziplistBlobLen((unsigned char*)o->ptr);
+        /* Save a list value: the number of nodes, then the listpack of
+         * every node as a string. */
+        if (o->encoding == REDIS_ENCODING_QUICKLIST) {
+            quicklist *ql = o->ptr;
+            quicklistNode *node = ql->head;
 
-            if ((n = rdbSaveRawString(rdb,o->ptr,l)) == -1) return -1;
+            if ((n = rdbSaveLen(rdb,ql->len)) == -1) return -1;
             nwritten += n;
-        } else if (o->encoding == REDIS_ENCODING_LINKEDLIST) {
-            list *list = o->ptr;
-            listIter li;
-            listNode *ln;
 
-            if ((n = rdbSaveLen(rdb,listLength(list))) == -1) return -1;
-            nwritten += n;
+            while(node) {
+                /* Compressed nodes are saved as they are. */
+                if (quicklistNodeIsCompressed(node)) {
+                    void *data;
+                    size_t comprlen = quicklistGetLzf(node,&data);
 
-            listRewind(list,&li);
-            while((ln = listNext(&li))) {
-                robj *eleobj = listNodeValue(ln);
-                if ((n = rdbSaveStringObject(rdb,eleobj)) == -1) return -1;
+                    if ((n = rdbSaveLzfBlob(rdb,data,comprlen,node->sz)) == -1)
+                        return -1;
+                } else {
+                    if ((n = rdbSaveRawString(rdb,node->entry,node->sz)) == -1)
+                        return -1;
+                }
                 nwritten += n;
+                node = node->next;
             }
         } else {
             redisPanic("Unknown list encoding");
@@ -532,8 +540,8 @@ int rdbSaveObject(rio *rdb, robj *o) {
         }
     } else if (o->type == REDIS_ZSET) {
         /* Save a sorted set value */
-        if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-            size_t l = ziplistBlobLen((unsigned char*)o->ptr);
+        if (o->encoding == REDIS_ENCODING_LISTPACK) {
+            size_t l = lpBytes((unsigned char*)o->ptr);
 
             if ((n = rdbSaveRawString(rdb,o->ptr,l)) == -1) return -1;
             nwritten += n;
@@ -555,13 +563,30 @@ int rdbSaveObject(rio *rdb, robj *o) {
                 nwritten += n;
             }
             dictReleaseIterator(di);
+        } else if (o->encoding == REDIS_ENCODING_BTREE) {
+            zbtree *zbt = ((zset*)o->ptr)->zbt;
+            zbtreeLeaf *l;
+            unsigned int j;
+
+            /* Saved in order, so that loading only appends to the tree. */
+            if ((n = rdbSaveLen(rdb,zbt->length)) == -1) return -1;
+            nwritten += n;
+
+            for (l = zbt->head; l; l = l->next) {
+                for (j = 0; j < l->count; j++) {
+                    if ((n = rdbSaveStringObject(rdb,l->obj[j])) == -1) return -1;
+                    nwritten += n;
+                    if ((n = rdbSaveDoubleValue(rdb,l->score[j])) == -1) return -1;
+                    nwritten += n;
+                }
+            }
         } else {
             redisPanic("Unknown sorted set encoding");
         }
     } else if (o->type == REDIS_HASH) {
         /* Save a hash value */
-        if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-            size_t l = ziplistBlobLen((unsigned char*)o->ptr);
+        if (o->encoding == REDIS_ENCODING_LISTPACK) {
+            size_t l = lpBytes((unsigned char*)o->ptr);
 
             if ((n = rdbSaveRawString(rdb,o->ptr,l)) == -1) return -1;
             nwritten += n;
@@ -788,33 +813,44 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
         /* Read list value */
         if ((len = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) return NULL;
 
-        /* Use a real list when there are too many entries */
-        if (len > server.list_max_ziplist_entries) {
-            o = createListObject();
-        } else {
-            o = createZiplistObject();
-        }
+        o = createQuicklistObject();
+        quicklistSetOptions(o->ptr,server.list_max_ziplist_size,
+                            server.list_compress_depth);
 
         /* Load every single element of the list */
         while(len--) {
             if ((ele = rdbLoadEncodedStringObject(rdb)) == NULL) return NULL;
+            dec = getDecodedObject(ele);
+            quicklistPushTail(o->ptr,dec->ptr,sdslen(dec->ptr));
+            decrRefCount(dec);
+            decrRefCount(ele);
+        }
+    } else if (rdbtype == REDIS_RDB_TYPE_LIST_QUICKLIST ||
+               rdbtype == REDIS_RDB_TYPE_LIST_QUICKLIST_2) {
+        /* Read the listpacks of the nodes, or the ziplists of the nodes
+         * saved before listpacks were introduced, that are converted. */
+        if ((len = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) return NULL;
+        o = createQuicklistObject();
+        quicklistSetOptions(o->ptr,server.list_max_ziplist_size,
+                            server.list_compress_depth);
 
-            /* If we are using a ziplist and the value is too big, convert
-             * the object to a real list. */
-            if (o->encoding == REDIS_ENCODING_ZIPLIST &&
-                ele->encoding == REDIS_ENCODING_RAW &&
-                sdslen(ele->ptr) > server.list_max_ziplist_value)
-                    listTypeConvert(o,REDIS_ENCODING_LINKEDLIST);
-
-            if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-                dec = getDecodedObject(ele);
-                o->ptr = ziplistPush(o->ptr,dec->ptr,sdslen(dec->ptr),REDIS_TAIL);
-                decrRefCount(dec);
-                decrRefCount(ele);
+        while(len--) {
+            robj *aux = rdbLoadStringObject(rdb);
+            unsigned char *lp;
+
+            if (aux == NULL) return NULL;
+            if (rdbtype == REDIS_RDB_TYPE_LIST_QUICKLIST) {
+                lp = lpFromZiplist(aux->ptr);
             } else {
-                ele = tryObjectEncoding(ele);
-                listAddNodeTail(o->ptr,ele);
+                lp = zmalloc(sdslen(aux->ptr));
+                memcpy(lp,aux->ptr,sdslen(aux->ptr));
             }
+            decrRefCount(aux);
+            if (lpLength(lp) == 0) {
+                zfree(lp);
+                continue;
+            }
+            quicklistAppendListpack(o->ptr,lp);
         }
     } else if (rdbtype == REDIS_RDB_TYPE_SET) {
         /* Read list/set value */
@@ -859,36 +895,32 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
         /* Read list/set value */
         size_t zsetlen;
         size_t maxelelen = 0;
-        zset *zs;
 
         if ((zsetlen = rdbLoadLen(rdb,NULL)) == REDIS_RDB_LENERR) return NULL;
         o = createZsetObject();
-        zs = o->ptr;
 
         /* Load every single element of the list/set */
         while(zsetlen--) {
             robj *ele;
             double score;
-            zskiplistNode *znode;
 
             if ((ele = rdbLoadEncodedStringObject(rdb)) == NULL) return NULL;
             ele = tryObjectEncoding(ele);
             if (rdbLoadDoubleValue(rdb,&score) == -1) return NULL;
 
             /* Don't care about integer-encoded strings. */
-            if (ele->encoding == REDIS_ENCODING_RAW &&
+            if (sdsEncodedObject(ele) &&
                 sdslen(ele->ptr) > maxelelen)
                     maxelelen = sdslen(ele->ptr);
 
-            znode = zslInsert(zs->zsl,score,ele);
-            dictAdd(zs->dict,ele,&znode->score);
-            incrRefCount(ele); /* added to skiplist */
+            zsetAddNew(o,score,ele);
+            decrRefCount(ele);
         }
 
         /* Convert *after* loading, since sorted sets are not stored ordered. */
         if (zsetLength(o) <= server.zset_max_ziplist_entries &&
             maxelelen <= server.zset_max_ziplist_value)
-                zsetConvert(o,REDIS_ENCODING_ZIPLIST);
+                zsetConvert(o,REDIS_ENCODING_LISTPACK);
     } else if (rdbtype == REDIS_RDB_TYPE_HASH) {
         size_t len;
         int ret;
@@ -902,22 +934,22 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
         if (len > server.hash_max_ziplist_entries)
             hashTypeConvert(o, REDIS_ENCODING_HT);
 
-        /* Load every field and value into the ziplist */
-        while (o->encoding == REDIS_ENCODING_ZIPLIST && len > 0) {
+        /* Load every field and value into the listpack */
+        while (o->encoding == REDIS_ENCODING_LISTPACK && len > 0) {
             robj *field, *value;
 
             len--;
             /* Load raw strings */
             field = rdbLoadStringObject(rdb);
             if (field == NULL) return NULL;
-            redisAssert(field->encoding == REDIS_ENCODING_RAW);
+            redisAssert(sdsEncodedObject(field));
             value = rdbLoadStringObject(rdb);
             if (value == NULL) return NULL;
-            redisAssert(field->encoding == REDIS_ENCODING_RAW);
+            redisAssert(sdsEncodedObject(field));
 
-            /* Add pair to ziplist */
-            o->ptr = ziplistPush(o->ptr, field->ptr, sdslen(field->ptr), ZIPLIST_TAIL);
-            o->ptr = ziplistPush(o->ptr, value->ptr, sdslen(value->ptr), ZIPLIST_TAIL);
+            /* Add pair to listpack */
+            o->ptr = lpPush(o->ptr, field->ptr, sdslen(field->ptr), LP_TAIL);
+            o->ptr = lpPush(o->ptr, value->ptr, sdslen(value->ptr), LP_TAIL);
             /* Convert to hash table if size threshold is exceeded */
             if (sdslen(field->ptr) > server.hash_max_ziplist_value ||
                 sdslen(value->ptr) > server.hash_max_ziplist_value)
@@ -957,7 +989,9 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                rdbtype == REDIS_RDB_TYPE_LIST_ZIPLIST ||
                rdbtype == REDIS_RDB_TYPE_SET_INTSET   ||
                rdbtype == REDIS_RDB_TYPE_ZSET_ZIPLIST ||
-               rdbtype == REDIS_RDB_TYPE_HASH_ZIPLIST)
+               rdbtype == REDIS_RDB_TYPE_HASH_ZIPLIST ||
+               rdbtype == REDIS_RDB_TYPE_ZSET_LISTPACK ||
+               rdbtype == REDIS_RDB_TYPE_HASH_LISTPACK)
     {
         robj *aux = rdbLoadStringObject(rdb);
 
@@ -975,10 +1009,10 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
          * converted. */
         switch(rdbtype) {
             case REDIS_RDB_TYPE_HASH_ZIPMAP:
-                /* Convert to ziplist encoded hash. This must be deprecated
+                /* Convert to listpack encoded hash. This must be deprecated
                  * when loading dumps created by Redis 2.4 gets deprecated. */
                 {
-                    unsigned char *zl = ziplistNew();
+                    unsigned char *lp = lpNew();
                     unsigned char *zi = zipmapRewind(o->ptr);
                     unsigned char *fstr, *vstr;
                     unsigned int flen, vlen;
@@ -987,14 +1021,14 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                     while ((zi = zipmapNext(zi, &fstr, &flen, &vstr, &vlen)) != NULL) {
                         if (flen > maxlen) maxlen = flen;
                         if (vlen > maxlen) maxlen = vlen;
-                        zl = ziplistPush(zl, fstr, flen, ZIPLIST_TAIL);
-                        zl = ziplistPush(zl, vstr, vlen, ZIPLIST_TAIL);
+                        lp = lpPush(lp, fstr, flen, LP_TAIL);
+                        lp = lpPush(lp, vstr, vlen, LP_TAIL);
                     }
 
                     zfree(o->ptr);
-                    o->ptr = zl;
+                    o->ptr = lp;
                     o->type = REDIS_HASH;
-                    o->encoding = REDIS_ENCODING_ZIPLIST;
+                    o->encoding = REDIS_ENCODING_LISTPACK;
 
                     if (hashTypeLength(o) > server.hash_max_ziplist_entries ||
                         maxlen > server.hash_max_ziplist_value)
@@ -1006,8 +1040,7 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
             case REDIS_RDB_TYPE_LIST_ZIPLIST:
                 o->type = REDIS_LIST;
                 o->encoding = REDIS_ENCODING_ZIPLIST;
-                if (ziplistLen(o->ptr) > server.list_max_ziplist_entries)
-                    listTypeConvert(o,REDIS_ENCODING_LINKEDLIST);
+                listTypeConvert(o,REDIS_ENCODING_QUICKLIST);
                 break;
             case REDIS_RDB_TYPE_SET_INTSET:
                 o->type = REDIS_SET;
@@ -1016,14 +1049,28 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
                     setTypeConvert(o,REDIS_ENCODING_HT);
                 break;
             case REDIS_RDB_TYPE_ZSET_ZIPLIST:
+            case REDIS_RDB_TYPE_ZSET_LISTPACK:
+                if (rdbtype == REDIS_RDB_TYPE_ZSET_ZIPLIST) {
+                    unsigned char *lp = lpFromZiplist(o->ptr);
+
+                    zfree(o->ptr);
+                    o->ptr = lp;
+                }
                 o->type = REDIS_ZSET;
-                o->encoding = REDIS_ENCODING_ZIPLIST;
+                o->encoding = REDIS_ENCODING_LISTPACK;
                 if (zsetLength(o) > server.zset_max_ziplist_entries)
-                    zsetConvert(o,REDIS_ENCODING_SKIPLIST);
+                    zsetConvert(o,zsetIndexEncoding());
                 break;
             case REDIS_RDB_TYPE_HASH_ZIPLIST:
+            case REDIS_RDB_TYPE_HASH_LISTPACK:
+                if (rdbtype == REDIS_RDB_TYPE_HASH_ZIPLIST) {
+                    unsigned char *lp = lpFromZiplist(o->ptr);
+
+                    zfree(o->ptr);
+                    o->ptr = lp;
+                }
                 o->type = REDIS_HASH;
-                o->encoding = REDIS_ENCODING_ZIPLIST;
+                o->encoding = REDIS_ENCODING_LISTPACK;
                 if (hashTypeLength(o) > server.hash_max_ziplist_entries)
                     hashTypeConvert(o, REDIS_ENCODING_HT);
                 break;
@@ -39,6 +39,7 @@
 #include <sys/time.h>
 #include <signal.h>
 #include <assert.h>
+#include <math.h>
 
 #include "ae.h"
 #include "hiredis.h"
@@ -63,6 +64,8 @@ static struct config {
     int datasize;
     int randomkeys;
     int randomkeys_keyspacelen;
+    double zipf;            /* Zipf exponent for random keys, 0 = uniform */
+    double *zipfcdf;        /* Cumulative distribution of the key ranks */
     int keepalive;
     int pipeline;
     long long start;
@@ -151,12 +154,50 @@ static void resetClient(client c) {
     c->pending = config.pipeline;
 }
 
+/* Precompute the cumulative distribution of a zipfian distribution with
+ * exponent config.zipf over the keyspace, so that a key can be sampled
+ * with a binary search in randomKey(). Key 0 is the most popular one. */
+static void initZipfDistribution(void) {
+    double sum = 0;
+    int j, n = config.randomkeys_keyspacelen;
+
+    config.zipfcdf = zmalloc(sizeof(double)*n);
+    for (j = 0; j < n; j++) {
+        sum += 1.0/pow(j+1,config.zipf);
+        config.zipfcdf[j] = sum;
+    }
+    for (j = 0; j < n; j++) config.zipfcdf[j] /= sum;
+}
+
+/* Return a random key in the range 0..keyspacelen-1, uniformly distributed
+ * or following the zipfian distribution requested with --zipf. */
+static size_t randomKey(void) {
+    double u;
+    size_t lo, hi;
+
+    if (config.zipfcdf == NULL)
+        return random() % config.randomkeys_keyspacelen;
+
+    u = (double)random()/RAND_MAX;
+    lo = 0;
+    hi = config.randomkeys_keyspacelen-1;
+    while (lo < hi) {
+        size_t mid = (lo+hi)/2;
+
+        if (config.zipfcdf[mid] < u)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
 static void randomizeClientKey(client c) {
     size_t i;
 
     for (i = 0; i < c->randlen; i++) {
         char *p = c->randptr[i]+11;
-        size_t r = random() % config.randomkeys_keyspacelen;
+        size_t r = randomKey();
         size_t j;
 
         for (j = 0; j < 12; j++) {
@@ -504,6 +545,10 @@ int parseOptions(int argc, const char **argv) {
             config.randomkeys_keyspacelen = atoi(argv[++i]);
             if (config.randomkeys_keyspacelen < 0)
                 config.randomkeys_keyspacelen = 0;
+        } else if (!strcmp(argv[i],"--zipf")) {
+            if (lastarg) goto invalid;
+            config.zipf = atof(argv[++i]);
+            if (config.zipf < 0) config.zipf = 0;
         } else if (!strcmp(argv[i],"-q")) {
             config.quiet = 1;
         } else if (!strcmp(argv[i],"--csv")) {
@@ -561,6 +606,9 @@ usage:
 "  from 0 to keyspacelen-1. The substitution changes every time a command\n"
 "  is executed. Default tests use this to hit random keys in the\n"
 "  specified range.\n"
+" --zipf <exponent>  Pick the random keys of -r following a zipfian\n"
+"  distribution with the specified exponent (0.99 is a typical value)\n"
+"  instead of uniformly. Key 0 is the most accessed one.\n"
 " -P <numreq>        Pipeline <numreq> requests. Default 1 (no pipeline).\n"
 " -q                 Quiet. Just show query/sec values\n"
 " --csv              Output in CSV format\n"
@@ -635,6 +683,8 @@ int main(int argc, const char **argv) {
     config.pipeline = 1;
     config.randomkeys = 0;
     config.randomkeys_keyspacelen = 0;
+    config.zipf = 0;
+    config.zipfcdf = NULL;
     config.quiet = 0;
     config.csv = 0;
     config.loop = 0;
@@ -652,6 +702,8 @@ int main(int argc, const char **argv) {
     argv += i;
 
     config.latency = zmalloc(sizeof(long long)*config.requests);
+    if (config.randomkeys && config.randomkeys_keyspacelen && config.zipf > 0)
+        initZipfDistribution();
 
     if (config.keepalive == 0) {
         printf("WARNING: keepalive disabled, you probably need 'echo 1 > /proc/sys/net/ipv4/tcp_tw_reuse' for Linux and 'sudo sysctl -w net.inet.tcp.msl=1000' for Mac OS X in order to use a lot of clients/requests\n");
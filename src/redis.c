@@ -122,6 +122,7 @@ struct redisCommand redisCommandTable[] = {
     {"append",appendCommand,3,"wm",0,NULL,1,1,1,0,0},
     {"strlen",strlenCommand,2,"r",0,NULL,1,1,1,0,0},
     {"del",delCommand,-2,"w",0,noPreloadGetKeys,1,-1,1,0,0},
+    {"unlink",unlinkCommand,-2,"w",0,noPreloadGetKeys,1,-1,1,0,0},
     {"exists",existsCommand,2,"r",0,NULL,1,1,1,0,0},
     {"setbit",setbitCommand,4,"wm",0,NULL,1,1,1,0,0},
     {"getbit",getbitCommand,3,"r",0,NULL,1,1,1,0,0},
@@ -227,8 +228,8 @@ struct redisCommand redisCommandTable[] = {
     {"sync",syncCommand,1,"ars",0,NULL,0,0,0,0,0},
     {"psync",syncCommand,3,"ars",0,NULL,0,0,0,0,0},
     {"replconf",replconfCommand,-1,"arslt",0,NULL,0,0,0,0,0},
-    {"flushdb",flushdbCommand,1,"w",0,NULL,0,0,0,0,0},
-    {"flushall",flushallCommand,1,"w",0,NULL,0,0,0,0,0},
+    {"flushdb",flushdbCommand,-1,"w",0,NULL,0,0,0,0,0},
+    {"flushall",flushallCommand,-1,"w",0,NULL,0,0,0,0,0},
     {"sort",sortCommand,-2,"wm",0,NULL,1,1,1,0,0},
     {"info",infoCommand,-1,"rlt",0,NULL,0,0,0,0,0},
     {"monitor",monitorCommand,1,"ars",0,NULL,0,0,0,0,0},
@@ -250,6 +251,7 @@ struct redisCommand redisCommandTable[] = {
     {"migrate",migrateCommand,6,"aw",0,NULL,0,0,0,0,0},
     {"dump",dumpCommand,2,"ar",0,NULL,1,1,1,0,0},
     {"object",objectCommand,-2,"r",0,NULL,2,2,2,0,0},
+    {"memory",memoryCommand,-2,"r",0,NULL,0,0,0,0,0},
     {"client",clientCommand,-2,"ar",0,NULL,0,0,0,0,0},
     {"eval",evalCommand,-3,"s",0,zunionInterGetKeys,0,0,0,0,0},
     {"evalsha",evalShaCommand,-3,"s",0,zunionInterGetKeys,0,0,0,0,0},
@@ -423,6 +425,31 @@ void dictSdsDestructor(void *privdata, void *val)
     sdsfree(val);
 }
 
+void *dictSdsDup(void *privdata, const void *key)
+{
+    DICT_NOTUSED(privdata);
+
+    return sdsdup((const sds) key);
+}
+
+/* Embed sds keys in the dict entry: the copy is a regular sds string with
+ * no free space, so it can be used everywhere a key is expected. */
+size_t dictSdsEmbedLen(const void *key)
+{
+    return sizeof(struct sdshdr)+sdslen((const sds) key)+1;
+}
+
+void *dictSdsEmbed(void *buf, const void *key)
+{
+    struct sdshdr *sh = buf;
+    size_t len = sdslen((const sds) key);
+
+    sh->len = len;
+    sh->free = 0;
+    memcpy(sh->buf,key,len+1);
+    return sh->buf;
+}
+
 int dictObjKeyCompare(void *privdata, const void *key1,
         const void *key2)
 {
@@ -464,7 +491,7 @@ int dictEncObjKeyCompare(void *privdata, const void *key1,
 unsigned int dictEncObjHash(const void *key) {
     robj *o = (robj*) key;
 
-    if (o->encoding == REDIS_ENCODING_RAW) {
+    if (sdsEncodedObject(o)) {
         return dictGenHashFunction(o->ptr, sdslen((sds)o->ptr));
     } else {
         if (o->encoding == REDIS_ENCODING_INT) {
@@ -504,14 +531,17 @@ dictType zsetDictType = {
     NULL                       /* val destructor */
 };
 
-/* Db->dict, keys are sds strings, vals are Redis objects. */
+/* Db->dict, keys are sds strings, vals are Redis objects. Keys are copied
+ * by the dict, and embedded in the entries unless open addressing is used. */
 dictType dbDictType = {
     dictSdsHash,                /* hash function */
-    NULL,                       /* key dup */
+    dictSdsDup,                 /* key dup */
     NULL,                       /* val dup */
     dictSdsKeyCompare,          /* key compare */
     dictSdsDestructor,          /* key destructor */
-    dictRedisObjectDestructor   /* val destructor */
+    dictRedisObjectDestructor,  /* val destructor */
+    dictSdsEmbedLen,            /* key embed len */
+    dictSdsEmbed                /* key embed */
 };
 
 /* server.lua_scripts sha (as sds string) -> scripts (as robj) cache. */
@@ -544,7 +574,7 @@ dictType commandTableDictType = {
     NULL                       /* val destructor */
 };
 
-/* Hash type hash table (note that small hashes are represented with ziplists) */
+/* Hash type hash table (note that small hashes are represented with listpacks) */
 dictType hashDictType = {
     dictEncObjHash,             /* hash function */
     NULL,                       /* key dup */
@@ -583,6 +613,12 @@ int htNeedsResize(dict *dict) {
 
     size = dictSlots(dict);
     used = dictSize(dict);
+    /* Linear hashing tables are resized a few buckets at a time without
+     * any big allocation, so they are kept near the 1:1 ratio both ways:
+     * they may also lag behind the growth while a child was saving. */
+    if (dictIsLinear(dict))
+        return used > size ||
+               (size > DICT_HT_INITIAL_SIZE && used*2 < size);
     return (size && used && size > DICT_HT_INITIAL_SIZE &&
             (used*100/size < REDIS_HT_MINFILL));
 }
@@ -643,14 +679,15 @@ void updateDictResizePolicy(void) {
  *
  * The parameter 'now' is the current time in milliseconds as is passed
  * to the function to avoid too many gettimeofday() syscalls. */
-int activeExpireCycleTryExpire(redisDb *db, struct dictEntry *de, long long now) {
-    long long t = dictGetSignedIntegerVal(de);
+int activeExpireCycleTryExpire(redisDb *db, sds key, long long t, long long now) {
     if (now > t) {//ȷʵɾ
-        sds key = dictGetKey(de);
         robj *keyobj = createStringObject(key,sdslen(key));
 
         propagateExpire(db,keyobj);
-        dbDelete(db,keyobj);
+        if (server.lazyfree_lazy_expire)
+            dbAsyncDelete(db,keyobj);
+        else
+            dbSyncDelete(db,keyobj);
         notifyKeyspaceEvent(REDIS_NOTIFY_EXPIRED,
             "expired",keyobj,db->id);
         decrRefCount(keyobj);
@@ -661,6 +698,23 @@ int activeExpireCycleTryExpire(redisDb *db, struct dictEntry *de, long long now)
     }
 }
 
+/* Expire the keys of 'db' that are due according to its expires index,
+ * starting from the ones that expired first. Returns 1 if the time limit
+ * was reached before all the due keys were expired, otherwise 0. */
+int activeExpireIndexCycle(redisDb *db, long long start, long long timelimit) {
+    zskiplistNode *first;
+    long long now = mstime();
+    unsigned long expired = 0;
+
+    while((first = db->expires_index->header->level[0].forward) != NULL) {
+        if (!activeExpireCycleTryExpire(db,first->obj->ptr,first->score,now))
+            break;
+        if ((++expired & 0xf) == 0 && (ustime()-start) > timelimit)
+            return 1;
+    }
+    return 0;
+}
+
 /* Try to expire a few timed out keys. The algorithm used is adaptive and
  * will use few CPU cycles if there are few expiring keys, otherwise
  * it will get more aggressive to avoid that too much memory is used by
@@ -681,7 +735,11 @@ int activeExpireCycleTryExpire(redisDb *db, struct dictEntry *de, long long now)
  *
  * If type is ACTIVE_EXPIRE_CYCLE_SLOW, that normal expire cycle is
  * executed, where the time limit is a percentage of the REDIS_HZ period
- * as specified by the REDIS_EXPIRELOOKUPS_TIME_PERC define. */
+ * as specified by the REDIS_EXPIRELOOKUPS_TIME_PERC define.
+ *
+ * DBs having an expires index (see active-expire-index) first expire the
+ * keys that are due in expire time order, then a single round of samples
+ * is taken to update the stats. */
 
 void activeExpireCycle(int type) {
     /* This function has some global state in order to continue the work
@@ -694,6 +752,7 @@ void activeExpireCycle(int type) {
     unsigned int j, iteration = 0;
     unsigned int dbs_per_call = REDIS_DBCRON_DBS_PER_CALL;//ݿĿ
     long long start = ustime(), timelimit;
+    long total_sampled = 0, total_expired = 0;
 
     if (type == ACTIVE_EXPIRE_CYCLE_FAST) {//beforeSleepִпɾڼ
         /* Don't start a fast cycle if the previous cycle did not exited
@@ -738,12 +797,20 @@ void activeExpireCycle(int type) {
          * distribute the time evenly across DBs. */
         current_db++;
 
+        if (db->expires_index && activeExpireIndexCycle(db,start,timelimit)) {
+            timelimit_exit = 1;
+            break;
+        }
+
         /* Continue to expire if at the end of the cycle more than 25%
          * of the keys were expired. */
         do {
-            unsigned long num, slots;
+            unsigned long num, slots, k;
             long long now, ttl_sum;
             int ttl_samples;
+            dictEntry *samples[ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP];
+            sds keys[ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP];
+            long long whens[ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP];
 
             /* If there is nothing to expire try next DB ASAP. */
             if ((num = dictSize(db->expires)) == 0) { //ڼexpiresֵΪ
@@ -769,18 +836,26 @@ void activeExpireCycle(int type) {
             if (num > ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP)// ÿοɲҵĴ20
                 num = ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP;
 
-            while (num--) {
-                dictEntry *de;
-                long long ttl;
-                // Ҵ TTL  key Ƿ
-                if ((de = dictGetRandomKey(db->expires)) == NULL) break;
-                ttl = dictGetSignedIntegerVal(de)-now;
+            /* Sample all the keys at once. The key and the expire time
+             * of the samples are copied before expiring anything, since
+             * deleting keys may move the entries of the expires dict. */
+            num = dictGetSomeKeys(db->expires,samples,num);
+            for (k = 0; k < num; k++) {
+                keys[k] = dictGetKey(samples[k]);
+                whens[k] = dictGetSignedIntegerVal(samples[k]);
+            }
+            for (k = 0; k < num; k++) {
+                long long ttl = whens[k]-now;
+
                 //ɾڼ
-                if (activeExpireCycleTryExpire(db,de,now)) expired++;
+                if (activeExpireCycleTryExpire(db,keys[k],whens[k],now))
+                    expired++;
                 if (ttl < 0) ttl = 0;
                 ttl_sum += ttl;
                 ttl_samples++;
             }
+            total_sampled += num;
+            total_expired += expired;
 
             /* Update the average TTL stats for this database. */
             if (ttl_samples) {//ݿƽttl
@@ -801,11 +876,23 @@ void activeExpireCycle(int type) {
             {
                 timelimit_exit = 1;
             }
-            if (timelimit_exit) return; //ʱ˳
+            if (timelimit_exit) break; //ʱ˳
             /* We don't repeat the cycle if there are less than 25% of keys
              * found expired in the current DB. */
             //ڵǰݿcurrentdbɾ25%Ĺڼô˳
         } while (expired > ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP/4);
+        if (timelimit_exit) break;
+    }
+
+    if (timelimit_exit) server.stat_expired_time_cap_reached_count++;
+
+    /* Update the estimate of the ratio of keys already expired but not
+     * yet reclaimed, smoothing it with the previous value. */
+    if (total_sampled) {
+        double current_perc = (double)total_expired/total_sampled;
+
+        server.stat_expired_stale_perc = (current_perc*0.05)+
+                                         (server.stat_expired_stale_perc*0.95);
     }
 }
 
@@ -940,6 +1027,9 @@ void databasesCron(void) {
     if (server.active_expire_enabled && server.masterhost == NULL)
         activeExpireCycle(ACTIVE_EXPIRE_CYCLE_SLOW);
 
+    /* Defrag keys gradually. */
+    activeDefragCycle();
+
     /* Perform hash tables rehashing if needed, but only if there are no
      * other processes saving the DB on disk. Otherwise rehashing is bad
      * as will cause a lot of copy-on-write of memory pages. */
@@ -1022,13 +1112,13 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
     run_with_period(100) trackOperationsPerSecond();
 
     /* We have just 22 bits per object for LRU information.
-     * So we use an (eventually wrapping) LRU clock with 10 seconds resolution.
-     * 2^22 bits with 10 seconds resolution is more or less 1.5 years.
+     * So we use an (eventually wrapping) LRU clock with 1 second resolution.
+     * 2^22 bits with 1 second resolution is more or less 48 days.
      *
-     * Note that even if this will wrap after 1.5 years it's not a problem,
+     * Note that even if this will wrap after 48 days it's not a problem,
      * everything will still work but just some object will appear younger
      * to Redis. But for this to happen a given object should never be touched
-     * for 1.5 years.
+     * for 48 days.
      *
      * Note that you can change the resolution altering the
      * REDIS_LRU_CLOCK_RESOLUTION define.
@@ -1080,6 +1170,9 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
     /* Handle background operations on Redis databases. */
     databasesCron();
 
+    /* Stop using atomic reference counts if the lazy free thread is idle. */
+    lazyfreeCron();
+
     /* Start a scheduled AOF rewrite if this was requested by the user while
      * a BGSAVE was in progress. */
     // ûִ BGREWRITEAOF Ļں̨ʼ AOF д
@@ -1164,6 +1257,9 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
     /* Close clients that need to be closed asynchronous */
     freeClientsInAsyncFreeQueue();
 
+    /* Release the reply chunks not recently used. */
+    run_with_period(1000) shrinkReplyChunkPool();
+
     /* Replication cron function -- used to reconnect to master and
      * to detect transfer failures. */
     run_with_period(1000) replicationCron(); //
@@ -1185,6 +1281,10 @@ void beforeSleep(struct aeEventLoop *eventLoop) {
     listNode *ln;
     redisClient *c;
 
+    /* Perform the reads deferred to the I/O threads, and execute the
+     * commands they parsed. */
+    handleClientsWithPendingReadsUsingThreads();
+
     /* Run a fast expire cycle (the called function will return
      * ASAP if a fast cycle is not needed). */
     if (server.active_expire_enabled && server.masterhost == NULL)
@@ -1210,6 +1310,11 @@ void beforeSleep(struct aeEventLoop *eventLoop) {
     /* Write the AOF buffer on disk */
     //server.aof_bufеfsync
     flushAppendOnlyFile(0);
+
+    /* Write the replies to the clients. This is done only now that the
+     * AOF buffer is written, exactly like it happens when the replies are
+     * written by the event loop write handler. */
+    handleClientsWithPendingWritesUsingThreads();
 }
 
 /* =========================== Server initialization ======================== */
@@ -1316,6 +1421,10 @@ void initServerConfig() {
     server.tcpkeepalive = REDIS_DEFAULT_TCP_KEEPALIVE;
     server.active_expire_enabled = 1;
     server.client_max_querybuf_len = REDIS_MAX_QUERYBUF_LEN;
+    server.io_threads_num = REDIS_DEFAULT_IO_THREADS;
+    server.io_threads_do_reads = REDIS_DEFAULT_IO_THREADS_DO_READS;
+    server.io_threads_active = 0;
+    server.main_thread_id = pthread_self();
     server.saveparams = NULL;
     server.loading = 0;
     server.logfile = zstrdup(REDIS_DEFAULT_LOGFILE);//־ļ
@@ -1347,18 +1456,34 @@ void initServerConfig() {
     server.rdb_checksum = REDIS_DEFAULT_RDB_CHECKSUM;
     server.stop_writes_on_bgsave_err = REDIS_DEFAULT_STOP_WRITES_ON_BGSAVE_ERROR;
     server.activerehashing = REDIS_DEFAULT_ACTIVE_REHASHING;
+    server.keyspace_hash_table = REDIS_DEFAULT_KEYSPACE_HASH_TABLE;
+    server.active_expire_index = REDIS_DEFAULT_ACTIVE_EXPIRE_INDEX;
     server.notify_keyspace_events = 0;
     server.maxclients = REDIS_MAX_CLIENTS;
     server.bpop_blocked_clients = 0;
     server.maxmemory = REDIS_DEFAULT_MAXMEMORY;
     server.maxmemory_policy = REDIS_DEFAULT_MAXMEMORY_POLICY;
     server.maxmemory_samples = REDIS_DEFAULT_MAXMEMORY_SAMPLES;
+    server.lfu_log_factor = REDIS_DEFAULT_LFU_LOG_FACTOR;
+    server.lfu_decay_time = REDIS_DEFAULT_LFU_DECAY_TIME;
+    server.lazyfree_lazy_eviction = REDIS_DEFAULT_LAZYFREE_LAZY_EVICTION;
+    server.lazyfree_lazy_expire = REDIS_DEFAULT_LAZYFREE_LAZY_EXPIRE;
+    server.lazyfree_lazy_server_del = REDIS_DEFAULT_LAZYFREE_LAZY_SERVER_DEL;
+    server.resp_cache_max_memory = REDIS_DEFAULT_RESP_CACHE_MAX_MEMORY;
+    server.resp_cache_min_hits = REDIS_DEFAULT_RESP_CACHE_MIN_HITS;
+    server.active_defrag_enabled = REDIS_DEFAULT_ACTIVE_DEFRAG;
+    server.active_defrag_ignore_bytes = REDIS_DEFAULT_DEFRAG_IGNORE_BYTES;
+    server.active_defrag_threshold_lower = REDIS_DEFAULT_DEFRAG_THRESHOLD_LOWER;
+    server.active_defrag_threshold_upper = REDIS_DEFAULT_DEFRAG_THRESHOLD_UPPER;
+    server.active_defrag_cycle_min = REDIS_DEFAULT_DEFRAG_CYCLE_MIN;
+    server.active_defrag_cycle_max = REDIS_DEFAULT_DEFRAG_CYCLE_MAX;
     server.hash_max_ziplist_entries = REDIS_HASH_MAX_ZIPLIST_ENTRIES;//hashziplistĿ
     server.hash_max_ziplist_value = REDIS_HASH_MAX_ZIPLIST_VALUE;
-    server.list_max_ziplist_entries = REDIS_LIST_MAX_ZIPLIST_ENTRIES;
-    server.list_max_ziplist_value = REDIS_LIST_MAX_ZIPLIST_VALUE;
+    server.list_max_ziplist_size = REDIS_LIST_MAX_ZIPLIST_SIZE;
+    server.list_compress_depth = REDIS_LIST_COMPRESS_DEPTH;
     server.set_max_intset_entries = REDIS_SET_MAX_INTSET_ENTRIES;
     server.zset_max_ziplist_entries = REDIS_ZSET_MAX_ZIPLIST_ENTRIES;
+    server.zset_btree_index = REDIS_DEFAULT_ZSET_BTREE_INDEX;
     server.zset_max_ziplist_value = REDIS_ZSET_MAX_ZIPLIST_VALUE;
     server.shutdown_asap = 0;
     server.repl_ping_slave_period = REDIS_REPL_PING_SLAVE_PERIOD;
@@ -1533,9 +1658,22 @@ int listenToPort(int port, int *fds, int *count) {
         }
         (*count)++;
     }
+    /* The accept handlers drain the backlog until accept() would block. */
+    for (j = 0; j < *count; j++) anetNonBlock(NULL,fds[j]);
     return REDIS_OK;
 }
 
+/* Create a dictionary of the keyspace, db->dict or db->expires, using the
+ * hash table type selected by keyspace-hash-table. */
+dict *createKeyspaceDict(dictType *type) {
+    if (server.keyspace_hash_table == REDIS_KEYSPACE_OPEN_ADDRESSING)
+        return dictCreateOpenAddressing(type,NULL);
+    else if (server.keyspace_hash_table == REDIS_KEYSPACE_LINEAR)
+        return dictCreateLinear(type,NULL);
+    else
+        return dictCreate(type,NULL);
+}
+
 void initServer() {
     int j;
 
@@ -1551,6 +1689,14 @@ void initServer() {
     server.current_client = NULL;
     server.clients = listCreate();
     server.clients_to_close = listCreate();
+    server.clients_pending_read = listCreate();
+    server.clients_pending_write = listCreate();
+    server.reply_chunk_pool = zmalloc(sizeof(sds)*REDIS_REPLY_CHUNK_POOL_MAX);
+    server.reply_chunk_pool_len = 0;
+    server.reply_chunk_pool_min = 0;
+    server.resp_cache = NULL;
+    server.resp_cache_used = 0;
+    server.resp_cache_memory = 0;
     server.slaves = listCreate();
     server.monitors = listCreate();
     server.slaveseldb = -1; /* Force to emit the first SELECT command. */
@@ -1575,6 +1721,7 @@ void initServer() {
             redisLog(REDIS_WARNING, "Opening socket: %s", server.neterr);
             exit(1);
         }
+        anetNonBlock(NULL,server.sofd);
     }
 
     /* Abort if there are no listening sockets at all. */
@@ -1585,8 +1732,11 @@ void initServer() {
 
     /* Create the Redis databases, and initialize other internal state. */
     for (j = 0; j < server.dbnum; j++) {//ʼݿ
-        server.db[j].dict = dictCreate(&dbDictType,NULL);
-        server.db[j].expires = dictCreate(&keyptrDictType,NULL);
+        server.db[j].dict = createKeyspaceDict(&dbDictType);
+        server.db[j].expires = createKeyspaceDict(&keyptrDictType);
+        server.db[j].expires_index =
+            server.active_expire_index ? zslCreate() : NULL;
+        server.db[j].eviction_pool = evictionPoolAlloc();
         server.db[j].blocking_keys = dictCreate(&keylistDictType,NULL);
         server.db[j].ready_keys = dictCreate(&setDictType,NULL);
         server.db[j].watched_keys = dictCreate(&keylistDictType,NULL);
@@ -1610,6 +1760,8 @@ void initServer() {
     server.stat_numcommands = 0;
     server.stat_numconnections = 0;
     server.stat_expiredkeys = 0;
+    server.stat_expired_stale_perc = 0;
+    server.stat_expired_time_cap_reached_count = 0;
     server.stat_evictedkeys = 0;
     server.stat_starttime = time(NULL);
     server.stat_keyspace_misses = 0;
@@ -1617,6 +1769,18 @@ void initServer() {
     server.stat_peak_memory = 0;
     server.stat_fork_time = 0;
     server.stat_rejected_conn = 0;
+    server.stat_accept_events = 0;
+    server.stat_accept_batch_max = 0;
+    server.stat_reply_chunk_hits = 0;
+    server.stat_reply_chunk_misses = 0;
+    server.stat_resp_cache_hits = 0;
+    server.stat_resp_cache_misses = 0;
+    server.stat_active_defrag_hits = 0;
+    server.stat_active_defrag_misses = 0;
+    server.stat_active_defrag_key_hits = 0;
+    server.stat_active_defrag_key_misses = 0;
+    server.stat_active_defrag_bytes = 0;
+    server.active_defrag_running = 0;
     server.stat_sync_full = 0;
     server.stat_sync_partial_ok = 0;
     server.stat_sync_partial_err = 0;
@@ -1677,6 +1841,8 @@ void initServer() {
     scriptingInit();
     slowlogInit();
     bioInit();
+    initThreadedIO();
+    server.initial_memory_usage = zmalloc_used_memory();
 }
 
 /* Populates the Redis Command Table starting from the hard coded list
@@ -1832,6 +1998,7 @@ void forceCommandPropagation(redisClient *c, int flags) {
 void call(redisClient *c, int flags) {
     long long dirty, start = ustime(), duration;
     int client_old_flags = c->flags;
+    int keyhash_mark;
 
     /* Sent the command to clients in MONITOR mode, only if the commands are
      * not generated from reading an AOF. */
@@ -1846,8 +2013,10 @@ void call(redisClient *c, int flags) {
     c->flags &= ~(REDIS_FORCE_AOF|REDIS_FORCE_REPL);
     redisOpArrayInit(&server.also_propagate);
     dirty = server.dirty;
+    keyhash_mark = keyHashCacheArgs(c);
     //ִв
     c->cmd->proc(c);
+    keyHashReleaseArgs(keyhash_mark);
     dirty = server.dirty-dirty;
     duration = ustime()-start;
 
@@ -2320,6 +2489,8 @@ sds genRedisInfoString(char *section) {
     if (allsections || defsections || !strcasecmp(section,"memory")) {
         char hmem[64];
         char peak_hmem[64];
+        size_t frag_bytes;
+        float frag_pct = getAllocatorFragmentation(&frag_bytes);
 
         bytesToHuman(hmem,zmalloc_used_memory());
         bytesToHuman(peak_hmem,server.stat_peak_memory);
@@ -2333,7 +2504,16 @@ sds genRedisInfoString(char *section) {
             "used_memory_peak_human:%s\r\n"
             "used_memory_lua:%lld\r\n"
             "mem_fragmentation_ratio:%.2f\r\n"
-            "mem_allocator:%s\r\n",
+            "mem_allocator:%s\r\n"
+            "reply_chunk_pool_size:%d\r\n"
+            "reply_chunk_pool_memory:%zu\r\n"
+            "reply_chunk_pool_hits:%lld\r\n"
+            "reply_chunk_pool_misses:%lld\r\n"
+            "reply_chunk_pool_hit_rate:%.2f\r\n"
+            "lazyfree_pending_objects:%zu\r\n"
+            "allocator_frag_ratio:%.2f\r\n"
+            "allocator_frag_bytes:%zu\r\n"
+            "active_defrag_running:%d\r\n",
             zmalloc_used_memory(),
             hmem,
             zmalloc_get_rss(),
@@ -2341,7 +2521,18 @@ sds genRedisInfoString(char *section) {
             peak_hmem,
             ((long long)lua_gc(server.lua,LUA_GCCOUNT,0))*1024LL,
             zmalloc_get_fragmentation_ratio(),
-            ZMALLOC_LIB
+            ZMALLOC_LIB,
+            server.reply_chunk_pool_len,
+            replyChunkPoolMemory(),
+            server.stat_reply_chunk_hits,
+            server.stat_reply_chunk_misses,
+            (server.stat_reply_chunk_hits+server.stat_reply_chunk_misses) ?
+                (double)server.stat_reply_chunk_hits/
+                (server.stat_reply_chunk_hits+server.stat_reply_chunk_misses) : 0,
+            lazyfreeGetPendingObjectsCount(),
+            1+frag_pct/100,
+            frag_bytes,
+            server.active_defrag_running
             );
     }
 
@@ -2438,13 +2629,27 @@ sds genRedisInfoString(char *section) {
             "total_commands_processed:%lld\r\n"
             "instantaneous_ops_per_sec:%lld\r\n"
             "rejected_connections:%lld\r\n"
+            "accept_events:%lld\r\n"
+            "accept_batch_max:%d\r\n"
             "sync_full:%lld\r\n"
             "sync_partial_ok:%lld\r\n"
             "sync_partial_err:%lld\r\n"
             "expired_keys:%lld\r\n"
+            "expired_stale_perc:%.2f\r\n"
+            "expired_stale_keys:%llu\r\n"
+            "expired_time_cap_reached_count:%lld\r\n"
             "evicted_keys:%lld\r\n"
             "keyspace_hits:%lld\r\n"
             "keyspace_misses:%lld\r\n"
+            "resp_cache_keys:%d\r\n"
+            "resp_cache_memory:%zu\r\n"
+            "resp_cache_hits:%lld\r\n"
+            "resp_cache_misses:%lld\r\n"
+            "active_defrag_hits:%lld\r\n"
+            "active_defrag_misses:%lld\r\n"
+            "active_defrag_key_hits:%lld\r\n"
+            "active_defrag_key_misses:%lld\r\n"
+            "active_defrag_bytes:%lld\r\n"
             "pubsub_channels:%ld\r\n"
             "pubsub_patterns:%lu\r\n"
             "latest_fork_usec:%lld\r\n",
@@ -2452,13 +2657,27 @@ sds genRedisInfoString(char *section) {
             server.stat_numcommands,
             getOperationsPerSecond(),
             server.stat_rejected_conn,
+            server.stat_accept_events,
+            server.stat_accept_batch_max,
             server.stat_sync_full,
             server.stat_sync_partial_ok,
             server.stat_sync_partial_err,
             server.stat_expiredkeys,
+            server.stat_expired_stale_perc*100,
+            estimateStaleKeys(),
+            server.stat_expired_time_cap_reached_count,
             server.stat_evictedkeys,
             server.stat_keyspace_hits,
             server.stat_keyspace_misses,
+            server.resp_cache_used,
+            server.resp_cache_memory,
+            server.stat_resp_cache_hits,
+            server.stat_resp_cache_misses,
+            server.stat_active_defrag_hits,
+            server.stat_active_defrag_misses,
+            server.stat_active_defrag_key_hits,
+            server.stat_active_defrag_key_misses,
+            server.stat_active_defrag_bytes,
             dictSize(server.pubsub_channels),
             listLength(server.pubsub_patterns),
             server.stat_fork_time);
@@ -2590,6 +2809,13 @@ sds genRedisInfoString(char *section) {
         (float)c_ru.ru_utime.tv_sec+(float)c_ru.ru_utime.tv_usec/1000000);
     }
 
+    /* Threads */
+    if (allsections || defsections || !strcasecmp(section,"threads")) {
+        if (sections++) info = sdscat(info,"\r\n");
+        info = sdscatprintf(info,"# Threads\r\n");
+        info = genIOThreadsInfoString(info);
+    }
+
     /* cmdtime */
     if (allsections || !strcasecmp(section,"commandstats")) {
         if (sections++) info = sdscat(info,"\r\n");
@@ -2650,6 +2876,136 @@ void monitorCommand(redisClient *c) {
 
 /* ============================ Maxmemory directive  ======================== */
 
+/* ---------------------------------------------------------------------------
+ * The eviction pool
+ *
+ * The LRU and TTL policies evict the best candidate among a few sampled
+ * keys. Instead of forgetting about all the other keys of the sample, every
+ * DB keeps a pool of the best candidates seen so far: every sample is merged
+ * into the pool, and the best key of the pool is evicted. This approximates
+ * the true LRU much better for the same number of samples.
+ *
+ * The pool is sorted by ascending idle time (for volatile-ttl the idle time
+ * is the inverse of the expire time), empty entries are on the right.
+ * The keys of the pool are copies, so entries may refer to keys that were
+ * deleted or accessed after they entered the pool: they are validated before
+ * being evicted.
+ * ------------------------------------------------------------------------ */
+
+struct evictionPoolEntry *evictionPoolAlloc(void) {
+    struct evictionPoolEntry *ep;
+    int j;
+
+    ep = zmalloc(sizeof(*ep)*REDIS_EVICTION_POOL_SIZE);
+    for (j = 0; j < REDIS_EVICTION_POOL_SIZE; j++) {
+        ep[j].idle = 0;
+        ep[j].key = NULL;
+    }
+    return ep;
+}
+
+/* Remove the entry 'k' from the pool, shifting the entries at its right. */
+static void evictionPoolDelete(struct evictionPoolEntry *pool, int k) {
+    sdsfree(pool[k].key);
+    memmove(pool+k,pool+k+1,
+            sizeof(pool[0])*(REDIS_EVICTION_POOL_SIZE-k-1));
+    pool[REDIS_EVICTION_POOL_SIZE-1].key = NULL;
+    pool[REDIS_EVICTION_POOL_SIZE-1].idle = 0;
+}
+
+/* Empty the pools of all the DBs. Called when the policy is changed, since
+ * the idle values of the different policies can't be compared. */
+void evictionPoolEmpty(void) {
+    int j;
+
+    for (j = 0; j < server.dbnum; j++) {
+        struct evictionPoolEntry *pool = server.db[j].eviction_pool;
+
+        while(pool[0].key) evictionPoolDelete(pool,0);
+    }
+}
+
+/* Return the idle value of the key having the entry 'de' in the sampled
+ * dictionary, that is db->dict or db->expires according to the policy.
+ * With the LFU policies the less frequently used keys are the most idle. */
+static unsigned long long evictionPoolIdle(redisDb *db, dictEntry *de) {
+    if (server.maxmemory_policy == REDIS_MAXMEMORY_VOLATILE_TTL)
+        return ULLONG_MAX - (unsigned long long)dictGetSignedIntegerVal(de);
+
+    /* When policy is volatile-lru or volatile-lfu we need an additional
+     * lookup to locate the real key, as the sampled dict is db->expires. */
+    if (server.maxmemory_policy == REDIS_MAXMEMORY_VOLATILE_LRU ||
+        server.maxmemory_policy == REDIS_MAXMEMORY_VOLATILE_LFU)
+        de = dictFind(db->dict,dictGetKey(de));
+    if (REDIS_MAXMEMORY_IS_LFU(server.maxmemory_policy))
+        return REDIS_LFU_COUNTER_MAX - LFUDecrAndReturn(dictGetVal(de));
+    return estimateObjectIdleTime(dictGetVal(de));
+}
+
+/* Sample a few keys of 'sampledict' and add them to the pool of 'db' if
+ * they are better candidates than the ones already there. */
+static void evictionPoolPopulate(redisDb *db, dict *sampledict) {
+    struct evictionPoolEntry *pool = db->eviction_pool;
+    dictEntry *_samples[REDIS_EVICTION_SAMPLES_ARRAY_SIZE];
+    dictEntry **samples = _samples;
+    unsigned int count, j;
+
+    if (server.maxmemory_samples > REDIS_EVICTION_SAMPLES_ARRAY_SIZE)
+        samples = zmalloc(sizeof(dictEntry*)*server.maxmemory_samples);
+    count = dictGetSomeKeys(sampledict,samples,server.maxmemory_samples);
+
+    for (j = 0; j < count; j++) {
+        unsigned long long idle = evictionPoolIdle(db,samples[j]);
+        int k = 0;
+
+        /* Find the first entry with an idle time not smaller than ours,
+         * or the first empty entry. */
+        while (k < REDIS_EVICTION_POOL_SIZE &&
+               pool[k].key &&
+               pool[k].idle < idle) k++;
+        if (k == 0 && pool[REDIS_EVICTION_POOL_SIZE-1].key != NULL) {
+            /* Worse than every key of a full pool. */
+            continue;
+        } else if (k < REDIS_EVICTION_POOL_SIZE && pool[k].key == NULL) {
+            /* Inserting into an empty entry. */
+        } else if (pool[REDIS_EVICTION_POOL_SIZE-1].key == NULL) {
+            /* There is space on the right: shift the entries from 'k'. */
+            memmove(pool+k+1,pool+k,
+                    sizeof(pool[0])*(REDIS_EVICTION_POOL_SIZE-k-1));
+        } else {
+            /* The pool is full: drop the worst entry, on the left, and
+             * insert our key just before the entry at 'k'. */
+            k--;
+            sdsfree(pool[0].key);
+            memmove(pool,pool+1,sizeof(pool[0])*k);
+        }
+        pool[k].key = sdsdup(dictGetKey(samples[j]));
+        pool[k].idle = idle;
+    }
+    if (samples != _samples) zfree(samples);
+}
+
+/* Return the key of 'sampledict' to evict according to the pool of 'db',
+ * removing it from the pool, or NULL if the pool has no valid candidate.
+ * Candidates are valid if they still exist and are at least as good as when
+ * they entered the pool: keys accessed since then are discarded. */
+static sds evictionPoolBest(redisDb *db, dict *sampledict) {
+    struct evictionPoolEntry *pool = db->eviction_pool;
+    int k;
+
+    for (k = REDIS_EVICTION_POOL_SIZE-1; k >= 0; k--) {
+        dictEntry *de;
+        int valid;
+
+        if (pool[k].key == NULL) continue;
+        de = dictFind(sampledict,pool[k].key);
+        valid = de && evictionPoolIdle(db,de) >= pool[k].idle;
+        evictionPoolDelete(pool,k);
+        if (valid) return dictGetKey(de);
+    }
+    return NULL;
+}
+
 /* This function gets called when 'maxmemory' is set on the config file to limit
  * the max memory used by the server, before processing a command.
  *
@@ -2666,7 +3022,7 @@ void monitorCommand(redisClient *c) {
  * used by the server.
  */
 int freeMemoryIfNeeded(void) {
-    size_t mem_used, mem_tofree, mem_freed;
+    size_t mem_used, mem_tofree, mem_freed, mem_reported;
     int slaves = listLength(server.slaves);
 
     /* Remove the size of slaves output buffers and AOF buffer from the
@@ -2691,26 +3047,42 @@ int freeMemoryIfNeeded(void) {
         mem_used -= aofRewriteBufferSize();
     }
 
+    /* The RESP cache is bounded by resp-cache-max-memory on its own, so
+     * it is not counted: emptying it every time keys have to be evicted
+     * would prevent it from staying warm in the very deployments that
+     * use both. */
+    mem_used -= server.resp_cache_memory;
+
     /* Check if we are over the memory limit. */
     if (mem_used <= server.maxmemory) return REDIS_OK;
 
+    /* Before evicting keys, release the memory held by the reply chunks
+     * pool, that is just a cache. */
+    if (server.reply_chunk_pool_len) {
+        size_t freed = emptyReplyChunkPool();
+
+        mem_used = (freed > mem_used) ? 0 : mem_used-freed;
+        if (mem_used <= server.maxmemory) return REDIS_OK;
+    }
+
     if (server.maxmemory_policy == REDIS_MAXMEMORY_NO_EVICTION)
         return REDIS_ERR; /* We need to free memory, but policy forbids. */
 
     /* Compute how much memory we need to free. */
     mem_tofree = mem_used - server.maxmemory;
     mem_freed = 0;
+    mem_reported = zmalloc_used_memory();
     while (mem_freed < mem_tofree) {
         int j, k, keys_freed = 0;
 
         for (j = 0; j < server.dbnum; j++) {
-            long bestval = 0; /* just to prevent warning */
             sds bestkey = NULL;
             struct dictEntry *de;
             redisDb *db = server.db+j;
             dict *dict;
 
             if (server.maxmemory_policy == REDIS_MAXMEMORY_ALLKEYS_LRU ||
+                server.maxmemory_policy == REDIS_MAXMEMORY_ALLKEYS_LFU ||
                 server.maxmemory_policy == REDIS_MAXMEMORY_ALLKEYS_RANDOM)
             {
                 dict = server.db[j].dict;
@@ -2727,48 +3099,14 @@ int freeMemoryIfNeeded(void) {
                 bestkey = dictGetKey(de);
             }
 
-            /* volatile-lru and allkeys-lru policy */
-            else if (server.maxmemory_policy == REDIS_MAXMEMORY_ALLKEYS_LRU ||
-                server.maxmemory_policy == REDIS_MAXMEMORY_VOLATILE_LRU)
-            {
-                for (k = 0; k < server.maxmemory_samples; k++) {
-                    sds thiskey;
-                    long thisval;
-                    robj *o;
-
-                    de = dictGetRandomKey(dict);
-                    thiskey = dictGetKey(de);
-                    /* When policy is volatile-lru we need an additional lookup
-                     * to locate the real key, as dict is set to db->expires. */
-                    if (server.maxmemory_policy == REDIS_MAXMEMORY_VOLATILE_LRU)
-                        de = dictFind(db->dict, thiskey);
-                    o = dictGetVal(de);
-                    thisval = estimateObjectIdleTime(o);
-
-                    /* Higher idle time is better candidate for deletion */
-                    if (bestkey == NULL || thisval > bestval) {
-                        bestkey = thiskey;
-                        bestval = thisval;
-                    }
-                }
-            }
-
-            /* volatile-ttl */
-            else if (server.maxmemory_policy == REDIS_MAXMEMORY_VOLATILE_TTL) {
-                for (k = 0; k < server.maxmemory_samples; k++) {
-                    sds thiskey;
-                    long thisval;
-
-                    de = dictGetRandomKey(dict);
-                    thiskey = dictGetKey(de);
-                    thisval = (long) dictGetVal(de);
-
-                    /* Expire sooner (minor expire unix timestamp) is better
-                     * candidate for deletion */
-                    if (bestkey == NULL || thisval < bestval) {
-                        bestkey = thiskey;
-                        bestval = thisval;
-                    }
+            /* The LRU, LFU and TTL policies: refill the pool of the DB
+             * with a new sample and evict its best key. If all the keys of
+             * the pool were stale, the new sample is enough to find a valid
+             * candidate. */
+            else {
+                for (k = 0; k < 2 && bestkey == NULL; k++) {
+                    evictionPoolPopulate(db,dict);
+                    bestkey = evictionPoolBest(db,dict);
                 }
             }
 
@@ -2787,7 +3125,10 @@ int freeMemoryIfNeeded(void) {
                  * AOF and Output buffer memory will be freed eventually so
                  * we only care about memory used by the key space. */
                 delta = (long long) zmalloc_used_memory();
-                dbDelete(db,keyobj);
+                if (server.lazyfree_lazy_eviction)
+                    dbAsyncDelete(db,keyobj);
+                else
+                    dbSyncDelete(db,keyobj);
                 delta -= (long long) zmalloc_used_memory();
                 mem_freed += delta;
                 server.stat_evictedkeys++;
@@ -2801,9 +3142,30 @@ int freeMemoryIfNeeded(void) {
                  * deliver data to the slaves fast enough, so we force the
                  * transmission here inside the loop. */
                 if (slaves) flushSlavesOutputBuffers();
+
+                /* With lazy eviction the values are freed by another
+                 * thread, so dbAsyncDelete() frees almost nothing: check
+                 * how much memory the thread reclaimed so far. */
+                if (server.lazyfree_lazy_eviction) {
+                    size_t now = zmalloc_used_memory();
+
+                    if (now < mem_reported && mem_reported-now > mem_freed)
+                        mem_freed = mem_reported-now;
+                }
+            }
+        }
+        if (!keys_freed) {
+            /* Nothing left to evict, but the lazy free thread may still be
+             * releasing enough memory. */
+            while (bioPendingJobsOfType(REDIS_BIO_LAZY_FREE)) {
+                size_t now = zmalloc_used_memory();
+
+                if (now < mem_reported && mem_reported-now >= mem_tofree)
+                    return REDIS_OK;
+                usleep(1000);
             }
+            return REDIS_ERR; /* nothing to free... */
         }
-        if (!keys_freed) return REDIS_ERR; /* nothing to free... */
     }
     return REDIS_OK;
 }
@@ -58,6 +58,8 @@
 #include "zmalloc.h" /* total memory usage aware version of malloc/free */
 #include "anet.h"    /* Networking the easy way */
 #include "ziplist.h" /* Compact list data structure */
+#include "listpack.h" /* Compact list data structure, without cascade updates */
+#include "quicklist.h" /* Lists are encoded as linked lists of listpacks */
 #include "intset.h"  /* Compact integer set structure */
 #include "version.h" /* Version macro */
 #include "util.h"    /* Misc functions useful in many places */
@@ -76,6 +78,7 @@
 #define REDIS_CONFIGLINE_MAX    1024
 #define REDIS_DBCRON_DBS_PER_CALL 16
 #define REDIS_MAX_WRITE_PER_EVENT (1024*64)
+#define REDIS_MAX_ACCEPTS_PER_CALL 1000
 #define REDIS_SHARED_SELECT_CMDS 10
 #define REDIS_SHARED_INTEGERS 10000
 #define REDIS_SHARED_BULKHDR_LEN 32
@@ -113,11 +116,30 @@
 #define REDIS_DEFAULT_REPL_DISABLE_TCP_NODELAY 0
 #define REDIS_DEFAULT_MAXMEMORY 0
 #define REDIS_DEFAULT_MAXMEMORY_SAMPLES 3
+#define REDIS_DEFAULT_LFU_LOG_FACTOR 10
+#define REDIS_DEFAULT_LFU_DECAY_TIME 1
+#define REDIS_DEFAULT_LAZYFREE_LAZY_EVICTION 0
+#define REDIS_DEFAULT_LAZYFREE_LAZY_EXPIRE 0
+#define REDIS_DEFAULT_LAZYFREE_LAZY_SERVER_DEL 0
+#define REDIS_DEFAULT_ACTIVE_DEFRAG 0
+#define REDIS_DEFAULT_DEFRAG_IGNORE_BYTES (100<<20) /* 100 MB */
+#define REDIS_DEFAULT_DEFRAG_THRESHOLD_LOWER 10 /* Percentage */
+#define REDIS_DEFAULT_DEFRAG_THRESHOLD_UPPER 100 /* Percentage */
+#define REDIS_DEFAULT_DEFRAG_CYCLE_MIN 25 /* Percentage of CPU */
+#define REDIS_DEFAULT_DEFRAG_CYCLE_MAX 75 /* Percentage of CPU */
+#define REDIS_EVICTION_SAMPLES_ARRAY_SIZE 16 /* Samples taken without zmalloc(). */
+#define REDIS_EVICTION_POOL_SIZE 16 /* Eviction candidates kept per DB. */
+#define REDIS_DEFAULT_RESP_CACHE_MAX_MEMORY 0
+#define REDIS_DEFAULT_RESP_CACHE_MIN_HITS 8
 #define REDIS_DEFAULT_AOF_NO_FSYNC_ON_REWRITE 0
 #define REDIS_DEFAULT_ACTIVE_REHASHING 1
+#define REDIS_DEFAULT_ACTIVE_EXPIRE_INDEX 0
 #define REDIS_DEFAULT_AOF_REWRITE_INCREMENTAL_FSYNC 1
 #define REDIS_DEFAULT_MIN_SLAVES_TO_WRITE 0
 #define REDIS_DEFAULT_MIN_SLAVES_MAX_LAG 10
+#define REDIS_DEFAULT_IO_THREADS 1           /* Only the main thread. */
+#define REDIS_DEFAULT_IO_THREADS_DO_READS 1
+#define REDIS_IO_THREADS_MAX_NUM 128
 #define REDIS_IP_STR_LEN INET6_ADDRSTRLEN
 #define REDIS_PEER_ID_LEN (REDIS_IP_STR_LEN+32) /* Must be enough for ip:port */
 #define REDIS_BINDADDR_MAX 16
@@ -132,8 +154,13 @@
 #define REDIS_MAX_QUERYBUF_LEN  (1024*1024*1024) /* 1GB max query buffer. */
 #define REDIS_IOBUF_LEN         (1024*16)  /* Generic I/O buffer size */
 #define REDIS_REPLY_CHUNK_BYTES (16*1024) /* 16k output buffer */
+#define REDIS_REPLY_CHUNK_POOL_MAX 256    /* Max chunks kept for reuse */
+#define REDIS_RESP_CACHE_MAX_VALUE (1024*16) /* Max value len in RESP cache */
 #define REDIS_INLINE_MAX_SIZE   (1024*64) /* Max size of inline reads */
 #define REDIS_MBULK_BIG_ARG     (1024*32)
+#define REDIS_ARGV_POOL_SIZE    16        /* Argument objects kept per client */
+#define REDIS_ARGV_POOL_MAX_ALLOC 256     /* Max sds allocation to keep */
+#define REDIS_ARGV_MAX_KEEP     1024      /* Max argv array size to keep */
 #define REDIS_LONGSTR_SIZE      21          /* Bytes needed for long -> str */
 #define REDIS_AOF_AUTOSYNC_BYTES (1024*1024*32) /* fdatasync every 32MB */
 /* When configuring the Redis eventloop, we setup it so that the total number
@@ -177,6 +204,18 @@
 #define REDIS_ENCODING_ZIPLIST 5 /* Encoded as ziplist */
 #define REDIS_ENCODING_INTSET 6  /* Encoded as intset */
 #define REDIS_ENCODING_SKIPLIST 7  /* Encoded as skiplist */
+#define REDIS_ENCODING_EMBSTR 8  /* Embedded sds string encoding */
+#define REDIS_ENCODING_QUICKLIST 9 /* Encoded as linked list of listpacks */
+#define REDIS_ENCODING_LISTPACK 10 /* Encoded as listpack */
+#define REDIS_ENCODING_BTREE 11  /* Encoded as B+tree */
+
+/* Strings up to this length are created with the EMBSTR encoding: robj,
+ * sds header and payload then fit a single 64 bytes allocation. */
+#define REDIS_ENCODING_EMBSTR_SIZE_LIMIT 39
+
+/* Both the RAW and the EMBSTR encodings store an sds string in o->ptr,
+ * but only RAW strings can be modified in place. */
+#define sdsEncodedObject(objptr) (objptr->encoding == REDIS_ENCODING_RAW || objptr->encoding == REDIS_ENCODING_EMBSTR)
 
 /* Defines related to the dump file format. To store 32 bits lengths for short
  * keys requires a lot of space, so we check the most significant 2 bits of
@@ -229,6 +268,11 @@
 #define REDIS_FORCE_AOF (1<<14)   /* Force AOF propagation of current cmd. */
 #define REDIS_FORCE_REPL (1<<15)  /* Force replication of current cmd. */
 #define REDIS_PRE_PSYNC_SLAVE (1<<16) /* Slave don't understand PSYNC. */
+#define REDIS_PENDING_READ (1<<17) /* Socket read deferred to an I/O thread. */
+#define REDIS_PENDING_COMMAND (1<<18) /* Command parsed by an I/O thread,
+                                         waiting to be executed. */
+#define REDIS_PENDING_WRITE (1<<19) /* Client has output to send but the write
+                                       is deferred to beforeSleep(). */
 
 /* Client request types */
 #define REDIS_REQ_INLINE 1
@@ -294,11 +338,12 @@
 /* Zip structure related defaults */
 #define REDIS_HASH_MAX_ZIPLIST_ENTRIES 512
 #define REDIS_HASH_MAX_ZIPLIST_VALUE 64
-#define REDIS_LIST_MAX_ZIPLIST_ENTRIES 512
-#define REDIS_LIST_MAX_ZIPLIST_VALUE 64
+#define REDIS_LIST_MAX_ZIPLIST_SIZE -2
+#define REDIS_LIST_COMPRESS_DEPTH 0
 #define REDIS_SET_MAX_INTSET_ENTRIES 512
 #define REDIS_ZSET_MAX_ZIPLIST_ENTRIES 128
 #define REDIS_ZSET_MAX_ZIPLIST_VALUE 64
+#define REDIS_DEFAULT_ZSET_BTREE_INDEX 0
 
 /* Sets operations codes */
 #define REDIS_OP_UNION 0
@@ -312,8 +357,18 @@
 #define REDIS_MAXMEMORY_ALLKEYS_LRU 3
 #define REDIS_MAXMEMORY_ALLKEYS_RANDOM 4
 #define REDIS_MAXMEMORY_NO_EVICTION 5
+#define REDIS_MAXMEMORY_VOLATILE_LFU 6
+#define REDIS_MAXMEMORY_ALLKEYS_LFU 7
+#define REDIS_MAXMEMORY_IS_LFU(p) ((p) == REDIS_MAXMEMORY_VOLATILE_LFU || \
+                                   (p) == REDIS_MAXMEMORY_ALLKEYS_LFU)
 #define REDIS_DEFAULT_MAXMEMORY_POLICY REDIS_MAXMEMORY_VOLATILE_LRU
 
+/* Keyspace hash table types */
+#define REDIS_KEYSPACE_CHAINED 0
+#define REDIS_KEYSPACE_OPEN_ADDRESSING 1
+#define REDIS_KEYSPACE_LINEAR 2
+#define REDIS_DEFAULT_KEYSPACE_HASH_TABLE REDIS_KEYSPACE_CHAINED
+
 /* Scripting */
 #define REDIS_LUA_TIME_LIMIT 5000 /* milliseconds */
 
@@ -369,11 +424,20 @@
 /* A redis object, that is a type able to hold a string / list / set */
 
 /* The actual Redis Object */
-#define REDIS_LRU_CLOCK_MAX ((1<<21)-1) /* Max value of obj->lru */
-#define REDIS_LRU_CLOCK_RESOLUTION 10 /* LRU clock resolution in seconds */
+#define REDIS_LRU_CLOCK_MAX ((1<<22)-1) /* Max value of obj->lru */
+#define REDIS_LRU_CLOCK_RESOLUTION 1 /* LRU clock resolution in seconds */
+
+/* With the LFU policies obj->lru holds the access time in minutes in the
+ * REDIS_LFU_TIME_BITS high bits, and a logarithmic access counter in the
+ * low 8 bits. See LFULogIncr() and LFUDecrAndReturn() in object.c. */
+#define REDIS_LFU_TIME_BITS 14
+#define REDIS_LFU_TIME_MAX ((1<<REDIS_LFU_TIME_BITS)-1)
+#define REDIS_LFU_COUNTER_MAX 255
+#define REDIS_LFU_INIT_VAL 5    /* New keys don't look like the coldest. */
 typedef struct redisObject {
     unsigned type:4;  //
-    unsigned notused:2;     /* Not used */
+    unsigned respcached:1;  /* Has an entry in the RESP cache, respcache.c */
+    unsigned hashcached:1;  /* Key hash is cached, see keyHash() in db.c */
     unsigned encoding:4; //ݱ뷽ʽ
     unsigned lru:22;        /* lru time (relative to server.lruclock) */
     int refcount;   //ü
@@ -389,11 +453,23 @@ typedef struct redisObject {
     _var.type = REDIS_STRING; \
     _var.encoding = REDIS_ENCODING_RAW; \
     _var.ptr = _ptr; \
+    _var.respcached = 0; \
+    _var.hashcached = 0; \
 } while(0);
 
+/* An entry of the pool of the best keys to evict of a DB, see
+ * freeMemoryIfNeeded(). */
+struct evictionPoolEntry {
+    unsigned long long idle;    /* Idle time, or inverse TTL: higher is better */
+    sds key;                    /* Key name, or NULL if the entry is empty. */
+};
+
 typedef struct redisDb {
     dict *dict;                 /* The keyspace for this DB */
     dict *expires;              /* Timeout of keys with a timeout set */
+    struct zskiplist *expires_index; /* Keys with a timeout by expire time,
+                                        or NULL, see active-expire-index */
+    struct evictionPoolEntry *eviction_pool; /* Eviction candidates */
     dict *blocking_keys;        /* Keys with clients waiting for data (BLPOP) */
     dict *ready_keys;           /* Blocked keys that received a PUSH */
     dict *watched_keys;         /* WATCHED keys for MULTI/EXEC CAS */
@@ -452,6 +528,9 @@ typedef struct redisClient {
     size_t querybuf_peak;   /* Recent (100ms or more) peak of querybuf size */
     int argc;
     robj **argv;
+    int argv_len;           /* Size of the argv array, may be > argc */
+    robj *argv_pool[REDIS_ARGV_POOL_SIZE]; /* Argument objects to reuse */
+    int argv_pool_len;      /* Number of objects in argv_pool */
     struct redisCommand *cmd, *lastcmd;
     int reqtype;   //
     int multibulklen;       /* number of multi bulk arguments left to read */
@@ -482,6 +561,9 @@ typedef struct redisClient {
     dict *pubsub_channels;  /* channels a client is interested in (SUBSCRIBE) */
     list *pubsub_patterns;  /* patterns a client is interested in (SUBSCRIBE) */
 
+    size_t io_written;      /* Bytes written by an I/O thread, not yet
+                               consumed from the output buffers. */
+
     /* Response buffer */
     int bufpos; //ظ
     char buf[REDIS_REPLY_CHUNK_BYTES];
@@ -524,10 +606,39 @@ typedef struct zskiplist {
     int level;//Ŀǰ
 } zskiplist;
 
-/**Sorted SetͬʱʹdictskiplistΪڲԪصʱ򽫸ӶȽ͵O(1)*/
+/* ZSETs can also be indexed by a B+tree, see zbtree.c. The capacities make
+ * leaves fit in 1024 bytes and inner nodes in 2048 bytes. */
+#define ZBTREE_LEAF_SIZE 62
+#define ZBTREE_NODE_SIZE 63
+
+typedef struct zbtreeLeaf {
+    struct zbtreeLeaf *prev, *next;
+    unsigned int count;
+    double score[ZBTREE_LEAF_SIZE];
+    robj *obj[ZBTREE_LEAF_SIZE];
+} zbtreeLeaf;
+
+typedef struct zbtreeNode {
+    unsigned int count;                     /* Number of children. */
+    double score[ZBTREE_NODE_SIZE];         /* Separators, [0] is unused. */
+    robj *obj[ZBTREE_NODE_SIZE];
+    unsigned long span[ZBTREE_NODE_SIZE];   /* Elements under every child. */
+    void *child[ZBTREE_NODE_SIZE];
+} zbtreeNode;
+
+typedef struct zbtree {
+    void *root;             /* A leaf when height is 0, NULL if empty. */
+    zbtreeLeaf *head, *tail;
+    unsigned long length;
+    int height;
+} zbtree;
+
+/**Sorted SetͬʱʹdictskiplistΪڲԪصʱ򽫸ӶȽ͵O(1)
+   B+treeʱzbtzslһָΪNULL*/
 typedef struct zset {
     dict *dict;
     zskiplist *zsl;
+    zbtree *zbt;
 } zset;
 
 typedef struct clientBufferLimitsConfig {
@@ -578,6 +689,8 @@ struct redisServer {
     unsigned lruclock_padding:10;
     int shutdown_asap;          /* SHUTDOWN needed ASAP */
     int activerehashing;        /* Incremental rehash in serverCron() */
+    int keyspace_hash_table;    /* Hash table type of the keyspace dicts */
+    int active_expire_index;    /* Index the volatile keys by expire time */
     char *requirepass;          /* Pass for AUTH command, or NULL */
     char *pidfile;              /* PID file path */
     int arch_bits;              /* 32 or 64 depending on sizeof(long) */
@@ -595,9 +708,20 @@ struct redisServer {
     int sofd;                   /* Unix socket file descriptor */
     list *clients;              /* List of active clients */
     list *clients_to_close;     /* Clients to close asynchronously */
+    list *clients_pending_read; /* Clients with socket reads deferred to the
+                                   I/O threads, see beforeSleep(). */
+    list *clients_pending_write; /* Clients with output to flush, but no
+                                    write handler installed yet. */
     list *slaves, *monitors;    /* List of slaves and MONITORs */
     redisClient *current_client; /* Current client, only used on crash report */
     char neterr[ANET_ERR_LEN];  /* Error buffer for anet.c */
+    sds *reply_chunk_pool;      /* Free reply chunks, see networking.c */
+    int reply_chunk_pool_len;   /* Number of chunks in the pool */
+    int reply_chunk_pool_min;   /* Min pool length since last shrink */
+    struct respCacheEntry *resp_cache; /* Encoded replies of hot values,
+                                          see respcache.c */
+    int resp_cache_used;        /* Number of entries in the RESP cache */
+    size_t resp_cache_memory;   /* Memory used by the RESP cache */
     /* RDB / AOF loading information */
     int loading;                /* We are loading data from disk if true */
     off_t loading_total_bytes;
@@ -612,12 +736,26 @@ struct redisServer {
     long long stat_numcommands;     /* Number of processed commands */
     long long stat_numconnections;  /* Number of connections received */
     long long stat_expiredkeys;     /* Number of expired keys */
+    double stat_expired_stale_perc; /* Expired keys in the samples (0-1) */
+    long long stat_expired_time_cap_reached_count; /* Cycles out of time */
     long long stat_evictedkeys;     /* Number of evicted keys (maxmemory) */
     long long stat_keyspace_hits;   /* Number of successful lookups of keys */
     long long stat_keyspace_misses; /* Number of failed lookups of keys */
     size_t stat_peak_memory;        /* Max used memory record */
+    size_t initial_memory_usage;    /* Memory used after initServer() */
     long long stat_fork_time;       /* Time needed to perform latest fork() */
     long long stat_rejected_conn;   /* Clients rejected because of maxclients */
+    long long stat_accept_events;   /* Calls of the accept handlers */
+    int stat_accept_batch_max;      /* Max connections accepted in one call */
+    long long stat_reply_chunk_hits;   /* Reply chunks taken from the pool */
+    long long stat_reply_chunk_misses; /* Reply chunks allocated */
+    long long stat_resp_cache_hits;   /* GETs served from the RESP cache */
+    long long stat_resp_cache_misses; /* GETs not served from the cache */
+    long long stat_active_defrag_hits;   /* Allocations moved by defrag */
+    long long stat_active_defrag_misses; /* Allocations defrag left there */
+    long long stat_active_defrag_key_hits;   /* Keys with moved allocations */
+    long long stat_active_defrag_key_misses; /* Keys scanned, nothing moved */
+    long long stat_active_defrag_bytes;  /* Bytes moved by defrag */
     long long stat_sync_full;       /* Number of full resyncs with slaves. */
     long long stat_sync_partial_ok; /* Number of accepted PSYNC requests. */
     long long stat_sync_partial_err;/* Number of unaccepted PSYNC requests. */
@@ -638,6 +776,10 @@ struct redisServer {
     int active_expire_enabled;      /* Can be disabled for testing purposes. */
     size_t client_max_querybuf_len; /* Limit for client query buffer length */
     int dbnum;                      /* Total number of configured DBs */
+    int io_threads_num;             /* Number of I/O threads, main included. */
+    int io_threads_do_reads;        /* Read and parse queries in I/O threads. */
+    int io_threads_active;          /* I/O threads are currently running. */
+    pthread_t main_thread_id;       /* To tell the I/O threads apart. */
     int daemonize;                  /* True if running as a daemon */
     clientBufferLimitsConfig client_obuf_limits[REDIS_CLIENT_LIMIT_NUM_CLASSES];
     /* AOF persistence */
@@ -733,6 +875,23 @@ struct redisServer {
     unsigned long long maxmemory;   /* Max number of memory bytes to use */
     int maxmemory_policy;           /* Policy for key eviction */
     int maxmemory_samples;          /* Pricision of random sampling */
+    int lfu_log_factor;             /* LFU counter logarithmic factor. */
+    int lfu_decay_time;             /* LFU counter decay period in minutes. */
+    /* Lazy free */
+    int lazyfree_lazy_eviction;     /* Free evicted values in background. */
+    int lazyfree_lazy_expire;       /* Free expired values in background. */
+    int lazyfree_lazy_server_del;   /* Same for implicit deletions and
+                                       overwritten values. */
+    /* Active defragmentation, see defrag.c */
+    int active_defrag_enabled;
+    unsigned long long active_defrag_ignore_bytes; /* Min fragmented bytes */
+    int active_defrag_threshold_lower; /* Min fragmentation % to start */
+    int active_defrag_threshold_upper; /* Fragmentation % for max effort */
+    int active_defrag_cycle_min;    /* Min CPU % used by defrag */
+    int active_defrag_cycle_max;    /* Max CPU % used by defrag */
+    int active_defrag_running;      /* CPU % of the running scan, 0 if none */
+    unsigned long long resp_cache_max_memory; /* Max RESP cache size, 0 = off */
+    int resp_cache_min_hits;        /* Hits needed to enter the RESP cache */
     /* Blocked clients */
     unsigned int bpop_blocked_clients; /* Number of clients blocked by lists */
     list *unblocked_clients; /* list of clients to unblock before next loop */
@@ -746,11 +905,12 @@ struct redisServer {
     /* Zip structure config, see redis.conf for more information  */
     size_t hash_max_ziplist_entries;
     size_t hash_max_ziplist_value;
-    size_t list_max_ziplist_entries;
-    size_t list_max_ziplist_value;
+    int list_max_ziplist_size;
+    int list_compress_depth;
     size_t set_max_intset_entries;
     size_t zset_max_ziplist_entries;
     size_t zset_max_ziplist_value;
+    int zset_btree_index;   /* Index big sorted sets with a B+tree. */
     time_t unixtime;        /* Unix time sampled every cron cycle. */
     long long mstime;       /* Like 'unixtime' but with milliseconds resolution. */
     /* Pubsub */
@@ -825,15 +985,13 @@ typedef struct {
     robj *subject;
     unsigned char encoding;
     unsigned char direction; /* Iteration direction */
-    unsigned char *zi;
-    listNode *ln;
+    quicklistIter *iter;
 } listTypeIterator;
 
 /* Structure for an entry while iterating over a list. */
 typedef struct {
     listTypeIterator *li;
-    unsigned char *zi;  /* Entry in ziplist */
-    listNode *ln;       /* Entry in linked list */
+    quicklistEntry entry; /* Entry in quicklist */
 } listTypeEntry;
 
 /* Structure to hold set iteration abstraction. */
@@ -870,10 +1028,12 @@ extern struct sharedObjectsStruct shared;
 extern dictType setDictType;
 extern dictType zsetDictType;
 extern dictType dbDictType;
+extern dictType keyptrDictType;
 extern dictType shaScriptObjectDictType;
 extern double R_Zero, R_PosInf, R_NegInf, R_Nan;
 extern dictType hashDictType;
 extern dictType replScriptCacheDictType;
+extern int lazyfree_atomic_refcount;
 
 /*-----------------------------------------------------------------------------
  * Functions prototypes
@@ -899,6 +1059,7 @@ void addReply(redisClient *c, robj *obj);
 void *addDeferredMultiBulkLength(redisClient *c);
 void setDeferredMultiBulkLength(redisClient *c, void *node, long length);
 void addReplySds(redisClient *c, sds s);
+void addReplyString(redisClient *c, char *s, size_t len);
 void processInputBuffer(redisClient *c);
 void acceptTcpHandler(aeEventLoop *el, int fd, void *privdata, int mask);
 void acceptUnixHandler(aeEventLoop *el, int fd, void *privdata, int mask);
@@ -917,6 +1078,11 @@ void addReplyLongLong(redisClient *c, long long ll);
 void addReplyMultiBulkLen(redisClient *c, long length);
 void copyClientOutputBuffer(redisClient *dst, redisClient *src);
 void *dupClientReplyValue(void *o);
+void freeClientReplyValue(void *o);
+void shrinkReplyChunkPool(void);
+size_t emptyReplyChunkPool(void);
+size_t replyChunkPoolMemory(void);
+size_t zmalloc_size_sds(sds s);
 void getClientsMaxBuffers(unsigned long *longest_output_list,
                           unsigned long *biggest_input_buffer);
 void formatPeerId(char *peerid, size_t peerid_len, char *ip, int port);
@@ -932,6 +1098,12 @@ int getClientLimitClassByName(char *name);
 char *getClientLimitClassName(int class);
 void flushSlavesOutputBuffers(void);
 void disconnectSlaves(void);
+void initThreadedIO(void);
+int setIOThreadsNum(int num);
+void killIOThreads(void);
+int handleClientsWithPendingReadsUsingThreads(void);
+int handleClientsWithPendingWritesUsingThreads(void);
+sds genIOThreadsInfoString(sds info);
 
 #ifdef __GNUC__
 void addReplyErrorFormat(redisClient *c, const char *fmt, ...)
@@ -944,7 +1116,6 @@ void addReplyStatusFormat(redisClient *c, const char *fmt, ...);
 #endif
 
 /* List data type */
-void listTypeTryConversion(robj *subject, robj *value);
 void listTypePush(robj *subject, robj *value, int where);
 robj *listTypePop(robj *subject, int where);
 unsigned long listTypeLength(robj *subject);
@@ -982,20 +1153,22 @@ void freeZsetObject(robj *o);
 void freeHashObject(robj *o);
 robj *createObject(int type, void *ptr);
 robj *createStringObject(char *ptr, size_t len);
+robj *createRawStringObject(char *ptr, size_t len);
+robj *createEmbeddedStringObject(char *ptr, size_t len);
 robj *dupStringObject(robj *o);
+size_t getStringObjectSdsUsedMemory(robj *o);
 int isObjectRepresentableAsLongLong(robj *o, long long *llongval);
 robj *tryObjectEncoding(robj *o);
 robj *getDecodedObject(robj *o);
 size_t stringObjectLen(robj *o);
 robj *createStringObjectFromLongLong(long long value);
 robj *createStringObjectFromLongDouble(long double value);
-robj *createListObject(void);
-robj *createZiplistObject(void);
+robj *createQuicklistObject(void);
 robj *createSetObject(void);
 robj *createIntsetObject(void);
 robj *createHashObject(void);
 robj *createZsetObject(void);
-robj *createZsetZiplistObject(void);
+robj *createZsetListpackObject(void);
 int getLongFromObjectOrReply(redisClient *c, robj *o, long *target, const char *msg);
 int checkType(redisClient *c, robj *o, int type);
 int getLongLongFromObjectOrReply(redisClient *c, robj *o, long long *target, const char *msg);
@@ -1008,6 +1181,10 @@ int compareStringObjects(robj *a, robj *b);
 int collateStringObjects(robj *a, robj *b);
 int equalStringObjects(robj *a, robj *b);
 unsigned long estimateObjectIdleTime(robj *o);
+size_t objectComputeSize(robj *o, size_t samples);
+unsigned int objectInitialLRU(void);
+void updateObjectAccess(robj *o);
+unsigned long LFUDecrAndReturn(robj *o);
 
 /* Synchronous I/O with timeout */
 ssize_t syncWrite(int fd, char *ptr, ssize_t size, long long timeout);
@@ -1064,14 +1241,41 @@ zskiplistNode *zslInsert(zskiplist *zsl, double score, robj *obj);
 unsigned char *zzlInsert(unsigned char *zl, robj *ele, double score);
 int zslDelete(zskiplist *zsl, double score, robj *obj);
 zskiplistNode *zslFirstInRange(zskiplist *zsl, zrangespec range);
+int zslValueGteMin(double value, zrangespec *spec);
+int zslValueLteMax(double value, zrangespec *spec);
 double zzlGetScore(unsigned char *sptr);
 void zzlNext(unsigned char *zl, unsigned char **eptr, unsigned char **sptr);
 void zzlPrev(unsigned char *zl, unsigned char **eptr, unsigned char **sptr);
 unsigned int zsetLength(robj *zobj);
 void zsetConvert(robj *zobj, int encoding);
+int zsetIndexEncoding(void);
+void zsetAddNew(robj *zobj, double score, robj *ele);
+
+/* The dict of a sorted set maps elements to scores: with the skiplist the
+ * value points to the score in the skiplist node, with the B+tree, whose
+ * entries move, the score is stored in the dict entry. */
+#define zsetDictGetScore(zobj,de) ((zobj)->encoding == REDIS_ENCODING_BTREE ? \
+    dictGetDoubleVal(de) : *(double*)dictGetVal(de))
+
+/* B+tree sorted set index */
+zbtree *zbtCreate(void);
+void zbtFree(zbtree *zbt);
+void zbtInsert(zbtree *zbt, double score, robj *obj);
+int zbtDelete(zbtree *zbt, double score, robj *obj);
+unsigned long zbtGetRank(zbtree *zbt, double score, robj *obj);
+zbtreeLeaf *zbtGetElementByRank(zbtree *zbt, unsigned long rank, unsigned int *pos);
+zbtreeLeaf *zbtFirstInRange(zbtree *zbt, zrangespec range, unsigned int *pos);
+zbtreeLeaf *zbtLastInRange(zbtree *zbt, zrangespec range, unsigned int *pos);
+unsigned long zbtDeleteRangeByScore(zbtree *zbt, zrangespec range, dict *dict);
+unsigned long zbtDeleteRangeByRank(zbtree *zbt, unsigned int start, unsigned int end, dict *dict);
+void zbtNext(zbtreeLeaf **l, unsigned int *pos);
+void zbtPrev(zbtreeLeaf **l, unsigned int *pos);
 
 /* Core functions */
 int freeMemoryIfNeeded(void);
+dict *createKeyspaceDict(dictType *type);
+struct evictionPoolEntry *evictionPoolAlloc(void);
+void evictionPoolEmpty(void);
 int processCommand(redisClient *c);
 void setupSignalHandlers(void);
 struct redisCommand *lookupCommand(sds name);
@@ -1124,7 +1328,7 @@ unsigned long hashTypeLength(robj *o);
 hashTypeIterator *hashTypeInitIterator(robj *subject);
 void hashTypeReleaseIterator(hashTypeIterator *hi);
 int hashTypeNext(hashTypeIterator *hi);
-void hashTypeCurrentFromZiplist(hashTypeIterator *hi, int what,
+void hashTypeCurrentFromListpack(hashTypeIterator *hi, int what,
                                 unsigned char **vstr,
                                 unsigned int *vlen,
                                 long long *vll);
@@ -1139,6 +1343,26 @@ void freePubsubPattern(void *p);
 int listMatchPubsubPattern(void *a, void *b);
 int pubsubPublishMessage(robj *channel, robj *message);
 
+/* RESP cache */
+void addReplyBulkCached(redisClient *c, robj *o);
+void respCacheInvalidateKey(redisDb *db, robj *key);
+void respCacheDelete(robj *o);
+void respCacheResize(void);
+size_t respCacheEmpty(void);
+
+/* Lazy free */
+size_t lazyfreeGetPendingObjectsCount(void);
+size_t lazyfreeGetFreeEffort(robj *o);
+void freeObjAsync(robj *o);
+int dbAsyncDelete(redisDb *db, robj *key);
+long long emptyDbAsync(redisDb *db);
+void lazyfreeCron(void);
+void lazyfreeFreeFromBioThread(void *arg1, void *arg2, void *arg3);
+
+/* Active defragmentation */
+void activeDefragCycle(void);
+float getAllocatorFragmentation(size_t *out_frag_bytes);
+
 /* Keyspace events notification */
 void notifyKeyspaceEvent(int type, char *event, robj *key, int dbid);
 int keyspaceEventsStringToFlags(char *classes);
@@ -1163,12 +1387,24 @@ robj *lookupKeyRead(redisDb *db, robj *key);
 robj *lookupKeyWrite(redisDb *db, robj *key);
 robj *lookupKeyReadOrReply(redisClient *c, robj *key, robj *reply);
 robj *lookupKeyWriteOrReply(redisClient *c, robj *key, robj *reply);
+unsigned int keyHash(robj *key);
+int keyHashCacheArgs(redisClient *c);
+void keyHashReleaseArgs(int mark);
+void keyHashDelete(robj *o);
+void setExpiresIndex(int enabled);
+void expiresIndexEmpty(redisDb *db);
+unsigned long expiresIndexCountDue(redisDb *db, long long now);
+unsigned long long estimateStaleKeys(void);
+void dbPrefetchHashes(redisDb *db, const unsigned int *hashes, int count);
+void dbPrefetchKeys(redisDb *db, robj **keys, int count);
+int isPrefetchableKeyArg(struct redisCommand *cmd, int argc, int i);
 void dbAdd(redisDb *db, robj *key, robj *val);
 void dbOverwrite(redisDb *db, robj *key, robj *val);
 void setKey(redisDb *db, robj *key, robj *val);
 int dbExists(redisDb *db, robj *key);
 robj *dbRandomKey(redisDb *db);
 int dbDelete(redisDb *db, robj *key);
+int dbSyncDelete(redisDb *db, robj *key);
 long long emptyDb();
 int selectDb(redisClient *c, int id);
 void signalModifiedKey(redisDb *db, robj *key);
@@ -1211,6 +1447,7 @@ void setexCommand(redisClient *c);
 void psetexCommand(redisClient *c);
 void getCommand(redisClient *c);
 void delCommand(redisClient *c);
+void unlinkCommand(redisClient *c);
 void existsCommand(redisClient *c);
 void setbitCommand(redisClient *c);
 void getbitCommand(redisClient *c);
@@ -1334,6 +1571,7 @@ void restoreCommand(redisClient *c);
 void migrateCommand(redisClient *c);
 void dumpCommand(redisClient *c);
 void objectCommand(redisClient *c);
+void memoryCommand(redisClient *c);
 void clientCommand(redisClient *c);
 void evalCommand(redisClient *c);
 void evalShaCommand(redisClient *c);
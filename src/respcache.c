@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2013, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "redis.h"
+
+/* This file implements a small cache of protocol encoded replies for hot
+ * string values. Serving a GET requires, for every call, to emit the bulk
+ * length header, to copy the value and to append the trailing CRLF, that is
+ * three appends to the client output buffer plus a conversion to string
+ * of the length (and of the value itself when it is integer encoded). For
+ * the few values that receive most of the traffic we can instead keep the
+ * full "$<len>\r\n<value>\r\n" string around and serve it with a single
+ * append.
+ *
+ * The cache is a direct mapped table indexed by an hash of the value object
+ * pointer: every value can only live in a given slot, so a lookup costs a
+ * single memory access and there is no need for a dictionary. Objects
+ * having an entry in the cache are flagged with the 'respcached' bit, so
+ * the common case of a GET against a value that is not cached, or a write
+ * or a free of a value that is not cached, costs just a bit test.
+ *
+ * Values are admitted only after they are requested server.resp_cache_min_hits
+ * times, according to a table of saturating counters indexed by the same
+ * hash. Counters are halved from time to time so that only values that are
+ * popular right now are able to enter the cache, and when two values map to
+ * the same slot the most popular one wins. This way a value is not evicted
+ * and encoded again over and over, that would be slower than not caching
+ * at all.
+ *
+ * The cache entries are invalidated when the key is modified (see
+ * signalModifiedKey()) and when the value object is freed (see
+ * decrRefCount()), and the whole cache is bounded by the
+ * resp-cache-max-memory configuration directive. A value of zero (the
+ * default) disables the cache. */
+
+#define REDIS_RESP_CACHE_SLOTS (1<<14)    /* Must be a power of two. */
+#define REDIS_RESP_CACHE_COUNTERS (1<<16) /* Must be a power of two. */
+#define REDIS_RESP_CACHE_DECAY_PERIOD (REDIS_RESP_CACHE_COUNTERS*4)
+
+typedef struct respCacheEntry {
+    robj *val;      /* Cached value, NULL if the slot is free. */
+    sds reply;      /* Protocol encoding of the value. */
+} respCacheEntry;
+
+static unsigned char respCacheCounters[REDIS_RESP_CACHE_COUNTERS];
+static unsigned long respCacheCounterUpdates = 0;
+
+/* A couple of multiply / shift steps are enough to spread the (aligned)
+ * pointer bits, and are much cheaper than the generic dict.c hash function:
+ * that matters since the hash is computed for every GET. */
+static unsigned int respCacheHash(robj *o) {
+    unsigned long long h = (unsigned long)o;
+
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return (unsigned int)h;
+}
+
+#define respCacheSlot(h) ((h) & (REDIS_RESP_CACHE_SLOTS-1))
+#define respCacheCounter(h) \
+    respCacheCounters[((h) >> 16) & (REDIS_RESP_CACHE_COUNTERS-1)]
+
+/* Update the popularity counter of the object with hash 'h' and return
+ * non zero if the object is hot enough to be cached. */
+static int respCacheIsHot(unsigned int h) {
+    if (++respCacheCounterUpdates == REDIS_RESP_CACHE_DECAY_PERIOD) {
+        int j;
+
+        for (j = 0; j < REDIS_RESP_CACHE_COUNTERS; j++)
+            respCacheCounters[j] >>= 1;
+        respCacheCounterUpdates = 0;
+    }
+    if (respCacheCounter(h) < 255) respCacheCounter(h)++;
+    return respCacheCounter(h) >= server.resp_cache_min_hits;
+}
+
+/* Free the cache entry 'e', that must be in use. */
+static void respCacheFreeEntry(respCacheEntry *e) {
+    server.resp_cache_memory -= zmalloc_size_sds(e->reply);
+    server.resp_cache_used--;
+    sdsfree(e->reply);
+    e->val->respcached = 0;
+    e->val = NULL;
+    e->reply = NULL;
+}
+
+/* Remove the cache entry of 'o'. The object must be flagged as cached. */
+void respCacheDelete(robj *o) {
+    respCacheEntry *e = server.resp_cache+respCacheSlot(respCacheHash(o));
+
+    redisAssertWithInfo(NULL,o,e->val == o);
+    respCacheFreeEntry(e);
+}
+
+/* Try to create the cache entry for 'o', that has hash 'h'. Returns the
+ * entry on success, or NULL if the value can't be cached. */
+static respCacheEntry *respCacheAdd(robj *o, unsigned int h) {
+    char buf[REDIS_LONGSTR_SIZE];
+    char *ptr;
+    size_t len, used, hdrlen;
+    respCacheEntry *e;
+    sds reply;
+
+    if (server.resp_cache == NULL)
+        server.resp_cache = zcalloc(sizeof(respCacheEntry)*
+                                    REDIS_RESP_CACHE_SLOTS);
+    e = server.resp_cache+respCacheSlot(h);
+
+    /* The slot is taken by a value at least as popular as this one. */
+    if (e->val &&
+        respCacheCounter(h) <= respCacheCounter(respCacheHash(e->val)))
+        return NULL;
+
+    if (o->encoding == REDIS_ENCODING_INT) {
+        len = ll2string(buf,sizeof(buf),(long)o->ptr);
+        ptr = buf;
+    } else {
+        ptr = o->ptr;
+        len = sdslen(ptr);
+    }
+    if (len > REDIS_RESP_CACHE_MAX_VALUE) return NULL;
+
+    /* Check the memory limit before allocating anything, since once the
+     * cache is full we get here for every GET of an hot value. */
+    used = server.resp_cache_memory;
+    if (e->val) used -= zmalloc_size_sds(e->reply);
+    if (used+len+REDIS_LONGSTR_SIZE+5 > server.resp_cache_max_memory)
+        return NULL;
+
+    reply = sdsMakeRoomFor(sdsempty(),len+REDIS_LONGSTR_SIZE+5);
+    reply[0] = '$';
+    hdrlen = 1+ll2string(reply+1,REDIS_LONGSTR_SIZE,len);
+    memcpy(reply+hdrlen,"\r\n",2);
+    memcpy(reply+hdrlen+2,ptr,len);
+    memcpy(reply+hdrlen+2+len,"\r\n",2);
+    sdsIncrLen(reply,hdrlen+len+4);
+    if (used+zmalloc_size_sds(reply) > server.resp_cache_max_memory) {
+        sdsfree(reply);
+        return NULL;
+    }
+
+    if (e->val) respCacheFreeEntry(e);
+    e->val = o;
+    e->reply = reply;
+    o->respcached = 1;
+    server.resp_cache_memory += zmalloc_size_sds(reply);
+    server.resp_cache_used++;
+    return e;
+}
+
+/* Add the bulk reply of the string value 'o' to the client output,
+ * using (and populating) the cache when possible. */
+void addReplyBulkCached(redisClient *c, robj *o) {
+    respCacheEntry *e;
+    unsigned int h;
+
+    if (server.resp_cache_max_memory == 0) {
+        addReplyBulk(c,o);
+        return;
+    }
+    h = respCacheHash(o);
+    if (o->respcached) {
+        e = server.resp_cache+respCacheSlot(h);
+        server.stat_resp_cache_hits++;
+    } else {
+        server.stat_resp_cache_misses++;
+        if (!respCacheIsHot(h) || (e = respCacheAdd(o,h)) == NULL) {
+            addReplyBulk(c,o);
+            return;
+        }
+    }
+    addReplyString(c,e->reply,sdslen(e->reply));
+}
+
+/* Called when 'key' is modified: the value may be changed in place (for
+ * instance by APPEND or SETRANGE), so any cached encoding is dropped. */
+void respCacheInvalidateKey(redisDb *db, robj *key) {
+    dictEntry *de;
+    robj *val;
+
+    if (server.resp_cache_used == 0) return;
+    de = dictFindWithHash(db->dict,key->ptr,keyHash(key));
+    if (de == NULL) return;
+    val = dictGetVal(de);
+    if (val->respcached) respCacheDelete(val);
+}
+
+/* Resize the cache according to server.resp_cache_max_memory, emptying it
+ * when the cache is disabled. */
+void respCacheResize(void) {
+    int j;
+
+    for (j = 0; j < REDIS_RESP_CACHE_SLOTS &&
+                server.resp_cache_memory > server.resp_cache_max_memory; j++)
+    {
+        if (server.resp_cache[j].val) respCacheFreeEntry(server.resp_cache+j);
+    }
+}
+
+/* Drop every entry of the cache, returning the amount of memory reclaimed.
+ * Used when the values of a whole DB are freed in the background. */
+size_t respCacheEmpty(void) {
+    size_t freed = server.resp_cache_memory;
+    int j;
+
+    for (j = 0; j < REDIS_RESP_CACHE_SLOTS && server.resp_cache_used; j++) {
+        if (server.resp_cache[j].val) respCacheFreeEntry(server.resp_cache+j);
+    }
+    return freed;
+}
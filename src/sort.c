@@ -219,7 +219,7 @@ void sortCommand(redisClient *c) {
     if (sortval)
         incrRefCount(sortval);
     else
-        sortval = createListObject();
+        sortval = createQuicklistObject();
 
     /* The SORT command has an SQL-alike syntax, parse it */
     while(j < c->argc) {
@@ -275,8 +275,9 @@ void sortCommand(redisClient *c) {
     }
 
     /* Destructively convert encoded sorted sets for SORT. */
-    if (sortval->type == REDIS_ZSET)
-        zsetConvert(sortval, REDIS_ENCODING_SKIPLIST);
+    if (sortval->type == REDIS_ZSET &&
+        sortval->encoding == REDIS_ENCODING_LISTPACK)
+        zsetConvert(sortval, zsetIndexEncoding());
 
     /* Objtain the length of the object to sort. */
     switch(sortval->type) {
@@ -336,6 +337,33 @@ void sortCommand(redisClient *c) {
             j++;
         }
         setTypeReleaseIterator(si);
+    } else if (sortval->type == REDIS_ZSET && dontsort &&
+               sortval->encoding == REDIS_ENCODING_BTREE) {
+        /* Like the skiplist case below, for sorted sets indexed by a
+         * B+tree. */
+        zbtree *zbt = ((zset*)sortval->ptr)->zbt;
+        zbtreeLeaf *l;
+        unsigned int pos;
+        int rangelen = vectorlen;
+
+        if (desc)
+            l = zbtGetElementByRank(zbt,zbt->length-start,&pos);
+        else
+            l = zbtGetElementByRank(zbt,start+1,&pos);
+
+        while(rangelen--) {
+            redisAssertWithInfo(c,sortval,l != NULL);
+            vector[j].obj = l->obj[pos];
+            vector[j].u.score = 0;
+            vector[j].u.cmpobj = NULL;
+            j++;
+            if (desc)
+                zbtPrev(&l,&pos);
+            else
+                zbtNext(&l,&pos);
+        }
+        end -= start;
+        start = 0;
     } else if (sortval->type == REDIS_ZSET && dontsort) {
         /* Special handling for a sorted set, if 'dontsort' is true.
          * This makes sure we return elements in the sorted set original
@@ -411,7 +439,7 @@ void sortCommand(redisClient *c) {
             if (alpha) {
                 if (sortby) vector[j].u.cmpobj = getDecodedObject(byval);
             } else {
-                if (byval->encoding == REDIS_ENCODING_RAW) {
+                if (sdsEncodedObject(byval)) {
                     char *eptr;
 
                     vector[j].u.score = strtod(byval->ptr,&eptr);
@@ -482,7 +510,10 @@ void sortCommand(redisClient *c) {
             }
         }
     } else {
-        robj *sobj = createZiplistObject();
+        robj *sobj = createQuicklistObject();
+
+        quicklistSetOptions(sobj->ptr,server.list_max_ziplist_size,
+                            server.list_compress_depth);
 
         /* STORE option specified, set the sorting result as a List object */
         for (j = start; j <= end; j++) {
@@ -35,33 +35,33 @@
  *----------------------------------------------------------------------------*/
 /**
     Redis_Hashϣ API
-    ڹϣϵͳֱ뷽ʽREDIS_ENCODING_ZIPLIST(ziplist)REDIS_ENCODING_HT(dict)
+    ڹϣϵͳֱ뷽ʽREDIS_ENCODING_LISTPACK(listpack)REDIS_ENCODING_HT(dict)
 
     ϣʹֵʱ򽫹ϣļkeyΪֵļϣֵvalue
     ΪֵֵϣļֵַַͣбϣϺ򼯡
-    ʹ REDIS_ENCODING_ZIPLIST ϣʱֵͨһͬѹб.
+    ʹ REDIS_ENCODING_LISTPACK ϣʱֵͨһͬѹб.
     ӵ key-value Իᱻӵѹбıβ
 
-    հ׹ϣʱĬʹ REDIS_ENCODING_ZIPLIST 룬κһ
+    հ׹ϣʱĬʹ REDIS_ENCODING_LISTPACK 룬κһ
     ʱ򽫱лΪ REDIS_ENCODING_HT 
     1) ϣĳĳֵĳȴ server.hash_max_ziplist_value ĬֵΪ 64
     2) ѹбеĽڵ server.hash_max_ziplist_entries ĬֵΪ 512 
 */
 
 /* Check the length of a number of objects to see if we need to convert a
- * ziplist to a real hash. Note that we only check string encoded objects
+ * listpack to a real hash. Note that we only check string encoded objects
  * as their string length can be queried in constant time. */
-//Redis_hashת ziplist -> dict
+//Redis_hashת listpack -> dict
 void hashTypeTryConversion(robj *o, robj **argv, int start, int end) {
     int i;
 
-    if (o->encoding != REDIS_ENCODING_ZIPLIST) return;//벻ziplist˵Ѿdict
+    if (o->encoding != REDIS_ENCODING_LISTPACK) return;//벻listpack˵Ѿdict
 
     for (i = start; i <= end; i++) {
-        if (argv[i]->encoding == REDIS_ENCODING_RAW &&
+        if (sdsEncodedObject(argv[i]) &&
             sdslen(argv[i]->ptr) > server.hash_max_ziplist_value)
         {
-            hashTypeConvert(o, REDIS_ENCODING_HT);//ziplistתΪdict
+            hashTypeConvert(o, REDIS_ENCODING_HT);//listpackתΪdict
             break;
         }
     }
@@ -75,9 +75,9 @@ void hashTypeTryObjectEncoding(robj *subject, robj **o1, robj **o2) {
     }
 }
 
-/* Get the value from a ziplist encoded hash, identified by field.
+/* Get the value from a listpack encoded hash, identified by field.
  * Returns -1 when the field cannot be found. */
-int hashTypeGetFromZiplist(robj *o, robj *field,
+int hashTypeGetFromListpack(robj *o, robj *field,
                            unsigned char **vstr,
                            unsigned int *vlen,
                            long long *vll)
@@ -85,17 +85,17 @@ int hashTypeGetFromZiplist(robj *o, robj *field,
     unsigned char *zl, *fptr = NULL, *vptr = NULL;
     int ret;
 
-    redisAssert(o->encoding == REDIS_ENCODING_ZIPLIST);
+    redisAssert(o->encoding == REDIS_ENCODING_LISTPACK);
 
     field = getDecodedObject(field);
 
     zl = o->ptr;
-    fptr = ziplistIndex(zl, ZIPLIST_HEAD);//õ׵ַ
+    fptr = lpFirst(zl);//õ׵ַ
     if (fptr != NULL) {
-        fptr = ziplistFind(fptr, field->ptr, sdslen(field->ptr), 1);//
+        fptr = lpFind(zl, fptr, field->ptr, sdslen(field->ptr), 1);//
         if (fptr != NULL) {
             /* Grab pointer to the value (fptr points to the field) */
-            vptr = ziplistNext(zl, fptr);//ȡvalue
+            vptr = lpNext(zl, fptr);//ȡvalue
             redisAssert(vptr != NULL);
         }
     }
@@ -103,7 +103,7 @@ int hashTypeGetFromZiplist(robj *o, robj *field,
     decrRefCount(field);
 
     if (vptr != NULL) {
-        ret = ziplistGet(vptr, vstr, vlen, vll);
+        ret = lpGet(vptr, vstr, vlen, vll);
         redisAssert(ret);
         return 0;
     }
@@ -133,12 +133,12 @@ int hashTypeGetFromHashTable(robj *o, robj *field, robj **value) {
 robj *hashTypeGetObject(robj *o, robj *field) {
     robj *value = NULL;
 
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *vstr = NULL;
         unsigned int vlen = UINT_MAX;
         long long vll = LLONG_MAX;
 
-        if (hashTypeGetFromZiplist(o, field, &vstr, &vlen, &vll) == 0) {
+        if (hashTypeGetFromListpack(o, field, &vstr, &vlen, &vll) == 0) {
             if (vstr) {
                 value = createStringObject((char*)vstr, vlen);
             } else {
@@ -163,12 +163,12 @@ robj *hashTypeGetObject(robj *o, robj *field) {
  * exists, and 0 when it doesn't. */
 //fieldǷѾ
 int hashTypeExists(robj *o, robj *field) {
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *vstr = NULL;
         unsigned int vlen = UINT_MAX;
         long long vll = LLONG_MAX;
 
-        if (hashTypeGetFromZiplist(o, field, &vstr, &vlen, &vll) == 0) return 1;
+        if (hashTypeGetFromListpack(o, field, &vstr, &vlen, &vll) == 0) return 1;
     } else if (o->encoding == REDIS_ENCODING_HT) {
         robj *aux;
 
@@ -187,41 +187,38 @@ int hashTypeExists(robj *o, robj *field) {
 int hashTypeSet(robj *o, robj *field, robj *value) {
     int update = 0;
 
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl, *fptr, *vptr;
 
         field = getDecodedObject(field);//ַ
         value = getDecodedObject(value);
 
-        //  ziplist ԲҲ field Ѿڣ
+        //  listpack ԲҲ field Ѿڣ
         zl = o->ptr;
-        fptr = ziplistIndex(zl, ZIPLIST_HEAD);//ȡziplistָ
+        fptr = lpFirst(zl);//ȡlistpackָ
         if (fptr != NULL) {
-            fptr = ziplistFind(fptr, field->ptr, sdslen(field->ptr), 1);
-            if (fptr != NULL) {//ԭziplistԴ
+            fptr = lpFind(zl, fptr, field->ptr, sdslen(field->ptr), 1);
+            if (fptr != NULL) {//ԭlistpackԴ
                 /* Grab pointer to the value (fptr points to the field) */
-                vptr = ziplistNext(zl, fptr);//õvalue׵ַ
+                vptr = lpNext(zl, fptr);//õvalue׵ַ
                 redisAssert(vptr != NULL);
                 update = 1;
 
-                /* Delete value */
-                zl = ziplistDelete(zl, &vptr);//ɾvalue
-
-                /* Insert new value *///ٲµvalue
-                zl = ziplistInsert(zl, vptr, value->ptr, sdslen(value->ptr));
+                /* Replace value *///滻valueӰԪ
+                zl = lpReplace(zl, &vptr, value->ptr, sdslen(value->ptr));
             }
         }
 
-        if (!update) {//µfield/value׷ӵziplistβ
-            /* Push new field/value pair onto the tail of the ziplist */
-            zl = ziplistPush(zl, field->ptr, sdslen(field->ptr), ZIPLIST_TAIL);
-            zl = ziplistPush(zl, value->ptr, sdslen(value->ptr), ZIPLIST_TAIL);
+        if (!update) {//µfield/value׷ӵlistpackβ
+            /* Push new field/value pair onto the tail of the listpack */
+            zl = lpPush(zl, field->ptr, sdslen(field->ptr), LP_TAIL);
+            zl = lpPush(zl, value->ptr, sdslen(value->ptr), LP_TAIL);
         }
         o->ptr = zl;
         decrRefCount(field);
         decrRefCount(value);
 
-        /* Check if the ziplist needs to be converted to a hash table */
+        /* Check if the listpack needs to be converted to a hash table */
         //ǷҪתΪHT
         if (hashTypeLength(o) > server.hash_max_ziplist_entries)
             hashTypeConvert(o, REDIS_ENCODING_HT);
@@ -243,18 +240,17 @@ int hashTypeSet(robj *o, robj *field, robj *value) {
 int hashTypeDelete(robj *o, robj *field) {
     int deleted = 0;
 
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl, *fptr;
 
         field = getDecodedObject(field);
 
         zl = o->ptr;
-        fptr = ziplistIndex(zl, ZIPLIST_HEAD);
+        fptr = lpFirst(zl);
         if (fptr != NULL) {
-            fptr = ziplistFind(fptr, field->ptr, sdslen(field->ptr), 1);
+            fptr = lpFind(zl, fptr, field->ptr, sdslen(field->ptr), 1);
             if (fptr != NULL) {
-                zl = ziplistDelete(zl,&fptr);//ɾfield
-                zl = ziplistDelete(zl,&fptr);
+                zl = lpDeleteRangeWithEntry(zl,&fptr,2);//ɾfieldvalue
                 o->ptr = zl;
                 deleted = 1;
             }
@@ -282,8 +278,8 @@ int hashTypeDelete(robj *o, robj *field) {
 unsigned long hashTypeLength(robj *o) {
     unsigned long length = ULONG_MAX;
 
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-        length = ziplistLen(o->ptr) / 2;
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
+        length = lpLength(o->ptr) / 2;
     } else if (o->encoding == REDIS_ENCODING_HT) {
         length = dictSize((dict*)o->ptr);
     } else {
@@ -298,7 +294,7 @@ hashTypeIterator *hashTypeInitIterator(robj *subject) {
     hi->subject = subject;
     hi->encoding = subject->encoding;
 
-    if (hi->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (hi->encoding == REDIS_ENCODING_LISTPACK) {
         hi->fptr = NULL;
         hi->vptr = NULL;
     } else if (hi->encoding == REDIS_ENCODING_HT) {
@@ -321,7 +317,7 @@ void hashTypeReleaseIterator(hashTypeIterator *hi) {
 /* Move to the next entry in the hash. Return REDIS_OK when the next entry
  * could be found and REDIS_ERR when the iterator reaches the end. */
 int hashTypeNext(hashTypeIterator *hi) {
-    if (hi->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (hi->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl;
         unsigned char *fptr, *vptr;
 
@@ -332,16 +328,16 @@ int hashTypeNext(hashTypeIterator *hi) {
         if (fptr == NULL) {
             /* Initialize cursor */
             redisAssert(vptr == NULL);
-            fptr = ziplistIndex(zl, 0);
+            fptr = lpSeek(zl, 0);
         } else {
             /* Advance cursor */
             redisAssert(vptr != NULL);
-            fptr = ziplistNext(zl, vptr);
+            fptr = lpNext(zl, vptr);
         }
         if (fptr == NULL) return REDIS_ERR;
 
         /* Grab pointer to the value (fptr points to the field) */
-        vptr = ziplistNext(zl, fptr);
+        vptr = lpNext(zl, fptr);
         redisAssert(vptr != NULL);
 
         /* fptr, vptr now point to the first or next pair */
@@ -356,27 +352,27 @@ int hashTypeNext(hashTypeIterator *hi) {
 }
 
 /* Get the field or value at iterator cursor, for an iterator on a hash value
- * encoded as a ziplist. Prototype is similar to `hashTypeGetFromZiplist`. */
-void hashTypeCurrentFromZiplist(hashTypeIterator *hi, int what,
+ * encoded as a listpack. Prototype is similar to `hashTypeGetFromListpack`. */
+void hashTypeCurrentFromListpack(hashTypeIterator *hi, int what,
                                 unsigned char **vstr,
                                 unsigned int *vlen,
                                 long long *vll)
 {
     int ret;
 
-    redisAssert(hi->encoding == REDIS_ENCODING_ZIPLIST);
+    redisAssert(hi->encoding == REDIS_ENCODING_LISTPACK);
 
     if (what & REDIS_HASH_KEY) {
-        ret = ziplistGet(hi->fptr, vstr, vlen, vll);
+        ret = lpGet(hi->fptr, vstr, vlen, vll);
         redisAssert(ret);
     } else {
-        ret = ziplistGet(hi->vptr, vstr, vlen, vll);
+        ret = lpGet(hi->vptr, vstr, vlen, vll);
         redisAssert(ret);
     }
 }
 
 /* Get the field or value at iterator cursor, for an iterator on a hash value
- * encoded as a ziplist. Prototype is similar to `hashTypeGetFromHashTable`. */
+ * encoded as a listpack. Prototype is similar to `hashTypeGetFromHashTable`. */
 void hashTypeCurrentFromHashTable(hashTypeIterator *hi, int what, robj **dst) {
     redisAssert(hi->encoding == REDIS_ENCODING_HT);
 
@@ -393,12 +389,12 @@ void hashTypeCurrentFromHashTable(hashTypeIterator *hi, int what, robj **dst) {
 robj *hashTypeCurrentObject(hashTypeIterator *hi, int what) {
     robj *dst;
 
-    if (hi->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (hi->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *vstr = NULL;
         unsigned int vlen = UINT_MAX;
         long long vll = LLONG_MAX;
 
-        hashTypeCurrentFromZiplist(hi, what, &vstr, &vlen, &vll);
+        hashTypeCurrentFromListpack(hi, what, &vstr, &vlen, &vll);
         if (vstr) {
             dst = createStringObject((char*)vstr, vlen);
         } else {
@@ -431,10 +427,10 @@ robj *hashTypeLookupWriteOrCreate(redisClient *c, robj *key) {
     return o;
 }
 
-void hashTypeConvertZiplist(robj *o, int enc) {
-    redisAssert(o->encoding == REDIS_ENCODING_ZIPLIST);
+void hashTypeConvertListpack(robj *o, int enc) {
+    redisAssert(o->encoding == REDIS_ENCODING_LISTPACK);
 
-    if (enc == REDIS_ENCODING_ZIPLIST) {
+    if (enc == REDIS_ENCODING_LISTPACK) {
         /* Nothing to do... */
 
     } else if (enc == REDIS_ENCODING_HT) {
@@ -454,8 +450,8 @@ void hashTypeConvertZiplist(robj *o, int enc) {
             value = tryObjectEncoding(value);
             ret = dictAdd(dict, field, value);
             if (ret != DICT_OK) {
-                redisLogHexDump(REDIS_WARNING,"ziplist with dup elements dump",
-                    o->ptr,ziplistBlobLen(o->ptr));
+                redisLogHexDump(REDIS_WARNING,"listpack with dup elements dump",
+                    o->ptr,lpBytes(o->ptr));
                 redisAssert(ret == DICT_OK);
             }
         }
@@ -472,8 +468,8 @@ void hashTypeConvertZiplist(robj *o, int enc) {
 }
 
 void hashTypeConvert(robj *o, int enc) {
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-        hashTypeConvertZiplist(o, enc);
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
+        hashTypeConvertListpack(o, enc);
     } else if (o->encoding == REDIS_ENCODING_HT) {
         redisPanic("Not implemented");
     } else {
@@ -628,12 +624,12 @@ static void addHashFieldToReply(redisClient *c, robj *o, robj *field) {
         return;
     }
 
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (o->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *vstr = NULL;
         unsigned int vlen = UINT_MAX;
         long long vll = LLONG_MAX;
 
-        ret = hashTypeGetFromZiplist(o, field, &vstr, &vlen, &vll);
+        ret = hashTypeGetFromListpack(o, field, &vstr, &vlen, &vll);
         if (ret < 0) {
             addReply(c, shared.nullbulk);
         } else {
@@ -684,6 +680,15 @@ void hmgetCommand(redisClient *c) {
 
     addReplyMultiBulkLen(c, c->argc-2);
     for (i = 2; i < c->argc; i++) {
+        /* Prefetch the fields of hash tables in batches, like MGET. */
+        if (o && o->encoding == REDIS_ENCODING_HT &&
+            (i-2) % DICT_PREFETCH_BATCH == 0 && c->argc > 3)
+        {
+            int count = c->argc-i;
+
+            if (count > DICT_PREFETCH_BATCH) count = DICT_PREFETCH_BATCH;
+            dictPrefetch(o->ptr,(void**)c->argv+i,count,DICT_PREFETCH_VALS);
+        }
         addHashFieldToReply(c, o, c->argv[i]);
     }
 }
@@ -727,12 +732,12 @@ void hlenCommand(redisClient *c) {
 }
 
 static void addHashIteratorCursorToReply(redisClient *c, hashTypeIterator *hi, int what) {
-    if (hi->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (hi->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *vstr = NULL;
         unsigned int vlen = UINT_MAX;
         long long vll = LLONG_MAX;
 
-        hashTypeCurrentFromZiplist(hi, what, &vstr, &vlen, &vll);
+        hashTypeCurrentFromListpack(hi, what, &vstr, &vlen, &vll);
         if (vstr) {
             addReplyBulkCBuffer(c, vstr, vlen);
         } else {
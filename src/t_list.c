@@ -30,11 +30,10 @@
 #include "redis.h"
 
 /**
-    Redis_List REDIS_ENCODING_ZIPLIST  REDIS_ENCODING_LINKEDLIST ַʽ
-    бʱ Redis Ĭʹ REDIS_ENCODING_ZIPLIST 룬һʱ
-    бᱻת REDIS_ENCODING_LINKEDLIST 룺
-    ͼбһֵַַĳȳserver.list_max_ziplist_valueĬֵΪ64 
-    ziplist Ľڵ㳬 server.list_max_ziplist_entriesĬֵΪ 512 
+    Redis_List  REDIS_ENCODING_QUICKLIST 룺ɶ listpack ڵɵ˫
+    ÿ listpack ĴС server.list_max_ziplist_size ƣΪԪظ
+     -1  -5 Ϊ 4kb  64kb ֽڱͷβ push/pop ֻҪ޸
+    β listpack ڵ˾ʹ½ڵ㣬ڵΪʱͷš
 */
 
 void signalListAsReady(redisClient *c, robj *key);
@@ -43,17 +42,6 @@ void signalListAsReady(redisClient *c, robj *key);
  * List API
  *----------------------------------------------------------------------------*/
 
-/* Check the argument length to see if it requires us to convert the ziplist
- * to a real list. Only check raw-encoded objects because integer encoded
- * objects are never too long. */
-void listTypeTryConversion(robj *subject, robj *value) {
-    if (subject->encoding != REDIS_ENCODING_ZIPLIST) return;
-    //ַvalueĳȴserver.list_max_ziplist_valueǿƱת
-    if (value->encoding == REDIS_ENCODING_RAW &&
-        sdslen(value->ptr) > server.list_max_ziplist_value)
-            listTypeConvert(subject,REDIS_ENCODING_LINKEDLIST);
-}
-
 /* The function pushes an element to the specified list object 'subject',
  * at head or tail position as specified by 'where'.
  *
@@ -63,64 +51,31 @@ void listTypeTryConversion(robj *subject, robj *value) {
  * ߲ض value мᴦ
  */
 void listTypePush(robj *subject, robj *value, int where) {
-    /* Check if we need to convert the ziplist */
-    //ǷҪббת ziplist -> linkedlist
-    listTypeTryConversion(subject,value);
-    if (subject->encoding == REDIS_ENCODING_ZIPLIST &&
-        ziplistLen(subject->ptr) >= server.list_max_ziplist_entries)
-            //ǿת ziplist -> linkedlist
-            listTypeConvert(subject,REDIS_ENCODING_LINKEDLIST);
-
-    //ziplist Push
-    if (subject->encoding == REDIS_ENCODING_ZIPLIST) {
-        int pos = (where == REDIS_HEAD) ? ZIPLIST_HEAD : ZIPLIST_TAIL;
+    if (subject->encoding == REDIS_ENCODING_QUICKLIST) {
+        int pos = (where == REDIS_HEAD) ? QUICKLIST_HEAD : QUICKLIST_TAIL;
         value = getDecodedObject(value);
-        subject->ptr = ziplistPush(subject->ptr,value->ptr,sdslen(value->ptr),pos);
+        quicklistPush(subject->ptr,value->ptr,sdslen(value->ptr),pos);
         decrRefCount(value);
-    } //list Push
-    else if (subject->encoding == REDIS_ENCODING_LINKEDLIST) {
-        if (where == REDIS_HEAD) {
-            listAddNodeHead(subject->ptr,value);
-        } else {
-            listAddNodeTail(subject->ptr,value);
-        }
-        incrRefCount(value);
     } else {
         redisPanic("Unknown list encoding");
     }
 }
 
+/* Create the object returned by listTypePop() for string elements. */
+static void *listPopSaver(unsigned char *data, unsigned int sz) {
+    return createStringObject((char*)data,sz);
+}
+
 /*бͷβƳһԪ*/
 robj *listTypePop(robj *subject, int where) {
+    long long vlong;
     robj *value = NULL;
-    if (subject->encoding == REDIS_ENCODING_ZIPLIST) {//ziplist
-        unsigned char *p;
-        unsigned char *vstr;
-        unsigned int vlen;
-        long long vlong;
-        int pos = (where == REDIS_HEAD) ? 0 : -1;
-        p = ziplistIndex(subject->ptr,pos);
-        if (ziplistGet(p,&vstr,&vlen,&vlong)) {
-            if (vstr) {
-                value = createStringObject((char*)vstr,vlen);
-            } else {
-                value = createStringObjectFromLongLong(vlong);
-            }
-            /* We only need to delete an element when it exists */
-            subject->ptr = ziplistDelete(subject->ptr,&p);
-        }
-    } else if (subject->encoding == REDIS_ENCODING_LINKEDLIST) {//list
-        list *list = subject->ptr;
-        listNode *ln;
-        if (where == REDIS_HEAD) {
-            ln = listFirst(list);
-        } else {
-            ln = listLast(list);
-        }
-        if (ln != NULL) {
-            value = listNodeValue(ln);
-            incrRefCount(value);
-            listDelNode(list,ln);
+    int ql_where = (where == REDIS_HEAD) ? QUICKLIST_HEAD : QUICKLIST_TAIL;
+
+    if (subject->encoding == REDIS_ENCODING_QUICKLIST) {
+        if (quicklistPopCustom(subject->ptr,ql_where,(unsigned char **)&value,
+                               NULL,&vlong,listPopSaver)) {
+            if (!value) value = createStringObjectFromLongLong(vlong);
         }
     } else {
         redisPanic("Unknown list encoding");
@@ -130,10 +85,8 @@ robj *listTypePop(robj *subject, int where) {
 
 //length
 unsigned long listTypeLength(robj *subject) {
-    if (subject->encoding == REDIS_ENCODING_ZIPLIST) {
-        return ziplistLen(subject->ptr);
-    } else if (subject->encoding == REDIS_ENCODING_LINKEDLIST) {
-        return listLength((list*)subject->ptr);
+    if (subject->encoding == REDIS_ENCODING_QUICKLIST) {
+        return quicklistCount(subject->ptr);
     } else {
         redisPanic("Unknown list encoding");
     }
@@ -146,10 +99,13 @@ listTypeIterator *listTypeInitIterator(robj *subject, long index, unsigned char
     li->subject = subject;
     li->encoding = subject->encoding;
     li->direction = direction;
-    if (li->encoding == REDIS_ENCODING_ZIPLIST) { //ziplist
-        li->zi = ziplistIndex(subject->ptr,index);
-    } else if (li->encoding == REDIS_ENCODING_LINKEDLIST) { //linkedlist
-        li->ln = listIndex(subject->ptr,index);
+    li->iter = NULL;
+    if (li->encoding == REDIS_ENCODING_QUICKLIST) {
+        /* REDIS_HEAD means moving towards the head, that is starting the
+         * quicklist iteration from the tail. */
+        int iter_direction =
+            (direction == REDIS_HEAD) ? AL_START_TAIL : AL_START_HEAD;
+        li->iter = quicklistGetIteratorAtIdx(subject->ptr,iter_direction,index);
     } else {
         redisPanic("Unknown list encoding");
     }
@@ -158,6 +114,7 @@ listTypeIterator *listTypeInitIterator(robj *subject, long index, unsigned char
 
 /* Clean up the iterator. */
 void listTypeReleaseIterator(listTypeIterator *li) {
+    quicklistReleaseIterator(li->iter);
     zfree(li);
 }
 
@@ -170,24 +127,8 @@ int listTypeNext(listTypeIterator *li, listTypeEntry *entry) {
     redisAssert(li->subject->encoding == li->encoding);
 
     entry->li = li;
-    if (li->encoding == REDIS_ENCODING_ZIPLIST) {
-        entry->zi = li->zi;
-        if (entry->zi != NULL) {
-            if (li->direction == REDIS_TAIL)
-                li->zi = ziplistNext(li->subject->ptr,li->zi);
-            else
-                li->zi = ziplistPrev(li->subject->ptr,li->zi);
-            return 1;
-        }
-    } else if (li->encoding == REDIS_ENCODING_LINKEDLIST) {
-        entry->ln = li->ln;
-        if (entry->ln != NULL) {
-            if (li->direction == REDIS_TAIL)
-                li->ln = li->ln->next;
-            else
-                li->ln = li->ln->prev;
-            return 1;
-        }
+    if (li->encoding == REDIS_ENCODING_QUICKLIST) {
+        return quicklistNext(li->iter,&entry->entry);
     } else {
         redisPanic("Unknown list encoding");
     }
@@ -195,26 +136,16 @@ int listTypeNext(listTypeIterator *li, listTypeEntry *entry) {
 }
 
 /* Return entry or NULL at the current position of the iterator. */
-//صǰڵֵѾɣ NULL
+//صǰڵֵ
 robj *listTypeGet(listTypeEntry *entry) {
-    listTypeIterator *li = entry->li;
     robj *value = NULL;
-    if (li->encoding == REDIS_ENCODING_ZIPLIST) {
-        unsigned char *vstr;
-        unsigned int vlen;
-        long long vlong;
-        redisAssert(entry->zi != NULL);
-        if (ziplistGet(entry->zi,&vstr,&vlen,&vlong)) {
-            if (vstr) {
-                value = createStringObject((char*)vstr,vlen);
-            } else {
-                value = createStringObjectFromLongLong(vlong);
-            }
+    if (entry->li->encoding == REDIS_ENCODING_QUICKLIST) {
+        if (entry->entry.value) {
+            value = createStringObject((char*)entry->entry.value,
+                                       entry->entry.sz);
+        } else {
+            value = createStringObjectFromLongLong(entry->entry.longval);
         }
-    } else if (li->encoding == REDIS_ENCODING_LINKEDLIST) {
-        redisAssert(entry->ln != NULL);
-        value = listNodeValue(entry->ln);
-        incrRefCount(value);
     } else {
         redisPanic("Unknown list encoding");
     }
@@ -223,30 +154,18 @@ robj *listTypeGet(listTypeEntry *entry) {
 
 //뺯wherevalueбԪentry֮ǰ֮
 void listTypeInsert(listTypeEntry *entry, robj *value, int where) {
-    robj *subject = entry->li->subject;
-    if (entry->li->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (entry->li->encoding == REDIS_ENCODING_QUICKLIST) {
+        quicklistIter *iter = entry->li->iter;
+
         value = getDecodedObject(value);
         if (where == REDIS_TAIL) {//뵽entry֮
-            unsigned char *next = ziplistNext(subject->ptr,entry->zi);
-
-            /* When we insert after the current element, but the current element
-             * is the tail of the list, we need to do a push. */
-            if (next == NULL) {//һڵΪգôziplistzlend
-                subject->ptr = ziplistPush(subject->ptr,value->ptr,sdslen(value->ptr),REDIS_TAIL);
-            } else {
-                subject->ptr = ziplistInsert(subject->ptr,next,value->ptr,sdslen(value->ptr));
-            }
+            quicklistInsertAfter(iter,&entry->entry,
+                                 value->ptr,sdslen(value->ptr));
         } else {
-            subject->ptr = ziplistInsert(subject->ptr,entry->zi,value->ptr,sdslen(value->ptr));
+            quicklistInsertBefore(iter,&entry->entry,
+                                  value->ptr,sdslen(value->ptr));
         }
         decrRefCount(value);
-    } else if (entry->li->encoding == REDIS_ENCODING_LINKEDLIST) {
-        if (where == REDIS_TAIL) {
-            listInsertNode(subject->ptr,entry->ln,value,AL_START_TAIL);
-        } else {
-            listInsertNode(subject->ptr,entry->ln,value,AL_START_HEAD);
-        }
-        incrRefCount(value);
     } else {
         redisPanic("Unknown list encoding");
     }
@@ -255,59 +174,36 @@ void listTypeInsert(listTypeEntry *entry, robj *value, int where) {
 /* Compare the given object with the entry at the current position. */
 //ȽбڵentryֵoֵǷͬ
 int listTypeEqual(listTypeEntry *entry, robj *o) {
-    listTypeIterator *li = entry->li;
-    if (li->encoding == REDIS_ENCODING_ZIPLIST) {
-        redisAssertWithInfo(NULL,o,o->encoding == REDIS_ENCODING_RAW);
-        return ziplistCompare(entry->zi,o->ptr,sdslen(o->ptr));
-    } else if (li->encoding == REDIS_ENCODING_LINKEDLIST) {
-        return equalStringObjects(o,listNodeValue(entry->ln));
+    if (entry->li->encoding == REDIS_ENCODING_QUICKLIST) {
+        redisAssertWithInfo(NULL,o,sdsEncodedObject(o));
+        return quicklistCompare(entry->entry.zi,o->ptr,sdslen(o->ptr));
     } else {
         redisPanic("Unknown list encoding");
     }
 }
 
-/* Delete the element pointed to. */
+/* Delete the element pointed to. The iterator will return the element
+ * following it. */
 void listTypeDelete(listTypeEntry *entry) {
-    listTypeIterator *li = entry->li;
-    if (li->encoding == REDIS_ENCODING_ZIPLIST) {
-        unsigned char *p = entry->zi;
-        li->subject->ptr = ziplistDelete(li->subject->ptr,&p);
-
-        /* Update position of the iterator depending on the direction */
-        if (li->direction == REDIS_TAIL)
-            li->zi = p;
-        else
-            li->zi = ziplistPrev(li->subject->ptr,p);
-    } else if (entry->li->encoding == REDIS_ENCODING_LINKEDLIST) {
-        listNode *next;
-        if (li->direction == REDIS_TAIL)
-            next = entry->ln->next;
-        else
-            next = entry->ln->prev;
-        listDelNode(li->subject->ptr,entry->ln);
-        li->ln = next;
+    if (entry->li->encoding == REDIS_ENCODING_QUICKLIST) {
+        quicklistDelEntry(entry->li->iter,&entry->entry);
     } else {
         redisPanic("Unknown list encoding");
     }
 }
 
+/* Convert a list loaded from an old RDB file, encoded as a single ziplist,
+ * into a quicklist. */
 void listTypeConvert(robj *subject, int enc) {
-    listTypeIterator *li;
-    listTypeEntry entry;
     redisAssertWithInfo(NULL,subject,subject->type == REDIS_LIST);
-
-    if (enc == REDIS_ENCODING_LINKEDLIST) {
-        list *l = listCreate();
-        listSetFreeMethod(l,decrRefCountVoid);
-
-        /* listTypeGet returns a robj with incremented refcount */
-        li = listTypeInitIterator(subject,0,REDIS_TAIL);
-        while (listTypeNext(li,&entry)) listAddNodeTail(l,listTypeGet(&entry));
-        listTypeReleaseIterator(li);
-
-        subject->encoding = REDIS_ENCODING_LINKEDLIST;
-        zfree(subject->ptr);
-        subject->ptr = l;
+    redisAssertWithInfo(NULL,subject,
+                        subject->encoding == REDIS_ENCODING_ZIPLIST);
+
+    if (enc == REDIS_ENCODING_QUICKLIST) {
+        subject->ptr = quicklistCreateFromZiplist(server.list_max_ziplist_size,
+                                                  server.list_compress_depth,
+                                                  subject->ptr);
+        subject->encoding = REDIS_ENCODING_QUICKLIST;
     } else {
         redisPanic("Unsupported list conversion");
     }
@@ -337,7 +233,9 @@ void pushGenericCommand(redisClient *c, int where) {
     for (j = 2; j < c->argc; j++) {
         c->argv[j] = tryObjectEncoding(c->argv[j]);
         if (!lobj) {
-            lobj = createZiplistObject();//ʹziplist
+            lobj = createQuicklistObject();
+            quicklistSetOptions(lobj->ptr,server.list_max_ziplist_size,
+                                server.list_compress_depth);
             dbAdd(c->db,c->argv[1],lobj);
         }
         listTypePush(lobj,c->argv[j],where);
@@ -375,14 +273,6 @@ void pushxGenericCommand(redisClient *c, robj *refval, robj *val, int where) {
         checkType(c,subject,REDIS_LIST)) return;
 
     if (refval != NULL) { //ִlinsertָrefvalΪpivot
-        /* We're not sure if this value can be inserted yet, but we cannot
-         * convert the list inside the iterator. We don't want to loop over
-         * the list twice (once to see if the value can be inserted and once
-         * to do the actual insert), so we assume this value can be inserted
-         * and convert the ziplist to a regular list if necessary. */
-        //ǷҪת
-        listTypeTryConversion(subject,val);
-
         /* Seek refval from head to tail */
         //ͷβҰrefvalĽڵ
         iter = listTypeInitIterator(subject,0,REDIS_TAIL);//ɵ
@@ -395,11 +285,7 @@ void pushxGenericCommand(redisClient *c, robj *refval, robj *val, int where) {
         }
         listTypeReleaseIterator(iter); //ͷŵ
 
-        if (inserted) {//ɹһԪغҪжбǷҪת
-            /* Check if the length exceeds the ziplist length threshold. */
-            if (subject->encoding == REDIS_ENCODING_ZIPLIST &&
-                ziplistLen(subject->ptr) > server.list_max_ziplist_entries)
-                    listTypeConvert(subject,REDIS_ENCODING_LINKEDLIST);
+        if (inserted) {
             signalModifiedKey(c->db,c->argv[1]);
             notifyKeyspaceEvent(REDIS_NOTIFY_LIST,"linsert",
                                 c->argv[1],c->db->id);
@@ -463,33 +349,19 @@ void lindexCommand(redisClient *c) {
     robj *o = lookupKeyReadOrReply(c,c->argv[1],shared.nullbulk);
     if (o == NULL || checkType(c,o,REDIS_LIST)) return;
     long index;
-    robj *value = NULL;
 
     if ((getLongFromObjectOrReply(c, c->argv[2], &index, NULL) != REDIS_OK))
         return;
 
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-        unsigned char *p;
-        unsigned char *vstr;
-        unsigned int vlen;
-        long long vlong;
-        p = ziplistIndex(o->ptr,index);
-        if (ziplistGet(p,&vstr,&vlen,&vlong)) {
-            if (vstr) {
-                value = createStringObject((char*)vstr,vlen);
+    if (o->encoding == REDIS_ENCODING_QUICKLIST) {
+        quicklistEntry entry;
+        if (quicklistIndex(o->ptr,index,&entry)) {
+            if (entry.value) {
+                addReplyBulkCBuffer(c,entry.value,entry.sz);
             } else {
-                value = createStringObjectFromLongLong(vlong);
+                addReplyBulkLongLong(c,entry.longval);
             }
-            addReplyBulk(c,value);
-            decrRefCount(value);
-        } else {
-            addReply(c,shared.nullbulk);
-        }
-    } else if (o->encoding == REDIS_ENCODING_LINKEDLIST) {
-        listNode *ln = listIndex(o->ptr,index);
-        if (ln != NULL) {
-            value = listNodeValue(ln);
-            addReplyBulk(c,value);
+            quicklistCompressEntry(&entry);
         } else {
             addReply(c,shared.nullbulk);
         }
@@ -510,30 +382,16 @@ void lsetCommand(redisClient *c) {
     if ((getLongFromObjectOrReply(c, c->argv[2], &index, NULL) != REDIS_OK))
         return;
 
-    listTypeTryConversion(o,value);
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-        unsigned char *p, *zl = o->ptr;
-        p = ziplistIndex(zl,index);
-        if (p == NULL) {
-            addReply(c,shared.outofrangeerr);
-        } else {
-            o->ptr = ziplistDelete(o->ptr,&p);//ɾԭĽڵֵ
-            value = getDecodedObject(value);
-            o->ptr = ziplistInsert(o->ptr,p,value->ptr,sdslen(value->ptr)); //µĽڵֵ
-            decrRefCount(value);
-            addReply(c,shared.ok);
-            signalModifiedKey(c->db,c->argv[1]);
-            notifyKeyspaceEvent(REDIS_NOTIFY_LIST,"lset",c->argv[1],c->db->id);
-            server.dirty++;
-        }
-    } else if (o->encoding == REDIS_ENCODING_LINKEDLIST) {
-        listNode *ln = listIndex(o->ptr,index);
-        if (ln == NULL) {
+    if (o->encoding == REDIS_ENCODING_QUICKLIST) {
+        int replaced;
+
+        value = getDecodedObject(value);
+        replaced = quicklistReplaceAtIndex(o->ptr,index,value->ptr,
+                                           sdslen(value->ptr));
+        decrRefCount(value);
+        if (!replaced) {
             addReply(c,shared.outofrangeerr);
         } else {
-            decrRefCount((robj*)listNodeValue(ln));
-            listNodeValue(ln) = value;
-            incrRefCount(value);
             addReply(c,shared.ok);
             signalModifiedKey(c->db,c->argv[1]);
             notifyKeyspaceEvent(REDIS_NOTIFY_LIST,"lset",c->argv[1],c->db->id);
@@ -612,36 +470,23 @@ void lrangeCommand(redisClient *c) {
 
     /* Return the result in form of a multi-bulk reply */
     addReplyMultiBulkLen(c,rangelen);
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-        unsigned char *p = ziplistIndex(o->ptr,start);
-        unsigned char *vstr;
-        unsigned int vlen;
-        long long vlong;
+    if (o->encoding == REDIS_ENCODING_QUICKLIST) {
+        /* quicklistIndex() reaches the first element from the nearest end
+         * of the list, skipping whole nodes. */
+        listTypeIterator *li = listTypeInitIterator(o,start,REDIS_TAIL);
+        listTypeEntry entry;
 
         while(rangelen--) {
-            ziplistGet(p,&vstr,&vlen,&vlong);
-            if (vstr) {
-                addReplyBulkCBuffer(c,vstr,vlen);
+            listTypeNext(li,&entry);
+            if (entry.entry.value) {
+                addReplyBulkCBuffer(c,entry.entry.value,entry.entry.sz);
             } else {
-                addReplyBulkLongLong(c,vlong);
+                addReplyBulkLongLong(c,entry.entry.longval);
             }
-            p = ziplistNext(o->ptr,p);
-        }
-    } else if (o->encoding == REDIS_ENCODING_LINKEDLIST) {
-        listNode *ln;
-
-        /* If we are nearest to the end of the list, reach the element
-         * starting from tail and going backward, as it is faster. */
-        //ʼλstartѾһ볤ȣôΪ˼ӿٶȣʹβͷ
-        if (start > llen/2) start -= llen;
-        ln = listIndex(o->ptr,start);
-
-        while(rangelen--) {
-            addReplyBulk(c,ln->value);
-            ln = ln->next;
         }
+        listTypeReleaseIterator(li);
     } else {
-        redisPanic("List encoding is not LINKEDLIST nor ZIPLIST!");
+        redisPanic("List encoding is not QUICKLIST!");
     }
 }
 
@@ -650,9 +495,7 @@ void lrangeCommand(redisClient *c) {
 */
 void ltrimCommand(redisClient *c) {
     robj *o;
-    long start, end, llen, j, ltrim, rtrim;
-    list *list;
-    listNode *ln;
+    long start, end, llen, ltrim, rtrim;
 
     if ((getLongFromObjectOrReply(c, c->argv[2], &start, NULL) != REDIS_OK) ||
         (getLongFromObjectOrReply(c, c->argv[3], &end, NULL) != REDIS_OK)) return;
@@ -679,19 +522,9 @@ void ltrimCommand(redisClient *c) {
     }
 
     /* Remove list elements to perform the trim */
-    if (o->encoding == REDIS_ENCODING_ZIPLIST) {
-        o->ptr = ziplistDeleteRange(o->ptr,0,ltrim);
-        o->ptr = ziplistDeleteRange(o->ptr,-rtrim,rtrim);
-    } else if (o->encoding == REDIS_ENCODING_LINKEDLIST) {
-        list = o->ptr;
-        for (j = 0; j < ltrim; j++) {
-            ln = listFirst(list);
-            listDelNode(list,ln);
-        }
-        for (j = 0; j < rtrim; j++) {
-            ln = listLast(list);
-            listDelNode(list,ln);
-        }
+    if (o->encoding == REDIS_ENCODING_QUICKLIST) {
+        quicklistDelRange(o->ptr,0,ltrim);
+        quicklistDelRange(o->ptr,-rtrim,rtrim);
     } else {
         redisPanic("Unknown list encoding");
     }
@@ -725,9 +558,8 @@ void lremCommand(redisClient *c) {
     subject = lookupKeyWriteOrReply(c,c->argv[1],shared.czero);
     if (subject == NULL || checkType(c,subject,REDIS_LIST)) return;
 
-    /* Make sure obj is raw when we're dealing with a ziplist */
-    if (subject->encoding == REDIS_ENCODING_ZIPLIST)
-        obj = getDecodedObject(obj);
+    /* Make sure obj is raw, the elements are stored in listpacks */
+    obj = getDecodedObject(obj);
 
     listTypeIterator *li; //б
     if (toremove < 0) {
@@ -748,8 +580,7 @@ void lremCommand(redisClient *c) {
     listTypeReleaseIterator(li);
 
     /* Clean up raw encoded object */
-    if (subject->encoding == REDIS_ENCODING_ZIPLIST)
-        decrRefCount(obj);
+    decrRefCount(obj);
 
     if (listTypeLength(subject) == 0) dbDelete(c->db,c->argv[1]);
     addReplyLongLong(c,removed);
@@ -775,7 +606,9 @@ void lremCommand(redisClient *c) {
 void rpoplpushHandlePush(redisClient *c, robj *dstkey, robj *dstobj, robj *value) {
     /* Create the list if the key does not exist */
     if (!dstobj) {//ĿбΪ
-        dstobj = createZiplistObject();
+        dstobj = createQuicklistObject();
+        quicklistSetOptions(dstobj->ptr,server.list_max_ziplist_size,
+                            server.list_compress_depth);
         dbAdd(c->db,dstkey,dstobj);
         signalListAsReady(c,dstkey); // dstkey ӵ server.ready_keys б
     }
@@ -890,23 +723,26 @@ void blockForKeys(redisClient *c, robj **keys, int numkeys, time_t timeout, robj
 
     //  key 뵽 client.bpop.keys ֵO(N)
     for (j = 0; j < numkeys; j++) {
+        unsigned int h = keyHash(keys[j]);
+
         /* If the key already exists in the dict ignore it. */
         // ¼ key ͻ
-        if (dictAdd(c->bpop.keys,keys[j],NULL) != DICT_OK) continue;
+        if ((de = dictAddRawWithHash(c->bpop.keys,keys[j],h)) == NULL)
+            continue;
+        dictSetVal(c->bpop.keys,de,NULL);
         incrRefCount(keys[j]);
 
         /* And in the other "side", to map keys -> clients */
         // Ŀͻӵ db->blocking_keys ֵ
-        de = dictFind(c->db->blocking_keys,keys[j]);
+        de = dictFindWithHash(c->db->blocking_keys,keys[j],h);
         if (de == NULL) {
             //  key һαһ
-            int retval;
-
             /* For every key we take a list of clients blocked for it */
             l = listCreate();
-            retval = dictAdd(c->db->blocking_keys,keys[j],l);//ӵֵ
+            de = dictAddRawWithHash(c->db->blocking_keys,keys[j],h);
+            redisAssertWithInfo(c,keys[j],de != NULL);
+            dictSetVal(c->db->blocking_keys,de,l);//ӵֵ
             incrRefCount(keys[j]);
-            redisAssertWithInfo(c,keys[j],retval == DICT_OK);
         } else {// Ѿͻ˱ key 
             l = dictGetVal(de);
         }
@@ -966,14 +802,18 @@ void unblockClientWaitingData(redisClient *c) {
  * The list will be finally processed by handleClientsBlockedOnLists() */
 void signalListAsReady(redisClient *c, robj *key) {
     readyList *rl;
+    dictEntry *de;
+    unsigned int h;
 
     /* No clients blocking for this key? No need to queue it. */
     // ûпͻڵȴ key ֱӷ
-    if (dictFind(c->db->blocking_keys,key) == NULL) return;
+    if (dictSize(c->db->blocking_keys) == 0) return;
+    h = keyHash(key);
+    if (dictFindWithHash(c->db->blocking_keys,key,h) == NULL) return;
 
     /* Key was already signaled? No need to queue it again. */
     // key Ѿλھбֱӷ
-    if (dictFind(c->db->ready_keys,key) != NULL) return;
+    if (dictFindWithHash(c->db->ready_keys,key,h) != NULL) return;
 
     /* Ok, we need to queue this key into server.ready_keys. */
     // Ӱ key  db Ϣ readyList ṹ˵ľб
@@ -987,7 +827,9 @@ void signalListAsReady(redisClient *c, robj *key) {
      * to avoid adding it multiple times into a list with a simple O(1)
      * check. */
     incrRefCount(key);
-    redisAssert(dictAdd(c->db->ready_keys,key,NULL) == DICT_OK);
+    de = dictAddRawWithHash(c->db->ready_keys,key,h);
+    redisAssert(de != NULL);
+    dictSetVal(c->db->ready_keys,de,NULL);
 }
 
 /* This is an helper function for handleClientsBlockedOnLists(). It's work
@@ -529,7 +529,7 @@ void srandmemberWithCountCommand(redisClient *c) {
 
             if (encoding == REDIS_ENCODING_INTSET) {
                 retval = dictAdd(d,createStringObjectFromLongLong(llele),NULL);
-            } else if (ele->encoding == REDIS_ENCODING_RAW) {
+            } else if (sdsEncodedObject(ele)) {
                 retval = dictAdd(d,dupStringObject(ele),NULL);
             } else if (ele->encoding == REDIS_ENCODING_INT) {
                 retval = dictAdd(d,
@@ -561,7 +561,7 @@ void srandmemberWithCountCommand(redisClient *c) {
             encoding = setTypeRandomElement(set,&ele,&llele);
             if (encoding == REDIS_ENCODING_INTSET) {
                 ele = createStringObjectFromLongLong(llele);
-            } else if (ele->encoding == REDIS_ENCODING_RAW) {
+            } else if (sdsEncodedObject(ele)) {
                 ele = dupStringObject(ele);
             } else if (ele->encoding == REDIS_ENCODING_INT) {
                 ele = createStringObjectFromLongLong((long)ele->ptr);
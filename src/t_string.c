@@ -171,7 +171,7 @@ int getGenericCommand(redisClient *c) {
         addReply(c,shared.wrongtypeerr);
         return REDIS_ERR;
     } else {
-        addReplyBulk(c,o);
+        addReplyBulkCached(c,o);
         return REDIS_OK;
     }
 }
@@ -244,7 +244,7 @@ void setrangeCommand(redisClient *c) {
         //  o ǹ߱(ԭʼַ)ʱһ
         if (o->refcount != 1 || o->encoding != REDIS_ENCODING_RAW) {
             robj *decoded = getDecodedObject(o);
-            o = createStringObject(decoded->ptr, sdslen(decoded->ptr));
+            o = createRawStringObject(decoded->ptr, sdslen(decoded->ptr));
             decrRefCount(decoded);
             dbOverwrite(c->db,c->argv[1],o);
         }
@@ -305,14 +305,22 @@ void mgetCommand(redisClient *c) {
 
     addReplyMultiBulkLen(c,c->argc-1);
     for (j = 1; j < c->argc; j++) {
-        robj *o = lookupKeyRead(c->db,c->argv[j]);
+        robj *o;
+
+        if ((j-1) % DICT_PREFETCH_BATCH == 0 && c->argc > 2) {
+            int count = c->argc-j;
+
+            if (count > DICT_PREFETCH_BATCH) count = DICT_PREFETCH_BATCH;
+            dbPrefetchKeys(c->db,c->argv+j,count);
+        }
+        o = lookupKeyRead(c->db,c->argv[j]);
         if (o == NULL) {
             addReply(c,shared.nullbulk);
         } else {
             if (o->type != REDIS_STRING) {
                 addReply(c,shared.nullbulk);
             } else {
-                addReplyBulk(c,o);
+                addReplyBulkCached(c,o);
             }
         }
     }
@@ -474,7 +482,7 @@ void appendCommand(redisClient *c) {
         //  key Ǳ򱻱ģôһ
         if (o->refcount != 1 || o->encoding != REDIS_ENCODING_RAW) {
             robj *decoded = getDecodedObject(o);
-            o = createStringObject(decoded->ptr, sdslen(decoded->ptr));
+            o = createRawStringObject(decoded->ptr, sdslen(decoded->ptr));
             decrRefCount(decoded);
             dbOverwrite(c->db,c->argv[1],o);
         }
@@ -239,12 +239,12 @@ int zslDelete(zskiplist *zsl, double score, robj *obj) {
 }
 
 // value Ƿ spec ָķΧ, value >= min
-static int zslValueGteMin(double value, zrangespec *spec) {
+int zslValueGteMin(double value, zrangespec *spec) {
     return spec->minex ? (value > spec->min) : (value >= spec->min);
 }
 
 //value <= max
-static int zslValueLteMax(double value, zrangespec *spec) {
+int zslValueLteMax(double value, zrangespec *spec) {
     return spec->maxex ? (value < spec->max) : (value <= spec->max);
 }
 
@@ -473,10 +473,10 @@ static int zslParseRange(robj *min, robj *max, zrangespec *spec) {
 }
 
 /*-----------------------------------------------------------------------------
- * Ziplist-backed sorted set API
+ * Listpack-backed sorted set API
  *----------------------------------------------------------------------------*/
 
-double zzlGetScore(unsigned char *sptr) {//sptrziplistȡscore
+double zzlGetScore(unsigned char *sptr) {//sptrlistpackȡscore
     unsigned char *vstr;
     unsigned int vlen;
     long long vlong;
@@ -484,7 +484,7 @@ double zzlGetScore(unsigned char *sptr) {//
     double score;
 
     redisAssert(sptr != NULL);
-    redisAssert(ziplistGet(sptr,&vstr,&vlen,&vlong));
+    redisAssert(lpGet(sptr,&vstr,&vlen,&vlong));
 
     if (vstr) {
         memcpy(buf,vstr,vlen);
@@ -506,7 +506,7 @@ int zzlCompareElements(unsigned char *eptr, unsigned char *cstr, unsigned int cl
     int minlen, cmp;
 
     //õeptrscoreֵziplitʹͱ룬ôvstr=NULL,ֵ洢vlong
-    redisAssert(ziplistGet(eptr,&vstr,&vlen,&vlong));
+    redisAssert(lpGet(eptr,&vstr,&vlen,&vlong));
     if (vstr == NULL) {
         /* Store string representation of long long in buf. */
         vlen = ll2string((char*)vbuf,sizeof(vbuf),vlong);
@@ -520,7 +520,7 @@ int zzlCompareElements(unsigned char *eptr, unsigned char *cstr, unsigned int cl
 }
 
 unsigned int zzlLength(unsigned char *zl) {
-    return ziplistLen(zl)/2;
+    return lpLength(zl)/2;
 }
 
 /* Move to next entry based on the values in eptr and sptr. Both are set to
@@ -529,9 +529,9 @@ void zzlNext(unsigned char *zl, unsigned char **eptr, unsigned char **sptr) {
     unsigned char *_eptr, *_sptr;
     redisAssert(*eptr != NULL && *sptr != NULL);
 
-    _eptr = ziplistNext(zl,*sptr);
+    _eptr = lpNext(zl,*sptr);
     if (_eptr != NULL) {
-        _sptr = ziplistNext(zl,_eptr);
+        _sptr = lpNext(zl,_eptr);
         redisAssert(_sptr != NULL);
     } else {
         /* No next entry. */
@@ -548,9 +548,9 @@ void zzlPrev(unsigned char *zl, unsigned char **eptr, unsigned char **sptr) {
     unsigned char *_eptr, *_sptr;
     redisAssert(*eptr != NULL && *sptr != NULL);
 
-    _sptr = ziplistPrev(zl,*eptr);
+    _sptr = lpPrev(zl,*eptr);
     if (_sptr != NULL) {
-        _eptr = ziplistPrev(zl,_sptr);
+        _eptr = lpPrev(zl,_sptr);
         redisAssert(_eptr != NULL);
     } else {
         /* No previous entry. */
@@ -572,13 +572,13 @@ int zzlIsInRange(unsigned char *zl, zrangespec *range) {
             (range->min == range->max && (range->minex || range->maxex)))
         return 0;
 
-    p = ziplistIndex(zl,-1); /* Last score. */
+    p = lpSeek(zl,-1); /* Last score. */
     if (p == NULL) return 0; /* Empty sorted set */
     score = zzlGetScore(p);
     if (!zslValueGteMin(score,range))
         return 0;
 
-    p = ziplistIndex(zl,1); /* First score. */
+    p = lpSeek(zl,1); /* First score. */
     redisAssert(p != NULL);
     score = zzlGetScore(p);
     if (!zslValueLteMax(score,range))
@@ -590,14 +590,14 @@ int zzlIsInRange(unsigned char *zl, zrangespec *range) {
 /* Find pointer to the first element contained in the specified range.
  * Returns NULL when no element is contained in the range. */
 unsigned char *zzlFirstInRange(unsigned char *zl, zrangespec range) {
-    unsigned char *eptr = ziplistIndex(zl,0), *sptr;
+    unsigned char *eptr = lpSeek(zl,0), *sptr;
     double score;
 
     /* If everything is out of range, return early. */
     if (!zzlIsInRange(zl,&range)) return NULL;
 
     while (eptr != NULL) {
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         redisAssert(sptr != NULL);
 
         score = zzlGetScore(sptr);
@@ -609,7 +609,7 @@ unsigned char *zzlFirstInRange(unsigned char *zl, zrangespec range) {
         }
 
         /* Move to next element. */
-        eptr = ziplistNext(zl,sptr);
+        eptr = lpNext(zl,sptr);
     }
 
     return NULL;
@@ -618,14 +618,14 @@ unsigned char *zzlFirstInRange(unsigned char *zl, zrangespec range) {
 /* Find pointer to the last element contained in the specified range.
  * Returns NULL when no element is contained in the range. */
 unsigned char *zzlLastInRange(unsigned char *zl, zrangespec range) {
-    unsigned char *eptr = ziplistIndex(zl,-2), *sptr;
+    unsigned char *eptr = lpSeek(zl,-2), *sptr;
     double score;
 
     /* If everything is out of range, return early. */
     if (!zzlIsInRange(zl,&range)) return NULL;
 
     while (eptr != NULL) {
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         redisAssert(sptr != NULL);
 
         score = zzlGetScore(sptr);
@@ -638,9 +638,9 @@ unsigned char *zzlLastInRange(unsigned char *zl, zrangespec range) {
 
         /* Move to previous element by moving to the score of previous element.
          * When this returns NULL, we know there also is no element. */
-        sptr = ziplistPrev(zl,eptr);
+        sptr = lpPrev(zl,eptr);
         if (sptr != NULL)
-            redisAssert((eptr = ziplistPrev(zl,sptr)) != NULL);
+            redisAssert((eptr = lpPrev(zl,sptr)) != NULL);
         else
             eptr = NULL;
     }
@@ -649,14 +649,14 @@ unsigned char *zzlLastInRange(unsigned char *zl, zrangespec range) {
 }
 
 unsigned char *zzlFind(unsigned char *zl, robj *ele, double *score) {
-    unsigned char *eptr = ziplistIndex(zl,0), *sptr;
+    unsigned char *eptr = lpSeek(zl,0), *sptr;
 
     ele = getDecodedObject(ele);
     while (eptr != NULL) {
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         redisAssertWithInfo(NULL,ele,sptr != NULL);
 
-        if (ziplistCompare(eptr,ele->ptr,sdslen(ele->ptr))) {
+        if (lpCompare(eptr,ele->ptr,sdslen(ele->ptr))) {
             /* Matching element, pull out score. */
             if (score != NULL) *score = zzlGetScore(sptr);
             decrRefCount(ele);
@@ -664,22 +664,19 @@ unsigned char *zzlFind(unsigned char *zl, robj *ele, double *score) {
         }
 
         /* Move to next element. */
-        eptr = ziplistNext(zl,sptr);
+        eptr = lpNext(zl,sptr);
     }
 
     decrRefCount(ele);
     return NULL;
 }
 
-/* Delete (element,score) pair from ziplist. Use local copy of eptr because we
+/* Delete (element,score) pair from listpack. Use local copy of eptr because we
  * don't want to modify the one given as argument. */
 unsigned char *zzlDelete(unsigned char *zl, unsigned char *eptr) {
     unsigned char *p = eptr;
 
-    /* TODO: add function to ziplist API to delete N elements from offset. */
-    zl = ziplistDelete(zl,&p);
-    zl = ziplistDelete(zl,&p);
-    return zl;
+    return lpDeleteRangeWithEntry(zl,&p,2);
 }
 
 /**ҵľλú󣬸úʽִв
@@ -691,36 +688,36 @@ unsigned char *zzlInsertAt(unsigned char *zl, unsigned char *eptr, robj *ele, do
     int scorelen;
     size_t offset;
 
-    redisAssertWithInfo(NULL,ele,ele->encoding == REDIS_ENCODING_RAW);
+    redisAssertWithInfo(NULL,ele,sdsEncodedObject(ele));
     scorelen = d2string(scorebuf,sizeof(scorebuf),score); //double convert to string
     if (eptr == NULL) {//β
-        zl = ziplistPush(zl,ele->ptr,sdslen(ele->ptr),ZIPLIST_TAIL);
-        zl = ziplistPush(zl,(unsigned char*)scorebuf,scorelen,ZIPLIST_TAIL);
+        zl = lpPush(zl,ele->ptr,sdslen(ele->ptr),LP_TAIL);
+        zl = lpPush(zl,(unsigned char*)scorebuf,scorelen,LP_TAIL);
     } else {
         /* Keep offset relative to zl, as it might be re-allocated. */
         offset = eptr-zl;
-        zl = ziplistInsert(zl,eptr,ele->ptr,sdslen(ele->ptr));
+        zl = lpInsert(zl,eptr,ele->ptr,sdslen(ele->ptr));
         eptr = zl+offset;
 
         /* Insert score after the element. */
-        redisAssertWithInfo(NULL,ele,(sptr = ziplistNext(zl,eptr)) != NULL);
-        zl = ziplistInsert(zl,sptr,(unsigned char*)scorebuf,scorelen);
+        redisAssertWithInfo(NULL,ele,(sptr = lpNext(zl,eptr)) != NULL);
+        zl = lpInsert(zl,sptr,(unsigned char*)scorebuf,scorelen);
     }
 
     return zl;
 }
 
-/* Insert (element,score) pair in ziplist. This function assumes the element is
+/* Insert (element,score) pair in listpack. This function assumes the element is
  * not yet present in the list. */
-//ziplist洢sorted setʱʹ(element,score)ʽ
+//listpack洢sorted setʱʹ(element,score)ʽ
 //ӶO(N)
 unsigned char *zzlInsert(unsigned char *zl, robj *ele, double score) {
-    unsigned char *eptr = ziplistIndex(zl,0), *sptr;//eptrһԪص׵ַ
+    unsigned char *eptr = lpSeek(zl,0), *sptr;//eptrһԪص׵ַ
     double s;
 
     ele = getDecodedObject(ele);
     while (eptr != NULL) {
-        sptr = ziplistNext(zl,eptr);//õ¸ڵ׵ַ洢scoreֵĵַ
+        sptr = lpNext(zl,eptr);//õ¸ڵ׵ַ洢scoreֵĵַ
         redisAssertWithInfo(NULL,ele,sptr != NULL);
         s = zzlGetScore(sptr);//õ׸Ԫصscoreֵ
 
@@ -740,7 +737,7 @@ unsigned char *zzlInsert(unsigned char *zl, robj *ele, double score) {
         }
 
         /* Move to next element. */
-        eptr = ziplistNext(zl,sptr);//ƶһڵ
+        eptr = lpNext(zl,sptr);//ƶһڵ
     }
 
     /* Push on tail of list when it was not yet inserted. */
@@ -753,7 +750,7 @@ unsigned char *zzlInsert(unsigned char *zl, robj *ele, double score) {
 
 //ɾscorerange֮Ԫ
 unsigned char *zzlDeleteRangeByScore(unsigned char *zl, zrangespec range, unsigned long *deleted) {
-    unsigned char *eptr, *sptr;
+    unsigned char *eptr, *sptr, *first;
     double score;
     unsigned long num = 0;
 
@@ -762,20 +759,16 @@ unsigned char *zzlDeleteRangeByScore(unsigned char *zl, zrangespec range, unsign
     eptr = zzlFirstInRange(zl,range);
     if (eptr == NULL) return zl;
 
-    /* When the tail of the ziplist is deleted, eptr will point to the sentinel
-     * byte and ziplistNext will return NULL. */
-    while ((sptr = ziplistNext(zl,eptr)) != NULL) {
+    /* The elements in range are contiguous: count them, then delete all
+     * the element and score pairs at once. */
+    first = eptr;
+    while (eptr != NULL && (sptr = lpNext(zl,eptr)) != NULL) {
         score = zzlGetScore(sptr);
-        if (zslValueLteMax(score,&range)) {
-            /* Delete both the element and the score. */
-            zl = ziplistDelete(zl,&eptr);
-            zl = ziplistDelete(zl,&eptr);
-            num++;
-        } else {
-            /* No longer in range. */
-            break;
-        }
+        if (!zslValueLteMax(score,&range)) break; /* No longer in range. */
+        eptr = lpNext(zl,sptr);
+        num++;
     }
+    zl = lpDeleteRangeWithEntry(zl,&first,2*num);
 
     if (deleted != NULL) *deleted = num;
     return zl;
@@ -786,7 +779,7 @@ unsigned char *zzlDeleteRangeByScore(unsigned char *zl, zrangespec range, unsign
 unsigned char *zzlDeleteRangeByRank(unsigned char *zl, unsigned int start, unsigned int end, unsigned long *deleted) {
     unsigned int num = (end-start)+1;
     if (deleted) *deleted = num;
-    zl = ziplistDeleteRange(zl,2*(start-1),2*num);
+    zl = lpDeleteRange(zl,2*(start-1),2*num);
     return zl;
 }
 
@@ -794,9 +787,9 @@ unsigned char *zzlDeleteRangeByRank(unsigned char *zl, unsigned int start, unsig
  * Common sorted set API
  *----------------------------------------------------------------------------*/
 /**
-    Redis_zsetʹREDIS_ENCONDING_ZIPLISTREDIS_ENCODING_SKIPLIST
+    Redis_zsetʹREDIS_ENCODING_LISTPACKREDIS_ENCODING_SKIPLIST
     ͨ ZADD ӵһԪص key ʱͨĵһԪôʲô򼯡
-    һԪطĻʹһ REDIS_ENCODING_ZIPLIST 򼯣
+    һԪطĻʹһ REDIS_ENCODING_LISTPACK 򼯣
     1)  server.zset_max_ziplist_entries ֵ 0 ĬΪ 128 
     2) Ԫص member Сڷ server.zset_max_ziplist_value ֵĬΪ 64
     򣬳ʹһ REDIS_ENCODING_SKIPLIST 
@@ -804,16 +797,48 @@ unsigned char *zzlDeleteRangeByRank(unsigned char *zl, unsigned int start, unsig
 
 unsigned int zsetLength(robj *zobj) {
     int length = -1;
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         length = zzlLength(zobj->ptr);
     } else if (zobj->encoding == REDIS_ENCODING_SKIPLIST) {
         length = ((zset*)zobj->ptr)->zsl->length;
+    } else if (zobj->encoding == REDIS_ENCODING_BTREE) {
+        length = ((zset*)zobj->ptr)->zbt->length;
     } else {
         redisPanic("Unknown sorted set encoding");
     }
     return length;
 }
 
+/* Return the encoding of sorted sets too big to be encoded as listpacks. */
+int zsetIndexEncoding(void) {
+    return server.zset_btree_index ? REDIS_ENCODING_BTREE :
+                                     REDIS_ENCODING_SKIPLIST;
+}
+
+/* Add a new element to a sorted set encoded as a skiplist or a B+tree: the
+ * element must not be already a member. Both the dict and the ordered index
+ * take a reference to 'ele'. */
+void zsetAddNew(robj *zobj, double score, robj *ele) {
+    zset *zs = zobj->ptr;
+
+    if (zobj->encoding == REDIS_ENCODING_SKIPLIST) {
+        zskiplistNode *node = zslInsert(zs->zsl,score,ele);
+
+        redisAssertWithInfo(NULL,ele,dictAdd(zs->dict,ele,&node->score) == DICT_OK);
+    } else if (zobj->encoding == REDIS_ENCODING_BTREE) {
+        dictEntry *de;
+
+        zbtInsert(zs->zbt,score,ele);
+        de = dictAddRaw(zs->dict,ele);
+        redisAssertWithInfo(NULL,ele,de != NULL);
+        dictSetDoubleVal(de,score);
+    } else {
+        redisPanic("Unknown sorted set encoding");
+    }
+    incrRefCount(ele); /* Added to the index. */
+    incrRefCount(ele); /* Added to dictionary. */
+}
+
 void zsetConvert(robj *zobj, int encoding) {
     zset *zs;
     zskiplistNode *node, *next;
@@ -821,51 +846,77 @@ void zsetConvert(robj *zobj, int encoding) {
     double score;
 
     if (zobj->encoding == encoding) return;
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
         unsigned char *vstr;
         unsigned int vlen;
         long long vlong;
 
-        if (encoding != REDIS_ENCODING_SKIPLIST)
+        if (encoding != REDIS_ENCODING_SKIPLIST &&
+            encoding != REDIS_ENCODING_BTREE)
             redisPanic("Unknown target encoding");
 
         zs = zmalloc(sizeof(*zs));
         zs->dict = dictCreate(&zsetDictType,NULL);
-        zs->zsl = zslCreate();
+        if (encoding == REDIS_ENCODING_SKIPLIST) {
+            zs->zsl = zslCreate();
+            zs->zbt = NULL;
+        } else {
+            zs->zsl = NULL;
+            zs->zbt = zbtCreate();
+        }
+        zobj->ptr = zs;
+        zobj->encoding = encoding;
 
-        eptr = ziplistIndex(zl,0);
+        eptr = lpSeek(zl,0);
         redisAssertWithInfo(NULL,zobj,eptr != NULL);
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         redisAssertWithInfo(NULL,zobj,sptr != NULL);
 
         while (eptr != NULL) {
             score = zzlGetScore(sptr);
-            redisAssertWithInfo(NULL,zobj,ziplistGet(eptr,&vstr,&vlen,&vlong));
+            redisAssertWithInfo(NULL,zobj,lpGet(eptr,&vstr,&vlen,&vlong));
             if (vstr == NULL)
                 ele = createStringObjectFromLongLong(vlong);
             else
                 ele = createStringObject((char*)vstr,vlen);
 
-            /* Has incremented refcount since it was just created. */
-            node = zslInsert(zs->zsl,score,ele);
-            redisAssertWithInfo(NULL,zobj,dictAdd(zs->dict,ele,&node->score) == DICT_OK);
-            incrRefCount(ele); /* Added to dictionary. */
+            zsetAddNew(zobj,score,ele);
+            decrRefCount(ele);
             zzlNext(zl,&eptr,&sptr);
         }
 
-        zfree(zobj->ptr);
-        zobj->ptr = zs;
-        zobj->encoding = REDIS_ENCODING_SKIPLIST;
+        zfree(zl);
+    } else if (zobj->encoding == REDIS_ENCODING_BTREE) {
+        unsigned char *zl = lpNew();
+        zbtreeLeaf *l;
+        unsigned int j;
+
+        if (encoding != REDIS_ENCODING_LISTPACK)
+            redisPanic("Unknown target encoding");
+
+        zs = zobj->ptr;
+        for (l = zs->zbt->head; l; l = l->next) {
+            for (j = 0; j < l->count; j++) {
+                ele = getDecodedObject(l->obj[j]);
+                zl = zzlInsertAt(zl,NULL,ele,l->score[j]);
+                decrRefCount(ele);
+            }
+        }
+        dictRelease(zs->dict);
+        zbtFree(zs->zbt);
+        zfree(zs);
+        zobj->ptr = zl;
+        zobj->encoding = REDIS_ENCODING_LISTPACK;
     } else if (zobj->encoding == REDIS_ENCODING_SKIPLIST) {
-        unsigned char *zl = ziplistNew();
+        unsigned char *zl = lpNew();
 
-        if (encoding != REDIS_ENCODING_ZIPLIST)
+        if (encoding != REDIS_ENCODING_LISTPACK)
             redisPanic("Unknown target encoding");
 
         /* Approach similar to zslFree(), since we want to free the skiplist at
-         * the same time as creating the ziplist. */
+         * the same time as creating the listpack. */
         zs = zobj->ptr;
         dictRelease(zs->dict);
         node = zs->zsl->header->level[0].forward;
@@ -884,7 +935,7 @@ void zsetConvert(robj *zobj, int encoding) {
 
         zfree(zs);
         zobj->ptr = zl;
-        zobj->encoding = REDIS_ENCODING_ZIPLIST;
+        zobj->encoding = REDIS_ENCODING_LISTPACK;
     } else {
         redisPanic("Unknown sorted set encoding");
     }
@@ -927,7 +978,7 @@ void zaddGenericCommand(redisClient *c, int incr) {
         {
             zobj = createZsetObject();//skiplist
         } else {
-            zobj = createZsetZiplistObject();//ziplist
+            zobj = createZsetListpackObject();//listpack
         }
         dbAdd(c->db,key,zobj);
     } else {
@@ -940,12 +991,12 @@ void zaddGenericCommand(redisClient *c, int incr) {
     for (j = 0; j < elements; j++) {
         score = scores[j];
 
-        if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {//ziplist
+        if (zobj->encoding == REDIS_ENCODING_LISTPACK) {//listpack
             unsigned char *eptr;
 
-            /* Prefer non-encoded element when dealing with ziplists. */
+            /* Prefer non-encoded element when dealing with listpacks. */
             ele = c->argv[3+j*2];//ȡԪ
-            if ((eptr = zzlFind(zobj->ptr,ele,&curscore)) != NULL) {//,ziplist O(N)
+            if ((eptr = zzlFind(zobj->ptr,ele,&curscore)) != NULL) {//,listpack O(N)
                 if (incr) {//zincrby
                     score += curscore;
                     if (isnan(score)) {
@@ -965,14 +1016,15 @@ void zaddGenericCommand(redisClient *c, int incr) {
                 /* Optimize: check if the element is too large or the list
                  * becomes too long *before* executing zzlInsert. */
                 zobj->ptr = zzlInsert(zobj->ptr,ele,score);
-                if (zzlLength(zobj->ptr) > server.zset_max_ziplist_entries)//תziplist->skiplist
-                    zsetConvert(zobj,REDIS_ENCODING_SKIPLIST);
+                if (zzlLength(zobj->ptr) > server.zset_max_ziplist_entries)//תlistpack->skiplist
+                    zsetConvert(zobj,zsetIndexEncoding());
                 if (sdslen(ele->ptr) > server.zset_max_ziplist_value)
-                    zsetConvert(zobj,REDIS_ENCODING_SKIPLIST);
+                    zsetConvert(zobj,zsetIndexEncoding());
                 server.dirty++;
                 added++;
             }
-        } else if (zobj->encoding == REDIS_ENCODING_SKIPLIST) {
+        } else if (zobj->encoding == REDIS_ENCODING_SKIPLIST ||
+                   zobj->encoding == REDIS_ENCODING_BTREE) {
             zset *zs = zobj->ptr;
             zskiplistNode *znode;
             dictEntry *de;
@@ -982,7 +1034,7 @@ void zaddGenericCommand(redisClient *c, int incr) {
             de = dictFind(zs->dict,ele);//memberҵõֵentry, O(1)
             if (de != NULL) {
                 curobj = dictGetKey(de);
-                curscore = *(double*)dictGetVal(de);
+                curscore = zsetDictGetScore(zobj,de);
 
                 if (incr) {
                     score += curscore;
@@ -997,23 +1049,28 @@ void zaddGenericCommand(redisClient *c, int incr) {
                 /* Remove and re-insert when score changed. We can safely
                  * delete the key object from the skiplist, since the
                  * dictionary still has a reference to it. */
-                if (score != curscore) {
+                if (score != curscore &&
+                    zobj->encoding == REDIS_ENCODING_SKIPLIST) {
                     redisAssertWithInfo(c,curobj,zslDelete(zs->zsl,curscore,curobj));
                     znode = zslInsert(zs->zsl,score,curobj);
                     incrRefCount(curobj); /* Re-inserted in skiplist. */
                     dictGetVal(de) = &znode->score; /* Update score ptr. */
                     server.dirty++;
                     updated++;
+                } else if (score != curscore) {
+                    redisAssertWithInfo(c,curobj,zbtDelete(zs->zbt,curscore,curobj));
+                    zbtInsert(zs->zbt,score,curobj);
+                    incrRefCount(curobj); /* Re-inserted in the B+tree. */
+                    dictSetDoubleVal(de,score);
+                    server.dirty++;
+                    updated++;
                 }
             } else {
                 /**
                     skiplistdictʹùͬclientscore, memberrobjָ룬
                     ҪԽԼռ䣬ͬʱͷclientʱֱfree(c->argv)Ϳ
                 */
-                znode = zslInsert(zs->zsl,score,ele);//ӵskiplist
-                incrRefCount(ele); /* Inserted in skiplist. */
-                redisAssertWithInfo(c,NULL,dictAdd(zs->dict,ele,&znode->score) == DICT_OK);//ӵdict
-                incrRefCount(ele); /* Added to dictionary. */
+                zsetAddNew(zobj,score,ele);//ӵskiplistB+treeԼdict
                 server.dirty++;
                 added++;
             }
@@ -1054,7 +1111,7 @@ void zremCommand(redisClient *c) {
     if ((zobj = lookupKeyWriteOrReply(c,key,shared.czero)) == NULL ||
         checkType(c,zobj,REDIS_ZSET)) return;
 
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *eptr;
 
         for (j = 2; j < c->argc; j++) {
@@ -1067,7 +1124,8 @@ void zremCommand(redisClient *c) {
                 }
             }
         }
-    } else if (zobj->encoding == REDIS_ENCODING_SKIPLIST) {
+    } else if (zobj->encoding == REDIS_ENCODING_SKIPLIST ||
+               zobj->encoding == REDIS_ENCODING_BTREE) {
         zset *zs = zobj->ptr;
         dictEntry *de;
         double score;
@@ -1077,9 +1135,12 @@ void zremCommand(redisClient *c) {
             if (de != NULL) {
                 deleted++;
 
-                /* Delete from the skiplist */
-                score = *(double*)dictGetVal(de);
-                redisAssertWithInfo(c,c->argv[j],zslDelete(zs->zsl,score,c->argv[j]));
+                /* Delete from the skiplist or the B+tree */
+                score = zsetDictGetScore(zobj,de);
+                if (zobj->encoding == REDIS_ENCODING_SKIPLIST)
+                    redisAssertWithInfo(c,c->argv[j],zslDelete(zs->zsl,score,c->argv[j]));
+                else
+                    redisAssertWithInfo(c,c->argv[j],zbtDelete(zs->zbt,score,c->argv[j]));
 
                 /* Delete from the hash table */
                 dictDelete(zs->dict,c->argv[j]);
@@ -1121,15 +1182,19 @@ void zremrangebyscoreCommand(redisClient *c) {
     if ((zobj = lookupKeyWriteOrReply(c,key,shared.czero)) == NULL ||
         checkType(c,zobj,REDIS_ZSET)) return;
 
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         zobj->ptr = zzlDeleteRangeByScore(zobj->ptr,range,&deleted);
         if (zzlLength(zobj->ptr) == 0) {
             dbDelete(c->db,key);
             keyremoved = 1;
         }
-    } else if (zobj->encoding == REDIS_ENCODING_SKIPLIST) {
+    } else if (zobj->encoding == REDIS_ENCODING_SKIPLIST ||
+               zobj->encoding == REDIS_ENCODING_BTREE) {
         zset *zs = zobj->ptr;
-        deleted = zslDeleteRangeByScore(zs->zsl,range,zs->dict);
+        if (zobj->encoding == REDIS_ENCODING_SKIPLIST)
+            deleted = zslDeleteRangeByScore(zs->zsl,range,zs->dict);
+        else
+            deleted = zbtDeleteRangeByScore(zs->zbt,range,zs->dict);
         if (htNeedsResize(zs->dict)) dictResize(zs->dict);
         if (dictSize(zs->dict) == 0) {
             dbDelete(c->db,key);
@@ -1179,18 +1244,22 @@ void zremrangebyrankCommand(redisClient *c) {
     }
     if (end >= llen) end = llen-1;
 
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         /* Correct for 1-based rank. */
         zobj->ptr = zzlDeleteRangeByRank(zobj->ptr,start+1,end+1,&deleted);
         if (zzlLength(zobj->ptr) == 0) {
             dbDelete(c->db,key);
             keyremoved = 1;
         }
-    } else if (zobj->encoding == REDIS_ENCODING_SKIPLIST) {
+    } else if (zobj->encoding == REDIS_ENCODING_SKIPLIST ||
+               zobj->encoding == REDIS_ENCODING_BTREE) {
         zset *zs = zobj->ptr;
 
         /* Correct for 1-based rank. */
-        deleted = zslDeleteRangeByRank(zs->zsl,start+1,end+1,zs->dict);
+        if (zobj->encoding == REDIS_ENCODING_SKIPLIST)
+            deleted = zslDeleteRangeByRank(zs->zsl,start+1,end+1,zs->dict);
+        else
+            deleted = zbtDeleteRangeByRank(zs->zbt,start+1,end+1,zs->dict);
         if (htNeedsResize(zs->dict)) dictResize(zs->dict);
         if (dictSize(zs->dict) == 0) {
             dbDelete(c->db,key);
@@ -1240,6 +1309,11 @@ typedef struct {
                 zset *zs;
                 zskiplistNode *node;
             } sl;
+            struct {
+                zset *zs;
+                zbtreeLeaf *leaf;
+                unsigned int pos;
+            } bt;
         } zset;
     } iter;
 } zsetopsrc;
@@ -1287,16 +1361,20 @@ void zuiInitIterator(zsetopsrc *op) {
         }
     } else if (op->type == REDIS_ZSET) {
         iterzset *it = &op->iter.zset;
-        if (op->encoding == REDIS_ENCODING_ZIPLIST) {
+        if (op->encoding == REDIS_ENCODING_LISTPACK) {
             it->zl.zl = op->subject->ptr;
-            it->zl.eptr = ziplistIndex(it->zl.zl,0);
+            it->zl.eptr = lpSeek(it->zl.zl,0);
             if (it->zl.eptr != NULL) {
-                it->zl.sptr = ziplistNext(it->zl.zl,it->zl.eptr);
+                it->zl.sptr = lpNext(it->zl.zl,it->zl.eptr);
                 redisAssert(it->zl.sptr != NULL);
             }
         } else if (op->encoding == REDIS_ENCODING_SKIPLIST) {
             it->sl.zs = op->subject->ptr;
             it->sl.node = it->sl.zs->zsl->header->level[0].forward;
+        } else if (op->encoding == REDIS_ENCODING_BTREE) {
+            it->bt.zs = op->subject->ptr;
+            it->bt.leaf = it->bt.zs->zbt->head;
+            it->bt.pos = 0;
         } else {
             redisPanic("Unknown sorted set encoding");
         }
@@ -1320,9 +1398,10 @@ void zuiClearIterator(zsetopsrc *op) {
         }
     } else if (op->type == REDIS_ZSET) {
         iterzset *it = &op->iter.zset;
-        if (op->encoding == REDIS_ENCODING_ZIPLIST) {
+        if (op->encoding == REDIS_ENCODING_LISTPACK) {
             REDIS_NOTUSED(it); /* skip */
-        } else if (op->encoding == REDIS_ENCODING_SKIPLIST) {
+        } else if (op->encoding == REDIS_ENCODING_SKIPLIST ||
+                   op->encoding == REDIS_ENCODING_BTREE) {
             REDIS_NOTUSED(it); /* skip */
         } else {
             redisPanic("Unknown sorted set encoding");
@@ -1346,11 +1425,14 @@ int zuiLength(zsetopsrc *op) {
             redisPanic("Unknown set encoding");
         }
     } else if (op->type == REDIS_ZSET) {
-        if (op->encoding == REDIS_ENCODING_ZIPLIST) {
+        if (op->encoding == REDIS_ENCODING_LISTPACK) {
             return zzlLength(op->subject->ptr);
         } else if (op->encoding == REDIS_ENCODING_SKIPLIST) {
             zset *zs = op->subject->ptr;
             return zs->zsl->length;
+        } else if (op->encoding == REDIS_ENCODING_BTREE) {
+            zset *zs = op->subject->ptr;
+            return zs->zbt->length;
         } else {
             redisPanic("Unknown sorted set encoding");
         }
@@ -1396,11 +1478,11 @@ int zuiNext(zsetopsrc *op, zsetopval *val) {
         }
     } else if (op->type == REDIS_ZSET) {
         iterzset *it = &op->iter.zset;
-        if (op->encoding == REDIS_ENCODING_ZIPLIST) {
+        if (op->encoding == REDIS_ENCODING_LISTPACK) {
             /* No need to check both, but better be explicit. */
             if (it->zl.eptr == NULL || it->zl.sptr == NULL)
                 return 0;
-            redisAssert(ziplistGet(it->zl.eptr,&val->estr,&val->elen,&val->ell));
+            redisAssert(lpGet(it->zl.eptr,&val->estr,&val->elen,&val->ell));
             val->score = zzlGetScore(it->zl.sptr);
 
             /* Move to next element. */
@@ -1413,6 +1495,14 @@ int zuiNext(zsetopsrc *op, zsetopval *val) {
 
             /* Move to next element. */
             it->sl.node = it->sl.node->level[0].forward;
+        } else if (op->encoding == REDIS_ENCODING_BTREE) {
+            if (it->bt.leaf == NULL)
+                return 0;
+            val->ele = it->bt.leaf->obj[it->bt.pos];
+            val->score = it->bt.leaf->score[it->bt.pos];
+
+            /* Move to next element. */
+            zbtNext(&it->bt.leaf,&it->bt.pos);
         } else {
             redisPanic("Unknown sorted set encoding");
         }
@@ -1430,7 +1520,7 @@ int zuiLongLongFromValue(zsetopval *val) {
             if (val->ele->encoding == REDIS_ENCODING_INT) {
                 val->ell = (long)val->ele->ptr;
                 val->flags |= OPVAL_VALID_LL;
-            } else if (val->ele->encoding == REDIS_ENCODING_RAW) {
+            } else if (sdsEncodedObject(val->ele)) {
                 if (string2ll(val->ele->ptr,sdslen(val->ele->ptr),&val->ell))
                     val->flags |= OPVAL_VALID_LL;
             } else {
@@ -1465,7 +1555,7 @@ int zuiBufferFromValue(zsetopval *val) {
             if (val->ele->encoding == REDIS_ENCODING_INT) {
                 val->elen = ll2string((char*)val->_buf,sizeof(val->_buf),(long)val->ele->ptr);
                 val->estr = val->_buf;
-            } else if (val->ele->encoding == REDIS_ENCODING_RAW) {
+            } else if (sdsEncodedObject(val->ele)) {
                 val->elen = sdslen(val->ele->ptr);
                 val->estr = val->ele->ptr;
             } else {
@@ -1510,18 +1600,19 @@ int zuiFind(zsetopsrc *op, zsetopval *val, double *score) {
     } else if (op->type == REDIS_ZSET) {
         zuiObjectFromValue(val);
 
-        if (op->encoding == REDIS_ENCODING_ZIPLIST) {
+        if (op->encoding == REDIS_ENCODING_LISTPACK) {
             if (zzlFind(op->subject->ptr,val->ele,score) != NULL) {
                 /* Score is already set by zzlFind. */
                 return 1;
             } else {
                 return 0;
             }
-        } else if (op->encoding == REDIS_ENCODING_SKIPLIST) {
+        } else if (op->encoding == REDIS_ENCODING_SKIPLIST ||
+                   op->encoding == REDIS_ENCODING_BTREE) {
             zset *zs = op->subject->ptr;
             dictEntry *de;
             if ((de = dictFind(zs->dict,val->ele)) != NULL) {
-                *score = *(double*)dictGetVal(de);
+                *score = zsetDictGetScore(op->subject,de);
                 return 1;
             } else {
                 return 0;
@@ -1570,7 +1661,6 @@ void zunionInterGenericCommand(redisClient *c, robj *dstkey, int op) {
     unsigned int maxelelen = 0;
     robj *dstobj;
     zset *dstzset;
-    zskiplistNode *znode;
     int touched = 0;
 
     /* expect setnum input keys to be given */
@@ -1685,12 +1775,9 @@ void zunionInterGenericCommand(redisClient *c, robj *dstkey, int op) {
                 /* Only continue when present in every input. */
                 if (j == setnum) {
                     tmp = zuiObjectFromValue(&zval);
-                    znode = zslInsert(dstzset->zsl,score,tmp);
-                    incrRefCount(tmp); /* added to skiplist */
-                    dictAdd(dstzset->dict,tmp,&znode->score);
-                    incrRefCount(tmp); /* added to dictionary */
+                    zsetAddNew(dstobj,score,tmp);
 
-                    if (tmp->encoding == REDIS_ENCODING_RAW)
+                    if (sdsEncodedObject(tmp))
                         if (sdslen(tmp->ptr) > maxelelen)
                             maxelelen = sdslen(tmp->ptr);
                 }
@@ -1731,12 +1818,9 @@ void zunionInterGenericCommand(redisClient *c, robj *dstkey, int op) {
                 }
 
                 tmp = zuiObjectFromValue(&zval);
-                znode = zslInsert(dstzset->zsl,score,tmp);
-                incrRefCount(zval.ele); /* added to skiplist */
-                dictAdd(dstzset->dict,tmp,&znode->score);
-                incrRefCount(zval.ele); /* added to dictionary */
+                zsetAddNew(dstobj,score,tmp);
 
-                if (tmp->encoding == REDIS_ENCODING_RAW)
+                if (sdsEncodedObject(tmp))
                     if (sdslen(tmp->ptr) > maxelelen)
                         maxelelen = sdslen(tmp->ptr);
             }
@@ -1751,11 +1835,11 @@ void zunionInterGenericCommand(redisClient *c, robj *dstkey, int op) {
         touched = 1;
         server.dirty++;
     }
-    if (dstzset->zsl->length) {
-        /* Convert to ziplist when in limits. */
-        if (dstzset->zsl->length <= server.zset_max_ziplist_entries &&
+    if (zsetLength(dstobj)) {
+        /* Convert to listpack when in limits. */
+        if (zsetLength(dstobj) <= server.zset_max_ziplist_entries &&
             maxelelen <= server.zset_max_ziplist_value)
-                zsetConvert(dstobj,REDIS_ENCODING_ZIPLIST);
+                zsetConvert(dstobj,REDIS_ENCODING_LISTPACK);
 
         dbAdd(c->db,dstkey,dstobj);
         addReplyLongLong(c,zsetLength(dstobj));
@@ -1835,7 +1919,7 @@ void zrangeGenericCommand(redisClient *c, int reverse) {
     /* Return the result in form of a multi-bulk reply */
     addReplyMultiBulkLen(c, withscores ? (rangelen*2) : rangelen);
 
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
         unsigned char *vstr;
@@ -1843,16 +1927,16 @@ void zrangeGenericCommand(redisClient *c, int reverse) {
         long long vlong;
 
         if (reverse)
-            eptr = ziplistIndex(zl,-2-(2*start));
+            eptr = lpSeek(zl,-2-(2*start));
         else
-            eptr = ziplistIndex(zl,2*start);
+            eptr = lpSeek(zl,2*start);
 
         redisAssertWithInfo(c,zobj,eptr != NULL);
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
 
         while (rangelen--) {
             redisAssertWithInfo(c,zobj,eptr != NULL && sptr != NULL);
-            redisAssertWithInfo(c,zobj,ziplistGet(eptr,&vstr,&vlen,&vlong));
+            redisAssertWithInfo(c,zobj,lpGet(eptr,&vstr,&vlen,&vlong));
             if (vstr == NULL)
                 addReplyBulkLongLong(c,vlong);
             else
@@ -1892,6 +1976,26 @@ void zrangeGenericCommand(redisClient *c, int reverse) {
                 addReplyDouble(c,ln->score);
             ln = reverse ? ln->backward : ln->level[0].forward;
         }
+    } else if (zobj->encoding == REDIS_ENCODING_BTREE) {
+        zset *zs = zobj->ptr;
+        zbtreeLeaf *l;
+        unsigned int pos;
+
+        if (reverse)
+            l = zbtGetElementByRank(zs->zbt,llen-start,&pos);
+        else
+            l = zbtGetElementByRank(zs->zbt,start+1,&pos);
+
+        while(rangelen--) {
+            redisAssertWithInfo(c,zobj,l != NULL);
+            addReplyBulk(c,l->obj[pos]);
+            if (withscores)
+                addReplyDouble(c,l->score[pos]);
+            if (reverse)
+                zbtPrev(&l,&pos);
+            else
+                zbtNext(&l,&pos);
+        }
     } else {
         redisPanic("Unknown sorted set encoding");
     }
@@ -1957,7 +2061,7 @@ void genericZrangebyscoreCommand(redisClient *c, int reverse) {
     if ((zobj = lookupKeyReadOrReply(c,key,shared.emptymultibulk)) == NULL ||
         checkType(c,zobj,REDIS_ZSET)) return;
 
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
         unsigned char *vstr;
@@ -1980,7 +2084,7 @@ void genericZrangebyscoreCommand(redisClient *c, int reverse) {
 
         /* Get score pointer for the first element. */
         redisAssertWithInfo(c,zobj,eptr != NULL);
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
 
         /* We don't know in advance how many matching elements there are in the
          * list, so we push this object that will represent the multi-bulk
@@ -2007,8 +2111,8 @@ void genericZrangebyscoreCommand(redisClient *c, int reverse) {
                 if (!zslValueLteMax(score,&range)) break;
             }
 
-            /* We know the element exists, so ziplistGet should always succeed */
-            redisAssertWithInfo(c,zobj,ziplistGet(eptr,&vstr,&vlen,&vlong));
+            /* We know the element exists, so lpGet should always succeed */
+            redisAssertWithInfo(c,zobj,lpGet(eptr,&vstr,&vlen,&vlong));
 
             rangelen++;
             if (vstr == NULL) {
@@ -2083,6 +2187,60 @@ void genericZrangebyscoreCommand(redisClient *c, int reverse) {
                 ln = ln->level[0].forward;
             }
         }
+    } else if (zobj->encoding == REDIS_ENCODING_BTREE) {
+        zset *zs = zobj->ptr;
+        zbtreeLeaf *l;
+        unsigned int pos;
+
+        /* If reversed, get the last element in range as starting point. */
+        if (reverse) {
+            l = zbtLastInRange(zs->zbt,range,&pos);
+        } else {
+            l = zbtFirstInRange(zs->zbt,range,&pos);
+        }
+
+        /* No "first" element in the specified interval. */
+        if (l == NULL) {
+            addReply(c, shared.emptymultibulk);
+            return;
+        }
+
+        replylen = addDeferredMultiBulkLength(c);
+
+        /* If there is an offset, just traverse the number of elements without
+         * checking the score because that is done in the next loop. */
+        while (l && offset--) {
+            if (reverse) {
+                zbtPrev(&l,&pos);
+            } else {
+                zbtNext(&l,&pos);
+            }
+        }
+
+        while (l && limit--) {
+            double score = l->score[pos];
+
+            /* Abort when the element is no longer in range. */
+            if (reverse) {
+                if (!zslValueGteMin(score,&range)) break;
+            } else {
+                if (!zslValueLteMax(score,&range)) break;
+            }
+
+            rangelen++;
+            addReplyBulk(c,l->obj[pos]);
+
+            if (withscores) {
+                addReplyDouble(c,score);
+            }
+
+            /* Move to next element */
+            if (reverse) {
+                zbtPrev(&l,&pos);
+            } else {
+                zbtNext(&l,&pos);
+            }
+        }
     } else {
         redisPanic("Unknown sorted set encoding");
     }
@@ -2123,7 +2281,7 @@ void zcountCommand(redisClient *c) {
     if ((zobj = lookupKeyReadOrReply(c, key, shared.czero)) == NULL ||
         checkType(c, zobj, REDIS_ZSET)) return;
 
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
         double score;
@@ -2138,7 +2296,7 @@ void zcountCommand(redisClient *c) {
         }
 
         /* First element is in range */
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         score = zzlGetScore(sptr);
         redisAssertWithInfo(c,zobj,zslValueLteMax(score,&range));
 
@@ -2177,6 +2335,20 @@ void zcountCommand(redisClient *c) {
                 count -= (zsl->length - rank);
             }
         }
+    } else if (zobj->encoding == REDIS_ENCODING_BTREE) {
+        zbtree *zbt = ((zset*)zobj->ptr)->zbt;
+        zbtreeLeaf *first, *last;
+        unsigned int fpos, lpos;
+
+        /* The count is the difference of the ranks of the first and the
+         * last element in range. */
+        first = zbtFirstInRange(zbt, range, &fpos);
+        if (first != NULL) {
+            last = zbtLastInRange(zbt, range, &lpos);
+            redisAssertWithInfo(c,zobj,last != NULL);
+            count = zbtGetRank(zbt, last->score[lpos], last->obj[lpos]) -
+                    zbtGetRank(zbt, first->score[fpos], first->obj[fpos]) + 1;
+        }
     } else {
         redisPanic("Unknown sorted set encoding");
     }
@@ -2204,19 +2376,20 @@ void zscoreCommand(redisClient *c) {
     if ((zobj = lookupKeyReadOrReply(c,key,shared.nullbulk)) == NULL ||
         checkType(c,zobj,REDIS_ZSET)) return;
 
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         if (zzlFind(zobj->ptr,c->argv[2],&score) != NULL)
             addReplyDouble(c,score);
         else
             addReply(c,shared.nullbulk);
-    } else if (zobj->encoding == REDIS_ENCODING_SKIPLIST) {
+    } else if (zobj->encoding == REDIS_ENCODING_SKIPLIST ||
+               zobj->encoding == REDIS_ENCODING_BTREE) {
         zset *zs = zobj->ptr;
         dictEntry *de;
 
         c->argv[2] = tryObjectEncoding(c->argv[2]);
         de = dictFind(zs->dict,c->argv[2]);
         if (de != NULL) {
-            score = *(double*)dictGetVal(de);
+            score = zsetDictGetScore(zobj,de);
             addReplyDouble(c,score);
         } else {
             addReply(c,shared.nullbulk);
@@ -2237,19 +2410,19 @@ void zrankGenericCommand(redisClient *c, int reverse) {
         checkType(c,zobj,REDIS_ZSET)) return;
     llen = zsetLength(zobj);
 
-    redisAssertWithInfo(c,ele,ele->encoding == REDIS_ENCODING_RAW);
-    if (zobj->encoding == REDIS_ENCODING_ZIPLIST) {
+    redisAssertWithInfo(c,ele,sdsEncodedObject(ele));
+    if (zobj->encoding == REDIS_ENCODING_LISTPACK) {
         unsigned char *zl = zobj->ptr;
         unsigned char *eptr, *sptr;
 
-        eptr = ziplistIndex(zl,0);
+        eptr = lpSeek(zl,0);
         redisAssertWithInfo(c,zobj,eptr != NULL);
-        sptr = ziplistNext(zl,eptr);
+        sptr = lpNext(zl,eptr);
         redisAssertWithInfo(c,zobj,sptr != NULL);
 
         rank = 1;
         while(eptr != NULL) {
-            if (ziplistCompare(eptr,ele->ptr,sdslen(ele->ptr)))
+            if (lpCompare(eptr,ele->ptr,sdslen(ele->ptr)))
                 break;
             rank++;
             zzlNext(zl,&eptr,&sptr);
@@ -2263,17 +2436,20 @@ void zrankGenericCommand(redisClient *c, int reverse) {
         } else {
             addReply(c,shared.nullbulk);
         }
-    } else if (zobj->encoding == REDIS_ENCODING_SKIPLIST) {
+    } else if (zobj->encoding == REDIS_ENCODING_SKIPLIST ||
+               zobj->encoding == REDIS_ENCODING_BTREE) {
         zset *zs = zobj->ptr;
-        zskiplist *zsl = zs->zsl;
         dictEntry *de;
         double score;
 
         ele = c->argv[2] = tryObjectEncoding(c->argv[2]);
         de = dictFind(zs->dict,ele);
         if (de != NULL) {
-            score = *(double*)dictGetVal(de);
-            rank = zslGetRank(zsl,score,ele);
+            score = zsetDictGetScore(zobj,de);
+            if (zobj->encoding == REDIS_ENCODING_SKIPLIST)
+                rank = zslGetRank(zs->zsl,score,ele);
+            else
+                rank = zbtGetRank(zs->zbt,score,ele);
             redisAssertWithInfo(c,ele,rank); /* Existing elements always have a rank. */
             if (reverse)
                 addReplyLongLong(c,llen-rank);
@@ -0,0 +1,660 @@
+/*
+ * Copyright (c) 2013, Salvatore Sanfilippo <antirez at gmail dot com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *   * Redistributions of source code must retain the above copyright notice,
+ *     this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of Redis nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without
+ *     specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "redis.h"
+
+/* B+tree ordered index of sorted sets.
+ *
+ * With zset-btree-index enabled, sorted sets too big for a listpack use this
+ * B+tree instead of the skiplist as ordered index. Looking up a skiplist
+ * costs a cache miss for every node visited, since every node is a separate
+ * allocation, while the B+tree stores the (score, element) pairs ordered in
+ * wide leaves, the scores and the elements in two separated arrays, so that
+ * a binary search in a leaf only touches a few cache lines of scores. The
+ * leaves are linked in both directions to walk ranges.
+ *
+ * Inner nodes store for every child the number of elements of its subtree,
+ * the "span", in order to compute ranks and to seek by rank in O(log(N)),
+ * and a separator, a key not greater than the keys of the child and
+ * greater than the keys of the previous child. The separator of the first
+ * child is unused. Separators are copies of keys that were in the tree when
+ * they were created, and are not updated when that key is deleted since
+ * they still separate the two children: so they take a reference to the
+ * element object.
+ *
+ * Every node but the root has at least a quarter of its capacity filled:
+ * a node falling under this limit after a deletion is merged with a
+ * sibling, or takes some of its entries if the two don't fit in a node.
+ * The root is collapsed when it has a single child.
+ *
+ * Like the skiplist, the tree only provides ordered access: the dict of the
+ * zset maps elements to scores, storing the score in the dict entry since
+ * the elements move inside and across the leaves. */
+
+#define ZBTREE_LEAF_MIN (ZBTREE_LEAF_SIZE/4)
+#define ZBTREE_NODE_MIN (ZBTREE_NODE_SIZE/4)
+#define ZBTREE_MAX_HEIGHT 32
+
+/* Compare the key (s1,o1) with (s2,o2), with the ordering of sorted sets:
+ * by score, then lexicographically by element. */
+static int zbtCompare(double s1, robj *o1, double s2, robj *o2) {
+    if (s1 < s2) return -1;
+    if (s1 > s2) return 1;
+    return compareStringObjects(o1,o2);
+}
+
+static zbtreeLeaf *zbtCreateLeaf(void) {
+    zbtreeLeaf *l = zmalloc(sizeof(*l));
+
+    l->prev = l->next = NULL;
+    l->count = 0;
+    return l;
+}
+
+static zbtreeNode *zbtCreateNode(void) {
+    zbtreeNode *n = zmalloc(sizeof(*n));
+
+    n->count = 0;
+    n->obj[0] = NULL;
+    return n;
+}
+
+zbtree *zbtCreate(void) {
+    zbtree *zbt = zmalloc(sizeof(*zbt));
+
+    zbt->root = NULL;
+    zbt->head = zbt->tail = NULL;
+    zbt->length = 0;
+    zbt->height = 0;
+    return zbt;
+}
+
+static void zbtFreeSubtree(void *x, int height) {
+    unsigned int j;
+
+    if (height == 0) {
+        zbtreeLeaf *l = x;
+
+        for (j = 0; j < l->count; j++) decrRefCount(l->obj[j]);
+        zfree(l);
+    } else {
+        zbtreeNode *n = x;
+
+        for (j = 0; j < n->count; j++) {
+            if (j) decrRefCount(n->obj[j]);
+            zbtFreeSubtree(n->child[j],height-1);
+        }
+        zfree(n);
+    }
+}
+
+void zbtFree(zbtree *zbt) {
+    if (zbt->root) zbtFreeSubtree(zbt->root,zbt->height);
+    zfree(zbt);
+}
+
+/* Move 'count' entries of the leaf 'src' starting at 'from' to the leaf
+ * 'dst' starting at 'to'. The two ranges may overlap. */
+static void zbtLeafMove(zbtreeLeaf *dst, unsigned int to, zbtreeLeaf *src,
+                        unsigned int from, unsigned int count)
+{
+    memmove(dst->score+to,src->score+from,count*sizeof(double));
+    memmove(dst->obj+to,src->obj+from,count*sizeof(robj*));
+}
+
+/* Like zbtLeafMove() for the children of inner nodes, moving their
+ * separators and spans as well. */
+static void zbtNodeMove(zbtreeNode *dst, unsigned int to, zbtreeNode *src,
+                        unsigned int from, unsigned int count)
+{
+    memmove(dst->score+to,src->score+from,count*sizeof(double));
+    memmove(dst->obj+to,src->obj+from,count*sizeof(robj*));
+    memmove(dst->span+to,src->span+from,count*sizeof(unsigned long));
+    memmove(dst->child+to,src->child+from,count*sizeof(void*));
+}
+
+/* Return the number of elements under the inner node 'n'. */
+static unsigned long zbtNodeLength(zbtreeNode *n) {
+    unsigned long len = 0;
+    unsigned int j;
+
+    for (j = 0; j < n->count; j++) len += n->span[j];
+    return len;
+}
+
+/* Return the position of the first entry of the leaf not smaller than the
+ * key, or the number of entries if all the entries are smaller. */
+static unsigned int zbtLeafSearch(zbtreeLeaf *l, double score, robj *obj) {
+    unsigned int lo = 0, hi = l->count, mid;
+
+    while (lo < hi) {
+        mid = (lo+hi)/2;
+        if (zbtCompare(l->score[mid],l->obj[mid],score,obj) < 0)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Return the child of the inner node that may contain the key: the last
+ * one with a separator not greater than the key. */
+static unsigned int zbtNodeSearch(zbtreeNode *n, double score, robj *obj) {
+    unsigned int lo = 1, hi = n->count, mid;
+
+    while (lo < hi) {
+        mid = (lo+hi)/2;
+        if (zbtCompare(n->score[mid],n->obj[mid],score,obj) <= 0)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    return lo-1;
+}
+
+/* Insert a new element in the tree. The caller must make sure the element
+ * is not already in the tree. Like zslInsert(), the tree takes the
+ * reference of the caller to 'obj'. */
+void zbtInsert(zbtree *zbt, double score, robj *obj) {
+    zbtreeNode *path[ZBTREE_MAX_HEIGHT], *n, *nn;
+    unsigned int idx[ZBTREE_MAX_HEIGHT], pos, split, j;
+    zbtreeLeaf *l, *nl;
+    unsigned long lspan, rspan;
+    double sepscore;
+    robj *sepobj;
+    void *x, *newchild;
+    int level, append;
+
+    if (zbt->root == NULL)
+        zbt->root = zbt->head = zbt->tail = zbtCreateLeaf();
+
+    /* Descend to the leaf, counting the new element in the spans of the
+     * children we traverse. path[level] is the parent of the node 'level'
+     * levels above the leaves, so path[0] is the parent of the leaf. */
+    x = zbt->root;
+    for (level = zbt->height-1; level >= 0; level--) {
+        n = x;
+        j = zbtNodeSearch(n,score,obj);
+        n->span[j]++;
+        path[level] = n;
+        idx[level] = j;
+        x = n->child[j];
+    }
+    l = x;
+    pos = zbtLeafSearch(l,score,obj);
+    zbt->length++;
+
+    if (l->count < ZBTREE_LEAF_SIZE) {
+        zbtLeafMove(l,pos+1,l,pos,l->count-pos);
+        l->score[pos] = score;
+        l->obj[pos] = obj;
+        l->count++;
+        return;
+    }
+
+    /* The leaf is full: move the upper half of it to a new leaf. Elements
+     * appended to the tail of the tree are often followed by more, as
+     * when loading an RDB file, so in this case the new leaf only gets
+     * the minimum number of entries, and the nodes stay mostly full. */
+    append = (l == zbt->tail && pos == l->count);
+    split = append ? ZBTREE_LEAF_SIZE-ZBTREE_LEAF_MIN+1 : ZBTREE_LEAF_SIZE/2;
+    nl = zbtCreateLeaf();
+    zbtLeafMove(nl,0,l,split,l->count-split);
+    nl->count = l->count-split;
+    l->count = split;
+    nl->prev = l;
+    nl->next = l->next;
+    if (l->next) l->next->prev = nl; else zbt->tail = nl;
+    l->next = nl;
+
+    if (pos > split) {
+        l = nl;
+        pos -= split;
+    }
+    zbtLeafMove(l,pos+1,l,pos,l->count-pos);
+    l->score[pos] = score;
+    l->obj[pos] = obj;
+    l->count++;
+
+    /* Add the new leaf to the parent, splitting the inner nodes on the way
+     * up while they are full. */
+    lspan = nl->prev->count;
+    rspan = nl->count;
+    sepscore = nl->score[0];
+    sepobj = nl->obj[0];
+    incrRefCount(sepobj);
+    newchild = nl;
+    for (level = 0; level < zbt->height; level++) {
+        n = path[level];
+        j = idx[level]+1;
+        n->span[j-1] = lspan;
+        if (n->count < ZBTREE_NODE_SIZE) {
+            zbtNodeMove(n,j+1,n,j,n->count-j);
+            n->score[j] = sepscore;
+            n->obj[j] = sepobj;
+            n->span[j] = rspan;
+            n->child[j] = newchild;
+            n->count++;
+            return;
+        }
+
+        /* Split the node: the separator of the first child of the new node
+         * moves up to the parent. */
+        split = append ? ZBTREE_NODE_SIZE-ZBTREE_NODE_MIN+1 : ZBTREE_NODE_SIZE/2;
+        nn = zbtCreateNode();
+        zbtNodeMove(nn,0,n,split,n->count-split);
+        nn->count = n->count-split;
+        n->count = split;
+        if (j > split) {
+            n = nn;
+            j -= split;
+        }
+        zbtNodeMove(n,j+1,n,j,n->count-j);
+        n->score[j] = sepscore;
+        n->obj[j] = sepobj;
+        n->span[j] = rspan;
+        n->child[j] = newchild;
+        n->count++;
+
+        n = path[level];
+        sepscore = nn->score[0];
+        sepobj = nn->obj[0];
+        nn->obj[0] = NULL;
+        lspan = zbtNodeLength(n);
+        rspan = zbtNodeLength(nn);
+        newchild = nn;
+    }
+
+    /* The root was split as well: add a level to the tree. */
+    redisAssert(zbt->height < ZBTREE_MAX_HEIGHT);
+    n = zbtCreateNode();
+    n->count = 2;
+    n->child[0] = zbt->root;
+    n->span[0] = lspan;
+    n->score[1] = sepscore;
+    n->obj[1] = sepobj;
+    n->span[1] = rspan;
+    n->child[1] = newchild;
+    zbt->root = n;
+    zbt->height++;
+}
+
+/* Merge the leaves 'r-1' and 'r' of the inner node 'p', or move entries
+ * between them so that they hold the same number of entries if they don't
+ * fit in a single leaf. */
+static void zbtRebalanceLeaves(zbtree *zbt, zbtreeNode *p, unsigned int r) {
+    zbtreeLeaf *left = p->child[r-1], *right = p->child[r];
+    unsigned int total = left->count+right->count, move;
+
+    if (total <= ZBTREE_LEAF_SIZE) {
+        zbtLeafMove(left,left->count,right,0,right->count);
+        left->count = total;
+        left->next = right->next;
+        if (right->next) right->next->prev = left; else zbt->tail = left;
+        p->span[r-1] += p->span[r];
+        decrRefCount(p->obj[r]);
+        zbtNodeMove(p,r,p,r+1,p->count-r-1);
+        p->count--;
+        zfree(right);
+        return;
+    }
+
+    if (left->count < total/2) {
+        move = total/2-left->count;
+        zbtLeafMove(left,left->count,right,0,move);
+        zbtLeafMove(right,0,right,move,right->count-move);
+        left->count += move;
+        right->count -= move;
+    } else {
+        move = left->count-total/2;
+        zbtLeafMove(right,move,right,0,right->count);
+        zbtLeafMove(right,0,left,left->count-move,move);
+        left->count -= move;
+        right->count += move;
+    }
+    p->span[r-1] = left->count;
+    p->span[r] = right->count;
+    decrRefCount(p->obj[r]);
+    p->score[r] = right->score[0];
+    p->obj[r] = right->obj[0];
+    incrRefCount(p->obj[r]);
+}
+
+/* Like zbtRebalanceLeaves() for the inner nodes 'r-1' and 'r' of 'p'. The
+ * separator of the right node in 'p' moves down as the separator of its
+ * first child, and the separator of the first child of the right node
+ * moves up if the nodes are not merged. */
+static void zbtRebalanceNodes(zbtreeNode *p, unsigned int r) {
+    zbtreeNode *left = p->child[r-1], *right = p->child[r];
+    unsigned int total = left->count+right->count, move;
+
+    right->score[0] = p->score[r];
+    right->obj[0] = p->obj[r];
+
+    if (total <= ZBTREE_NODE_SIZE) {
+        zbtNodeMove(left,left->count,right,0,right->count);
+        left->count = total;
+        p->span[r-1] += p->span[r];
+        zbtNodeMove(p,r,p,r+1,p->count-r-1);
+        p->count--;
+        zfree(right);
+        return;
+    }
+
+    if (left->count < total/2) {
+        move = total/2-left->count;
+        zbtNodeMove(left,left->count,right,0,move);
+        zbtNodeMove(right,0,right,move,right->count-move);
+        left->count += move;
+        right->count -= move;
+    } else {
+        move = left->count-total/2;
+        zbtNodeMove(right,move,right,0,right->count);
+        zbtNodeMove(right,0,left,left->count-move,move);
+        left->count -= move;
+        right->count += move;
+    }
+    p->score[r] = right->score[0];
+    p->obj[r] = right->obj[0];
+    right->obj[0] = NULL;
+    p->span[r-1] = zbtNodeLength(left);
+    p->span[r] = zbtNodeLength(right);
+}
+
+/* Delete the element with matching score and object from the tree,
+ * releasing the reference of the tree to the element. Return 1 if the
+ * element was found and deleted, 0 otherwise. */
+int zbtDelete(zbtree *zbt, double score, robj *obj) {
+    zbtreeNode *path[ZBTREE_MAX_HEIGHT], *n;
+    unsigned int idx[ZBTREE_MAX_HEIGHT], pos, j;
+    zbtreeLeaf *l;
+    void *x;
+    int level;
+
+    if (zbt->root == NULL) return 0;
+    x = zbt->root;
+    for (level = zbt->height-1; level >= 0; level--) {
+        n = x;
+        j = zbtNodeSearch(n,score,obj);
+        path[level] = n;
+        idx[level] = j;
+        x = n->child[j];
+    }
+    l = x;
+    pos = zbtLeafSearch(l,score,obj);
+    if (pos == l->count || l->score[pos] != score ||
+        !equalStringObjects(l->obj[pos],obj)) return 0;
+
+    decrRefCount(l->obj[pos]);
+    zbtLeafMove(l,pos,l,pos+1,l->count-pos-1);
+    l->count--;
+    for (level = 0; level < zbt->height; level++)
+        path[level]->span[idx[level]]--;
+    zbt->length--;
+
+    /* Fix the nodes that fell under the minimum size, from the leaf up.
+     * The parent of a node to fix always has two children at least: it
+     * is either the root, or a node not yet touched by the deletion. */
+    for (level = 0; level < zbt->height; level++) {
+        unsigned int count;
+
+        n = path[level];
+        j = idx[level];
+        if (level == 0) {
+            count = ((zbtreeLeaf*)n->child[j])->count;
+            if (count >= ZBTREE_LEAF_MIN) break;
+        } else {
+            count = ((zbtreeNode*)n->child[j])->count;
+            if (count >= ZBTREE_NODE_MIN) break;
+        }
+        if (j+1 < n->count) j++;
+        if (level == 0)
+            zbtRebalanceLeaves(zbt,n,j);
+        else
+            zbtRebalanceNodes(n,j);
+    }
+
+    /* Collapse the root while it has a single child. */
+    while (zbt->height > 0 && ((zbtreeNode*)zbt->root)->count == 1) {
+        n = zbt->root;
+        zbt->root = n->child[0];
+        zbt->height--;
+        zfree(n);
+    }
+    if (zbt->length == 0) {
+        zfree(zbt->root);
+        zbt->root = zbt->head = zbt->tail = NULL;
+    }
+    return 1;
+}
+
+/* Find the rank of the element with matching score and object. Like
+ * zslGetRank() the rank is 1-based, and 0 is returned when the element
+ * is not found. */
+unsigned long zbtGetRank(zbtree *zbt, double score, robj *obj) {
+    unsigned long rank = 0;
+    unsigned int pos, j, i;
+    zbtreeLeaf *l;
+    void *x;
+    int level;
+
+    if ((x = zbt->root) == NULL) return 0;
+    for (level = zbt->height; level > 0; level--) {
+        zbtreeNode *n = x;
+
+        j = zbtNodeSearch(n,score,obj);
+        for (i = 0; i < j; i++) rank += n->span[i];
+        x = n->child[j];
+    }
+    l = x;
+    pos = zbtLeafSearch(l,score,obj);
+    if (pos == l->count || l->score[pos] != score ||
+        !equalStringObjects(l->obj[pos],obj)) return 0;
+    return rank+pos+1;
+}
+
+/* Find an element by its 1-based rank, returning the leaf holding it and
+ * setting '*pos' to its position in the leaf. Returns NULL if the rank is
+ * out of range. */
+zbtreeLeaf *zbtGetElementByRank(zbtree *zbt, unsigned long rank, unsigned int *pos) {
+    unsigned int j;
+    void *x;
+    int level;
+
+    if (rank == 0 || rank > zbt->length) return NULL;
+    rank--;
+    x = zbt->root;
+    for (level = zbt->height; level > 0; level--) {
+        zbtreeNode *n = x;
+
+        for (j = 0; rank >= n->span[j]; j++) rank -= n->span[j];
+        x = n->child[j];
+    }
+    *pos = rank;
+    return x;
+}
+
+/* Returns if there is a part of the tree in range. */
+static int zbtIsInRange(zbtree *zbt, zrangespec *range) {
+    /* Test for ranges that will always be empty. */
+    if (range->min > range->max ||
+            (range->min == range->max && (range->minex || range->maxex)))
+        return 0;
+    if (zbt->length == 0) return 0;
+    if (!zslValueGteMin(zbt->tail->score[zbt->tail->count-1],range))
+        return 0;
+    if (!zslValueLteMax(zbt->head->score[0],range))
+        return 0;
+    return 1;
+}
+
+/* Find the first element in the specified range, returning its leaf and
+ * setting '*pos' to its position in the leaf, or NULL when there is no
+ * element in range. */
+zbtreeLeaf *zbtFirstInRange(zbtree *zbt, zrangespec range, unsigned int *pos) {
+    unsigned int lo, hi, mid;
+    zbtreeLeaf *l;
+    void *x;
+    int level;
+
+    if (!zbtIsInRange(zbt,&range)) return NULL;
+
+    /* Go to the last child whose separator is below the range: the
+     * previous children only hold smaller keys. */
+    x = zbt->root;
+    for (level = zbt->height; level > 0; level--) {
+        zbtreeNode *n = x;
+
+        lo = 1; hi = n->count;
+        while (lo < hi) {
+            mid = (lo+hi)/2;
+            if (!zslValueGteMin(n->score[mid],&range)) lo = mid+1; else hi = mid;
+        }
+        x = n->child[lo-1];
+    }
+    l = x;
+    lo = 0; hi = l->count;
+    while (lo < hi) {
+        mid = (lo+hi)/2;
+        if (!zslValueGteMin(l->score[mid],&range)) lo = mid+1; else hi = mid;
+    }
+
+    /* All the keys of the leaf are below the range: since the last key of
+     * the tree is not, the first key of the next leaf is the one. */
+    if (lo == l->count) {
+        l = l->next;
+        lo = 0;
+        redisAssert(l != NULL);
+    }
+    if (!zslValueLteMax(l->score[lo],&range)) return NULL;
+    *pos = lo;
+    return l;
+}
+
+/* Find the last element in the specified range, like zbtFirstInRange(). */
+zbtreeLeaf *zbtLastInRange(zbtree *zbt, zrangespec range, unsigned int *pos) {
+    unsigned int lo, hi, mid;
+    zbtreeLeaf *l;
+    void *x;
+    int level;
+
+    if (!zbtIsInRange(zbt,&range)) return NULL;
+
+    /* Go to the last child whose separator is not above the range: the
+     * next children only hold greater keys. */
+    x = zbt->root;
+    for (level = zbt->height; level > 0; level--) {
+        zbtreeNode *n = x;
+
+        lo = 1; hi = n->count;
+        while (lo < hi) {
+            mid = (lo+hi)/2;
+            if (zslValueLteMax(n->score[mid],&range)) lo = mid+1; else hi = mid;
+        }
+        x = n->child[lo-1];
+    }
+    l = x;
+    lo = 0; hi = l->count;
+    while (lo < hi) {
+        mid = (lo+hi)/2;
+        if (zslValueLteMax(l->score[mid],&range)) lo = mid+1; else hi = mid;
+    }
+
+    /* All the keys of the leaf are above the range: the last key of the
+     * previous leaf is smaller than the separator that led us here, so it
+     * is the one. */
+    if (lo == 0) {
+        l = l->prev;
+        redisAssert(l != NULL);
+        lo = l->count;
+    }
+    lo--;
+    if (!zslValueGteMin(l->score[lo],&range)) return NULL;
+    *pos = lo;
+    return l;
+}
+
+/* Delete all the elements with score in range, from the tree and from the
+ * dict of the sorted set. Returns the number of deleted elements. */
+unsigned long zbtDeleteRangeByScore(zbtree *zbt, zrangespec range, dict *dict) {
+    unsigned long removed = 0;
+    unsigned int pos;
+    zbtreeLeaf *l;
+
+    while ((l = zbtFirstInRange(zbt,range,&pos)) != NULL) {
+        double score = l->score[pos];
+        robj *obj = l->obj[pos];
+
+        dictDelete(dict,obj);
+        zbtDelete(zbt,score,obj);
+        removed++;
+    }
+    return removed;
+}
+
+/* Delete all the elements with rank between start and end, 1-based and
+ * inclusive, from the tree and from the dict of the sorted set. Returns
+ * the number of deleted elements. */
+unsigned long zbtDeleteRangeByRank(zbtree *zbt, unsigned int start, unsigned int end, dict *dict) {
+    unsigned long removed = 0;
+    unsigned int pos;
+    zbtreeLeaf *l;
+
+    while (start+removed <= end &&
+           (l = zbtGetElementByRank(zbt,start,&pos)) != NULL)
+    {
+        double score = l->score[pos];
+        robj *obj = l->obj[pos];
+
+        dictDelete(dict,obj);
+        zbtDelete(zbt,score,obj);
+        removed++;
+    }
+    return removed;
+}
+
+/* Move the position '*l','*pos' to the next element, setting '*l' to NULL
+ * after the last one. */
+void zbtNext(zbtreeLeaf **l, unsigned int *pos) {
+    if (++(*pos) == (*l)->count) {
+        *l = (*l)->next;
+        *pos = 0;
+    }
+}
+
+/* Move the position '*l','*pos' to the previous element, setting '*l' to
+ * NULL before the first one. */
+void zbtPrev(zbtreeLeaf **l, unsigned int *pos) {
+    if (*pos == 0) {
+        *l = (*l)->prev;
+        if (*l) *pos = (*l)->count-1;
+    } else {
+        (*pos)--;
+    }
+}
@@ -65,6 +65,12 @@
 #define ZMALLOC_LIB "libc"
 #endif
 
+/* Active defragmentation needs the allocator to tell which allocations
+ * are worth moving, see defrag.c: only our jemalloc does. */
+#if defined(USE_JEMALLOC) && defined(JEMALLOC_FRAG_HINT)
+#define HAVE_DEFRAG
+#endif
+
 void *zmalloc(size_t size);
 void *zcalloc(size_t size);
 void *zrealloc(void *ptr, size_t size);
@@ -0,0 +1,48 @@
+# Copy RDB with ziplist encoded hashes, sorted sets and quicklist nodes,
+# saved before listpacks were introduced, to server path
+set server_path [tmpdir "server.convert-ziplist-on-load"]
+
+exec cp -f tests/assets/ziplist-encodings.rdb $server_path
+start_server [list overrides [list "dir" $server_path "dbfilename" "ziplist-encodings.rdb"]] {
+  test "RDB load ziplist hash: converts to listpack" {
+    r select 0
+
+    assert_match "*listpack*" [r debug object hash]
+    assert_equal 3 [r hlen hash]
+    assert_equal {v1 v2 12345} [r hmget hash f1 f2 num]
+  }
+
+  test "RDB load ziplist zset: converts to listpack" {
+    assert_match "*listpack*" [r debug object zset]
+    assert_equal {d -1 a 1 b 2 c 3.5} [r zrange zset 0 -1 withscores]
+  }
+
+  test "RDB load quicklist of ziplists: converts the nodes to listpacks" {
+    assert_match "*quicklist*" [r debug object list]
+    assert_equal {a b c d 1 2 3 4 5 -100 hello 1000000} [r lrange list 0 -1]
+    r rpush list e
+    r lpush list z
+    assert_equal {z a b} [r lrange list 0 2]
+    assert_equal {hello 1000000 e} [r lrange list -3 -1]
+  }
+
+  test "RDB load ziplist encodings: values are saved again as listpacks" {
+    r debug reload
+    assert_match "*listpack*" [r debug object hash]
+    assert_match "*listpack*" [r debug object zset]
+    assert_equal 14 [r llen list]
+    assert_equal {v1 v2 12345} [r hmget hash f1 f2 num]
+  }
+}
+
+exec cp -f tests/assets/ziplist-encodings.rdb $server_path
+start_server [list overrides [list "dir" $server_path "dbfilename" "ziplist-encodings.rdb" "hash-max-ziplist-entries" 1 "zset-max-ziplist-entries" 1]] {
+  test "RDB load ziplist hash and zset: converted when the max entries are exceeded" {
+    r select 0
+
+    assert_match "*hashtable*" [r debug object hash]
+    assert_match "*skiplist*" [r debug object zset]
+    assert_equal {v1 v2 12345} [r hmget hash f1 f2 num]
+    assert_equal {d -1 a 1 b 2 c 3.5} [r zrange zset 0 -1 withscores]
+  }
+}
@@ -37,6 +37,7 @@ set ::all_tests {
     integration/aof
     integration/rdb
     integration/convert-zipmap-hash-on-load
+    integration/convert-ziplist-on-load
     unit/pubsub
     unit/slowlog
     unit/scripting
@@ -47,6 +48,10 @@ set ::all_tests {
     unit/dump
     unit/bitops
     unit/memefficiency
+    unit/networking
+    unit/respcache
+    unit/keyspace-dict
+    unit/lazyfree
 }
 # Index to the next test to run in the ::all_tests list.
 set ::next_test 0
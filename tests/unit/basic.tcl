@@ -288,6 +288,34 @@ start_server {tags {"basic"}} {
         format $res
     } {1xyzk1}
 
+    test {Commands pipelining, read only commands after writes} {
+        set fd [r channel]
+        set buf {}
+        for {set j 0} {$j < 50} {incr j} {
+            append buf [format "*3\r\n\$3\r\nSET\r\n\$%d\r\npk:%d\r\n\$1\r\n%d\r\n" [string length pk:$j] $j [expr {$j%10}]]
+            append buf [format "*2\r\n\$3\r\nGET\r\n\$%d\r\npk:%d\r\n" [string length pk:$j] $j]
+            append buf "PING\r\n"
+        }
+        # Split the pipeline in the middle of a command.
+        set half [expr {[string length $buf]/2}]
+        puts -nonewline $fd [string range $buf 0 $half]
+        flush $fd
+        after 10
+        puts -nonewline $fd [string range $buf $half+1 end]
+        flush $fd
+        set err {}
+        for {set j 0} {$j < 50} {incr j} {
+            ::redis::redis_read_reply $fd
+            set v [::redis::redis_read_reply $fd]
+            ::redis::redis_read_reply $fd
+            if {$v ne [expr {$j%10}]} {
+                set err "GET pk:$j returned '$v'"
+                break
+            }
+        }
+        set err
+    } {}
+
     test {Non existing command} {
         catch {r foobaredcommand} err
         string match ERR* $err
@@ -430,6 +458,24 @@ start_server {tags {"basic"}} {
         r mget foo baazz bar myset
     } {BAR {} FOO {}}
 
+    test {MGET with more keys than a prefetch batch} {
+        set keys {}
+        set expected {}
+        for {set j 0} {$j < 100} {incr j} {
+            if {$j % 3} {
+                r set mkey:$j val:$j
+                if {$j % 2} {r expire mkey:$j 100}
+                lappend expected val:$j
+            } else {
+                lappend expected {}
+            }
+            lappend keys mkey:$j
+        }
+        lappend keys myset
+        lappend expected {}
+        assert_equal $expected [r mget {*}$keys]
+    }
+
     test {RANDOMKEY} {
         r flushdb
         r set foo x
@@ -474,6 +520,16 @@ start_server {tags {"basic"}} {
         r mget x y z
     } [list 10 {foo bar} "x x x x x x x\n\n\r\n"]
 
+    test {MSET and DEL with more keys than the key hashes cache} {
+        set args {}
+        for {set j 0} {$j < 1000} {incr j} {lappend args mset:$j $j}
+        r mset {*}$args
+        set keys {}
+        for {set j 0} {$j < 1000} {incr j 2} {lappend keys mset:$j}
+        list [r del {*}$keys] [r get mset:998] [r get mset:999] \
+             [llength [r keys mset:*]]
+    } {500 {} 999 500}
+
     test {MSET wrong number of args} {
         catch {r mset x 10 y "foo bar" z} err
         format $err
@@ -69,7 +69,12 @@ start_server {tags {"dump"}} {
     test {MIGRATE can correctly transfer large values} {
         set first [srv 0 client]
         r del key
-        for {set j 0} {$j < 5000} {incr j} {
+        # MIGRATE writes the RESTORE payload to the target in chunks of
+        # 64k, so the value must serialize to more than that to exercise
+        # multiple writes. Quicklist nodes are serialized as LZF compressed
+        # listpacks, and these repetitive elements compress very well: it
+        # takes 40000 iterations to get a payload of about 90k.
+        for {set j 0} {$j < 40000} {incr j} {
             r rpush key 1 2 3 4 5 6 7 8 9 10
             r rpush key "item 1" "item 2" "item 3" "item 4" "item 5" \
                         "item 6" "item 7" "item 8" "item 9" "item 10"
@@ -87,7 +92,7 @@ start_server {tags {"dump"}} {
             assert {[$first exists key] == 0}
             assert {[$second exists key] == 1}
             assert {[$second ttl key] == -1}
-            assert {[$second llen key] == 5000*20}
+            assert {[$second llen key] == 40000*20}
         }
     }
 
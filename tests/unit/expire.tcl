@@ -199,3 +199,69 @@ start_server {tags {"expire"}} {
         lsort [r keys *]
     } {a e foo s t}
 }
+
+start_server {tags {"expire"} overrides {active-expire-index yes}} {
+    test {Expires index - due keys are reclaimed among many long lived ones} {
+        r flushdb
+        for {set j 0} {$j < 5000} {incr j} {
+            r setex long:$j 1000 x
+        }
+        for {set j 0} {$j < 50} {incr j} {
+            r psetex short:$j 100 x
+        }
+        after 600
+        r dbsize
+    } {5000}
+
+    test {Expires index - TTL changes are tracked} {
+        r flushdb
+        r set a x; r pexpire a 100; r pexpire a 100000
+        r set b x; r pexpire b 100; r persist b
+        r set c x; r pexpire c 100; r rename c d
+        r set e x; r pexpire e 100; r set e y
+        r set f x; r pexpire f 100; r del f; r set f z
+        r set g x; r pexpire g 100000; r pexpire g 100
+        after 600
+        lsort [r keys *]
+    } {a b e f}
+
+    test {Expires index - expired_stale_keys is exact} {
+        r flushdb
+        r debug set-active-expire 0
+        for {set j 0} {$j < 30} {incr j} {
+            r psetex key:$j [expr {$j < 20 ? 10 : 100000}] x
+        }
+        after 100
+        set stale [s expired_stale_keys]
+        r debug set-active-expire 1
+        after 300
+        list $stale [s expired_stale_keys] [r dbsize]
+    } {20 0 10}
+
+    test {Expires index - survives DEBUG RELOAD and FLUSHALL} {
+        r flushall
+        r debug set-active-expire 0
+        r psetex x 1000 x
+        r setex y 100 y
+        r debug reload
+        after 1100
+        set stale [s expired_stale_keys]
+        r flushall
+        r debug set-active-expire 1
+        list $stale [s expired_stale_keys]
+    } {1 0}
+
+    test {Expires index - can be disabled and enabled at runtime} {
+        r flushdb
+        r config set active-expire-index no
+        r debug set-active-expire 0
+        for {set j 0} {$j < 10} {incr j} {r psetex key:$j 10 x}
+        r setex other 1000 x
+        r config set active-expire-index yes
+        after 100
+        set stale [s expired_stale_keys]
+        r debug set-active-expire 1
+        after 300
+        list [lindex [r config get active-expire-index] 1] $stale [r dbsize]
+    } {yes 10 1}
+}
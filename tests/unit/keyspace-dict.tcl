@@ -0,0 +1,121 @@
+foreach type {open-addressing linear} {
+    start_server [list tags {"keyspace-dict"} \
+                       overrides [list keyspace-hash-table $type]] {
+        test "Keyspace hash table type is reported by CONFIG GET - $type" {
+            lindex [r config get keyspace-hash-table] 1
+        } $type
+
+        test "Keyspace hash table type can't be changed at runtime - $type" {
+            catch {r config set keyspace-hash-table chained} e
+            set e
+        } {*Unsupported*}
+
+        test "Keys survive table growth, deletions and reinsertions - $type" {
+            r flushdb
+            for {set j 0} {$j < 5000} {incr j} {
+                r set key:$j $j
+            }
+            for {set j 0} {$j < 5000} {incr j 2} {
+                r del key:$j
+            }
+            for {set j 0} {$j < 2000} {incr j} {
+                r set key:$j again:$j
+            }
+            set err {}
+            for {set j 0} {$j < 5000} {incr j} {
+                if {$j < 2000} {
+                    set exp again:$j
+                } elseif {$j % 2} {
+                    set exp $j
+                } else {
+                    set exp {}
+                }
+                if {[r get key:$j] ne $exp} {
+                    set err "key:$j is '[r get key:$j]' instead of '$exp'"
+                    break
+                }
+            }
+            list $err [r dbsize]
+        } {{} 3500}
+
+        test "Keys survive the table shrinking - $type" {
+            r flushdb
+            r debug populate 20000
+            for {set j 100} {$j < 20000} {incr j} {
+                r del key:$j
+            }
+            # Give serverCron() the time to resize the table.
+            after 1000
+            set err {}
+            for {set j 0} {$j < 100} {incr j} {
+                if {[r get key:$j] ne "value:$j"} {
+                    set err "key:$j is '[r get key:$j]'"
+                    break
+                }
+            }
+            list $err [r dbsize] [llength [r keys *]]
+        } {{} 100 100}
+
+        test "Expires work - $type" {
+            r flushdb
+            for {set j 0} {$j < 1000} {incr j} {
+                r set key:$j $j
+                if {$j % 2} {r pexpire key:$j 100}
+            }
+            after 300
+            # Access every key so the expired ones are removed for sure.
+            for {set j 0} {$j < 1000} {incr j} {r exists key:$j}
+            list [r dbsize] [r ttl key:0]
+        } {500 -1}
+
+        test "SCAN, KEYS and RANDOMKEY - $type" {
+            r flushdb
+            r debug populate 3000
+            set cur 0
+            set keys {}
+            while 1 {
+                set res [r scan $cur count 100]
+                set cur [lindex $res 0]
+                lappend keys {*}[lindex $res 1]
+                if {$cur == 0} break
+            }
+            set keys [lsort -unique $keys]
+            assert_equal 3000 [llength $keys]
+            assert_equal 3000 [llength [r keys *]]
+            assert_match {key:*} [r randomkey]
+            r flushdb
+            r randomkey
+        } {}
+
+        test "SCAN returns all the keys while the table grows - $type" {
+            r flushdb
+            r debug populate 1000
+            set cur 0
+            set keys {}
+            set j 1000
+            while 1 {
+                set res [r scan $cur count 20]
+                set cur [lindex $res 0]
+                lappend keys {*}[lindex $res 1]
+                for {set k 0} {$k < 50} {incr k} {r set key:$j x; incr j}
+                if {$cur == 0} break
+            }
+            set keys [lsort -unique $keys]
+            set missing 0
+            for {set k 0} {$k < 1000} {incr k} {
+                if {[lsearch -sorted $keys key:$k] == -1} {incr missing}
+            }
+            set missing
+        } {0}
+
+        test "DEBUG RELOAD - $type" {
+            r flushdb
+            r debug populate 2000
+            r expire key:10 1000
+            set digest [r debug digest]
+            r debug reload
+            list [expr {[r debug digest] eq $digest}] [r dbsize] \
+                 [expr {[r ttl key:10] > 0}]
+        } {1 2000 1}
+    }
+}
@@ -0,0 +1,131 @@
+start_server {tags {"lazyfree"}} {
+    proc fill_set {key count} {
+        for {set j 0} {$j < $count} {incr j 1000} {
+            set args {}
+            for {set k $j} {$k < $j+1000 && $k < $count} {incr k} {
+                lappend args member:$k
+            }
+            r sadd $key {*}$args
+        }
+    }
+
+    proc wait_lazyfree_done {} {
+        wait_for_condition 100 50 {
+            [s lazyfree_pending_objects] == 0
+        } else {
+            fail "Lazy free objects not freed in time"
+        }
+    }
+
+    test "UNLINK can reclaim memory in background" {
+        set orig_mem [s used_memory]
+        fill_set myset 50000
+        assert {[s used_memory] > $orig_mem+1000000}
+        assert_equal 1 [r unlink myset]
+        assert_equal 0 [r exists myset]
+        wait_lazyfree_done
+        assert {[s used_memory] < $orig_mem+1000000}
+    }
+
+    test "UNLINK of small and missing keys" {
+        r set foo bar
+        r rpush mylist a b c
+        list [r unlink foo mylist nokey] [r exists foo] [r exists mylist]
+    } {2 0 0}
+
+    test "FLUSHDB ASYNC can reclaim memory in background" {
+        set orig_mem [s used_memory]
+        fill_set myset 50000
+        r debug populate 1000
+        r setex volatile 100 x
+        assert_equal OK [r flushdb async]
+        assert_equal 0 [r dbsize]
+        wait_lazyfree_done
+        assert {[s used_memory] < $orig_mem+1000000}
+        r set foo bar
+        r expire foo 100
+        list [r get foo] [expr {[r ttl foo] > 0}]
+    } {bar 1}
+
+    test "FLUSHALL ASYNC empties every DB" {
+        r select 10
+        r set foo bar
+        r select 9
+        fill_set myset 5000
+        r flushall async
+        r select 10
+        set res [r dbsize]
+        r select 9
+        lappend res [r dbsize]
+    } {0 0}
+
+    test "FLUSHDB and FLUSHALL reject unknown arguments" {
+        catch {r flushdb sync} e1
+        catch {r flushall async async} e2
+        list $e1 $e2
+    } {*syntax* *syntax*}
+
+    test "Shared objects are released by the lazy free thread" {
+        r set num 123
+        set refcount [r object refcount num]
+        # Integers below 10000 are shared objects.
+        for {set j 0} {$j < 10000} {incr j 500} {
+            set args {}
+            for {set k $j} {$k < $j+500} {incr k} {lappend args $k}
+            r sadd myset {*}$args
+        }
+        assert_equal hashtable [r object encoding myset]
+        assert_equal [expr {$refcount+1}] [r object refcount num]
+        r unlink myset
+        # Use the shared integers while the thread releases them.
+        for {set j 0} {$j < 1000} {incr j} {r set key:$j $j}
+        wait_lazyfree_done
+        # key:123 references the same shared integer.
+        assert_equal [expr {$refcount+1}] [r object refcount num]
+    }
+
+    test "lazyfree-lazy-server-del frees overwritten values in background" {
+        r config set lazyfree-lazy-server-del yes
+        set orig_mem [s used_memory]
+        fill_set myset 50000
+        fill_set other 50000
+        r set myset foo
+        r sunionstore other nokey
+        wait_lazyfree_done
+        r config set lazyfree-lazy-server-del no
+        set res [list [r get myset] [r exists other] \
+                      [expr {[s used_memory] < $orig_mem+1000000}]]
+        r del myset
+        set res
+    } {foo 0 1}
+
+    test "lazyfree-lazy-expire frees expired values in background" {
+        r config set lazyfree-lazy-expire yes
+        fill_set myset 50000
+        r pexpire myset 10
+        after 100
+        assert_equal 0 [r exists myset]
+        wait_lazyfree_done
+        r config set lazyfree-lazy-expire no
+    }
+
+    test "lazyfree-lazy-eviction frees evicted values in background" {
+        r flushall
+        set orig_mem [s used_memory]
+        for {set j 0} {$j < 20} {incr j} {fill_set set:$j 2000}
+        set limit [expr {$orig_mem+([s used_memory]-$orig_mem)/2}]
+        r config set lazyfree-lazy-eviction yes
+        r config set maxmemory-policy allkeys-random
+        r config set maxmemory $limit
+        assert_equal OK [r set foo bar]
+        wait_lazyfree_done
+        set used [s used_memory]
+        r config set maxmemory 0
+        r config set lazyfree-lazy-eviction no
+        # The memory is reclaimed later, so more keys than needed may be
+        # evicted, but the limit is honoured. The limit is enforced before
+        # running the SET, that allocates a few more bytes.
+        assert {[s evicted_keys] > 0}
+        assert {$used < $limit+1024}
+    }
+}
@@ -1,6 +1,7 @@
 start_server {tags {"maxmemory"}} {
     foreach policy {
         allkeys-random allkeys-lru volatile-lru volatile-random volatile-ttl
+        allkeys-lfu volatile-lfu
     } {
         test "maxmemory - is the memory limit honoured? (policy $policy)" {
             # make sure to start with a blank instance
@@ -33,6 +34,7 @@ start_server {tags {"maxmemory"}} {
 
     foreach policy {
         allkeys-random allkeys-lru volatile-lru volatile-random volatile-ttl
+        allkeys-lfu volatile-lfu
     } {
         test "maxmemory - only allkeys-* should remove non-volatile keys ($policy)" {
             # make sure to start with a blank instance
@@ -74,7 +76,7 @@ start_server {tags {"maxmemory"}} {
     }
 
     foreach policy {
-        volatile-lru volatile-random volatile-ttl
+        volatile-lru volatile-random volatile-ttl volatile-lfu
     } {
         test "maxmemory - policy $policy should only remove volatile keys." {
             # make sure to start with a blank instance
@@ -117,4 +119,125 @@ start_server {tags {"maxmemory"}} {
             }
         }
     }
+
+    foreach policy {allkeys-lru volatile-ttl} {
+        test "maxmemory - more samples than the sampling array ($policy)" {
+            r flushall
+            r config set maxmemory-samples 64
+            set used [s used_memory]
+            set limit [expr {$used+100*1024}]
+            r config set maxmemory $limit
+            r config set maxmemory-policy $policy
+            for {set j 0} {$j < 10000} {incr j} {
+                r setex [randomKey] 10000 x
+            }
+            r config set maxmemory-samples 3
+            assert {[s evicted_keys] > 0}
+            assert {[s used_memory] < ($limit+4096)}
+        }
+    }
+
+    test "maxmemory - allkeys-lru keeps the recently accessed keys" {
+        r flushall
+        r config set maxmemory 0
+        r config set maxmemory-policy allkeys-lru
+        r config set maxmemory-samples 5
+        set rd [redis_deferring_client]
+        set val [string repeat x 100]
+        for {set j 0} {$j < 10000} {incr j} {
+            $rd set key:$j $val
+            if {$j % 100 == 99} {for {set k 0} {$k < 100} {incr k} {$rd read}}
+        }
+        r config set maxmemory [s used_memory]
+        # Make sure the accessed keys have a different LRU clock.
+        after 2000
+        for {set j 0} {$j < 5000} {incr j} {
+            $rd get key:$j
+            if {$j % 100 == 99} {for {set k 0} {$k < 100} {incr k} {$rd read}}
+        }
+        for {set j 0} {$j < 2500} {incr j} {
+            $rd set new:$j $val
+            if {$j % 100 == 99} {for {set k 0} {$k < 100} {incr k} {$rd read}}
+        }
+        set survived 0
+        for {set j 0} {$j < 5000} {incr j} {
+            $rd exists key:$j
+            if {$j % 100 == 99} {
+                for {set k 0} {$k < 100} {incr k} {incr survived [$rd read]}
+            }
+        }
+        $rd close
+        r config set maxmemory 0
+        assert {[s evicted_keys] >= 2000}
+        # Sampling without the eviction pool loses ~5% of the accessed keys.
+        assert {$survived >= 4900}
+    }
+
+    test "OBJECT FREQ requires an LFU policy" {
+        r config set maxmemory-policy allkeys-lru
+        r set foo bar
+        catch {r object freq foo} e1
+        r config set maxmemory-policy allkeys-lfu
+        catch {r object idletime foo} e2
+        list $e1 $e2
+    } {*not selected* *is selected*}
+
+    test "OBJECT FREQ grows logarithmically with the accesses" {
+        r config set maxmemory-policy allkeys-lfu
+        r config set lfu-decay-time 0
+        r del foo
+        r set foo bar
+        set initial [r object freq foo]
+        for {set j 0} {$j < 1000} {incr j} {r get foo}
+        set freq [r object freq foo]
+        # SET of an existing key preserves the counter.
+        r set foo baz
+        list $initial [expr {$freq > 6 && $freq < 40}] \
+             [expr {[r object freq foo] == $freq}]
+    } {5 1 1}
+
+    test "maxmemory - allkeys-lfu keeps the hot keys during a scan" {
+        r flushall
+        r config set maxmemory 0
+        r config set maxmemory-policy allkeys-lfu
+        r config set maxmemory-samples 5
+        r config set lfu-log-factor 0
+        set rd [redis_deferring_client]
+        set val [string repeat x 100]
+        set used [s used_memory]
+        for {set j 0} {$j < 2000} {incr j} {
+            $rd set hot:$j $val
+            if {$j % 100 == 99} {for {set k 0} {$k < 100} {incr k} {$rd read}}
+        }
+        # Leave room for as many keys as the hot ones.
+        r config set maxmemory [expr {[s used_memory]*2-$used}]
+        for {set i 0} {$i < 10} {incr i} {
+            for {set j 0} {$j < 2000} {incr j} {
+                $rd get hot:$j
+                if {$j % 100 == 99} {
+                    for {set k 0} {$k < 100} {incr k} {$rd read}
+                }
+            }
+        }
+        # Every key of the scan is accessed once, that would make it look
+        # just as recent as the hot keys with an LRU policy.
+        for {set j 0} {$j < 6000} {incr j} {
+            $rd set cold:$j $val
+            $rd get cold:$j
+            if {$j % 50 == 49} {for {set k 0} {$k < 100} {incr k} {$rd read}}
+        }
+        set survived 0
+        for {set j 0} {$j < 2000} {incr j} {
+            $rd exists hot:$j
+            if {$j % 100 == 99} {
+                for {set k 0} {$k < 100} {incr k} {incr survived [$rd read]}
+            }
+        }
+        $rd close
+        r config set maxmemory 0
+        r config set lfu-log-factor 10
+        r config set lfu-decay-time 1
+        assert {[s evicted_keys] >= 3000}
+        assert {$survived >= 1950}
+    }
 }
@@ -30,3 +30,173 @@ start_server {tags {"memefficiency"}} {
         }
     }
 }
+
+# Number of small allocations currently live according to jemalloc, taken
+# from the "small:" line (allocated, nmalloc, ndalloc, nrequests) of the
+# MEMORY MALLOC-STATS output.
+proc jemalloc_small_allocations {} {
+    foreach line [split [r memory malloc-stats] "\n"] {
+        if {[string match {small:*} $line]} {
+            return [expr {[lindex $line 2]-[lindex $line 3]}]
+        }
+    }
+    error "no small allocations stats"
+}
+
+start_server {tags {"memefficiency"}} {
+    test "EMBSTR encoding saves memory for short strings" {
+        r flushall
+        for {set j 0} {$j < 10000} {incr j} {
+            r set key:$j [string repeat A 20]
+        }
+        set embstr_mem [s used_memory]
+        set jemalloc [string match {jemalloc*} [s mem_allocator]]
+        if {$jemalloc} {set embstr_allocs [jemalloc_small_allocations]}
+        # APPEND converts the value to the RAW encoding.
+        for {set j 0} {$j < 10000} {incr j} {
+            r append key:$j ""
+        }
+        set raw_mem [s used_memory]
+        assert_equal raw [r object encoding key:0]
+        # EMBSTR saves an allocation per value. The libc malloc has a per
+        # allocation overhead, so used_memory shrinks. With jemalloc the size
+        # classes of the two allocations sum to the same size class of the
+        # single one and used_memory shows no saving, so check that the
+        # number of live allocations went down instead.
+        if {[string match {libc*} [s mem_allocator]]} {
+            assert {$raw_mem - $embstr_mem >= 10000*8}
+        } elseif {$jemalloc} {
+            set raw_allocs [jemalloc_small_allocations]
+            assert {$raw_allocs - $embstr_allocs >= 9000}
+        } else {
+            # Other allocators: just make sure EMBSTR is not worse.
+            assert {$raw_mem >= $embstr_mem}
+        }
+    }
+}
+
+start_server {tags {"memefficiency"}} {
+    test "MEMORY USAGE of strings and expires" {
+        r flushall
+        r set small foo
+        r set big [string repeat A 1000]
+        assert_equal {} [r memory usage nokey]
+        assert {[r memory usage big] > [r memory usage small] + 1000}
+        set usage [r memory usage small]
+        r expire small 100
+        assert {[r memory usage small] > $usage}
+    }
+
+    test "MEMORY USAGE agrees with used_memory" {
+        foreach {type cmd} {set sadd zset zadd hash hset list rpush} {
+            r flushall
+            set base [s used_memory]
+            for {set j 0} {$j < 5000} {incr j} {
+                switch $cmd {
+                    sadd {r sadd k member:$j}
+                    zadd {r zadd k $j member:$j}
+                    hset {r hset k field:$j value:$j}
+                    rpush {r rpush k value:$j}
+                }
+            }
+            set used [expr {[s used_memory]-$base}]
+            set usage [r memory usage k samples 0]
+            assert {$usage > $used*0.8 && $usage < $used*1.2}
+        }
+    }
+
+    test "MEMORY USAGE SAMPLES option" {
+        r flushall
+        r sadd k a b c
+        assert_equal [r memory usage k samples 0] [r memory usage k samples 10]
+        catch {r memory usage k samples -1} e
+        assert_match {*syntax*} $e
+        catch {r memory usage k foo} e
+        assert_match {*syntax*} $e
+    }
+
+    test "MEMORY STATS" {
+        r flushall
+        r select 9
+        r debug populate 1000
+        set stats [r memory stats]
+        assert_equal 1000 [dict get $stats keys.count]
+        assert {[dict get $stats total.allocated] ==
+                [dict get $stats overhead.total] +
+                [dict get $stats dataset.bytes]}
+        assert {[dict get $stats startup.allocated] > 0}
+        assert {[dict get [dict get $stats db.9] overhead.hashtable.main] >
+                1000*8}
+        assert {![dict exists $stats db.0]}
+    }
+
+    test "MEMORY STATS with cached Lua scripts" {
+        r script flush
+        for {set j 0} {$j < 300} {incr j} {
+            r script load "return $j"
+        }
+        set stats [r memory stats]
+        assert {[dict get $stats lua.caches] > 300*40}
+        r script flush
+    }
+
+    test "MEMORY MALLOC-STATS" {
+        assert {[string length [r memory malloc-stats]] > 0}
+    }
+}
+
+start_server {tags {"defrag"}} {
+    if {[string match {*jemalloc*} [s mem_allocator]]} {
+        test "Active defrag" {
+            r config set activedefrag no
+            r config set active-defrag-threshold-lower 5
+            r config set active-defrag-ignore-bytes 1000000
+            r flushdb
+            # Fill sets, sorted sets, hashes and strings, then remove most
+            # of the elements, leaving the allocator runs half empty.
+            set rd [redis_deferring_client]
+            set n 20000
+            for {set j 0} {$j < $n} {incr j} {
+                set k [expr {$j%100}]
+                $rd sadd set:$k member:$j
+                $rd zadd zset:$k $j member:$j
+                $rd hset hash:$k field:$j value:$j
+                $rd set str:$j [string repeat x [expr {$j%64}]]
+            }
+            for {set j 0} {$j < $n*4} {incr j} {$rd read}
+            for {set j 0} {$j < $n} {incr j} {
+                if {$j%4 == 0} continue
+                set k [expr {$j%100}]
+                $rd srem set:$k member:$j
+                $rd zrem zset:$k member:$j
+                $rd hdel hash:$k field:$j
+                $rd del str:$j
+            }
+            for {set j 0} {$j < $n*3} {incr j} {$rd read}
+            $rd close
+            set digest [r debug digest]
+            set frag [s allocator_frag_ratio]
+            set frag_bytes [s allocator_frag_bytes]
+            assert {$frag > 1.5}
+
+            r config set activedefrag yes
+            wait_for_condition 100 100 {
+                [s allocator_frag_ratio] < 1.5 &&
+                [s allocator_frag_bytes] < $frag_bytes/2 &&
+                [s active_defrag_running] == 0
+            } else {
+                fail "active defrag did not lower fragmentation"
+            }
+            assert {[s active_defrag_hits] > 0}
+            assert {[s active_defrag_key_hits] > 0}
+            assert_equal $digest [r debug digest]
+            r config set activedefrag no
+            # The moved skiplist nodes and dict entries are still linked.
+            assert_equal 200 [r zcard zset:0]
+            assert_equal member:4400 [lindex [r zrange zset:0 44 44] 0]
+            assert_equal 44 [r zrank zset:0 member:4400]
+            r debug reload
+            assert_equal $digest [r debug digest]
+        }
+    }
+}
@@ -11,6 +11,16 @@ start_server {tags {"multi"}} {
         list $v1 $v2 $v3
     } {QUEUED QUEUED {{a b c} PONG}}
 
+    test {EXEC with more read only commands than a prefetch batch} {
+        for {set j 0} {$j < 40} {incr j} {r set xkey:$j $j}
+        r multi
+        for {set j 0} {$j < 40} {incr j} {r get xkey:$j}
+        r mget xkey:1 xkey:2 nokey
+        set res [r exec]
+        for {set j 0} {$j < 40} {incr j} {r del xkey:$j}
+        list [llength $res] [lindex $res 39] [lindex $res 40]
+    } {41 39 {1 2 {}}}
+
     test {DISCARD} {
         r del mylist
         r rpush mylist a
@@ -221,6 +231,20 @@ start_server {tags {"multi"}} {
         r exec
     } {}
 
+    test {WATCH of a volatile key is touched by SET from another client} {
+        r del x
+        r set x foo
+        r expire x 100
+        r watch x
+        set rd [redis_deferring_client]
+        $rd set x bar
+        $rd read
+        $rd close
+        r multi
+        r ping
+        list [r exec] [r ttl x]
+    } {{} -1}
+
     test {WATCH will not consider touched expired keys} {
         r del x
         r set x foo
@@ -0,0 +1,181 @@
+start_server {tags {"networking"} overrides {io-threads 4}} {
+    # Queue a command from every client while the server is busy in
+    # DEBUG SLEEP, so that all of them are served in the same event loop
+    # iteration: this makes sure there are enough clients to wake up the
+    # I/O threads.
+    proc send_while_sleeping {clients script} {
+        set rd0 [redis_deferring_client]
+        $rd0 debug sleep 0.3
+        after 100
+        foreach rd $clients {uplevel 1 [list set rd $rd]; uplevel 1 $script}
+        $rd0 read
+        $rd0 close
+    }
+
+    test {I/O threads are reported in INFO and CONFIG GET} {
+        list [lindex [r config get io-threads] 1] [s io_threads] \
+             [lindex [r config get io-threads-do-reads] 1]
+    } {4 4 yes}
+
+    test {Replies are written by the I/O threads} {
+        r set foo bar
+        set clients {}
+        for {set j 0} {$j < 20} {incr j} {
+            lappend clients [redis_deferring_client]
+        }
+        send_while_sleeping $clients {
+            $rd incr counter
+            $rd get foo
+        }
+        foreach rd $clients {
+            $rd read
+            assert_equal bar [$rd read]
+        }
+        assert_equal 20 [r get counter]
+        assert {[s io_threaded_writes_processed] > 0}
+        foreach rd $clients {$rd close}
+    }
+
+    test {Big replies are fully transmitted by the I/O threads} {
+        r set bigval [string repeat x 500000]
+        set clients {}
+        for {set j 0} {$j < 20} {incr j} {
+            lappend clients [redis_deferring_client]
+        }
+        send_while_sleeping $clients {
+            $rd get bigval
+            $rd ping
+        }
+        foreach rd $clients {
+            assert_equal 500000 [string length [$rd read]]
+            assert_equal PONG [$rd read]
+            $rd close
+        }
+    }
+
+    test {Queries are read and parsed by the I/O threads} {
+        set clients {}
+        for {set j 0} {$j < 20} {incr j} {
+            lappend clients [redis_deferring_client]
+        }
+        send_while_sleeping $clients {
+            $rd lpush mylist a b c
+            $rd lrange mylist 0 -1
+            $rd del mylist
+        }
+        foreach rd $clients {
+            $rd read
+            assert_equal {c b a} [$rd read]
+            $rd read
+            $rd close
+        }
+        assert {[s io_threaded_reads_processed] > 0}
+    }
+
+    test {Protocol errors are reported with I/O threads} {
+        set clients {}
+        for {set j 0} {$j < 20} {incr j} {
+            lappend clients [redis_deferring_client]
+        }
+        send_while_sleeping $clients {
+            $rd write "*3\r\n\$3\r\nSET\r\n\$1\r\nx\r\nfooz\r\n"
+            $rd flush
+        }
+        foreach rd $clients {
+            assert_error "*expected '$', got 'f'*" {$rd read}
+            $rd close
+        }
+        r ping
+    } {PONG}
+
+    test {CONFIG SET io-threads} {
+        r config set io-threads 2
+        assert_equal 2 [s io_threads]
+        r config set io-threads-do-reads no
+        r config set io-threads 1
+        assert_equal 1 [s io_threads]
+        assert_equal 0 [s io_threads_active]
+        catch {r config set io-threads 0} e
+        set e
+    } {*Invalid argument*}
+}
+
+start_server {tags {"networking"}} {
+    test {Big multi bulk replies are transmitted with partial writes} {
+        r del biglist
+        for {set j 0} {$j < 5000} {incr j} {
+            r rpush biglist [string repeat $j 20]
+        }
+        # Pipeline many big replies without reading: the socket buffers
+        # fill up and the server has to deal with short writes in the
+        # middle of the reply list.
+        set rd [redis_deferring_client]
+        for {set j 0} {$j < 20} {incr j} {
+            $rd lrange biglist 0 -1
+        }
+        $rd flush
+        after 200
+        for {set j 0} {$j < 20} {incr j} {
+            set res [$rd read]
+            assert_equal 5000 [llength $res]
+            assert_equal [string repeat 4999 20] [lindex $res end]
+        }
+        $rd close
+    }
+
+    test {Reply chunks are reused across clients} {
+        r config resetstat
+        set rd [redis_deferring_client]
+        $rd lrange biglist 0 -1
+        assert_equal 5000 [llength [$rd read]]
+        $rd close
+        assert_equal 5000 [llength [r lrange biglist 0 -1]]
+        assert {[s reply_chunk_pool_hits] > 0}
+        assert {[s reply_chunk_pool_size] > 0}
+    }
+
+    test {Pipelined arguments stored by commands are not reused} {
+        r config set hash-max-ziplist-entries 0
+        r del h l s
+        set rd [redis_deferring_client]
+        for {set j 0} {$j < 100} {incr j} {
+            $rd set key:$j val:$j
+            $rd hset h field:$j val:$j
+            $rd rpush l val:$j
+            $rd sadd s val:$j
+            $rd get key:$j
+        }
+        $rd multi
+        $rd set queued val:queued
+        $rd exec
+        for {set j 0} {$j < 503} {incr j} {$rd read}
+        $rd close
+        r config set hash-max-ziplist-entries 512
+        for {set j 0} {$j < 100} {incr j} {
+            assert_equal val:$j [r get key:$j]
+            assert_equal val:$j [r hget h field:$j]
+            assert_equal val:$j [r lindex l $j]
+            assert_equal 1 [r sismember s val:$j]
+        }
+        list [r get queued] [r object encoding h]
+    } {val:queued hashtable}
+
+    test {Pending connections are accepted in batches} {
+        set rd [redis_deferring_client]
+        $rd debug sleep 0.5
+        after 100
+        # Connect while the server is busy, so that all the connections
+        # are waiting in the listening socket backlog.
+        set socks {}
+        for {set j 0} {$j < 50} {incr j} {
+            lappend socks [socket [srv 0 host] [srv 0 port]]
+        }
+        $rd read
+        $rd close
+        r ping
+        foreach s $socks {close $s}
+        assert {[s accept_batch_max] >= 50}
+        r config resetstat
+        s accept_batch_max
+    } {0}
+}
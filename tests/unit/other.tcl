@@ -227,6 +227,36 @@ start_server {tags {"other"}} {
         set _ $err
     } {}
 
+    test {Short strings are EMBSTR encoded, long strings RAW encoded} {
+        r set foo [string repeat x 39]
+        r set bar [string repeat x 40]
+        r set num 12345
+        list [r object encoding foo] [r object encoding bar] \
+             [r object encoding num]
+    } {embstr raw int}
+
+    test {APPEND, SETRANGE and SETBIT convert EMBSTR strings to RAW} {
+        set res {}
+        foreach cmd {{append foo x} {setrange foo 1 y} {setbit foo 0 1}} {
+            r set foo abc
+            r {*}$cmd
+            lappend res [r object encoding foo]
+        }
+        lappend res [r getbit foo 0] [r strlen foo]
+    } {raw raw raw 1 3}
+
+    test {EMBSTR strings survive DEBUG RELOAD and AOF rewrite} {
+        r flushdb
+        r set foo bar
+        r set big [string repeat x 100]
+        r debug reload
+        set res [list [r object encoding foo] [r object encoding big]]
+        r bgrewriteaof
+        waitForBgrewriteaof r
+        r debug loadaof
+        lappend res [r object encoding foo] [r get foo]
+    } {embstr raw embstr bar}
+
     # Leave the user with a clean DB before to exit
     test {FLUSHDB} {
         set aux {}
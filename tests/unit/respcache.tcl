@@ -0,0 +1,97 @@
+start_server {tags {"respcache"} overrides {resp-cache-max-memory 1mb resp-cache-min-hits 2}} {
+    proc get_many {key n} {
+        for {set j 0} {$j < $n} {incr j} {
+            set res [r get $key]
+        }
+        return $res
+    }
+
+    test {RESP cache is disabled by default} {
+        r config set resp-cache-max-memory 0
+        r config resetstat
+        r set foo bar
+        get_many foo 10
+        r config set resp-cache-max-memory 1048576
+        list [s resp_cache_keys] [s resp_cache_hits]
+    } {0 0}
+
+    test {Hot values are served from the RESP cache} {
+        r config resetstat
+        r set foo bar
+        assert_equal bar [get_many foo 10]
+        assert_equal {bar bar} [r mget foo foo]
+        assert_equal 1 [s resp_cache_keys]
+        assert {[s resp_cache_memory] > 0}
+        assert {[s resp_cache_hits] >= 8}
+    }
+
+    test {RESP cache works with integer encoded values} {
+        r set counter 12345
+        assert_equal 12345 [get_many counter 10]
+        r incr counter
+        assert_equal 12346 [get_many counter 10]
+    }
+
+    test {RESP cache is invalidated by writes} {
+        r set foo bar
+        get_many foo 10
+        r append foo baz
+        assert_equal barbaz [r get foo]
+        r setrange foo 0 X
+        assert_equal Xarbaz [r get foo]
+        r set foo newval
+        assert_equal newval [get_many foo 10]
+        r del foo
+        r get foo
+    } {}
+
+    test {RESP cache entries are released with their values} {
+        r flushall
+        r set a world
+        r set b hello
+        get_many a 10
+        get_many b 10
+        assert_equal 2 [s resp_cache_keys]
+        r del b
+        assert_equal 1 [s resp_cache_keys]
+        r flushall
+        list [s resp_cache_keys] [s resp_cache_memory]
+    } {0 0}
+
+    test {RESP cache memory is bounded} {
+        r config set resp-cache-max-memory 4096
+        for {set j 0} {$j < 100} {incr j} {
+            r set key:$j [string repeat x 100]
+            get_many key:$j 3
+        }
+        assert {[s resp_cache_memory] <= 4096}
+        assert {[s resp_cache_keys] > 0}
+        r config set resp-cache-max-memory 0
+        list [s resp_cache_keys] [s resp_cache_memory]
+    } {0 0}
+
+    test {RESP cache is not flushed by maxmemory evictions} {
+        r flushall
+        r config set resp-cache-max-memory 1048576
+        r config resetstat
+        r set hot [string repeat x 100]
+        get_many hot 10
+        assert_equal 1 [s resp_cache_keys]
+        r config set maxmemory-policy volatile-lru
+        r config set maxmemory [expr {[s used_memory]+100000}]
+        for {set j 0} {$j < 2000} {incr j} {
+            r setex key:$j 1000 [string repeat x 100]
+        }
+        r config set maxmemory 0
+        assert {[s evicted_keys] > 0}
+        assert_equal 1 [s resp_cache_keys]
+        assert_equal [string repeat x 100] [r get hot]
+    }
+
+    test {CONFIG SET resp-cache-min-hits} {
+        catch {r config set resp-cache-min-hits 0} e
+        assert_match {*Invalid argument*} $e
+        r config set resp-cache-min-hits 100
+        lindex [r config get resp-cache-min-hits] 1
+    } {100}
+}
@@ -1,8 +1,7 @@
 start_server {
     tags {list ziplist}
     overrides {
-        "list-max-ziplist-value" 200000
-        "list-max-ziplist-entries" 256
+        "list-max-ziplist-size" 16
     }
 } {
     test {Explicit regression for a list bug} {
@@ -75,5 +74,67 @@ start_server {
                 }
             }
         }
+
+        foreach {fill depth} {1 0 3 0 16 0 -1 0 -2 0 1 1 3 2 16 1 -2 1} {
+            test "quicklist implementation: edit stress testing, fill $fill depth $depth" {
+                r config set list-max-ziplist-size $fill
+                r config set list-compress-depth $depth
+                for {set j 0} {$j < 100} {incr j} {
+                    r del l
+                    set l {}
+                    for {set i 0} {$i < 100} {incr i} {
+                        # Repeated characters make the nodes compressible.
+                        set rv [randpath {randomValue} {
+                            string repeat a [randomInt 60]
+                        }]
+                        lappend l $rv
+                        r rpush l $rv
+                    }
+                    for {set i 0} {$i < 20 && [llength $l]} {incr i} {
+                        set len [llength $l]
+                        set pos [randomInt $len]
+                        set rv [randomValue]
+                        randpath {
+                            lset l $pos $rv
+                            r lset l $pos $rv
+                        } {
+                            set pivot [lindex $l $pos]
+                            set pos [lsearch -exact $l $pivot]
+                            set l [linsert $l $pos $rv]
+                            r linsert l before $pivot $rv
+                        } {
+                            set start [randomInt 10]
+                            set stop [expr {-1-[randomInt 10]}]
+                            set l [lrange $l $start end-[expr {-1-$stop}]]
+                            r ltrim l $start $stop
+                        } {
+                            set val [lindex $l $pos]
+                            set count [llength [lsearch -all -exact $l $val]]
+                            assert_equal $count [r lrem l 0 $val]
+                            set l [lsearch -all -inline -not -exact $l $val]
+                        } {
+                            randpath {
+                                assert_equal [lindex $l 0] [r lpop l]
+                                set l [lrange $l 1 end]
+                            } {
+                                assert_equal [lindex $l end] [r rpop l]
+                                set l [lrange $l 0 end-1]
+                            }
+                        }
+                        assert_equal $l [r lrange l 0 -1]
+                        if {[llength $l]} {
+                            set pos [randomInt [llength $l]]
+                            assert_equal [lindex $l $pos] [r lindex l $pos]
+                        }
+                    }
+                    if {$j % 20 == 0} {
+                        r debug reload
+                        assert_equal $l [r lrange l 0 -1]
+                    }
+                }
+                r config set list-max-ziplist-size 16
+                r config set list-compress-depth 0
+            }
+        }
     }
 }
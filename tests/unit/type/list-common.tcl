@@ -1,5 +1,5 @@
-# We need a value larger than list-max-ziplist-value to make sure
-# the list has the right encoding when it is swapped in again.
+# Lists are always quicklists now: the two values are kept so that every
+# test runs both with small and with larger elements.
 array set largevalue {}
 set largevalue(ziplist) "hello"
 set largevalue(linkedlist) [string repeat "hello" 4]
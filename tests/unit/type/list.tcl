@@ -1,8 +1,7 @@
 start_server {
     tags {"list"}
     overrides {
-        "list-max-ziplist-value" 16
-        "list-max-ziplist-entries" 256
+        "list-max-ziplist-size" 5
     }
 } {
     source "tests/unit/type/list-common.tcl"
@@ -19,7 +18,7 @@ start_server {
         assert_equal {} [r lindex myziplist2 3]
         assert_equal c [r rpop myziplist1]
         assert_equal a [r lpop myziplist1]
-        assert_encoding ziplist myziplist1
+        assert_encoding quicklist myziplist1
 
         # first rpush then lpush
         assert_equal 1 [r rpush myziplist2 a]
@@ -32,13 +31,13 @@ start_server {
         assert_equal {} [r lindex myziplist2 3]
         assert_equal a [r rpop myziplist2]
         assert_equal c [r lpop myziplist2]
-        assert_encoding ziplist myziplist2
+        assert_encoding quicklist myziplist2
     }
 
     test {LPUSH, RPUSH, LLENGTH, LINDEX, LPOP - regular list} {
         # first lpush then rpush
         assert_equal 1 [r lpush mylist1 $largevalue(linkedlist)]
-        assert_encoding linkedlist mylist1
+        assert_encoding quicklist mylist1
         assert_equal 2 [r rpush mylist1 b]
         assert_equal 3 [r rpush mylist1 c]
         assert_equal 3 [r llen mylist1]
@@ -51,7 +50,7 @@ start_server {
 
         # first rpush then lpush
         assert_equal 1 [r rpush mylist2 $largevalue(linkedlist)]
-        assert_encoding linkedlist mylist2
+        assert_encoding quicklist mylist2
         assert_equal 2 [r lpush mylist2 b]
         assert_equal 3 [r lpush mylist2 c]
         assert_equal 3 [r llen mylist2]
@@ -89,13 +88,18 @@ start_server {
     proc create_ziplist {key entries} {
         r del $key
         foreach entry $entries { r rpush $key $entry }
-        assert_encoding ziplist $key
+        assert_encoding quicklist $key
     }
 
     proc create_linkedlist {key entries} {
         r del $key
         foreach entry $entries { r rpush $key $entry }
-        assert_encoding linkedlist $key
+        assert_encoding quicklist $key
+    }
+
+    proc ql_nodes {key} {
+        regexp {ql_nodes:([0-9]+)} [r debug object $key] -> nodes
+        return $nodes
     }
 
     foreach {type large} [array get largevalue] {
@@ -524,52 +528,68 @@ start_server {
         set e
     } {*ERR*syntax*error*}
 
-    test {LPUSHX, RPUSHX convert from ziplist to list} {
-        set large $largevalue(linkedlist)
-
-        # convert when a large value is pushed
-        create_ziplist xlist a
-        assert_equal 2 [r rpushx xlist $large]
-        assert_encoding linkedlist xlist
-        create_ziplist xlist a
-        assert_equal 2 [r lpushx xlist $large]
-        assert_encoding linkedlist xlist
-
-        # convert when the length threshold is exceeded
-        create_ziplist xlist [lrepeat 256 a]
-        assert_equal 257 [r rpushx xlist b]
-        assert_encoding linkedlist xlist
-        create_ziplist xlist [lrepeat 256 a]
-        assert_equal 257 [r lpushx xlist b]
-        assert_encoding linkedlist xlist
-    }
-
-    test {LINSERT convert from ziplist to list} {
-        set large $largevalue(linkedlist)
-
-        # convert when a large value is inserted
-        create_ziplist xlist a
-        assert_equal 2 [r linsert xlist before a $large]
-        assert_encoding linkedlist xlist
-        create_ziplist xlist a
-        assert_equal 2 [r linsert xlist after a $large]
-        assert_encoding linkedlist xlist
-
-        # convert when the length threshold is exceeded
-        create_ziplist xlist [lrepeat 256 a]
-        assert_equal 257 [r linsert xlist before a a]
-        assert_encoding linkedlist xlist
-        create_ziplist xlist [lrepeat 256 a]
-        assert_equal 257 [r linsert xlist after a a]
-        assert_encoding linkedlist xlist
-
-        # don't convert when the value could not be inserted
-        create_ziplist xlist [lrepeat 256 a]
+    test {LPUSHX, RPUSHX spill into new quicklist nodes} {
+        create_ziplist xlist {a b c d e}
+        assert_equal 6 [r rpushx xlist f]
+        assert_equal 7 [r lpushx xlist z]
+        assert_equal {z a b c d e f} [r lrange xlist 0 -1]
+        assert_equal 3 [ql_nodes xlist]
+    }
+
+    test {LINSERT splits full quicklist nodes} {
+        set mylist {}
+        for {set i 0} {$i < 20} {incr i} {lappend mylist $i}
+        create_ziplist xlist $mylist
+        assert_equal 21 [r linsert xlist before 7 a]
+        assert_equal 22 [r linsert xlist after 12 b]
+        assert_equal 23 [r linsert xlist after 19 c]
+        assert_equal 24 [r linsert xlist before 0 d]
+        set mylist [linsert $mylist 7 a]
+        set mylist [linsert $mylist 14 b]
+        set mylist [linsert $mylist end c]
+        set mylist [linsert $mylist 0 d]
+        assert_equal $mylist [r lrange xlist 0 -1]
+        assert {[ql_nodes xlist] >= 5}
         assert_equal -1 [r linsert xlist before foo a]
-        assert_encoding ziplist xlist
-        create_ziplist xlist [lrepeat 256 a]
-        assert_equal -1 [r linsert xlist after foo a]
-        assert_encoding ziplist xlist
+        assert_equal 24 [r llen xlist]
+    }
+
+    test {Inner quicklist nodes are compressed with list-compress-depth} {
+        r config set list-compress-depth 1
+        r del xlist
+        set mylist {}
+        for {set i 0} {$i < 100} {incr i} {
+            set e "element-[string repeat x 30]-$i"
+            lappend mylist $e
+            r rpush xlist $e
+        }
+        regexp {ql_compression_ratio:([0-9.]+)} [r debug object xlist] -> ratio
+        assert {$ratio > 1.5}
+
+        # Read and modify the compressed nodes.
+        assert_equal [lindex $mylist 50] [r lindex xlist 50]
+        assert_equal [lrange $mylist 40 60] [r lrange xlist 40 60]
+        r lset xlist 50 foo
+        lset mylist 50 foo
+        r linsert xlist after foo bar
+        set mylist [linsert $mylist 51 bar]
+        assert_equal $mylist [r lrange xlist 0 -1]
+
+        # Compressed nodes are saved and loaded.
+        r debug reload
+        assert_equal $mylist [r lrange xlist 0 -1]
+        r ltrim xlist 1 -2
+        assert_equal [lrange $mylist 1 end-1] [r lrange xlist 0 -1]
+        r config set list-compress-depth 0
+    }
+
+    test {CONFIG SET accepts the deprecated list-max-ziplist-* options} {
+        set size [lindex [r config get list-max-ziplist-size] 1]
+        r config set list-max-ziplist-entries 512
+        r config set list-max-ziplist-value 64
+        catch {r config set list-max-ziplist-entries foo} e
+        assert_match {*Invalid argument*} $e
+        assert_equal $size [lindex [r config get list-max-ziplist-size] 1]
     }
 
     foreach {type num} {ziplist 250 linkedlist 500} {
@@ -595,18 +615,18 @@ start_server {
             for {set i 0} {$i < $num} {incr i} {
                 r rpush mylist $i
             }
-            assert_encoding $type mylist
+            assert_encoding quicklist mylist
             check_numbered_list_consistency mylist
         }
 
         test "LINDEX random access - $type" {
-            assert_encoding $type mylist
+            assert_encoding quicklist mylist
             check_random_access_consistency mylist
         }
 
         test "Check if list is still ok after a DEBUG RELOAD - $type" {
             r debug reload
-            assert_encoding $type mylist
+            assert_encoding quicklist mylist
             check_numbered_list_consistency mylist
             check_random_access_consistency mylist
         }
@@ -646,7 +666,7 @@ start_server {
             assert_equal c [r rpoplpush mylist1 mylist2]
             assert_equal "a $large" [r lrange mylist1 0 -1]
             assert_equal "c d" [r lrange mylist2 0 -1]
-            assert_encoding ziplist mylist2
+            assert_encoding quicklist mylist2
         }
 
         test "RPOPLPUSH with the same list as src and dst - $type" {
@@ -664,12 +684,7 @@ start_server {
                 assert_equal c [r rpoplpush srclist dstlist]
                 assert_equal "a b" [r lrange srclist 0 -1]
                 assert_equal "c $large $otherlarge" [r lrange dstlist 0 -1]
-
-                # When we rpoplpush'ed a large value, dstlist should be
-                # converted to the same encoding as srclist.
-                if {$type eq "linkedlist"} {
-                    assert_encoding linkedlist dstlist
-                }
+                assert_encoding quicklist dstlist
             }
         }
     }
@@ -730,7 +745,7 @@ start_server {
                 r lpush mylist $i
                 incr sum1 $i
             }
-            assert_encoding $type mylist
+            assert_encoding quicklist mylist
             set sum2 0
             for {set i 0} {$i < [expr $num/2]} {incr i} {
                 incr sum2 [r lpop mylist]
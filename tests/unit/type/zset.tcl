@@ -7,12 +7,17 @@ start_server {tags {"zset"}} {
     }
 
     proc basics {encoding} {
-        if {$encoding == "ziplist"} {
+        r config set zset-btree-index no
+        if {$encoding == "listpack"} {
             r config set zset-max-ziplist-entries 128
             r config set zset-max-ziplist-value 64
         } elseif {$encoding == "skiplist"} {
             r config set zset-max-ziplist-entries 0
             r config set zset-max-ziplist-value 0
+        } elseif {$encoding == "btree"} {
+            r config set zset-max-ziplist-entries 0
+            r config set zset-max-ziplist-value 0
+            r config set zset-btree-index yes
         } else {
             puts "Unknown sorted set encoding"
             exit
@@ -508,8 +513,9 @@ start_server {tags {"zset"}} {
         }
     }
 
-    basics ziplist
+    basics listpack
     basics skiplist
+    basics btree
 
     test {ZINTERSTORE regression with two sets, intset+hashtable} {
         r del seta setb setc
@@ -524,7 +530,7 @@ start_server {tags {"zset"}} {
         r zrange out 0 -1 withscores
     } {neginf 0}
 
-    test {ZINTERSTORE #516 regression, mixed sets and ziplist zsets} {
+    test {ZINTERSTORE #516 regression, mixed sets and listpack zsets} {
         r sadd one 100 101 102 103
         r sadd two 100 200 201 202
         r zadd three 1 500 1 501 1 502 1 503 1 100
@@ -533,7 +539,8 @@ start_server {tags {"zset"}} {
     } {100}
 
     proc stressers {encoding} {
-        if {$encoding == "ziplist"} {
+        r config set zset-btree-index no
+        if {$encoding == "listpack"} {
             # Little extra to allow proper fuzzing in the sorting stresser
             r config set zset-max-ziplist-entries 256
             r config set zset-max-ziplist-value 64
@@ -542,6 +549,11 @@ start_server {tags {"zset"}} {
             r config set zset-max-ziplist-entries 0
             r config set zset-max-ziplist-value 0
             if {$::accurate} {set elements 1000} else {set elements 100}
+        } elseif {$encoding == "btree"} {
+            r config set zset-max-ziplist-entries 0
+            r config set zset-max-ziplist-value 0
+            r config set zset-btree-index yes
+            if {$::accurate} {set elements 1000} else {set elements 100}
         } else {
             puts "Unknown sorted set encoding"
             exit
@@ -755,7 +767,108 @@ start_server {tags {"zset"}} {
     }
 
     tags {"slow"} {
-        stressers ziplist
+        stressers listpack
         stressers skiplist
+        stressers btree
+
+        test {ZSET btree and skiplist encodings agree after many changes} {
+            r config set zset-max-ziplist-entries 0
+            r del zbt zsl
+            foreach {key btree} {zbt yes zsl no} {
+                r config set zset-btree-index $btree
+                r zadd $key 0 init
+            }
+            assert_encoding btree zbt
+            assert_encoding skiplist zsl
+
+            # Enough elements for a tree with inner nodes, a few scores
+            # shared by many elements, and deletions merging nodes.
+            for {set j 0} {$j < 200} {incr j} {
+                set args {}
+                for {set i 0} {$i < 200} {incr i} {
+                    lappend args [randomInt 1000] [randomInt 30000]
+                }
+                set cmds [list [concat zadd $args]]
+                set args {}
+                for {set i 0} {$i < 60} {incr i} {
+                    lappend args [randomInt 30000]
+                }
+                lappend cmds [concat zrem $args]
+                lappend cmds [list zincrby [randomInt 100] [randomInt 30000]]
+                if {$j % 10 == 0} {
+                    set min [randomInt 1000]
+                    lappend cmds [list zremrangebyscore $min [expr {$min+5}]]
+                    lappend cmds [list zremrangebyscore ($min [expr {$min+3}]]
+                    set start [randomInt 10000]
+                    lappend cmds [list zremrangebyrank $start [expr {$start+500}]]
+                }
+                set min [randomInt 1000]
+                set max [expr {$min+[randomInt 50]}]
+                set rank [randomInt 10000]
+                set ele [randomInt 30000]
+                lappend cmds [list zrangebyscore $min $max withscores]
+                lappend cmds [list zrevrangebyscore ($max $min limit 3 20]
+                lappend cmds [list zcount $min ($max]
+                lappend cmds [list zrange $rank [expr {$rank+30}] withscores]
+                lappend cmds [list zrevrange $rank [expr {$rank+30}]]
+                lappend cmds [list zrank $ele]
+                lappend cmds [list zrevrank $ele]
+                lappend cmds [list zscore $ele]
+                lappend cmds [list zcard]
+
+                foreach cmd $cmds {
+                    set name [lindex $cmd 0]
+                    set bt [r $name zbt {*}[lrange $cmd 1 end]]
+                    set sl [r $name zsl {*}[lrange $cmd 1 end]]
+                    if {$bt ne $sl} {
+                        fail "$cmd: '$bt' != '$sl'"
+                    }
+                }
+            }
+            assert_encoding btree zbt
+            assert {[r zcard zbt] > 10000}
+            assert_equal [r zrange zsl 0 -1 withscores] \
+                         [r zrange zbt 0 -1 withscores]
+            assert_equal [r zrevrange zsl 0 -1] [r zrevrange zbt 0 -1]
+            assert_equal [r zcard zbt] [r zinterstore zout 2 zbt zsl weights 1 0]
+            assert_equal [r zrange zbt 0 -1 withscores] \
+                         [r zrange zout 0 -1 withscores]
+        }
+
+        test {ZSET btree encoding survives DEBUG RELOAD} {
+            r config set zset-btree-index yes
+            set digest [r debug digest]
+            r debug reload
+            assert_equal $digest [r debug digest]
+            assert_encoding btree zbt
+            assert_encoding btree zsl
+            r config set zset-btree-index no
+        }
+
+        test {ZSET btree encoding is converted to listpack by ZUNIONSTORE} {
+            r config set zset-max-ziplist-entries 128
+            r config set zset-btree-index yes
+            r del zbt zout
+            for {set j 0} {$j < 200} {incr j} {
+                r zadd zbt $j $j
+            }
+            assert_encoding btree zbt
+            r zremrangebyrank zbt 100 -1
+            r zunionstore zout 1 zbt
+            assert_encoding listpack zout
+            assert_equal [r zrange zbt 0 -1 withscores] \
+                         [r zrange zout 0 -1 withscores]
+            r config set zset-btree-index no
+        }
+    }
+
+    test {CONFIG GET and CONFIG SET zset-btree-index} {
+        assert_equal 2 [llength [r config get zset-btree-index]]
+        r config set zset-btree-index yes
+        assert_equal {zset-btree-index yes} [r config get zset-btree-index]
+        catch {r config set zset-btree-index maybe} e
+        assert_match {*Invalid argument*} $e
+        r config set zset-btree-index no
+        assert_equal {zset-btree-index no} [r config get zset-btree-index]
     }
 }
@@ -0,0 +1,231 @@
+/* Hit ratio simulation of the Redis approximated LRU.
+ *
+ * A cache holding a fixed number of keys is fed with a stream of accesses
+ * following a power law distribution. Every access to a key that is not in
+ * the cache is a miss: the key is added, evicting another key if the cache
+ * is full. The hit ratio of the following eviction algorithms is reported:
+ *
+ * - true LRU, the upper bound the other algorithms try to approximate.
+ * - sampling: evict the least recently used key among N random keys, that
+ *   is what Redis did before the eviction pool.
+ * - sampling + pool: the sampled keys are merged into a pool of the best
+ *   candidates seen so far, and the best candidate is evicted if it was not
+ *   accessed after entering the pool, exactly like freeMemoryIfNeeded().
+ * - random eviction, as a lower bound.
+ *
+ * The access time of the keys is exact here, while Redis uses a clock with
+ * one second resolution, and keys are sampled uniformly, while
+ * dictGetSomeKeys() returns keys of contiguous buckets.
+ *
+ * Compile with: cc -O2 -o lru-simulation lru-simulation.c
+ * Usage: ./lru-simulation [keys] [cache-size] [accesses] [exponent]
+ *
+ * Keys are accessed with probability proportional to rank^-(1/exponent)
+ * ish: the greater the exponent, the more skewed the distribution. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define POOL_SIZE 16    /* REDIS_EVICTION_POOL_SIZE */
+
+#define POLICY_LRU 0
+#define POLICY_SAMPLING 1
+#define POLICY_POOL 2
+#define POLICY_RANDOM 3
+
+static long numkeys, cachesize, accesses;
+static double exponent;
+
+/* Cache state, indexed by key. The resident keys are also stored in an
+ * array, to sample them in O(1). */
+static long long *atime;    /* Last access time, -1 if not cached. */
+static long *slot;          /* Position in 'resident'. */
+static long *resident;
+static long used;
+static long *prev, *next;   /* LRU list, head is the most recently used. */
+static long head, tail;
+
+typedef struct poolEntry {
+    long key;               /* -1 if the entry is empty. */
+    long long atime;        /* Access time when the key entered the pool. */
+} poolEntry;
+
+static poolEntry pool[POOL_SIZE];
+
+/* Simple xorshift generator, so that every run uses the same accesses. */
+static unsigned long long rngstate = 88172645463325252ULL;
+
+static unsigned long long rng(void) {
+    rngstate ^= rngstate << 13;
+    rngstate ^= rngstate >> 7;
+    rngstate ^= rngstate << 17;
+    return rngstate;
+}
+
+static double rngDouble(void) {
+    return (rng() >> 11) * (1.0/9007199254740992.0);
+}
+
+static long nextKey(void) {
+    double r = rngDouble(), x = r;
+    int j;
+
+    for (j = 1; j < (int)exponent; j++) x *= r;
+    return (long)(x*numkeys);
+}
+
+static void listUnlink(long k) {
+    if (prev[k] != -1) next[prev[k]] = next[k]; else head = next[k];
+    if (next[k] != -1) prev[next[k]] = prev[k]; else tail = prev[k];
+}
+
+static void listPush(long k) {
+    prev[k] = -1;
+    next[k] = head;
+    if (head != -1) prev[head] = k; else tail = k;
+    head = k;
+}
+
+static void cacheRemove(long k) {
+    long last = resident[--used];
+
+    resident[slot[k]] = last;
+    slot[last] = slot[k];
+    atime[k] = -1;
+    listUnlink(k);
+}
+
+static void cacheAdd(long k, long long now) {
+    slot[k] = used;
+    resident[used++] = k;
+    atime[k] = now;
+    listPush(k);
+}
+
+static long randomResident(void) {
+    return resident[rng() % used];
+}
+
+static long evictSampling(int samples) {
+    long best = -1;
+    int j;
+
+    for (j = 0; j < samples; j++) {
+        long k = randomResident();
+
+        if (best == -1 || atime[k] < atime[best]) best = k;
+    }
+    return best;
+}
+
+/* Same logic of evictionPoolPopulate() and evictionPoolBest(), using the
+ * access time instead of the idle time: lower is better. */
+static long evictPool(int samples) {
+    int j, k, attempt;
+
+    for (attempt = 0; attempt < 2; attempt++) {
+        for (j = 0; j < samples; j++) {
+            long key = randomResident();
+
+            k = 0;
+            while (k < POOL_SIZE && pool[k].key != -1 &&
+                   pool[k].atime > atime[key]) k++;
+            if (k == 0 && pool[POOL_SIZE-1].key != -1) {
+                continue;
+            } else if (k < POOL_SIZE && pool[k].key == -1) {
+                /* Empty entry. */
+            } else if (pool[POOL_SIZE-1].key == -1) {
+                memmove(pool+k+1,pool+k,sizeof(pool[0])*(POOL_SIZE-k-1));
+            } else {
+                k--;
+                memmove(pool,pool+1,sizeof(pool[0])*k);
+            }
+            pool[k].key = key;
+            pool[k].atime = atime[key];
+        }
+        for (k = POOL_SIZE-1; k >= 0; k--) {
+            long key = pool[k].key;
+            int valid;
+
+            if (key == -1) continue;
+            valid = atime[key] != -1 && atime[key] <= pool[k].atime;
+            memmove(pool+k,pool+k+1,sizeof(pool[0])*(POOL_SIZE-k-1));
+            pool[POOL_SIZE-1].key = -1;
+            if (valid) return key;
+        }
+    }
+    return randomResident();
+}
+
+static double simulate(int policy, int samples) {
+    long long now, hits = 0;
+    long j;
+
+    for (j = 0; j < numkeys; j++) atime[j] = -1;
+    for (j = 0; j < POOL_SIZE; j++) pool[j].key = -1;
+    used = 0;
+    head = tail = -1;
+    rngstate = 88172645463325252ULL;
+
+    for (now = 0; now < accesses; now++) {
+        long k = nextKey();
+
+        if (atime[k] != -1) {
+            /* Warm up the cache before counting the hits. */
+            if (now >= accesses/10) hits++;
+            atime[k] = now;
+            listUnlink(k);
+            listPush(k);
+            continue;
+        }
+        if (used == cachesize) {
+            long victim;
+
+            switch(policy) {
+            case POLICY_LRU: victim = tail; break;
+            case POLICY_SAMPLING: victim = evictSampling(samples); break;
+            case POLICY_POOL: victim = evictPool(samples); break;
+            default: victim = randomResident(); break;
+            }
+            cacheRemove(victim);
+        }
+        cacheAdd(k,now);
+    }
+    return (double)hits/(accesses-accesses/10);
+}
+
+int main(int argc, char **argv) {
+    int samples[] = {5, 10};
+    int j;
+
+    numkeys = argc > 1 ? atol(argv[1]) : 1000000;
+    cachesize = argc > 2 ? atol(argv[2]) : 100000;
+    accesses = argc > 3 ? atol(argv[3]) : 20000000;
+    exponent = argc > 4 ? atof(argv[4]) : 3;
+    if (numkeys <= 0 || cachesize <= 0 || cachesize > numkeys ||
+        accesses <= 0 || exponent < 1)
+    {
+        fprintf(stderr,
+            "Usage: %s [keys] [cache-size] [accesses] [exponent]\n", argv[0]);
+        exit(1);
+    }
+
+    atime = malloc(sizeof(*atime)*numkeys);
+    slot = malloc(sizeof(*slot)*numkeys);
+    resident = malloc(sizeof(*resident)*cachesize);
+    prev = malloc(sizeof(*prev)*numkeys);
+    next = malloc(sizeof(*next)*numkeys);
+
+    printf("%ld keys, cache of %ld keys, %ld accesses, exponent %g\n",
+        numkeys, cachesize, accesses, exponent);
+    printf("true LRU            hit ratio %.4f\n", simulate(POLICY_LRU,0));
+    for (j = 0; j < 2; j++) {
+        printf("%2d samples          hit ratio %.4f\n", samples[j],
+            simulate(POLICY_SAMPLING,samples[j]));
+        printf("%2d samples + pool   hit ratio %.4f\n", samples[j],
+            simulate(POLICY_POOL,samples[j]));
+    }
+    printf("random              hit ratio %.4f\n", simulate(POLICY_RANDOM,0));
+    return 0;
+}